@@ -0,0 +1,269 @@
+/*
+ * alert evaluates threshold rules on every sample of a device and
+ * reports when a condition is raised or cleared. Events are written
+ * as one line each to a FIFO, a Unix datagram socket or a command.
+ * Additional infos (including a license notice) are at the end of this file.
+ */
+
+#include "alert.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+/* an event has 6 fields: time, device, channel, condition, state, value */
+#define EVENT_FIELDS 6
+
+static const char *condition_names[TEMPER_ALERT_CONDITIONS] = { "high", "low", "rate" };
+
+/*
+ * condition_met
+ *
+ * checks one condition, raised thresholds only clear once the
+ * value is back by more than the hysteresis
+ */
+static bool condition_met(const struct temper_alert_rule *rule, const struct temper_alert_state *state,
+	int condition, uint64_t timestamp_us, float value)
+{
+	bool active = (state->active & condition) != 0;
+	float change;
+
+	switch (condition)
+	{
+		case TEMPER_ALERT_HIGH:
+			return value > (active ? rule->high - rule->hysteresis : rule->high);
+		case TEMPER_ALERT_LOW:
+			return value < (active ? rule->low + rule->hysteresis : rule->low);
+		case TEMPER_ALERT_RATE:
+			if ((state->last_us == 0) || (timestamp_us <= state->last_us))
+			{
+				return active;
+			}
+			change = (value > state->last) ? value - state->last : state->last - value;
+			return change * 60000000.0 > rule->rate * (float)(timestamp_us - state->last_us);
+	}
+	return false;
+}
+
+TEMPER_LIB_EXPORT int temper_alert_update(const struct temper_alert_rule *rule, struct temper_alert_state *state, uint64_t timestamp_us, float value)
+{
+	int previous = state->active;
+	int condition;
+	int cnt;
+
+	if (value <= TEMPER_INVALID)
+	{
+		return 0;
+	}
+	for (cnt = 0; cnt < TEMPER_ALERT_CONDITIONS; cnt++)
+	{
+		condition = 1 << cnt;
+		if (!(rule->checks & condition))
+		{
+			continue;
+		}
+		if (!condition_met(rule, state, condition, timestamp_us, value))
+		{
+			state->pending &= ~condition;
+			state->active &= ~condition;
+			continue;
+		}
+		if (!(state->pending & condition))
+		{
+			state->pending |= condition;
+			state->since_us[cnt] = timestamp_us;
+		}
+		if (timestamp_us - state->since_us[cnt] >= (uint64_t) rule->duration_ms * 1000)
+		{
+			state->active |= condition;
+		}
+	}
+	state->last = value;
+	state->last_us = timestamp_us;
+
+	return state->active ^ previous;
+}
+
+TEMPER_LIB_EXPORT const char *temper_alert_name(int condition)
+{
+	int cnt;
+
+	for (cnt = 0; cnt < TEMPER_ALERT_CONDITIONS; cnt++)
+	{
+		if (condition == (1 << cnt))
+		{
+			return condition_names[cnt];
+		}
+	}
+	return "unknown";
+}
+
+TEMPER_LIB_EXPORT int temper_alert_sink_open(struct temper_alert_sink *sink, const char *spec)
+{
+	memset(sink, 0, sizeof(*sink));
+	sink->fd = -1;
+	if (!strncmp(spec, "fifo:", 5))
+	{
+		sink->type = TEMPER_ALERT_SINK_FIFO;
+		sink->target = spec + 5;
+		// without a reader this fails with ENXIO, temper_alert_emit tries again
+		sink->fd = open(sink->target, O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+	}
+	else if (!strncmp(spec, "unix:", 5))
+	{
+		sink->type = TEMPER_ALERT_SINK_UNIX;
+		sink->target = spec + 5;
+		if (strlen(sink->target) >= sizeof(((struct sockaddr_un *) 0)->sun_path))
+		{
+			return TEMPER_ERR_PARAM;
+		}
+		sink->fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if (sink->fd < 0)
+		{
+			return TEMPER_ERR_OPEN;
+		}
+	}
+	else if (!strncmp(spec, "exec:", 5))
+	{
+		sink->type = TEMPER_ALERT_SINK_EXEC;
+		sink->target = spec + 5;
+	}
+	else
+	{
+		return TEMPER_ERR_PARAM;
+	}
+	if (*sink->target == '\0')
+	{
+		temper_alert_sink_close(sink);
+		return TEMPER_ERR_PARAM;
+	}
+
+	return TEMPER_OK;
+}
+
+/*
+ * run_command
+ *
+ * starts the command of sink with the fields of line as arguments,
+ * the intermediate child exits at once so nothing is left to reap
+ */
+static int run_command(const struct temper_alert_sink *sink, const char *line)
+{
+	char fields[512];
+	char *argv[EVENT_FIELDS + 5];
+	char *saveptr;
+	int argc = 0;
+	pid_t pid;
+	int status;
+
+	(void)snprintf(fields, sizeof(fields), "%s", line);
+	argv[argc++] = "sh";
+	argv[argc++] = "-c";
+	argv[argc++] = (char *) sink->target;
+	argv[argc++] = "sh";
+	argv[argc] = strtok_r(fields, " \n", &saveptr);
+	while ((argv[argc] != NULL) && (argc < EVENT_FIELDS + 4))
+	{
+		argv[++argc] = strtok_r(NULL, " \n", &saveptr);
+	}
+	argv[argc] = NULL;
+
+	pid = fork();
+	if (pid < 0)
+	{
+		return TEMPER_ERR_WRITE;
+	}
+	if (pid == 0)
+	{
+		if (fork() == 0)
+		{
+			execv("/bin/sh", argv);
+		}
+		_exit(0);
+	}
+	if ((waitpid(pid, &status, 0) != pid) || !WIFEXITED(status))
+	{
+		return TEMPER_ERR_WRITE;
+	}
+	return TEMPER_OK;
+}
+
+TEMPER_LIB_EXPORT int temper_alert_emit(struct temper_alert_sink *sink, const char *line)
+{
+	struct sockaddr_un addr;
+	size_t len = strlen(line);
+	int r = TEMPER_ERR_WRITE;
+
+	switch (sink->type)
+	{
+		case TEMPER_ALERT_SINK_FIFO:
+			if (sink->fd < 0)
+			{
+				sink->fd = open(sink->target, O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+			}
+			// lines are shorter than PIPE_BUF, so they are written completely or not at all
+			if ((sink->fd >= 0) && (write(sink->fd, line, len) == (ssize_t) len))
+			{
+				r = TEMPER_OK;
+			}
+			else if ((sink->fd >= 0) && (errno == EPIPE))
+			{
+				// the reader went away, wait for the next one
+				close(sink->fd);
+				sink->fd = -1;
+			}
+			break;
+		case TEMPER_ALERT_SINK_UNIX:
+			memset(&addr, 0, sizeof(addr));
+			addr.sun_family = AF_UNIX;
+			strcpy(addr.sun_path, sink->target);
+			if (sendto(sink->fd, line, len, MSG_NOSIGNAL,
+				(struct sockaddr *) &addr, sizeof(addr)) == (ssize_t) len)
+			{
+				r = TEMPER_OK;
+			}
+			break;
+		case TEMPER_ALERT_SINK_EXEC:
+			r = run_command(sink, line);
+			break;
+	}
+	if (r == TEMPER_OK)
+		sink->sent++;
+	else
+		sink->failed++;
+
+	return r;
+}
+
+TEMPER_LIB_EXPORT void temper_alert_sink_close(struct temper_alert_sink *sink)
+{
+	if (sink->fd >= 0)
+	{
+		close(sink->fd);
+		sink->fd = -1;
+	}
+}
+
+/*
+ * alert Copyright (C) 2020-2021 Armin Fuerst (armin@fuerst.priv.at)
+ *
+ * This file is part of tempersensor.
+ *
+ * Tempersensor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tempersensor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tempersensor.  If not, see <https://www.gnu.org/licenses/>.
+ */
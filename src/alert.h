@@ -0,0 +1,130 @@
+/*
+ * alert evaluates threshold rules on every sample of a device and
+ * reports when a condition is raised or cleared. Events are written
+ * as one line each to a FIFO, a Unix datagram socket or a command.
+ * Additional infos (including a license notice) are at the end of this file.
+ */
+
+#ifndef ALERT_H
+#define ALERT_H
+
+#include <stdint.h>
+
+#include "temper.h"
+
+/* conditions of a rule, bits of the masks below */
+#define TEMPER_ALERT_HIGH 0x01 /* value above high */
+#define TEMPER_ALERT_LOW 0x02 /* value below low */
+#define TEMPER_ALERT_RATE 0x04 /* value changing faster than rate */
+#define TEMPER_ALERT_CONDITIONS 3
+
+/*
+ * struct temper_alert_rule
+ *
+ * thresholds for one channel, conditions not in checks are ignored
+ */
+struct temper_alert_rule
+{
+	int channel; /* TEMPER_INT_TEMP ... */
+	int checks; /* TEMPER_ALERT_* to evaluate */
+	float high;
+	float low;
+	float hysteresis; /* distance back inside a threshold before clearing */
+	float rate; /* maximum change per minute */
+	uint32_t duration_ms; /* how long a condition must hold before it is raised */
+};
+
+/*
+ * struct temper_alert_state
+ *
+ * state of one rule for one device, zeroed before the first sample
+ */
+struct temper_alert_state
+{
+	int active; /* TEMPER_ALERT_* raised */
+	int pending; /* TEMPER_ALERT_* met, waiting for duration_ms */
+	uint64_t since_us[TEMPER_ALERT_CONDITIONS]; /* when a pending condition was met */
+	uint64_t last_us; /* timestamp of the previous valid value, 0 = none */
+	float last;
+};
+
+/*
+ * temper_alert_update
+ *
+ * evaluates rule for value captured at timestamp_us (microseconds) and
+ * returns the TEMPER_ALERT_* bits which changed in state->active. Takes
+ * constant time, invalid values leave the state unchanged.
+ */
+TEMPER_LIB_EXPORT int temper_alert_update(const struct temper_alert_rule *rule, struct temper_alert_state *state, uint64_t timestamp_us, float value);
+
+/*
+ * temper_alert_name
+ *
+ * returns the name of a single TEMPER_ALERT_* condition
+ */
+TEMPER_LIB_EXPORT const char *temper_alert_name(int condition);
+
+/* where events go */
+#define TEMPER_ALERT_SINK_FIFO 0
+#define TEMPER_ALERT_SINK_UNIX 1
+#define TEMPER_ALERT_SINK_EXEC 2
+
+/*
+ * struct temper_alert_sink
+ *
+ * destination of events, set up by temper_alert_sink_open
+ */
+struct temper_alert_sink
+{
+	int type; /* TEMPER_ALERT_SINK_* */
+	const char *target; /* path or command */
+	int fd;
+	unsigned long sent; /* events delivered */
+	unsigned long failed; /* events lost, e.g. no reader on the FIFO */
+};
+
+/*
+ * temper_alert_sink_open
+ *
+ * sets up sink for spec "fifo:PATH", "unix:PATH" or "exec:COMMAND",
+ * spec must stay valid while the sink is used. A FIFO without reader
+ * is opened again for every event, a command runs via /bin/sh with
+ * the fields of the event as $1 ... $6 and is not waited for. Ignore
+ * SIGPIPE, a FIFO whose reader went away raises it.
+ */
+TEMPER_LIB_EXPORT int temper_alert_sink_open(struct temper_alert_sink *sink, const char *spec);
+
+/*
+ * temper_alert_emit
+ *
+ * delivers one event line (ending with a newline) without blocking
+ */
+TEMPER_LIB_EXPORT int temper_alert_emit(struct temper_alert_sink *sink, const char *line);
+
+/*
+ * temper_alert_sink_close
+ *
+ * releases the resources of sink
+ */
+TEMPER_LIB_EXPORT void temper_alert_sink_close(struct temper_alert_sink *sink);
+
+#endif // ALERT_H
+
+/*
+ * alert Copyright (C) 2020-2021 Armin Fuerst (armin@fuerst.priv.at)
+ *
+ * This file is part of tempersensor.
+ *
+ * Tempersensor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tempersensor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tempersensor.  If not, see <https://www.gnu.org/licenses/>.
+ */
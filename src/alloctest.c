@@ -0,0 +1,111 @@
+/*
+ * alloctest counts the calls of the heap functions for the self test
+ * of steady state sampling, see alloctest.h.
+ * Additional infos (including a license notice) are at the end of this file.
+ */
+
+#include "alloctest.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+/* the functions of the C library, see ld --wrap */
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+int __real_posix_memalign(void **ptr, size_t alignment, size_t size);
+void *__real_aligned_alloc(size_t alignment, size_t size);
+void *__real_memalign(size_t alignment, size_t size);
+
+static bool counting;
+static unsigned long calls;
+
+/*
+ * count
+ *
+ * counts one call while counting, called from any thread
+ */
+static void count()
+{
+	if (__atomic_load_n(&counting, __ATOMIC_RELAXED))
+	{
+		__atomic_add_fetch(&calls, 1, __ATOMIC_RELAXED);
+	}
+}
+
+void alloctest_start()
+{
+	__atomic_store_n(&calls, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&counting, true, __ATOMIC_RELAXED);
+}
+
+unsigned long alloctest_stop()
+{
+	__atomic_store_n(&counting, false, __ATOMIC_RELAXED);
+	return __atomic_load_n(&calls, __ATOMIC_RELAXED);
+}
+
+void *__wrap_malloc(size_t size)
+{
+	count();
+	return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+	count();
+	return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+	count();
+	return __real_realloc(ptr, size);
+}
+
+void __wrap_free(void *ptr)
+{
+	// free(NULL) does nothing
+	if (ptr != NULL)
+	{
+		count();
+	}
+	__real_free(ptr);
+}
+
+int __wrap_posix_memalign(void **ptr, size_t alignment, size_t size)
+{
+	count();
+	return __real_posix_memalign(ptr, alignment, size);
+}
+
+void *__wrap_aligned_alloc(size_t alignment, size_t size)
+{
+	count();
+	return __real_aligned_alloc(alignment, size);
+}
+
+void *__wrap_memalign(size_t alignment, size_t size)
+{
+	count();
+	return __real_memalign(alignment, size);
+}
+
+/*
+ * alloctest Copyright (C) 2020-2021 Armin Fuerst (armin@fuerst.priv.at)
+ *
+ * This file is part of tempersensor.
+ *
+ * Tempersensor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tempersensor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tempersensor.  If not, see <https://www.gnu.org/licenses/>.
+ */
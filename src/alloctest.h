@@ -0,0 +1,48 @@
+/*
+ * alloctest counts the calls of the heap functions for the self test
+ * of steady state sampling. It is linked into tempersensor-alloctest
+ * only, with -Wl,--wrap for every heap function, so all calls of
+ * tempersensor and libtempersensor end up here whatever the C library.
+ * Allocations inside the C library (stdio buffers and the like) are
+ * not seen.
+ * Additional infos (including a license notice) are at the end of this file.
+ */
+
+#ifndef ALLOCTEST_H
+#define ALLOCTEST_H
+
+/*
+ * alloctest_start
+ *
+ * starts counting the calls of all threads from zero
+ */
+void alloctest_start();
+
+/*
+ * alloctest_stop
+ *
+ * stops counting, returns the calls allocating, resizing or freeing
+ * memory since alloctest_start
+ */
+unsigned long alloctest_stop();
+
+#endif // ALLOCTEST_H
+
+/*
+ * alloctest Copyright (C) 2020-2021 Armin Fuerst (armin@fuerst.priv.at)
+ *
+ * This file is part of tempersensor.
+ *
+ * Tempersensor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tempersensor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tempersensor.  If not, see <https://www.gnu.org/licenses/>.
+ */
@@ -0,0 +1,152 @@
+/*
+ * cache lets several processes share one device: a lock file per
+ * hidraw node serializes the USB exchange and keeps the last result,
+ * so callers arriving while (or shortly after) another process
+ * queried the device reuse its values instead of asking again.
+ * Additional infos (including a license notice) are at the end of this file.
+ */
+
+#include "cache.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+/* identifies the layout of the lock file, change if struct temper_cached changes */
+static const char cache_magic[8] = "TEMPERC2";
+
+/* interval to try again while the lock is held */
+#define LOCK_RETRY_MS 10
+
+struct cache_file
+{
+	char magic[8];
+	struct temper_cached cached;
+};
+
+static uint64_t now_us(int clock)
+{
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+TEMPER_LIB_EXPORT int temper_cache_lock(const char *dir, const char *devpath, int wait_ms, int *fd)
+{
+	struct timespec retry = { 0, LOCK_RETRY_MS * 1000000L };
+	char path[PATH_MAX];
+	const char *node = strrchr(devpath, '/');
+	uint64_t deadline = now_us(CLOCK_MONOTONIC) + (uint64_t) wait_ms * 1000;
+
+	node = (node == NULL) ? devpath : node + 1;
+	if (snprintf(path, sizeof(path), "%s/tempersensor-%s", dir, node) >= sizeof(path))
+	{
+		return TEMPER_ERR_PARAM;
+	}
+	// never follow symlinks, the directory is usually world-writable
+	*fd = open(path, O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0644);
+	if ((*fd < 0) && (errno == EACCES))
+	{
+		*fd = open(path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+	}
+	if (*fd < 0)
+	{
+		return TEMPER_ERR_OPEN;
+	}
+	// the holder may be anybody, so never wait without a limit
+	while (flock(*fd, LOCK_EX | LOCK_NB) < 0)
+	{
+		if ((errno != EWOULDBLOCK) && (errno != EINTR))
+		{
+			close(*fd);
+			*fd = -1;
+			return TEMPER_ERR_OPEN;
+		}
+		if (now_us(CLOCK_MONOTONIC) >= deadline)
+		{
+			close(*fd);
+			*fd = -1;
+			return TEMPER_ERR_TIMEOUT;
+		}
+		(void)nanosleep(&retry, NULL);
+	}
+
+	return TEMPER_OK;
+}
+
+TEMPER_LIB_EXPORT bool temper_cache_get(int fd, int max_age_ms, struct temper_cached *cached)
+{
+	struct cache_file file;
+	struct stat st;
+	uint64_t now = now_us(CLOCK_REALTIME);
+
+	if ((fstat(fd, &st) < 0) || !S_ISREG(st.st_mode) ||
+		((st.st_uid != geteuid()) && (st.st_uid != 0)))
+	{
+		return false;
+	}
+	if ((pread(fd, &file, sizeof(file), 0) != sizeof(file)) ||
+		memcmp(file.magic, cache_magic, sizeof(cache_magic)))
+	{
+		return false;
+	}
+	// results from the future (clock set back) are not trusted
+	if ((file.cached.timestamp_us > now) ||
+		(now - file.cached.timestamp_us > (uint64_t) max_age_ms * 1000))
+	{
+		return false;
+	}
+	*cached = file.cached;
+
+	return true;
+}
+
+TEMPER_LIB_EXPORT int temper_cache_put(int fd, const struct temper_cached *cached)
+{
+	struct cache_file file;
+
+	memset(&file, 0, sizeof(file));
+	memcpy(file.magic, cache_magic, sizeof(cache_magic));
+	file.cached = *cached;
+	if (pwrite(fd, &file, sizeof(file), 0) != sizeof(file))
+	{
+		return TEMPER_ERR_WRITE;
+	}
+
+	return TEMPER_OK;
+}
+
+TEMPER_LIB_EXPORT void temper_cache_unlock(int fd)
+{
+	if (fd >= 0)
+	{
+		// closing the last descriptor releases the lock
+		close(fd);
+	}
+}
+
+
+/*
+ * cache Copyright (C) 2020-2021 Armin Fuerst (armin@fuerst.priv.at)
+ *
+ * This file is part of tempersensor.
+ *
+ * Tempersensor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tempersensor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tempersensor.  If not, see <https://www.gnu.org/licenses/>.
+ */
@@ -0,0 +1,91 @@
+/*
+ * cache lets several processes share one device: a lock file per
+ * hidraw node serializes the USB exchange and keeps the last result,
+ * so callers arriving while (or shortly after) another process
+ * queried the device reuse its values instead of asking again.
+ * Additional infos (including a license notice) are at the end of this file.
+ */
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "temper.h"
+
+/* default directory for the lock files */
+#define TEMPER_CACHE_DIR "/var/lock"
+/* time to wait for the lock, longer than a query with some oversampling */
+#define TEMPER_CACHE_LOCK_MS 3000
+
+/*
+ * struct temper_cached
+ *
+ * the result of one query as stored in the lock file
+ */
+struct temper_cached
+{
+	uint64_t timestamp_us; /* CLOCK_REALTIME of the query */
+	int conversion_method; /* as set by temper_set_conversion_method */
+	int in_sensor; /* default sensor for IN of the device */
+	int out_sensor; /* default sensor for OUT of the device */
+	float values[TEMPER_CHANNELS];
+};
+
+/*
+ * temper_cache_lock
+ *
+ * opens (or creates) the lock file for devpath in dir and waits up
+ * to wait_ms for an exclusive lock, the file descriptor is stored in
+ * fd. Returns TEMPER_ERR_TIMEOUT if the lock is still held then, the
+ * caller queries without the cache: anybody may hold the lock of a
+ * shared directory. If the file belongs to somebody else, it is
+ * opened read-only: the lock still works, only temper_cache_put fails.
+ */
+TEMPER_LIB_EXPORT int temper_cache_lock(const char *dir, const char *devpath, int wait_ms, int *fd);
+
+/*
+ * temper_cache_get
+ *
+ * returns true and fills cached if the lock file holds a result
+ * not older than max_age_ms. Results in a file not owned by the
+ * caller or root are never used, anybody could have written them.
+ */
+TEMPER_LIB_EXPORT bool temper_cache_get(int fd, int max_age_ms, struct temper_cached *cached);
+
+/*
+ * temper_cache_put
+ *
+ * stores cached for the following callers
+ */
+TEMPER_LIB_EXPORT int temper_cache_put(int fd, const struct temper_cached *cached);
+
+/*
+ * temper_cache_unlock
+ *
+ * releases the lock and closes fd
+ */
+TEMPER_LIB_EXPORT void temper_cache_unlock(int fd);
+
+#endif // CACHE_H
+
+
+/*
+ * cache Copyright (C) 2020-2021 Armin Fuerst (armin@fuerst.priv.at)
+ *
+ * This file is part of tempersensor.
+ *
+ * Tempersensor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tempersensor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tempersensor.  If not, see <https://www.gnu.org/licenses/>.
+ */
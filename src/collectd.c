@@ -0,0 +1,135 @@
+/*
+ * collectd writes samples as PUTVAL lines for the exec plugin of
+ * collectd. The lines of one tick (a sample of every device) are
+ * written together, so collectd never sees half a tick.
+ * Additional infos (including a license notice) are at the end of this file.
+ */
+
+#include "collectd.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+TEMPER_LIB_EXPORT int temper_collectd_open(struct temper_collectd *collectd, const char *host, int interval_ms, int devices, int fd)
+{
+	memset(collectd, 0, sizeof(struct temper_collectd));
+	if (host != NULL)
+	{
+		(void)snprintf(collectd->host, sizeof(collectd->host), "%s", host);
+	}
+	else if (gethostname(collectd->host, sizeof(collectd->host)) != 0)
+	{
+		strcpy(collectd->host, "localhost");
+	}
+	collectd->host[sizeof(collectd->host) - 1] = '\0';
+	collectd->fd = fd;
+	collectd->interval_ms = interval_ms;
+	collectd->devices = devices;
+	collectd->size = devices * TEMPER_CHANNELS * TEMPER_COLLECTD_LINE;
+	collectd->buf = (char *) malloc(collectd->size);
+	collectd->reported = (bool *) calloc(devices, sizeof(bool));
+	if ((collectd->buf == NULL) || (collectd->reported == NULL))
+	{
+		temper_collectd_close(collectd);
+		return TEMPER_ERR_NOMEM;
+	}
+
+	return TEMPER_OK;
+}
+
+TEMPER_LIB_EXPORT void temper_collectd_flush(struct temper_collectd *collectd)
+{
+	size_t done = 0;
+	ssize_t r;
+
+	while (done < collectd->used)
+	{
+		r = write(collectd->fd, collectd->buf + done, collectd->used - done);
+		if ((r < 0) && (errno != EINTR))
+		{
+			break;
+		}
+		done += (r > 0) ? r : 0;
+	}
+	if (collectd->used > 0)
+	{
+		collectd->writes++;
+	}
+	collectd->used = 0;
+	if (collectd->reported != NULL)
+	{
+		memset(collectd->reported, 0, collectd->devices * sizeof(bool));
+	}
+	collectd->amount_reported = 0;
+}
+
+TEMPER_LIB_EXPORT void temper_collectd_sample(struct temper_collectd *collectd, const struct temper_sample *sample, const char *instance, int amount)
+{
+	const char *types[TEMPER_CHANNELS] = {
+		"temperature-internal", "humidity-internal", "temperature-external", "humidity-external",
+		"temperature-internal_dewpoint", "absolute_humidity-internal", "temperature-internal_heatindex",
+		"temperature-external_dewpoint", "absolute_humidity-external", "temperature-external_heatindex" };
+	int channel;
+
+	if ((sample->device < 0) || (sample->device >= collectd->devices))
+	{
+		return;
+	}
+	if (collectd->reported[sample->device])
+	{
+		temper_collectd_flush(collectd);
+	}
+	for (channel = 0; (channel < TEMPER_CHANNELS) && (sample->status == TEMPER_OK); channel++)
+	{
+		if ((sample->values[channel] <= TEMPER_INVALID) || (collectd->size - collectd->used < TEMPER_COLLECTD_LINE))
+		{
+			continue;
+		}
+		// collectd expects °C
+		collectd->used += snprintf(collectd->buf + collectd->used, collectd->size - collectd->used,
+			"PUTVAL \"%s/tempersensor-%s/%s\" interval=%.3f %llu.%03llu:%.2f\n",
+			collectd->host, instance, types[channel], collectd->interval_ms / 1000.0,
+			(unsigned long long)(sample->timestamp_us / 1000000),
+			(unsigned long long)((sample->timestamp_us / 1000) % 1000),
+			sample->values[channel]);
+	}
+	collectd->reported[sample->device] = true;
+	collectd->amount_reported++;
+	if (collectd->amount_reported >= amount)
+	{
+		temper_collectd_flush(collectd);
+	}
+}
+
+TEMPER_LIB_EXPORT void temper_collectd_close(struct temper_collectd *collectd)
+{
+	if (collectd->buf != NULL)
+	{
+		temper_collectd_flush(collectd);
+	}
+	free(collectd->buf);
+	free(collectd->reported);
+	collectd->buf = NULL;
+	collectd->reported = NULL;
+}
+
+/*
+ * collectd Copyright (C) 2020-2021 Armin Fuerst (armin@fuerst.priv.at)
+ *
+ * This file is part of tempersensor.
+ *
+ * Tempersensor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tempersensor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tempersensor.  If not, see <https://www.gnu.org/licenses/>.
+ */
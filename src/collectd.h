@@ -0,0 +1,90 @@
+/*
+ * collectd writes samples as PUTVAL lines for the exec plugin of
+ * collectd. The lines of one tick (a sample of every device) are
+ * written together, so collectd never sees half a tick.
+ * Additional infos (including a license notice) are at the end of this file.
+ */
+
+#ifndef COLLECTD_H
+#define COLLECTD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "sampler.h"
+#include "temper.h"
+
+#define TEMPER_COLLECTD_LINE 200 /* room for one PUTVAL line */
+
+/*
+ * struct temper_collectd
+ *
+ * PUTVAL lines of the current tick, set up by temper_collectd_open
+ */
+struct temper_collectd
+{
+	char host[256];
+	int fd;
+	int interval_ms;
+	int devices; /* devices there is room for */
+	char *buf;
+	size_t size;
+	size_t used;
+	bool *reported; /* per device, a sample is in buf */
+	int amount_reported;
+	unsigned long writes; /* ticks written */
+};
+
+/*
+ * temper_collectd_open
+ *
+ * prepares collecting the lines of up to devices devices sampled
+ * every interval_ms for fd, host NULL is the name of this host
+ */
+TEMPER_LIB_EXPORT int temper_collectd_open(struct temper_collectd *collectd, const char *host, int interval_ms, int devices, int fd);
+
+/*
+ * temper_collectd_sample
+ *
+ * adds a PUTVAL line per valid channel of sample, named
+ * HOST/tempersensor-INSTANCE/TYPE-TYPE_INSTANCE, instance names the
+ * device. A sample of a device already reported starts the next
+ * tick, the one completing the tick of the devices sampled (amount)
+ * ends it.
+ */
+TEMPER_LIB_EXPORT void temper_collectd_sample(struct temper_collectd *collectd, const struct temper_sample *sample, const char *instance, int amount);
+
+/*
+ * temper_collectd_flush
+ *
+ * writes the lines of the tick with one write
+ */
+TEMPER_LIB_EXPORT void temper_collectd_flush(struct temper_collectd *collectd);
+
+/*
+ * temper_collectd_close
+ *
+ * writes what is left and releases the buffers of collectd
+ */
+TEMPER_LIB_EXPORT void temper_collectd_close(struct temper_collectd *collectd);
+
+#endif // COLLECTD_H
+
+/*
+ * collectd Copyright (C) 2020-2021 Armin Fuerst (armin@fuerst.priv.at)
+ *
+ * This file is part of tempersensor.
+ *
+ * Tempersensor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tempersensor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tempersensor.  If not, see <https://www.gnu.org/licenses/>.
+ */
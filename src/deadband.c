@@ -0,0 +1,73 @@
+/*
+ * deadband decides which samples are worth writing: a sample passes
+ * if a channel moved further than its threshold since the last sample
+ * passed, became valid or invalid, or if nothing passed for too long.
+ * Additional infos (including a license notice) are at the end of this file.
+ */
+
+#include "deadband.h"
+#include <string.h>
+
+/*
+ * changed
+ *
+ * checks one channel against the value of the last sample passed
+ */
+static bool changed(const struct temper_deadband *db, int channel, float last, float value)
+{
+	float limit = db->threshold[channel];
+	float diff;
+
+	if ((last <= TEMPER_INVALID) || (value <= TEMPER_INVALID))
+	{
+		return (last <= TEMPER_INVALID) != (value <= TEMPER_INVALID);
+	}
+	if (db->relative[channel])
+	{
+		limit = limit * ((last < 0.0) ? -last : last) / 100.0;
+	}
+	diff = (value > last) ? value - last : last - value;
+	return diff > limit;
+}
+
+TEMPER_LIB_EXPORT bool temper_deadband_pass(const struct temper_deadband *db, struct temper_deadband_state *state, uint64_t timestamp_us, const float *values)
+{
+	bool pass = (state->last_us == 0) ||
+		((db->heartbeat_ms > 0) &&
+		(timestamp_us - state->last_us >= (uint64_t) db->heartbeat_ms * 1000));
+	int channel;
+
+	for (channel = 0; !pass && (channel < TEMPER_CHANNELS); channel++)
+	{
+		pass = changed(db, channel, state->last[channel], values[channel]);
+	}
+	if (!pass)
+	{
+		state->suppressed++;
+		return false;
+	}
+	memcpy(state->last, values, sizeof(state->last));
+	state->last_us = timestamp_us;
+	state->passed++;
+
+	return true;
+}
+
+/*
+ * deadband Copyright (C) 2020-2021 Armin Fuerst (armin@fuerst.priv.at)
+ *
+ * This file is part of tempersensor.
+ *
+ * Tempersensor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tempersensor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tempersensor.  If not, see <https://www.gnu.org/licenses/>.
+ */
@@ -0,0 +1,68 @@
+/*
+ * deadband decides which samples are worth writing: a sample passes
+ * if a channel moved further than its threshold since the last sample
+ * passed, became valid or invalid, or if nothing passed for too long.
+ * Additional infos (including a license notice) are at the end of this file.
+ */
+
+#ifndef DEADBAND_H
+#define DEADBAND_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "temper.h"
+
+/*
+ * struct temper_deadband
+ *
+ * thresholds per channel, 0 lets every change pass
+ */
+struct temper_deadband
+{
+	float threshold[TEMPER_CHANNELS];
+	bool relative[TEMPER_CHANNELS]; /* threshold in percent of the last value */
+	uint32_t heartbeat_ms; /* let a sample pass after this silence, 0 = never */
+};
+
+/*
+ * struct temper_deadband_state
+ *
+ * state of one device, zeroed before the first sample
+ */
+struct temper_deadband_state
+{
+	uint64_t last_us; /* timestamp of the last sample passed, 0 = none */
+	float last[TEMPER_CHANNELS];
+	unsigned long passed;
+	unsigned long suppressed;
+};
+
+/*
+ * temper_deadband_pass
+ *
+ * returns true if the sample values captured at timestamp_us
+ * (microseconds) should be written and remembers them
+ */
+TEMPER_LIB_EXPORT bool temper_deadband_pass(const struct temper_deadband *db, struct temper_deadband_state *state, uint64_t timestamp_us, const float *values);
+
+#endif // DEADBAND_H
+
+/*
+ * deadband Copyright (C) 2020-2021 Armin Fuerst (armin@fuerst.priv.at)
+ *
+ * This file is part of tempersensor.
+ *
+ * Tempersensor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tempersensor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tempersensor.  If not, see <https://www.gnu.org/licenses/>.
+ */
@@ -0,0 +1,147 @@
+/*
+ * decode holds the reference formulas converting the raw 16 bit
+ * values of TEMPer devices. libtempersensor does not use them at
+ * runtime: gentables evaluates them for every possible input at
+ * build time, the self test compares the tables against them.
+ * Additional infos (including a license notice) are at the end of this file.
+ */
+
+#ifndef DECODE_H
+#define DECODE_H
+
+#include <math.h>
+#include <stdint.h>
+
+#include "temper.h"
+
+/*
+ * method 1 only uses the upper 12 bits, a value is invalid
+ * if any of the lower 4 bits is set
+ */
+#define DECODE_METHOD1_SHIFT 4
+#define DECODE_METHOD1_INVALID 0x000F
+#define DECODE_METHOD1_SIZE (1 << (16 - DECODE_METHOD1_SHIFT))
+#define DECODE_METHOD2_SIZE (1 << 16)
+
+/*
+ * the generated tables, indexed by raw >> DECODE_METHOD1_SHIFT
+ * for method 1 and by raw for method 2
+ */
+extern const float temper_decode_method1[DECODE_METHOD1_SIZE];
+extern const float temper_decode_method2[DECODE_METHOD2_SIZE];
+
+/*
+ * decode_reference
+ *
+ * calculates the value of raw (first byte of the response in the
+ * upper 8 bits) for conversion_method
+ */
+static inline float decode_reference(int conversion_method, uint16_t raw)
+{
+	/*
+	   reverse engineering results for TEMPer 1.3:
+	    + relevant for this device are positions 4 + 5
+	    + in good case, the lower sigificant part of position 5
+	      is always 0
+	    + if error case, the lower sigificant part of position 5
+	      is F (or not zero?)
+	    + the value is represented in two's complement
+	    + position 4 is the part before the comma
+	    + the higher 4 bits of position 5 are after the comma
+	 */
+
+	if (conversion_method == 1)
+	{
+		/*
+		 * conversion_method 1: value in two's complement with fraction
+		 * If MSB is set, the temperature is negative in 2'complement form.
+		 * Since we cannot know how negative numbers are on the system,
+		 * we calculate it manually. Since TEMPer only has 4 bits after the
+		 * comma and they are the higher part of the byte, we shift the two
+		 * bytes after concatinating 4 bits to the right, deal with 12 bits
+		 * (0xFFF) and divide by 16.
+		 * Alternatively, we could omit the shift to the right, deal with
+		 * 16 bits (0xFFFF) and divide by 256.
+		 */
+
+		/* see whether we have valid result */
+		if ((raw & DECODE_METHOD1_INVALID) != 0)
+		{
+			return TEMPER_INVALID;
+		}
+
+		if ((raw & 0x8000) != 0)
+		{
+			// convert fixed comma from 2'complement form, < 0
+			// 1. ignore comma
+			// 2. subtract 1
+			// 3. invert bits
+			// 4. multiply by -1
+			// 5. divide by amount of distinct values behind the comma
+			//    - here we calculate with 4 bits => 2 by power of 4
+
+			return (float)((((raw >> 4) - 1) ^ 0xFFF) * -1) / pow(2, 4);
+		}
+		else
+		{
+			// convert fixed comma from 2'complement form, >= 0
+			// 1. ignore comma
+			// 2. divide by amount of distinct values behind the comma
+			//    - here we calculate with 4 bits => 2 by power of 4
+
+			return (float)(raw >> 4) / pow(2, 4);
+		}
+	}
+	else if (conversion_method == 2)
+	{
+		/*
+		 * conversion_method 2: value in two's complement multiplied
+		 * by 100, e.g. 22.06 °C = 2206
+		 */
+		if ((raw & 0x8000) != 0)
+		{
+			// convert two's complement, < 0
+			// 1. subtract 1 from integer
+			// 2. invert bits
+			// 3. make negative
+			// 4. after conversion, divide by 100
+			return (float)(((raw - 1) ^ 0xFFFF) * -1) / 100.0;
+		}
+		else
+		{
+			// convert two's complement, >= 0
+			// after conversion, divide by 100
+			return (float)raw / 100.0;
+		}
+	}
+	else
+	{
+		/*
+		 * if an unknown conversion_method is defined,
+		 * return invalid value
+		 */
+		return TEMPER_INVALID;
+	}
+}
+
+#endif // DECODE_H
+
+
+/*
+ * decode Copyright (C) 2020-2021 Armin Fuerst (armin@fuerst.priv.at)
+ *
+ * This file is part of tempersensor.
+ *
+ * Tempersensor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tempersensor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tempersensor.  If not, see <https://www.gnu.org/licenses/>.
+ */
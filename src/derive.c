@@ -0,0 +1,160 @@
+/*
+ * derive calculates dew point, absolute humidity and heat index from
+ * temperature and relative humidity. The saturation vapour pressure
+ * is interpolated from a table generated at build time, so deriving
+ * needs neither exp nor log and libtempersensor stays free of libm.
+ * Additional infos (including a license notice) are at the end of this file.
+ */
+
+#include "derive.h"
+
+/*
+ * the relative humidity sensors report up to 100 %, a bit of noise above
+ * is accepted, values outside do not come from a working sensor
+ */
+#define HUM_MAX 105.0
+
+/*
+ * svp
+ *
+ * saturation vapour pressure in hPa at temp °C, linearly interpolated
+ * between the steps of the table (at most 0.04% above the Magnus
+ * formula), TEMPER_INVALID outside the table
+ */
+static float svp(float temp)
+{
+	float pos = (temp - DERIVE_SVP_MIN) * DERIVE_SVP_STEPS;
+	int index;
+
+	if ((pos < 0.0) || (pos >= DERIVE_SVP_SIZE - 1))
+	{
+		return TEMPER_INVALID;
+	}
+	index = (int) pos;
+	return temper_derive_svp[index] + (pos - index) *
+		(temper_derive_svp[index + 1] - temper_derive_svp[index]);
+}
+
+/*
+ * dewpoint
+ *
+ * temperature in °C at which the vapour pressure e saturates, found by
+ * a binary search in the table and linear interpolation (at most
+ * 0.005 °C from the Magnus formula), TEMPER_INVALID below the table
+ */
+static float dewpoint(float e)
+{
+	int low = 0;
+	int high = DERIVE_SVP_SIZE - 1;
+	int mid;
+
+	if ((e < temper_derive_svp[low]) || (e > temper_derive_svp[high]))
+	{
+		return TEMPER_INVALID;
+	}
+	while (high - low > 1)
+	{
+		mid = (low + high) / 2;
+		if (temper_derive_svp[mid] <= e)
+			low = mid;
+		else
+			high = mid;
+	}
+	return DERIVE_SVP_MIN + (low + (e - temper_derive_svp[low]) /
+		(temper_derive_svp[high] - temper_derive_svp[low])) / DERIVE_SVP_STEPS;
+}
+
+/*
+ * square_root
+ *
+ * Newton's method for 0 <= x <= 1, the only range the heat index needs
+ */
+static float square_root(float x)
+{
+	float r = 1.0;
+	int cnt;
+
+	if (x <= 0.0)
+	{
+		return 0.0;
+	}
+	for (cnt = 0; cnt < 8; cnt++)
+	{
+		r = (r + x / r) / 2.0;
+	}
+	return r;
+}
+
+/*
+ * heatindex
+ *
+ * heat index in °C, the algorithm of derive_heatindex_reference
+ * with the square root above (within 0.001 °C of the reference)
+ */
+static float heatindex(float temp, float hum)
+{
+	float t = temp * 9.0 / 5.0 + 32.0;
+	float hi = 0.5 * (t + 61.0 + (t - 68.0) * 1.2 + hum * 0.094);
+
+	if ((hi + t) / 2.0 >= 80.0)
+	{
+		hi = -42.379 + 2.04901523 * t + 10.14333127 * hum
+			- 0.22475541 * t * hum - 0.00683783 * t * t
+			- 0.05481717 * hum * hum + 0.00122874 * t * t * hum
+			+ 0.00085282 * t * hum * hum - 0.00000199 * t * t * hum * hum;
+		if ((hum < 13.0) && (t >= 80.0) && (t <= 112.0))
+			hi -= (13.0 - hum) / 4.0 * square_root((17.0 - ((t > 95.0) ? t - 95.0 : 95.0 - t)) / 17.0);
+		else if ((hum > 85.0) && (t >= 80.0) && (t <= 87.0))
+			hi += (hum - 85.0) / 10.0 * (87.0 - t) / 5.0;
+	}
+	return (hi - 32.0) * 5.0 / 9.0;
+}
+
+static void derive(float *values, int temp, int hum, int dp, int ah, int hi)
+{
+	float e;
+
+	values[dp] = TEMPER_INVALID;
+	values[ah] = TEMPER_INVALID;
+	values[hi] = TEMPER_INVALID;
+	if ((values[temp] <= TEMPER_INVALID) || (values[hum] < 0.0) || (values[hum] > HUM_MAX))
+	{
+		return;
+	}
+	e = svp(values[temp]);
+	if (e <= TEMPER_INVALID)
+	{
+		return;
+	}
+	e = e * values[hum] / 100.0;
+	values[ah] = DERIVE_ABSHUM_FACTOR * e / (DERIVE_KELVIN + values[temp]);
+	values[dp] = dewpoint(e);
+	values[hi] = heatindex(values[temp], values[hum]);
+}
+
+TEMPER_LIB_EXPORT void temper_derive(float *values)
+{
+	derive(values, TEMPER_INT_TEMP, TEMPER_INT_HUM,
+		TEMPER_INT_DEWPOINT, TEMPER_INT_ABSHUM, TEMPER_INT_HEATINDEX);
+	derive(values, TEMPER_EXT_TEMP, TEMPER_EXT_HUM,
+		TEMPER_EXT_DEWPOINT, TEMPER_EXT_ABSHUM, TEMPER_EXT_HEATINDEX);
+}
+
+/*
+ * derive Copyright (C) 2020-2021 Armin Fuerst (armin@fuerst.priv.at)
+ *
+ * This file is part of tempersensor.
+ *
+ * Tempersensor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tempersensor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tempersensor.  If not, see <https://www.gnu.org/licenses/>.
+ */
@@ -0,0 +1,116 @@
+/*
+ * derive holds the reference formulas for the channels libtempersensor
+ * derives from temperature and relative humidity. Like decode.h, the
+ * library does not use them at runtime: gentables tabulates the
+ * saturation vapour pressure at build time, the self test compares
+ * the fast versions against them.
+ * Additional infos (including a license notice) are at the end of this file.
+ */
+
+#ifndef DERIVE_H
+#define DERIVE_H
+
+#include <math.h>
+
+#include "temper.h"
+
+/*
+ * Magnus formula over water with the coefficients of Sonntag (1990),
+ * within 0.1% of the exact saturation vapour pressure from -45 to 60 °C
+ */
+#define DERIVE_MAGNUS_E0 6.112 /* hPa */
+#define DERIVE_MAGNUS_A 17.62
+#define DERIVE_MAGNUS_B 243.12 /* °C */
+
+/* g/m³ per hPa/K, 100 / (461.5 J/(kg·K) specific gas constant of water vapour) * 1000 */
+#define DERIVE_ABSHUM_FACTOR 216.7
+#define DERIVE_KELVIN 273.15
+
+/* the table covers DERIVE_SVP_MIN to DERIVE_SVP_MAX °C in 1/DERIVE_SVP_STEPS °C steps */
+#define DERIVE_SVP_MIN -45
+#define DERIVE_SVP_MAX 80
+#define DERIVE_SVP_STEPS 2
+#define DERIVE_SVP_SIZE ((DERIVE_SVP_MAX - DERIVE_SVP_MIN) * DERIVE_SVP_STEPS + 1)
+
+/* the generated table, saturation vapour pressure in hPa */
+extern const float temper_derive_svp[DERIVE_SVP_SIZE];
+
+/*
+ * derive_svp_reference
+ *
+ * saturation vapour pressure in hPa at temp °C
+ */
+static inline double derive_svp_reference(double temp)
+{
+	return DERIVE_MAGNUS_E0 * exp(DERIVE_MAGNUS_A * temp / (DERIVE_MAGNUS_B + temp));
+}
+
+/*
+ * derive_dewpoint_reference
+ *
+ * dew point in °C at temp °C and hum % relative humidity
+ */
+static inline double derive_dewpoint_reference(double temp, double hum)
+{
+	double gamma = log(hum / 100.0) + DERIVE_MAGNUS_A * temp / (DERIVE_MAGNUS_B + temp);
+
+	return DERIVE_MAGNUS_B * gamma / (DERIVE_MAGNUS_A - gamma);
+}
+
+/*
+ * derive_abshum_reference
+ *
+ * absolute humidity in g/m³ at temp °C and hum % relative humidity
+ */
+static inline double derive_abshum_reference(double temp, double hum)
+{
+	return DERIVE_ABSHUM_FACTOR * hum / 100.0 * derive_svp_reference(temp)
+		/ (DERIVE_KELVIN + temp);
+}
+
+/*
+ * derive_heatindex_reference
+ *
+ * heat index in °C at temp °C and hum % relative humidity, following
+ * the algorithm of the US National Weather Service: Steadman's simple
+ * formula, above 80 °F the Rothfusz regression with its adjustments
+ */
+static inline double derive_heatindex_reference(double temp, double hum)
+{
+	double t = temp * 9.0 / 5.0 + 32.0;
+	double hi = 0.5 * (t + 61.0 + (t - 68.0) * 1.2 + hum * 0.094);
+
+	if ((hi + t) / 2.0 >= 80.0)
+	{
+		hi = -42.379 + 2.04901523 * t + 10.14333127 * hum
+			- 0.22475541 * t * hum - 0.00683783 * t * t
+			- 0.05481717 * hum * hum + 0.00122874 * t * t * hum
+			+ 0.00085282 * t * hum * hum - 0.00000199 * t * t * hum * hum;
+		if ((hum < 13.0) && (t >= 80.0) && (t <= 112.0))
+			hi -= (13.0 - hum) / 4.0 * sqrt((17.0 - fabs(t - 95.0)) / 17.0);
+		else if ((hum > 85.0) && (t >= 80.0) && (t <= 87.0))
+			hi += (hum - 85.0) / 10.0 * (87.0 - t) / 5.0;
+	}
+	return (hi - 32.0) * 5.0 / 9.0;
+}
+
+#endif // DERIVE_H
+
+/*
+ * derive Copyright (C) 2020-2021 Armin Fuerst (armin@fuerst.priv.at)
+ *
+ * This file is part of tempersensor.
+ *
+ * Tempersensor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tempersensor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tempersensor.  If not, see <https://www.gnu.org/licenses/>.
+ */
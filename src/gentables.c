@@ -0,0 +1,103 @@
+/*
+ * gentables writes the lookup table libtempersensor uses to convert
+ * raw values of one conversion method (or the saturation vapour
+ * pressure table for the derived channels) to stdout. It runs on the
+ * build host, so the formulas in decode.h and derive.h (and libm) are
+ * only needed at build time.
+ * Additional infos (including a license notice) are at the end of this file.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "decode.h"
+#include "derive.h"
+
+/*
+ * print_table
+ *
+ * hexadecimal float constants keep the values exact
+ */
+
+static void print_table(const char *name, int conversion_method, int size, int shift)
+{
+	int index;
+
+	printf("\nconst float %s[%i] =\n{\n", name, size);
+	for (index = 0; index < size; index++)
+	{
+		printf("%s%a,%s", (index % 4) ? " " : "\t",
+			decode_reference(conversion_method, (uint16_t)(index << shift)),
+			(index % 4 == 3) ? "\n" : "");
+	}
+	printf("};\n");
+}
+
+/*
+ * print_svp
+ *
+ * saturation vapour pressure for every step of the table range
+ */
+
+static void print_svp()
+{
+	int index;
+
+	printf("\nconst float temper_derive_svp[%i] =\n{\n", DERIVE_SVP_SIZE);
+	for (index = 0; index < DERIVE_SVP_SIZE; index++)
+	{
+		printf("%s%a,%s", (index % 4) ? " " : "\t",
+			(float)derive_svp_reference(DERIVE_SVP_MIN + (double)index / DERIVE_SVP_STEPS),
+			((index % 4 == 3) || (index == DERIVE_SVP_SIZE - 1)) ? "\n" : "");
+	}
+	printf("};\n");
+}
+
+int main(int argc, char *argv[])
+{
+	const char *table = (argc == 2) ? argv[1] : "";
+
+	/* one table per file, so linking only pulls in what is used */
+	printf("/* generated by gentables, do not edit */\n\n");
+	if (!strcmp(table, "1"))
+	{
+		printf("#include \"decode.h\"\n");
+		print_table("temper_decode_method1", 1, DECODE_METHOD1_SIZE, DECODE_METHOD1_SHIFT);
+	}
+	else if (!strcmp(table, "2"))
+	{
+		printf("#include \"decode.h\"\n");
+		print_table("temper_decode_method2", 2, DECODE_METHOD2_SIZE, 0);
+	}
+	else if (!strcmp(table, "svp"))
+	{
+		printf("#include \"derive.h\"\n");
+		print_svp();
+	}
+	else
+	{
+		fprintf(stderr, "usage: %s 1|2|svp\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/*
+ * gentables Copyright (C) 2020-2021 Armin Fuerst (armin@fuerst.priv.at)
+ *
+ * This file is part of tempersensor.
+ *
+ * Tempersensor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tempersensor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tempersensor.  If not, see <https://www.gnu.org/licenses/>.
+ */
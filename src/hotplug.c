@@ -0,0 +1,173 @@
+/*
+ * hotplug follows hidraw devices being plugged in and removed by
+ * listening to the uevents of the kernel, so long-running processes
+ * notice them without scanning /sys again.
+ * Additional infos (including a license notice) are at the end of this file.
+ */
+
+#include "hotplug.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+
+/* uevents are limited to a few kilobytes by the kernel */
+#define UEVENT_SIZE 8192
+
+TEMPER_LIB_EXPORT int temper_hotplug_open(int *fd)
+{
+	struct sockaddr_nl addr;
+
+	*fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+	if (*fd < 0)
+	{
+		return TEMPER_ERR_OPEN;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+	addr.nl_groups = 1; /* the kernel, not the messages udev sends after processing */
+	if (bind(*fd, (struct sockaddr *) &addr, sizeof(addr)) < 0)
+	{
+		close(*fd);
+		*fd = -1;
+		return TEMPER_ERR_OPEN;
+	}
+
+	return TEMPER_OK;
+}
+
+/*
+ * hid_ids
+ *
+ * finds the HID device in devpath (.../BUS:VENDOR:PRODUCT.INSTANCE/hidraw/hidrawN)
+ * and reads its IDs
+ */
+static bool hid_ids(const char *devpath, uint16_t *vendor_id, uint16_t *product_id)
+{
+	const char *end = strstr(devpath, "/hidraw/");
+	const char *start = end;
+	unsigned int bus;
+	unsigned int vendor;
+	unsigned int product;
+
+	if (end == NULL)
+	{
+		return false;
+	}
+	while ((start > devpath) && (start[-1] != '/'))
+	{
+		start--;
+	}
+	if (sscanf(start, "%x:%x:%x.", &bus, &vendor, &product) != 3)
+	{
+		return false;
+	}
+	*vendor_id = vendor;
+	*product_id = product;
+
+	return true;
+}
+
+TEMPER_LIB_EXPORT bool temper_hotplug_parse(const char *msg, size_t len, struct temper_uevent *ev)
+{
+	const char *action = NULL;
+	const char *devpath = NULL;
+	const char *subsystem = NULL;
+	const char *devname = NULL;
+	const char *end = msg + len;
+	const char *field;
+	size_t flen;
+
+	/* the header "ACTION@DEVPATH" is repeated by the fields */
+	for (field = msg; field < end; field += flen + 1)
+	{
+		flen = strnlen(field, end - field);
+		if (field + flen >= end)
+		{
+			/* not terminated */
+			break;
+		}
+		if (!strncmp(field, "ACTION=", 7))
+			action = field + 7;
+		else if (!strncmp(field, "DEVPATH=", 8))
+			devpath = field + 8;
+		else if (!strncmp(field, "SUBSYSTEM=", 10))
+			subsystem = field + 10;
+		else if (!strncmp(field, "DEVNAME=", 8))
+			devname = field + 8;
+	}
+	if ((action == NULL) || (devpath == NULL) || (subsystem == NULL) || (devname == NULL) ||
+		strcmp(subsystem, "hidraw"))
+	{
+		return false;
+	}
+	if (!strcmp(action, "add"))
+	{
+		ev->action = TEMPER_HOTPLUG_ADD;
+	}
+	else if (!strcmp(action, "remove"))
+	{
+		ev->action = TEMPER_HOTPLUG_REMOVE;
+	}
+	else
+	{
+		return false;
+	}
+	if (!hid_ids(devpath, &ev->info.vendor_id, &ev->info.product_id) ||
+		!temper_is_supported(ev->info.vendor_id, ev->info.product_id))
+	{
+		return false;
+	}
+	/* DEVNAME is relative to /dev */
+	if (snprintf(ev->info.devpath, sizeof(ev->info.devpath), "/dev/%s", devname) >= sizeof(ev->info.devpath))
+	{
+		return false;
+	}
+
+	return true;
+}
+
+TEMPER_LIB_EXPORT int temper_hotplug_read(int fd, struct temper_uevent *ev)
+{
+	char msg[UEVENT_SIZE];
+	struct sockaddr_storage from;
+	socklen_t fromlen = sizeof(from);
+	ssize_t r;
+
+	memset(&from, 0, sizeof(from));
+	r = recvfrom(fd, msg, sizeof(msg), MSG_DONTWAIT, (struct sockaddr *) &from, &fromlen);
+	if (r < 0)
+	{
+		return ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)) ?
+			TEMPER_ERR_TIMEOUT : TEMPER_ERR_READ;
+	}
+	/* anybody can send to the group, only trust the kernel */
+	if ((from.ss_family == AF_NETLINK) && (((struct sockaddr_nl *) &from)->nl_pid != 0))
+	{
+		return 0;
+	}
+
+	return temper_hotplug_parse(msg, r, ev) ? 1 : 0;
+}
+
+/*
+ * hotplug Copyright (C) 2020-2021 Armin Fuerst (armin@fuerst.priv.at)
+ *
+ * This file is part of tempersensor.
+ *
+ * Tempersensor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tempersensor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tempersensor.  If not, see <https://www.gnu.org/licenses/>.
+ */
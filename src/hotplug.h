@@ -0,0 +1,79 @@
+/*
+ * hotplug follows hidraw devices being plugged in and removed by
+ * listening to the uevents of the kernel, so long-running processes
+ * notice them without scanning /sys again.
+ * Additional infos (including a license notice) are at the end of this file.
+ */
+
+#ifndef HOTPLUG_H
+#define HOTPLUG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "temper.h"
+
+#define TEMPER_HOTPLUG_ADD 1
+#define TEMPER_HOTPLUG_REMOVE 2
+
+/*
+ * struct temper_uevent
+ *
+ * a supported hidraw device plugged in or removed
+ */
+struct temper_uevent
+{
+	int action; /* TEMPER_HOTPLUG_* */
+	struct temper_devinfo info;
+};
+
+/*
+ * temper_hotplug_open
+ *
+ * opens a non-blocking NETLINK_KOBJECT_UEVENT socket receiving
+ * the uevents of the kernel
+ */
+TEMPER_LIB_EXPORT int temper_hotplug_open(int *fd);
+
+/*
+ * temper_hotplug_parse
+ *
+ * decodes one uevent message ("ACTION@DEVPATH" followed by KEY=VALUE
+ * strings, all terminated by 0). Returns true for adding or removing
+ * a hidraw node of a supported device, the IDs are taken from the
+ * name of the HID device in DEVPATH, as sysfs is already gone when
+ * a device is removed.
+ */
+TEMPER_LIB_EXPORT bool temper_hotplug_parse(const char *msg, size_t len, struct temper_uevent *ev);
+
+/*
+ * temper_hotplug_read
+ *
+ * reads one message from fd, returns 1 if it describes a supported
+ * device (see temper_hotplug_parse), 0 if it did not,
+ * TEMPER_ERR_TIMEOUT if no message was waiting and TEMPER_ERR_READ
+ * on errors. On a netlink socket only messages from the kernel are
+ * accepted, other sockets can be used to inject messages.
+ */
+TEMPER_LIB_EXPORT int temper_hotplug_read(int fd, struct temper_uevent *ev);
+
+#endif // HOTPLUG_H
+
+/*
+ * hotplug Copyright (C) 2020-2021 Armin Fuerst (armin@fuerst.priv.at)
+ *
+ * This file is part of tempersensor.
+ *
+ * Tempersensor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tempersensor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tempersensor.  If not, see <https://www.gnu.org/licenses/>.
+ */
@@ -0,0 +1,589 @@
+/*
+ * mqtt is a minimal MQTT 3.1.1 client publishing samples to a broker.
+ * It keeps one connection, pipelines the publishes without waiting
+ * for their acknowledgements and reconnects with a backoff.
+ * Additional infos (including a license notice) are at the end of this file.
+ */
+
+#include "mqtt.h"
+#include "sampler.h"
+#include <errno.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+/* packet types, in the upper nibble of the first byte */
+#define CONNECT 0x10
+#define CONNACK 0x20
+#define PUBLISH 0x30
+#define PUBACK 0x40
+#define PINGREQ 0xc0
+#define PINGRESP 0xd0
+#define DISCONNECT 0xe0
+
+#define PUBLISH_DUP 0x08
+#define PUBLISH_RETAIN 0x01
+
+static void put16(unsigned char *p, uint16_t v)
+{
+	p[0] = v >> 8;
+	p[1] = v;
+}
+
+/*
+ * put_length
+ *
+ * encodes the remaining length of a packet, returns the bytes used
+ */
+static size_t put_length(unsigned char *p, size_t len)
+{
+	size_t used = 0;
+
+	do
+	{
+		p[used] = len & 0x7f;
+		len >>= 7;
+		if (len > 0)
+		{
+			p[used] |= 0x80;
+		}
+		used++;
+	} while (len > 0);
+
+	return used;
+}
+
+/*
+ * split_broker
+ *
+ * splits broker ("HOST", "HOST:PORT" or "[IPV6]:PORT") into host
+ * and port of mqtt
+ */
+static int split_broker(struct temper_mqtt *mqtt, const char *broker)
+{
+	const char *port = TEMPER_MQTT_PORT;
+	const char *end;
+
+	if (broker[0] == '[')
+	{
+		end = strchr(broker, ']');
+		if ((end == NULL) || ((end[1] != '\0') && (end[1] != ':')))
+		{
+			return TEMPER_ERR_PARAM;
+		}
+		if (end[1] == ':')
+		{
+			port = end + 2;
+		}
+		broker++;
+	}
+	else
+	{
+		end = strrchr(broker, ':');
+		if ((end != NULL) && (strchr(broker, ':') == end))
+		{
+			port = end + 1;
+		}
+		else
+		{
+			// no port or a bare IPv6 address
+			end = broker + strlen(broker);
+		}
+	}
+	if ((end == broker) || (end - broker >= sizeof(mqtt->host)) ||
+		(*port == '\0') || (strlen(port) >= sizeof(mqtt->port)))
+	{
+		return TEMPER_ERR_PARAM;
+	}
+	memcpy(mqtt->host, broker, end - broker);
+	mqtt->host[end - broker] = '\0';
+	strcpy(mqtt->port, port);
+
+	return TEMPER_OK;
+}
+
+static bool append(struct temper_mqtt *mqtt, const unsigned char *data, size_t len)
+{
+	if (len > sizeof(mqtt->out) - mqtt->out_used)
+	{
+		return false;
+	}
+	memcpy(mqtt->out + mqtt->out_used, data, len);
+	mqtt->out_used += len;
+
+	return true;
+}
+
+/*
+ * queue_unsent
+ *
+ * queues the QoS 1 publishes not sent on this connection in the order
+ * they were published, the ones sent on an earlier connection flagged
+ * as duplicates
+ */
+static void queue_unsent(struct temper_mqtt *mqtt)
+{
+	struct temper_mqtt_message *msg;
+	int cnt;
+
+	for (cnt = 0; cnt < mqtt->amount_inflight; cnt++)
+	{
+		msg = &mqtt->inflight[(mqtt->first_inflight + cnt) % TEMPER_MQTT_INFLIGHT];
+		if ((msg->id == 0) || msg->sent)
+		{
+			continue;
+		}
+		if (msg->dup)
+		{
+			msg->packet[0] |= PUBLISH_DUP;
+		}
+		if (!append(mqtt, msg->packet, msg->len))
+		{
+			break;
+		}
+		msg->sent = true;
+		if (!msg->dup)
+		{
+			mqtt->published++;
+		}
+	}
+}
+
+/*
+ * disconnect
+ *
+ * drops the connection and schedules the next one after the backoff,
+ * which doubles up to TEMPER_MQTT_BACKOFF_MAX
+ */
+static void disconnect(struct temper_mqtt *mqtt, uint64_t now)
+{
+	int cnt;
+
+	if (mqtt->fd >= 0)
+	{
+		close(mqtt->fd);
+		mqtt->fd = -1;
+	}
+	mqtt->state = TEMPER_MQTT_DISCONNECTED;
+	mqtt->failed = false;
+	mqtt->out_used = 0;
+	mqtt->in_used = 0;
+	for (cnt = 0; cnt < TEMPER_MQTT_INFLIGHT; cnt++)
+	{
+		if ((mqtt->inflight[cnt].id != 0) && mqtt->inflight[cnt].sent)
+		{
+			mqtt->inflight[cnt].sent = false;
+			mqtt->inflight[cnt].dup = true;
+		}
+	}
+	mqtt->reconnect_us = now + (uint64_t) mqtt->backoff_ms * 1000;
+	mqtt->backoff_ms *= 2;
+	if (mqtt->backoff_ms > TEMPER_MQTT_BACKOFF_MAX)
+	{
+		mqtt->backoff_ms = TEMPER_MQTT_BACKOFF_MAX;
+	}
+}
+
+/*
+ * connect_broker
+ *
+ * starts a connection without waiting for it and queues CONNECT,
+ * with a clean session: QoS 1 publishes are sent again by the client
+ */
+static void connect_broker(struct temper_mqtt *mqtt, uint64_t now)
+{
+	struct addrinfo hints;
+	struct addrinfo *result;
+	struct addrinfo *ai;
+	// fixed header, variable header and the longest client ID
+	unsigned char packet[2 + 12 + sizeof(mqtt->client_id)];
+	size_t id_len = strlen(mqtt->client_id);
+	size_t len;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo(mqtt->host, mqtt->port, &hints, &result) != 0)
+	{
+		disconnect(mqtt, now);
+		return;
+	}
+	for (ai = result; ai != NULL; ai = ai->ai_next)
+	{
+		mqtt->fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol);
+		if (mqtt->fd < 0)
+		{
+			continue;
+		}
+		if ((connect(mqtt->fd, ai->ai_addr, ai->ai_addrlen) == 0) || (errno == EINPROGRESS))
+		{
+			break;
+		}
+		close(mqtt->fd);
+		mqtt->fd = -1;
+	}
+	freeaddrinfo(result);
+	if (mqtt->fd < 0)
+	{
+		disconnect(mqtt, now);
+		return;
+	}
+
+	packet[0] = CONNECT;
+	len = 1 + put_length(packet + 1, 12 + id_len);
+	memcpy(packet + len, "\0\4MQTT\4\2", 8); // protocol level 4, clean session
+	put16(packet + len + 8, mqtt->keepalive);
+	put16(packet + len + 10, id_len);
+	memcpy(packet + len + 12, mqtt->client_id, id_len);
+	mqtt->out_used = 0;
+	(void)append(mqtt, packet, len + 12 + id_len);
+	mqtt->state = TEMPER_MQTT_CONNECTING;
+	mqtt->connect_us = now;
+	mqtt->tx_us = now;
+	mqtt->rx_us = now;
+	mqtt->ping_us = 0;
+}
+
+/*
+ * handle_packet
+ *
+ * acts on a complete packet of the broker, returns false if the
+ * connection has to be dropped
+ */
+static bool handle_packet(struct temper_mqtt *mqtt, const unsigned char *packet, size_t size)
+{
+	const unsigned char *body = packet + 1;
+	struct temper_mqtt_message *msg;
+	size_t len;
+	uint16_t id;
+	int cnt;
+
+	// skip the remaining length
+	while (*body++ & 0x80)
+		;
+	len = size - (body - packet);
+	switch (packet[0] & 0xf0)
+	{
+		case CONNACK:
+			if ((mqtt->state != TEMPER_MQTT_CONNECTING) || (len != 2) || (body[1] != 0))
+			{
+				// refused, with the backoff it is tried again
+				return false;
+			}
+			mqtt->state = TEMPER_MQTT_CONNECTED;
+			mqtt->backoff_ms = TEMPER_MQTT_BACKOFF_MIN;
+			mqtt->connects++;
+			queue_unsent(mqtt);
+			break;
+		case PUBACK:
+			if (len != 2)
+			{
+				return false;
+			}
+			id = ((uint16_t) body[0] << 8) | body[1];
+			for (cnt = 0; cnt < mqtt->amount_inflight; cnt++)
+			{
+				msg = &mqtt->inflight[(mqtt->first_inflight + cnt) % TEMPER_MQTT_INFLIGHT];
+				if (msg->id == id)
+				{
+					msg->id = 0;
+					msg->sent = false;
+					mqtt->acked++;
+					break;
+				}
+			}
+			// brokers acknowledge in order, the ring only ever has gaps briefly
+			while ((mqtt->amount_inflight > 0) && (mqtt->inflight[mqtt->first_inflight].id == 0))
+			{
+				mqtt->first_inflight = (mqtt->first_inflight + 1) % TEMPER_MQTT_INFLIGHT;
+				mqtt->amount_inflight--;
+			}
+			break;
+		default:
+			// PINGRESP only shows the broker is alive
+			break;
+	}
+
+	return true;
+}
+
+/*
+ * packet_size
+ *
+ * returns the size of the packet at p (avail bytes read), 0 if it is
+ * not complete yet or -1 if it is too large
+ */
+static ssize_t packet_size(const unsigned char *p, size_t avail)
+{
+	size_t len = 0;
+	size_t header;
+
+	// fixed header: type, remaining length of up to 4 bytes
+	for (header = 1; header < avail; header++)
+	{
+		if (header > 4)
+		{
+			return -1;
+		}
+		len |= (size_t)(p[header] & 0x7f) << (7 * (header - 1));
+		if (!(p[header] & 0x80))
+		{
+			// nothing the broker should send a publisher is that large
+			return (header + 1 + len > TEMPER_MQTT_IN) ? -1 :
+				(header + 1 + len <= avail) ? header + 1 + len : 0;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * receive
+ *
+ * reads what the broker sent and handles the complete packets,
+ * returns false if the connection is gone
+ */
+static bool receive(struct temper_mqtt *mqtt, uint64_t now)
+{
+	unsigned char *p;
+	ssize_t size;
+	ssize_t r;
+
+	for (;;)
+	{
+		r = recv(mqtt->fd, mqtt->in + mqtt->in_used, sizeof(mqtt->in) - mqtt->in_used, 0);
+		if (r == 0)
+		{
+			return false;
+		}
+		if (r < 0)
+		{
+			return (errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR);
+		}
+		mqtt->rx_us = now;
+		mqtt->in_used += r;
+		p = mqtt->in;
+		while ((size = packet_size(p, mqtt->in_used - (p - mqtt->in))) != 0)
+		{
+			if ((size < 0) || !handle_packet(mqtt, p, size))
+			{
+				return false;
+			}
+			p += size;
+		}
+		mqtt->in_used -= p - mqtt->in;
+		memmove(mqtt->in, p, mqtt->in_used);
+	}
+}
+
+TEMPER_LIB_EXPORT int temper_mqtt_open(struct temper_mqtt *mqtt, const char *broker, const char *client_id, int qos, int keepalive)
+{
+	memset(mqtt, 0, sizeof(*mqtt));
+	mqtt->fd = -1;
+	if ((qos < 0) || (qos > 1) || (keepalive < 1) || (keepalive > 65535) ||
+		(strlen(client_id) >= sizeof(mqtt->client_id)))
+	{
+		return TEMPER_ERR_PARAM;
+	}
+	strcpy(mqtt->client_id, client_id);
+	mqtt->qos = qos;
+	mqtt->keepalive = keepalive;
+	mqtt->backoff_ms = TEMPER_MQTT_BACKOFF_MIN;
+
+	return split_broker(mqtt, broker);
+}
+
+TEMPER_LIB_EXPORT int temper_mqtt_publish(struct temper_mqtt *mqtt, const char *topic, const char *payload, size_t len)
+{
+	struct temper_mqtt_message *msg;
+	unsigned char packet[TEMPER_MQTT_PACKET];
+	size_t topic_len = strlen(topic);
+	size_t remaining = 2 + topic_len + ((mqtt->qos > 0) ? 2 : 0) + len;
+	size_t used;
+
+	if (remaining + 3 > sizeof(packet))
+	{
+		return TEMPER_ERR_PARAM;
+	}
+	packet[0] = PUBLISH | (mqtt->qos << 1) | (mqtt->retain ? PUBLISH_RETAIN : 0);
+	used = 1 + put_length(packet + 1, remaining);
+	put16(packet + used, topic_len);
+	memcpy(packet + used + 2, topic, topic_len);
+	used += 2 + topic_len;
+	if (mqtt->qos == 0)
+	{
+		memcpy(packet + used, payload, len);
+		if ((mqtt->state != TEMPER_MQTT_CONNECTED) || !append(mqtt, packet, used + len))
+		{
+			mqtt->dropped++;
+			return TEMPER_ERR_WRITE;
+		}
+		mqtt->published++;
+		return TEMPER_OK;
+	}
+
+	if (mqtt->amount_inflight == TEMPER_MQTT_INFLIGHT)
+	{
+		// the broker fell behind, don't queue without bounds
+		mqtt->dropped++;
+		return TEMPER_ERR_WRITE;
+	}
+	if (++mqtt->next_id == 0)
+	{
+		mqtt->next_id = 1;
+	}
+	msg = &mqtt->inflight[(mqtt->first_inflight + mqtt->amount_inflight) % TEMPER_MQTT_INFLIGHT];
+	msg->id = mqtt->next_id;
+	msg->sent = false;
+	msg->dup = false;
+	put16(packet + used, msg->id);
+	memcpy(packet + used + 2, payload, len);
+	msg->len = used + 2 + len;
+	memcpy(msg->packet, packet, msg->len);
+	mqtt->amount_inflight++;
+	if (mqtt->state == TEMPER_MQTT_CONNECTED)
+	{
+		queue_unsent(mqtt);
+	}
+
+	return TEMPER_OK;
+}
+
+TEMPER_LIB_EXPORT void temper_mqtt_flush(struct temper_mqtt *mqtt)
+{
+	ssize_t r;
+
+	while ((mqtt->out_used > 0) && (mqtt->fd >= 0) && !mqtt->failed)
+	{
+		r = send(mqtt->fd, mqtt->out, mqtt->out_used, MSG_NOSIGNAL);
+		if (r < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			// the next tick reconnects
+			mqtt->failed = (errno != EAGAIN) && (errno != EWOULDBLOCK);
+			return;
+		}
+		mqtt->tx_us = temper_time_us(CLOCK_MONOTONIC);
+		mqtt->out_used -= r;
+		memmove(mqtt->out, mqtt->out + r, mqtt->out_used);
+		if ((mqtt->out_used == 0) && (mqtt->state == TEMPER_MQTT_CONNECTED))
+		{
+			// publishes which did not fit before
+			queue_unsent(mqtt);
+		}
+	}
+}
+
+TEMPER_LIB_EXPORT int temper_mqtt_tick(struct temper_mqtt *mqtt)
+{
+	const unsigned char ping[] = { PINGREQ, 0 };
+	uint64_t keepalive_us = (uint64_t) mqtt->keepalive * 1000000;
+	uint64_t now = temper_time_us(CLOCK_MONOTONIC);
+	uint64_t due;
+
+	if (mqtt->state == TEMPER_MQTT_DISCONNECTED)
+	{
+		if (now < mqtt->reconnect_us)
+		{
+			return (mqtt->reconnect_us - now + 999) / 1000;
+		}
+		connect_broker(mqtt, now);
+		if (mqtt->state == TEMPER_MQTT_DISCONNECTED)
+		{
+			return mqtt->reconnect_us > now ? (mqtt->reconnect_us - now + 999) / 1000 : 0;
+		}
+	}
+	if (mqtt->failed || !receive(mqtt, now))
+	{
+		disconnect(mqtt, now);
+		return (mqtt->reconnect_us - now + 999) / 1000;
+	}
+
+	if (mqtt->state == TEMPER_MQTT_CONNECTING)
+	{
+		// the broker did not answer CONNECT in time
+		due = mqtt->connect_us + keepalive_us;
+	}
+	else if (mqtt->ping_us > mqtt->rx_us)
+	{
+		// PINGRESP missing
+		due = mqtt->ping_us + keepalive_us;
+	}
+	else
+	{
+		// ping when either direction was quiet, PUBACKs don't come for QoS 0
+		due = ((mqtt->tx_us < mqtt->rx_us) ? mqtt->tx_us : mqtt->rx_us) + keepalive_us;
+		if (now >= due)
+		{
+			(void)append(mqtt, ping, sizeof(ping));
+			mqtt->ping_us = now;
+			due = now + keepalive_us;
+		}
+	}
+	if (now >= due)
+	{
+		disconnect(mqtt, now);
+		return (mqtt->reconnect_us - now + 999) / 1000;
+	}
+	temper_mqtt_flush(mqtt);
+	if (mqtt->failed)
+	{
+		disconnect(mqtt, now);
+		return (mqtt->reconnect_us - now + 999) / 1000;
+	}
+
+	return (due - now + 999) / 1000;
+}
+
+TEMPER_LIB_EXPORT void temper_mqtt_poll(struct temper_mqtt *mqtt, struct pollfd *pfd)
+{
+	pfd->fd = mqtt->fd;
+	pfd->events = POLLIN;
+	if ((mqtt->out_used > 0) || mqtt->failed)
+	{
+		pfd->events |= POLLOUT;
+	}
+}
+
+TEMPER_LIB_EXPORT void temper_mqtt_close(struct temper_mqtt *mqtt)
+{
+	const unsigned char packet[] = { DISCONNECT, 0 };
+
+	if (mqtt->state == TEMPER_MQTT_CONNECTED)
+	{
+		(void)append(mqtt, packet, sizeof(packet));
+	}
+	temper_mqtt_flush(mqtt);
+	if (mqtt->fd >= 0)
+	{
+		close(mqtt->fd);
+		mqtt->fd = -1;
+	}
+	mqtt->state = TEMPER_MQTT_DISCONNECTED;
+}
+
+
+/*
+ * mqtt Copyright (C) 2020-2021 Armin Fuerst (armin@fuerst.priv.at)
+ *
+ * This file is part of tempersensor.
+ *
+ * Tempersensor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tempersensor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tempersensor.  If not, see <https://www.gnu.org/licenses/>.
+ */
@@ -0,0 +1,155 @@
+/*
+ * mqtt is a minimal MQTT 3.1.1 client publishing samples to a broker.
+ * It keeps one connection, pipelines the publishes without waiting
+ * for their acknowledgements and reconnects with a backoff.
+ * Additional infos (including a license notice) are at the end of this file.
+ */
+
+#ifndef MQTT_H
+#define MQTT_H
+
+#include <poll.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "temper.h"
+
+#define TEMPER_MQTT_PORT "1883"
+#define TEMPER_MQTT_PACKET 256 /* largest PUBLISH packet */
+#define TEMPER_MQTT_INFLIGHT 32 /* QoS 1 publishes waiting for PUBACK */
+#define TEMPER_MQTT_OUT 16384 /* bytes waiting to be written */
+#define TEMPER_MQTT_IN 512 /* largest packet from the broker */
+#define TEMPER_MQTT_BACKOFF_MIN 250 /* ms before the first reconnect */
+#define TEMPER_MQTT_BACKOFF_MAX 30000 /* ms the backoff is capped at */
+
+/* state of struct temper_mqtt */
+#define TEMPER_MQTT_DISCONNECTED 0 /* waiting for the next reconnect */
+#define TEMPER_MQTT_CONNECTING 1 /* CONNECT sent, waiting for CONNACK */
+#define TEMPER_MQTT_CONNECTED 2
+
+/*
+ * struct temper_mqtt_message
+ *
+ * a QoS 1 publish until the broker acknowledged it
+ */
+struct temper_mqtt_message
+{
+	uint16_t id; /* packet identifier, 0 = slot free */
+	bool sent; /* in the output since the last (re)connect */
+	bool dup; /* sent on an earlier connection */
+	size_t len;
+	unsigned char packet[TEMPER_MQTT_PACKET];
+};
+
+/*
+ * struct temper_mqtt
+ *
+ * connection to a broker, set up by temper_mqtt_open
+ */
+struct temper_mqtt
+{
+	int fd;
+	int state;
+	char host[256];
+	char port[16];
+	char client_id[24]; /* 3.1.1 brokers must accept 23 characters */
+	int qos; /* 0 or 1 */
+	bool retain; /* broker keeps the last value of each topic */
+	int keepalive; /* seconds */
+	unsigned char out[TEMPER_MQTT_OUT];
+	size_t out_used;
+	unsigned char in[TEMPER_MQTT_IN];
+	size_t in_used;
+	struct temper_mqtt_message inflight[TEMPER_MQTT_INFLIGHT]; /* ring, in the order published */
+	int first_inflight;
+	int amount_inflight; /* up to the last one not acknowledged */
+	uint16_t next_id;
+	bool failed; /* a write failed, reconnect on the next tick */
+	int backoff_ms; /* wait before the next reconnect */
+	uint64_t reconnect_us; /* CLOCK_MONOTONIC, when to reconnect */
+	uint64_t connect_us; /* when the current connection was started */
+	uint64_t tx_us; /* last packet sent */
+	uint64_t rx_us; /* last packet received */
+	uint64_t ping_us; /* last PINGREQ */
+	unsigned long published; /* publishes written to the output */
+	unsigned long acked; /* QoS 1 publishes acknowledged */
+	unsigned long dropped; /* publishes which could not be queued */
+	unsigned long connects; /* connections accepted by the broker */
+};
+
+/*
+ * temper_mqtt_open
+ *
+ * sets up mqtt to publish to broker ("HOST[:PORT]", "[IPV6][:PORT]",
+ * default port TEMPER_MQTT_PORT) as client_id with qos (0 or 1),
+ * pinging after keepalive seconds. Connecting starts with the first
+ * temper_mqtt_tick.
+ */
+TEMPER_LIB_EXPORT int temper_mqtt_open(struct temper_mqtt *mqtt, const char *broker, const char *client_id, int qos, int keepalive);
+
+/*
+ * temper_mqtt_publish
+ *
+ * queues payload (len bytes) for topic. QoS 0 publishes are dropped
+ * while not connected, QoS 1 ones are kept for the next connection as
+ * long as TEMPER_MQTT_INFLIGHT are not waiting for an acknowledgement.
+ * Nothing is written before temper_mqtt_flush.
+ */
+TEMPER_LIB_EXPORT int temper_mqtt_publish(struct temper_mqtt *mqtt, const char *topic, const char *payload, size_t len);
+
+/*
+ * temper_mqtt_flush
+ *
+ * writes as much of the queued packets as the socket takes without
+ * blocking
+ */
+TEMPER_LIB_EXPORT void temper_mqtt_flush(struct temper_mqtt *mqtt);
+
+/*
+ * temper_mqtt_tick
+ *
+ * reads and handles the packets of the broker, pings, writes and
+ * (re)connects when due. Returns the milliseconds until it has to
+ * be called at the latest, it is also due when the descriptor set by
+ * temper_mqtt_poll is ready.
+ */
+TEMPER_LIB_EXPORT int temper_mqtt_tick(struct temper_mqtt *mqtt);
+
+/*
+ * temper_mqtt_poll
+ *
+ * sets pfd to wait for the connection of mqtt, fd is -1 while
+ * disconnected
+ */
+TEMPER_LIB_EXPORT void temper_mqtt_poll(struct temper_mqtt *mqtt, struct pollfd *pfd);
+
+/*
+ * temper_mqtt_close
+ *
+ * writes what is left without waiting, disconnects and releases the
+ * resources of mqtt
+ */
+TEMPER_LIB_EXPORT void temper_mqtt_close(struct temper_mqtt *mqtt);
+
+#endif // MQTT_H
+
+
+/*
+ * mqtt Copyright (C) 2020-2021 Armin Fuerst (armin@fuerst.priv.at)
+ *
+ * This file is part of tempersensor.
+ *
+ * Tempersensor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tempersensor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tempersensor.  If not, see <https://www.gnu.org/licenses/>.
+ */
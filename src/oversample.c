@@ -0,0 +1,220 @@
+/*
+ * oversample combines several back-to-back queries of a device into
+ * one stable reading: the values are checked against the recent
+ * history of the device and reduced by median or trimmed mean.
+ * Additional infos (including a license notice) are at the end of this file.
+ */
+
+#include "oversample.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* the history is only used as reference once it has some values */
+#define HISTORY_MIN 3
+
+static uint64_t monotonic_us()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int compare_floats(const void *a, const void *b)
+{
+	float fa = *(const float *) a;
+	float fb = *(const float *) b;
+
+	return (fa > fb) - (fa < fb);
+}
+
+/*
+ * median
+ *
+ * sorts values and returns their median
+ */
+static float median(float *values, int amount)
+{
+	qsort(values, amount, sizeof(float), compare_floats);
+	if (amount % 2)
+	{
+		return values[amount / 2];
+	}
+	return (values[amount / 2 - 1] + values[amount / 2]) / 2.0;
+}
+
+TEMPER_LIB_EXPORT void temper_oversample_init(struct temper_oversample *os, int reduce, float max_deviation)
+{
+	memset(os, 0, sizeof(*os));
+	os->reduce = reduce;
+	os->max_deviation = max_deviation;
+}
+
+TEMPER_LIB_EXPORT void temper_oversample_reset(struct temper_oversample *os)
+{
+	int channel;
+
+	os->readings = 0;
+	for (channel = 0; channel < TEMPER_RAW_CHANNELS; channel++)
+	{
+		os->amount[channel] = 0;
+	}
+}
+
+TEMPER_LIB_EXPORT void temper_oversample_feed(struct temper_oversample *os, const float *values)
+{
+	int channel;
+
+	os->readings++;
+	for (channel = 0; channel < TEMPER_RAW_CHANNELS; channel++)
+	{
+		if ((values[channel] > TEMPER_INVALID) &&
+			(os->amount[channel] < TEMPER_OVERSAMPLE_MAX))
+		{
+			os->values[channel][os->amount[channel]++] = values[channel];
+		}
+	}
+}
+
+/*
+ * reject_outliers
+ *
+ * moves the readings of channel close to the median of the history
+ * to the front and returns their amount, all readings if none is
+ */
+static int reject_outliers(struct temper_oversample *os, int channel)
+{
+	float history[TEMPER_OVERSAMPLE_HISTORY];
+	float reference;
+	float *v = os->values[channel];
+	int kept = 0;
+	int cnt;
+
+	if ((os->max_deviation <= 0.0) || (os->history_used[channel] < HISTORY_MIN))
+	{
+		return os->amount[channel];
+	}
+	memcpy(history, os->history[channel], os->history_used[channel] * sizeof(float));
+	reference = median(history, os->history_used[channel]);
+	for (cnt = 0; cnt < os->amount[channel]; cnt++)
+	{
+		if ((v[cnt] >= reference - os->max_deviation) &&
+			(v[cnt] <= reference + os->max_deviation))
+		{
+			v[kept++] = v[cnt];
+		}
+	}
+	if (kept == 0)
+	{
+		return os->amount[channel];
+	}
+	os->rejected += os->amount[channel] - kept;
+
+	return kept;
+}
+
+TEMPER_LIB_EXPORT int temper_oversample_reduce(struct temper_oversample *os, float *values)
+{
+	double sum;
+	int channel;
+	int amount;
+	int trim;
+	int cnt;
+
+	for (channel = 0; channel < TEMPER_RAW_CHANNELS; channel++)
+	{
+		if (os->amount[channel] == 0)
+		{
+			values[channel] = TEMPER_INVALID;
+			continue;
+		}
+		amount = reject_outliers(os, channel);
+		values[channel] = median(os->values[channel], amount);
+		if (os->reduce == TEMPER_REDUCE_TRIMMED)
+		{
+			// median() has sorted the values
+			trim = amount / 4;
+			sum = 0.0;
+			for (cnt = trim; cnt < amount - trim; cnt++)
+			{
+				sum += os->values[channel][cnt];
+			}
+			values[channel] = sum / (amount - 2 * trim);
+		}
+		os->history[channel][os->history_next[channel]] = values[channel];
+		os->history_next[channel] = (os->history_next[channel] + 1) % TEMPER_OVERSAMPLE_HISTORY;
+		if (os->history_used[channel] < TEMPER_OVERSAMPLE_HISTORY)
+		{
+			os->history_used[channel]++;
+		}
+	}
+	temper_derive(values);
+
+	return os->readings;
+}
+
+TEMPER_LIB_EXPORT int temper_query_oversampled(struct temper_ctx *ctx, struct temper_oversample *os, int samples, int budget_ms, float *values)
+{
+	uint64_t start = monotonic_us();
+	uint64_t budget = (uint64_t) budget_ms * 1000;
+	uint64_t before;
+	uint64_t longest = 0;
+	float reading[TEMPER_CHANNELS];
+	int r = TEMPER_OK;
+	int ok = 0;
+	int cnt;
+
+	if (samples > TEMPER_OVERSAMPLE_MAX)
+	{
+		samples = TEMPER_OVERSAMPLE_MAX;
+	}
+	temper_oversample_reset(os);
+	for (cnt = 0; cnt < samples; cnt++)
+	{
+		before = monotonic_us();
+		// stop if another query as slow as the slowest one would exceed the budget
+		if ((cnt > 0) && (before - start + longest > budget))
+		{
+			break;
+		}
+		r = temper_query(ctx, reading);
+		if (monotonic_us() - before > longest)
+		{
+			longest = monotonic_us() - before;
+		}
+		if (r == TEMPER_OK)
+		{
+			temper_oversample_feed(os, reading);
+			ok++;
+		}
+	}
+	if (ok == 0)
+	{
+		temper_invalidate(values);
+		return r;
+	}
+	temper_oversample_reduce(os, values);
+
+	return TEMPER_OK;
+}
+
+
+/*
+ * oversample Copyright (C) 2020-2021 Armin Fuerst (armin@fuerst.priv.at)
+ *
+ * This file is part of tempersensor.
+ *
+ * Tempersensor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tempersensor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tempersensor.  If not, see <https://www.gnu.org/licenses/>.
+ */
@@ -0,0 +1,103 @@
+/*
+ * oversample combines several back-to-back queries of a device into
+ * one stable reading: the values are checked against the recent
+ * history of the device and reduced by median or trimmed mean.
+ * Additional infos (including a license notice) are at the end of this file.
+ */
+
+#ifndef OVERSAMPLE_H
+#define OVERSAMPLE_H
+
+#include <stdint.h>
+
+#include "temper.h"
+
+/* how to reduce the readings of one sample */
+#define TEMPER_REDUCE_MEDIAN 0
+#define TEMPER_REDUCE_TRIMMED 1 /* mean without the lowest and highest quarter */
+
+/* maximum readings per sample and results kept as history */
+#define TEMPER_OVERSAMPLE_MAX 32
+#define TEMPER_OVERSAMPLE_HISTORY 8
+
+/*
+ * struct temper_oversample
+ *
+ * state of one device, set up by temper_oversample_init
+ */
+struct temper_oversample
+{
+	int reduce; /* TEMPER_REDUCE_* */
+	float max_deviation; /* from the median of the history, 0 = no check */
+	int readings; /* queries fed since temper_oversample_reset */
+	int amount[TEMPER_RAW_CHANNELS];
+	float values[TEMPER_RAW_CHANNELS][TEMPER_OVERSAMPLE_MAX];
+	int history_used[TEMPER_RAW_CHANNELS];
+	int history_next[TEMPER_RAW_CHANNELS];
+	float history[TEMPER_RAW_CHANNELS][TEMPER_OVERSAMPLE_HISTORY];
+	unsigned long rejected; /* values rejected as outliers */
+};
+
+/*
+ * temper_oversample_init
+ *
+ * sets up os for a new device
+ */
+TEMPER_LIB_EXPORT void temper_oversample_init(struct temper_oversample *os, int reduce, float max_deviation);
+
+/*
+ * temper_oversample_reset
+ *
+ * starts collecting the readings of the next sample
+ */
+TEMPER_LIB_EXPORT void temper_oversample_reset(struct temper_oversample *os);
+
+/*
+ * temper_oversample_feed
+ *
+ * adds the result of one query, invalid values are ignored
+ */
+TEMPER_LIB_EXPORT void temper_oversample_feed(struct temper_oversample *os, const float *values);
+
+/*
+ * temper_oversample_reduce
+ *
+ * rejects outliers, reduces the readings into values and adds
+ * the result to the history. A channel where all readings look
+ * like outliers keeps them: the value really changed. Only the raw
+ * channels are reduced, the derived ones are calculated from them.
+ * Returns the amount of readings fed.
+ */
+TEMPER_LIB_EXPORT int temper_oversample_reduce(struct temper_oversample *os, float *values);
+
+/*
+ * temper_query_oversampled
+ *
+ * queries ctx up to samples times, but stops before a further
+ * query would exceed budget_ms, and reduces the readings into
+ * values. Succeeds if at least one query succeeded, the readings
+ * are stored in os->readings.
+ */
+TEMPER_LIB_EXPORT int temper_query_oversampled(struct temper_ctx *ctx, struct temper_oversample *os, int samples, int budget_ms, float *values);
+
+#endif // OVERSAMPLE_H
+
+
+/*
+ * oversample Copyright (C) 2020-2021 Armin Fuerst (armin@fuerst.priv.at)
+ *
+ * This file is part of tempersensor.
+ *
+ * Tempersensor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tempersensor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tempersensor.  If not, see <https://www.gnu.org/licenses/>.
+ */
@@ -0,0 +1,317 @@
+/*
+ * push sends samples to a remote collector over UDP. Samples are
+ * batched into compact datagrams, numbered so the collector notices
+ * lost ones.
+ * Additional infos (including a license notice) are at the end of this file.
+ */
+
+#include "push.h"
+#include "sampler.h"
+#include <netdb.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+/* a sample with all channels */
+#define MAX_SAMPLE_SIZE (TEMPER_PUSH_SAMPLE_SIZE + 2 * TEMPER_CHANNELS)
+
+static void put16(unsigned char *p, uint16_t v)
+{
+	p[0] = v >> 8;
+	p[1] = v;
+}
+
+static void put32(unsigned char *p, uint32_t v)
+{
+	put16(p, v >> 16);
+	put16(p + 2, v);
+}
+
+static uint16_t get16(const unsigned char *p)
+{
+	return ((uint16_t) p[0] << 8) | p[1];
+}
+
+static uint32_t get32(const unsigned char *p)
+{
+	return ((uint32_t) get16(p) << 16) | get16(p + 2);
+}
+
+/*
+ * resolve
+ *
+ * creates the socket of push, connected to collector ("HOST",
+ * "HOST:PORT" or "[IPV6]:PORT")
+ */
+static int resolve(struct temper_push *push, const char *collector)
+{
+	struct addrinfo hints;
+	struct addrinfo *result;
+	struct addrinfo *ai;
+	char host[256];
+	const char *port = TEMPER_PUSH_PORT;
+	const char *end;
+
+	if (collector[0] == '[')
+	{
+		end = strchr(collector, ']');
+		if ((end == NULL) || ((end[1] != '\0') && (end[1] != ':')))
+		{
+			return TEMPER_ERR_PARAM;
+		}
+		if (end[1] == ':')
+		{
+			port = end + 2;
+		}
+		collector++;
+	}
+	else
+	{
+		end = strrchr(collector, ':');
+		if ((end != NULL) && (strchr(collector, ':') == end))
+		{
+			port = end + 1;
+		}
+		else
+		{
+			// no port or a bare IPv6 address
+			end = collector + strlen(collector);
+		}
+	}
+	if ((end == collector) || (end - collector >= sizeof(host)) || (*port == '\0'))
+	{
+		return TEMPER_ERR_PARAM;
+	}
+	memcpy(host, collector, end - collector);
+	host[end - collector] = '\0';
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+	if (getaddrinfo(host, port, &hints, &result) != 0)
+	{
+		return TEMPER_ERR_PARAM;
+	}
+	for (ai = result; ai != NULL; ai = ai->ai_next)
+	{
+		push->fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol);
+		if (push->fd < 0)
+		{
+			continue;
+		}
+		// connected, so send() needs no address and errors are reported
+		if (connect(push->fd, ai->ai_addr, ai->ai_addrlen) == 0)
+		{
+			break;
+		}
+		close(push->fd);
+		push->fd = -1;
+	}
+	freeaddrinfo(result);
+
+	return (push->fd >= 0) ? TEMPER_OK : TEMPER_ERR_OPEN;
+}
+
+TEMPER_LIB_EXPORT int temper_push_open(struct temper_push *push, const char *collector, uint32_t node, int batch, int flush_ms)
+{
+	memset(push, 0, sizeof(*push));
+	push->fd = -1;
+	if ((batch < 1) || (batch > TEMPER_PUSH_MAX_SAMPLES) || (flush_ms < 0))
+	{
+		return TEMPER_ERR_PARAM;
+	}
+	push->node = node;
+	push->batch = batch;
+	push->flush_ms = flush_ms;
+	push->used = TEMPER_PUSH_HEADER_SIZE;
+
+	return resolve(push, collector);
+}
+
+TEMPER_LIB_EXPORT int temper_push_flush(struct temper_push *push)
+{
+	unsigned char *h = push->buf;
+	int r = TEMPER_OK;
+
+	if (push->count == 0)
+	{
+		return TEMPER_OK;
+	}
+	put32(h, TEMPER_PUSH_MAGIC);
+	put32(h + 4, push->node);
+	put32(h + 8, push->sequence);
+	put32(h + 12, push->base_us >> 32);
+	put32(h + 16, push->base_us);
+	put16(h + 20, push->count);
+	put16(h + 22, 0);
+	// lost datagrams count too, the collector sees the gap
+	push->sequence++;
+	if (send(push->fd, push->buf, push->used, MSG_NOSIGNAL) == (ssize_t) push->used)
+	{
+		push->datagrams++;
+		push->samples += push->count;
+	}
+	else
+	{
+		push->failed++;
+		r = TEMPER_ERR_WRITE;
+	}
+	push->used = TEMPER_PUSH_HEADER_SIZE;
+	push->count = 0;
+
+	return r;
+}
+
+TEMPER_LIB_EXPORT int temper_push_add(struct temper_push *push, int device, uint64_t timestamp_us, int status, const float *values)
+{
+	unsigned char sample[MAX_SAMPLE_SIZE];
+	size_t size = TEMPER_PUSH_SAMPLE_SIZE;
+	int64_t offset;
+	uint16_t mask = 0;
+	float hundredths;
+	int r = TEMPER_OK;
+	int channel;
+
+	for (channel = 0; channel < TEMPER_CHANNELS; channel++)
+	{
+		hundredths = values[channel] * 100.0;
+		if ((values[channel] <= TEMPER_INVALID) || (hundredths < -32767.0) || (hundredths > 32767.0))
+		{
+			continue;
+		}
+		mask |= 1 << channel;
+		put16(sample + size, (int16_t)(hundredths + ((hundredths < 0) ? -0.5 : 0.5)));
+		size += 2;
+	}
+	offset = (int64_t)(timestamp_us - push->base_us);
+	if ((push->count > 0) && ((push->used + size > TEMPER_PUSH_SIZE) ||
+		(offset < INT32_MIN) || (offset > INT32_MAX)))
+	{
+		r = temper_push_flush(push);
+	}
+	if (push->count == 0)
+	{
+		push->base_us = timestamp_us;
+		push->due_us = temper_time_us(CLOCK_MONOTONIC) + (uint64_t) push->flush_ms * 1000;
+		offset = 0;
+	}
+	put16(sample, device);
+	sample[2] = (uint8_t)(int8_t) status;
+	sample[3] = 0;
+	put32(sample + 4, (uint32_t)(int32_t) offset);
+	put16(sample + 8, mask);
+	memcpy(push->buf + push->used, sample, size);
+	push->used += size;
+	push->count++;
+	if (push->count >= push->batch)
+	{
+		return temper_push_flush(push);
+	}
+
+	return r;
+}
+
+TEMPER_LIB_EXPORT int temper_push_tick(struct temper_push *push)
+{
+	uint64_t now;
+
+	if (push->count == 0)
+	{
+		return -1;
+	}
+	now = temper_time_us(CLOCK_MONOTONIC);
+	if (now >= push->due_us)
+	{
+		(void)temper_push_flush(push);
+		return -1;
+	}
+	// rounded up, so the next call finds the batch due
+	return (push->due_us - now + 999) / 1000;
+}
+
+TEMPER_LIB_EXPORT void temper_push_close(struct temper_push *push)
+{
+	if (push->fd >= 0)
+	{
+		(void)temper_push_flush(push);
+		close(push->fd);
+		push->fd = -1;
+	}
+}
+
+TEMPER_LIB_EXPORT int temper_push_decode(const unsigned char *buf, size_t len, struct temper_push_header *header, struct temper_push_sample *samples, int max)
+{
+	const unsigned char *p = buf + TEMPER_PUSH_HEADER_SIZE;
+	const unsigned char *end = buf + len;
+	struct temper_push_sample *sample;
+	uint16_t mask;
+	int channel;
+	int cnt;
+
+	if ((len < TEMPER_PUSH_HEADER_SIZE) || (get32(buf) != TEMPER_PUSH_MAGIC))
+	{
+		return TEMPER_ERR_PARAM;
+	}
+	header->node = get32(buf + 4);
+	header->sequence = get32(buf + 8);
+	header->base_us = ((uint64_t) get32(buf + 12) << 32) | get32(buf + 16);
+	header->count = get16(buf + 20);
+	if (header->count > max)
+	{
+		return TEMPER_ERR_PARAM;
+	}
+	for (cnt = 0; cnt < header->count; cnt++)
+	{
+		if (end - p < TEMPER_PUSH_SAMPLE_SIZE)
+		{
+			return TEMPER_ERR_PARAM;
+		}
+		sample = &samples[cnt];
+		sample->device = get16(p);
+		sample->status = (int8_t) p[2];
+		sample->timestamp_us = header->base_us + (int64_t)(int32_t) get32(p + 4);
+		mask = get16(p + 8);
+		if (mask >> TEMPER_CHANNELS)
+		{
+			return TEMPER_ERR_PARAM;
+		}
+		p += TEMPER_PUSH_SAMPLE_SIZE;
+		for (channel = 0; channel < TEMPER_CHANNELS; channel++)
+		{
+			sample->values[channel] = TEMPER_INVALID;
+			if (!(mask & (1 << channel)))
+			{
+				continue;
+			}
+			if (end - p < 2)
+			{
+				return TEMPER_ERR_PARAM;
+			}
+			sample->values[channel] = (int16_t) get16(p) / 100.0;
+			p += 2;
+		}
+	}
+
+	return (p == end) ? header->count : TEMPER_ERR_PARAM;
+}
+
+/*
+ * push Copyright (C) 2020-2021 Armin Fuerst (armin@fuerst.priv.at)
+ *
+ * This file is part of tempersensor.
+ *
+ * Tempersensor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tempersensor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tempersensor.  If not, see <https://www.gnu.org/licenses/>.
+ */
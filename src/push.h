@@ -0,0 +1,156 @@
+/*
+ * push sends samples to a remote collector over UDP. Samples are
+ * batched into compact datagrams, numbered so the collector notices
+ * lost ones.
+ * Additional infos (including a license notice) are at the end of this file.
+ */
+
+#ifndef PUSH_H
+#define PUSH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "temper.h"
+
+/*
+ * datagram format
+ *
+ * all numbers in network byte order, a header followed by count
+ * samples of variable size:
+ *
+ *   header  magic "TPS1", node (u32), sequence (u32), base timestamp
+ *           (u64, microseconds since the epoch), count (u16), 0 (u16)
+ *   sample  device (u16), status (i8, TEMPER_OK or TEMPER_ERR_*), 0 (u8),
+ *           timestamp - base (i32, microseconds), channel mask (u16,
+ *           bit n = channel n present), one value (i16, hundredths)
+ *           for every bit set, lowest channel first
+ *
+ * the sequence counts datagrams per node, starting at 0 with every
+ * start of the sender. Channels without a valid value (or outside
+ * the range of an i16) are left out.
+ */
+#define TEMPER_PUSH_MAGIC 0x54505331
+#define TEMPER_PUSH_HEADER_SIZE 24
+#define TEMPER_PUSH_SAMPLE_SIZE 10 /* without values */
+#define TEMPER_PUSH_SIZE 1400 /* stays below the MTU of usual links */
+#define TEMPER_PUSH_MAX_SAMPLES ((TEMPER_PUSH_SIZE - TEMPER_PUSH_HEADER_SIZE) / TEMPER_PUSH_SAMPLE_SIZE)
+#define TEMPER_PUSH_PORT "8837"
+
+/*
+ * struct temper_push
+ *
+ * sender of batches, set up by temper_push_open
+ */
+struct temper_push
+{
+	int fd;
+	uint32_t node;
+	int batch; /* samples per datagram */
+	int flush_ms; /* time a sample may wait for more */
+	uint32_t sequence; /* of the next datagram */
+	unsigned char buf[TEMPER_PUSH_SIZE];
+	size_t used;
+	int count; /* samples in buf */
+	uint64_t base_us; /* timestamp of the first sample in buf */
+	uint64_t due_us; /* CLOCK_MONOTONIC, when buf is sent at the latest */
+	unsigned long samples; /* samples sent */
+	unsigned long datagrams; /* datagrams sent */
+	unsigned long failed; /* datagrams which could not be sent */
+};
+
+/*
+ * struct temper_push_header
+ *
+ * decoded header of a datagram
+ */
+struct temper_push_header
+{
+	uint32_t node;
+	uint32_t sequence;
+	uint64_t base_us;
+	int count;
+};
+
+/*
+ * struct temper_push_sample
+ *
+ * decoded sample, channels not sent are TEMPER_INVALID
+ */
+struct temper_push_sample
+{
+	int device;
+	int status;
+	uint64_t timestamp_us;
+	float values[TEMPER_CHANNELS];
+};
+
+/*
+ * temper_push_open
+ *
+ * sets up push to send to collector ("HOST[:PORT]", "[IPV6][:PORT]",
+ * default port TEMPER_PUSH_PORT) as node. A datagram is sent when it
+ * holds batch samples (1 ... TEMPER_PUSH_MAX_SAMPLES), is full or its
+ * first sample waited flush_ms.
+ */
+TEMPER_LIB_EXPORT int temper_push_open(struct temper_push *push, const char *collector, uint32_t node, int batch, int flush_ms);
+
+/*
+ * temper_push_add
+ *
+ * adds a sample (values as TEMPER_CHANNELS entries) to the batch,
+ * sends the batch if it is complete
+ */
+TEMPER_LIB_EXPORT int temper_push_add(struct temper_push *push, int device, uint64_t timestamp_us, int status, const float *values);
+
+/*
+ * temper_push_tick
+ *
+ * sends the batch if its first sample waited flush_ms, returns the
+ * milliseconds until the next call is needed, -1 if the batch is empty
+ */
+TEMPER_LIB_EXPORT int temper_push_tick(struct temper_push *push);
+
+/*
+ * temper_push_flush
+ *
+ * sends the batch right away, without waiting for more samples
+ */
+TEMPER_LIB_EXPORT int temper_push_flush(struct temper_push *push);
+
+/*
+ * temper_push_close
+ *
+ * sends what is left and releases the resources of push
+ */
+TEMPER_LIB_EXPORT void temper_push_close(struct temper_push *push);
+
+/*
+ * temper_push_decode
+ *
+ * decodes a datagram of len bytes into header and up to max samples,
+ * returns the amount of samples or TEMPER_ERR_PARAM if the datagram
+ * is malformed
+ */
+TEMPER_LIB_EXPORT int temper_push_decode(const unsigned char *buf, size_t len, struct temper_push_header *header, struct temper_push_sample *samples, int max);
+
+#endif // PUSH_H
+
+/*
+ * push Copyright (C) 2020-2021 Armin Fuerst (armin@fuerst.priv.at)
+ *
+ * This file is part of tempersensor.
+ *
+ * Tempersensor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tempersensor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tempersensor.  If not, see <https://www.gnu.org/licenses/>.
+ */
@@ -0,0 +1,794 @@
+/*
+ * round queries a set of devices in one sampling round: the commands
+ * for all devices are sent first, then the responses are collected
+ * as they arrive. With io_uring all writes and reads of a round are
+ * submitted in batches with linked timeouts, otherwise epoll is used.
+ * Additional infos (including a license notice) are at the end of this file.
+ */
+
+#include "round.h"
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+/*
+ * io_uring is used through the raw system calls, so there is no
+ * dependency on liburing. IORING_OP_READ/WRITE need kernel headers
+ * of Linux 5.6 or newer, detected by IORING_FEAT_RW_CUR_POS.
+ */
+#if defined(__NR_io_uring_setup) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#ifdef IORING_FEAT_RW_CUR_POS
+#define HAVE_URING 1
+#endif
+#endif
+#endif
+
+#define MAX_RESPONSES 2
+
+/* operations encoded in the user_data of io_uring requests */
+#define OP_WRITE 0
+#define OP_READ 1
+#define OP_TIMEOUT 2
+#define USER_DATA(device, response, op) (((uint64_t)(device) << 4) | ((response) << 2) | (op))
+
+struct round_device
+{
+	struct temper_ctx *ctx;
+	int fd;
+	int responses; /* reports expected per request */
+	int received;
+	bool dirty; /* a response may still arrive after a timeout */
+	bool watched; /* registered with epoll, dropped on errors until the next round */
+	unsigned char report[MAX_RESPONSES][TEMPER_REPORT_SIZE];
+};
+
+#ifdef HAVE_URING
+struct uring
+{
+	int fd;
+	unsigned sq_entries;
+	void *sq_ptr;
+	size_t sq_size;
+	void *cq_ptr;
+	size_t cq_size;
+	struct io_uring_sqe *sqes;
+	size_t sqes_size;
+	unsigned *sq_head;
+	unsigned *sq_tail;
+	unsigned *sq_mask;
+	unsigned *sq_array;
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned *cq_mask;
+	struct io_uring_cqe *cqes;
+	unsigned local_tail; /* tail including requests not yet published */
+	unsigned queued; /* requests not yet submitted */
+};
+#endif
+
+struct temper_round
+{
+	int backend;
+	int requested; /* backend asked for by temper_round_new */
+	int amount;
+	int capacity; /* devices the arrays are allocated for */
+	int timeout_ms;
+	struct round_device *devices;
+	struct temper_round_stats stats;
+	int epfd;
+	struct epoll_event *events;
+#ifdef HAVE_URING
+	struct uring ring;
+	struct __kernel_timespec timeout;
+#endif
+};
+
+TEMPER_LIB_EXPORT const char *temper_backend_name(int backend)
+{
+	switch (backend)
+	{
+		case TEMPER_BACKEND_SEQUENTIAL:
+			return "sequential";
+		case TEMPER_BACKEND_AUTO:
+			return "auto";
+		case TEMPER_BACKEND_URING:
+			return "io_uring";
+		case TEMPER_BACKEND_EPOLL:
+			return "epoll";
+	}
+	return "unknown";
+}
+
+static uint64_t now_ms()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static uint64_t realtime_us()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*
+ * sent
+ *
+ * records the window in which the commands of a round were sent,
+ * the capture time of the round is its middle
+ */
+static void sent(struct temper_round *r, uint64_t first_us, uint64_t last_us)
+{
+	r->stats.spread_us = last_us - first_us;
+	r->stats.capture_us = first_us + r->stats.spread_us / 2;
+}
+
+#ifdef HAVE_URING
+static void uring_exit(struct uring *u)
+{
+	if (u->sqes != NULL)
+	{
+		munmap(u->sqes, u->sqes_size);
+	}
+	if ((u->cq_ptr != NULL) && (u->cq_ptr != u->sq_ptr))
+	{
+		munmap(u->cq_ptr, u->cq_size);
+	}
+	if (u->sq_ptr != NULL)
+	{
+		munmap(u->sq_ptr, u->sq_size);
+	}
+	if (u->fd >= 0)
+	{
+		close(u->fd);
+	}
+	memset(u, 0, sizeof(struct uring));
+	u->fd = -1;
+}
+
+/*
+ * uring_init
+ *
+ * sets up the rings, returns 0 if io_uring is not available
+ * (old kernel, disabled by sysctl or seccomp)
+ */
+static int uring_init(struct uring *u, unsigned entries)
+{
+	struct io_uring_params p;
+	void *ptr;
+
+	memset(u, 0, sizeof(struct uring));
+	memset(&p, 0, sizeof(p));
+	u->fd = syscall(__NR_io_uring_setup, entries, &p);
+	if (u->fd < 0)
+	{
+		return 0;
+	}
+	/* fast poll (Linux 5.7) avoids a kernel thread per pending read */
+	if (!(p.features & IORING_FEAT_FAST_POLL) || !(p.features & IORING_FEAT_NODROP))
+	{
+		uring_exit(u);
+		return 0;
+	}
+	u->sq_entries = p.sq_entries;
+	u->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	u->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		if (u->cq_size > u->sq_size)
+		{
+			u->sq_size = u->cq_size;
+		}
+		u->cq_size = u->sq_size;
+	}
+	ptr = mmap(NULL, u->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED, u->fd, IORING_OFF_SQ_RING);
+	if (ptr == MAP_FAILED)
+	{
+		uring_exit(u);
+		return 0;
+	}
+	u->sq_ptr = ptr;
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		u->cq_ptr = ptr;
+	}
+	else
+	{
+		ptr = mmap(NULL, u->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED, u->fd, IORING_OFF_CQ_RING);
+		if (ptr == MAP_FAILED)
+		{
+			uring_exit(u);
+			return 0;
+		}
+		u->cq_ptr = ptr;
+	}
+	u->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	ptr = mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED, u->fd, IORING_OFF_SQES);
+	if (ptr == MAP_FAILED)
+	{
+		uring_exit(u);
+		return 0;
+	}
+	u->sqes = (struct io_uring_sqe *) ptr;
+	u->sq_head = (unsigned *)((char *) u->sq_ptr + p.sq_off.head);
+	u->sq_tail = (unsigned *)((char *) u->sq_ptr + p.sq_off.tail);
+	u->sq_mask = (unsigned *)((char *) u->sq_ptr + p.sq_off.ring_mask);
+	u->sq_array = (unsigned *)((char *) u->sq_ptr + p.sq_off.array);
+	u->cq_head = (unsigned *)((char *) u->cq_ptr + p.cq_off.head);
+	u->cq_tail = (unsigned *)((char *) u->cq_ptr + p.cq_off.tail);
+	u->cq_mask = (unsigned *)((char *) u->cq_ptr + p.cq_off.ring_mask);
+	u->cqes = (struct io_uring_cqe *)((char *) u->cq_ptr + p.cq_off.cqes);
+	u->local_tail = *u->sq_tail;
+
+	return 1;
+}
+
+static struct io_uring_sqe *uring_sqe(struct uring *u, int opcode, int fd, uint64_t user_data)
+{
+	struct io_uring_sqe *sqe;
+	unsigned head = __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+	unsigned index;
+
+	if (u->local_tail - head >= u->sq_entries)
+	{
+		return NULL;
+	}
+	index = u->local_tail & *u->sq_mask;
+	sqe = &u->sqes[index];
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	sqe->opcode = opcode;
+	sqe->fd = fd;
+	sqe->user_data = user_data;
+	u->sq_array[index] = index;
+	u->local_tail++;
+	u->queued++;
+
+	return sqe;
+}
+
+/*
+ * uring_enter
+ *
+ * submits all queued requests and waits for min_complete
+ * completions in one system call
+ */
+static int uring_enter(struct uring *u, unsigned min_complete)
+{
+	int r;
+
+	__atomic_store_n(u->sq_tail, u->local_tail, __ATOMIC_RELEASE);
+	r = syscall(__NR_io_uring_enter, u->fd, u->queued, min_complete,
+		IORING_ENTER_GETEVENTS, NULL, 0);
+	if (r > 0)
+	{
+		u->queued -= r;
+	}
+	return r;
+}
+
+/*
+ * queue_device
+ *
+ * queues the chain write -> read -> timeout (-> read -> timeout)
+ * for one device. If a read times out, the rest of the chain is
+ * cancelled by the kernel.
+ */
+static int queue_device(struct temper_round *r, int index, const unsigned char *cmd, size_t size)
+{
+	struct round_device *dev = &r->devices[index];
+	struct io_uring_sqe *sqe;
+	int response;
+
+	sqe = uring_sqe(&r->ring, IORING_OP_WRITE, dev->fd, USER_DATA(index, 0, OP_WRITE));
+	if (sqe == NULL)
+	{
+		return 0;
+	}
+	sqe->addr = (uintptr_t) cmd;
+	sqe->len = size;
+	sqe->off = (uint64_t) -1;
+	sqe->flags = IOSQE_IO_LINK;
+	for (response = 0; response < dev->responses; response++)
+	{
+		sqe = uring_sqe(&r->ring, IORING_OP_READ, dev->fd, USER_DATA(index, response, OP_READ));
+		if (sqe == NULL)
+		{
+			return 0;
+		}
+		sqe->addr = (uintptr_t) dev->report[response];
+		sqe->len = TEMPER_REPORT_SIZE;
+		sqe->off = (uint64_t) -1;
+		sqe->flags = IOSQE_IO_LINK;
+		sqe = uring_sqe(&r->ring, IORING_OP_LINK_TIMEOUT, -1, USER_DATA(index, response, OP_TIMEOUT));
+		if (sqe == NULL)
+		{
+			return 0;
+		}
+		sqe->addr = (uintptr_t) &r->timeout;
+		sqe->len = 1;
+		if (response + 1 < dev->responses)
+		{
+			sqe->flags = IOSQE_IO_LINK;
+		}
+	}
+	return 1 + dev->responses * 2;
+}
+
+/*
+ * run_uring
+ *
+ * submits the requests of all devices and waits for all their
+ * completions, normally in a single io_uring_enter.
+ * Returns 0 if the kernel rejects the requests.
+ */
+static int run_uring(struct temper_round *r, float (*values)[TEMPER_CHANNELS], int *status)
+{
+	struct uring *u = &r->ring;
+	struct io_uring_cqe *cqe;
+	struct round_device *dev;
+	const unsigned char *cmd;
+	size_t size;
+	unsigned head;
+	unsigned pending = 0;
+	uint64_t first;
+	int refused = 0;
+	int queued;
+	int index;
+	int response;
+	int ret;
+
+	cmd = temper_request(&size);
+	for (index = 0; index < r->amount; index++)
+	{
+		queued = queue_device(r, index, cmd, size);
+		if (queued == 0)
+		{
+			return 0;
+		}
+		pending += queued;
+	}
+
+	/* submit without waiting, so the spread of sending can be told */
+	first = realtime_us();
+	r->stats.syscalls++;
+	if (uring_enter(u, 0) < 0)
+	{
+		return 0;
+	}
+	sent(r, first, realtime_us());
+	/* with a request refused, the others are still reaped: their
+	 * reads would write into the reports of the next round */
+	while (pending > 0)
+	{
+		r->stats.syscalls++;
+		ret = uring_enter(u, pending);
+		if (ret < 0)
+		{
+			if ((errno == EINTR) || (errno == EAGAIN) || (errno == EBUSY))
+			{
+				continue;
+			}
+			return 0;
+		}
+		head = *u->cq_head;
+		while (head != __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE))
+		{
+			cqe = &u->cqes[head & *u->cq_mask];
+			head++;
+			pending--;
+			index = cqe->user_data >> 4;
+			response = (cqe->user_data >> 2) & 0x03;
+			dev = &r->devices[index];
+			if (cqe->res == -EINVAL)
+			{
+				/* operation not supported by this kernel, the rest
+				 * of the chain completes as cancelled */
+				refused = 1;
+				continue;
+			}
+			if (refused)
+			{
+				continue;
+			}
+			switch (cqe->user_data & 0x03)
+			{
+				case OP_WRITE:
+					if (cqe->res < 0)
+					{
+						status[index] = TEMPER_ERR_WRITE;
+					}
+					break;
+				case OP_READ:
+					if ((cqe->res == -ECANCELED) || (cqe->res == -EINTR))
+					{
+						/* timed out or write failed, status tells */
+						break;
+					}
+					if (cqe->res <= 0)
+					{
+						status[index] = TEMPER_ERR_READ;
+						break;
+					}
+					temper_parse(dev->ctx, response, dev->report[response], values[index]);
+					dev->received++;
+					if (dev->received == dev->responses)
+					{
+						status[index] = TEMPER_OK;
+					}
+					break;
+			}
+		}
+		__atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+	}
+
+	return !refused;
+}
+#endif
+
+/*
+ * watch
+ *
+ * registers a device with epoll, returns 0 if that fails
+ */
+static int watch(struct temper_round *r, int index)
+{
+	struct epoll_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.u32 = index;
+	if (epoll_ctl(r->epfd, EPOLL_CTL_ADD, r->devices[index].fd, &ev) < 0)
+	{
+		return 0;
+	}
+	r->devices[index].watched = true;
+	return 1;
+}
+
+/*
+ * unwatch
+ *
+ * drops a device failing from epoll for the rest of the round,
+ * its error or hangup would be reported again and again otherwise
+ */
+static void unwatch(struct temper_round *r, struct round_device *dev)
+{
+	r->stats.syscalls++;
+	(void)epoll_ctl(r->epfd, EPOLL_CTL_DEL, dev->fd, NULL);
+	dev->watched = false;
+}
+
+/*
+ * run_epoll
+ *
+ * sends the command to all devices and reads the reports
+ * in the order they arrive until the timeout is reached
+ */
+static void run_epoll(struct temper_round *r, float (*values)[TEMPER_CHANNELS], int *status)
+{
+	struct round_device *dev;
+	const unsigned char *cmd;
+	unsigned char discard[TEMPER_REPORT_SIZE];
+	size_t size;
+	uint64_t deadline;
+	uint64_t first;
+	int remaining = 0;
+	int wait;
+	int index;
+	int n;
+	int cnt;
+
+	cmd = temper_request(&size);
+	for (index = 0; index < r->amount; index++)
+	{
+		/* failed in an earlier round, maybe back */
+		if (!r->devices[index].watched)
+		{
+			r->stats.syscalls++;
+			(void)watch(r, index);
+		}
+	}
+	first = realtime_us();
+	for (index = 0; index < r->amount; index++)
+	{
+		dev = &r->devices[index];
+		r->stats.syscalls++;
+		if (write(dev->fd, cmd, size) != size)
+		{
+			status[index] = TEMPER_ERR_WRITE;
+			dev->received = dev->responses;
+			continue;
+		}
+		remaining++;
+	}
+	sent(r, first, realtime_us());
+
+	deadline = now_ms() + r->timeout_ms;
+	while (remaining > 0)
+	{
+		wait = (int)(deadline - now_ms());
+		if (wait <= 0)
+		{
+			break;
+		}
+		r->stats.syscalls++;
+		n = epoll_wait(r->epfd, r->events, r->amount, wait);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			break;
+		}
+		for (cnt = 0; cnt < n; cnt++)
+		{
+			index = r->events[cnt].data.u32;
+			dev = &r->devices[index];
+			r->stats.syscalls++;
+			if (dev->received >= dev->responses)
+			{
+				/* late answer to an earlier round, or the device failed */
+				if ((r->events[cnt].events & (EPOLLERR | EPOLLHUP)) ||
+					(read(dev->fd, discard, sizeof(discard)) <= 0))
+				{
+					unwatch(r, dev);
+				}
+				continue;
+			}
+			if (read(dev->fd, dev->report[dev->received], TEMPER_REPORT_SIZE) <= 0)
+			{
+				status[index] = TEMPER_ERR_READ;
+				dev->received = dev->responses;
+				remaining--;
+				unwatch(r, dev);
+				continue;
+			}
+			temper_parse(dev->ctx, dev->received, dev->report[dev->received], values[index]);
+			dev->received++;
+			if (dev->received == dev->responses)
+			{
+				status[index] = TEMPER_OK;
+				remaining--;
+			}
+		}
+	}
+}
+
+/*
+ * drain_stale
+ *
+ * discards reports arriving after a timeout, they would be
+ * taken as answer to the next request otherwise
+ */
+static void drain_stale(struct temper_round *r, struct round_device *dev)
+{
+	struct pollfd pfd;
+	unsigned char discard[TEMPER_REPORT_SIZE];
+
+	pfd.fd = dev->fd;
+	pfd.events = POLLIN;
+	while (1)
+	{
+		r->stats.syscalls++;
+		if ((poll(&pfd, 1, 0) <= 0) || !(pfd.revents & POLLIN))
+		{
+			break;
+		}
+		r->stats.syscalls++;
+		if (read(dev->fd, discard, sizeof(discard)) <= 0)
+		{
+			break;
+		}
+	}
+	dev->dirty = false;
+}
+
+TEMPER_LIB_EXPORT int temper_round_run(struct temper_round *r, float (*values)[TEMPER_CHANNELS], int *status)
+{
+	struct round_device *dev;
+	int index;
+
+	for (index = 0; index < r->amount; index++)
+	{
+		dev = &r->devices[index];
+		temper_invalidate(values[index]);
+		status[index] = TEMPER_ERR_TIMEOUT;
+		dev->received = 0;
+		if (dev->dirty)
+		{
+			drain_stale(r, dev);
+		}
+	}
+
+#ifdef HAVE_URING
+	if (r->backend == TEMPER_BACKEND_URING)
+	{
+		if (!run_uring(r, values, status))
+		{
+			/* kernel refused, use epoll from now on */
+			uring_exit(&r->ring);
+			r->backend = TEMPER_BACKEND_EPOLL;
+			return temper_round_run(r, values, status);
+		}
+	}
+	else
+#endif
+	{
+		run_epoll(r, values, status);
+	}
+
+	r->stats.rounds++;
+	for (index = 0; index < r->amount; index++)
+	{
+		if (status[index] == TEMPER_ERR_TIMEOUT)
+		{
+			r->stats.timeouts++;
+			r->devices[index].dirty = true;
+		}
+	}
+
+	return TEMPER_OK;
+}
+
+/*
+ * attach
+ *
+ * registers amount devices (at most the capacity of r) with a fresh
+ * epoll instance and ring, returns 0 if that fails
+ */
+static int attach(struct temper_round *r, struct temper_ctx **ctxs, int amount)
+{
+	int index;
+
+	if (r->epfd >= 0)
+	{
+		close(r->epfd);
+	}
+#ifdef HAVE_URING
+	/* reads of the old devices may still be in flight */
+	if (r->ring.fd >= 0)
+	{
+		uring_exit(&r->ring);
+	}
+#endif
+	memset(r->devices, 0, r->capacity * sizeof(struct round_device));
+	r->amount = amount;
+	r->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (r->epfd < 0)
+	{
+		return 0;
+	}
+	for (index = 0; index < amount; index++)
+	{
+		r->devices[index].ctx = ctxs[index];
+		r->devices[index].fd = temper_fd(ctxs[index]);
+		r->devices[index].responses = temper_responses(ctxs[index]);
+		if (r->devices[index].responses > MAX_RESPONSES)
+		{
+			r->devices[index].responses = MAX_RESPONSES;
+		}
+		if (!watch(r, index))
+		{
+			return 0;
+		}
+	}
+
+	r->backend = TEMPER_BACKEND_EPOLL;
+#ifdef HAVE_URING
+	if (((r->requested == TEMPER_BACKEND_AUTO) || (r->requested == TEMPER_BACKEND_URING)) &&
+		uring_init(&r->ring, (1 + MAX_RESPONSES * 2) * amount))
+	{
+		r->backend = TEMPER_BACKEND_URING;
+	}
+#endif
+
+	return 1;
+}
+
+TEMPER_LIB_EXPORT struct temper_round *temper_round_new(struct temper_ctx **ctxs, int amount, int backend, int timeout_ms)
+{
+	struct temper_round *r;
+
+	r = (struct temper_round *) calloc(1, sizeof(struct temper_round));
+	if (r == NULL)
+	{
+		return NULL;
+	}
+	r->requested = backend;
+	r->capacity = amount;
+	r->timeout_ms = timeout_ms;
+	r->epfd = -1;
+#ifdef HAVE_URING
+	r->ring.fd = -1;
+	r->timeout.tv_sec = timeout_ms / 1000;
+	r->timeout.tv_nsec = (long long)(timeout_ms % 1000) * 1000000;
+#endif
+	r->devices = (struct round_device *) calloc(amount, sizeof(struct round_device));
+	r->events = (struct epoll_event *) calloc(amount, sizeof(struct epoll_event));
+	if ((r->devices == NULL) || (r->events == NULL) || !attach(r, ctxs, amount))
+	{
+		temper_round_free(r);
+		return NULL;
+	}
+
+	return r;
+}
+
+TEMPER_LIB_EXPORT int temper_round_reset(struct temper_round *r, struct temper_ctx **ctxs, int amount)
+{
+	if ((amount < 1) || (amount > r->capacity))
+	{
+		return TEMPER_ERR_PARAM;
+	}
+	memset(&r->stats, 0, sizeof(r->stats));
+	if (!attach(r, ctxs, amount))
+	{
+		r->amount = 0;
+		return TEMPER_ERR_OPEN;
+	}
+
+	return TEMPER_OK;
+}
+
+TEMPER_LIB_EXPORT int temper_round_backend(const struct temper_round *r)
+{
+	return r->backend;
+}
+
+TEMPER_LIB_EXPORT void temper_round_stats(const struct temper_round *r, struct temper_round_stats *stats)
+{
+	*stats = r->stats;
+}
+
+TEMPER_LIB_EXPORT void temper_round_free(struct temper_round *r)
+{
+	if (r == NULL)
+	{
+		return;
+	}
+#ifdef HAVE_URING
+	if (r->ring.fd >= 0)
+	{
+		uring_exit(&r->ring);
+	}
+#endif
+	if (r->epfd >= 0)
+	{
+		close(r->epfd);
+	}
+	free(r->events);
+	free(r->devices);
+	free(r);
+}
+
+/*
+ * round Copyright (C) 2020-2021 Armin Fuerst (armin@fuerst.priv.at)
+ *
+ * This file is part of tempersensor.
+ *
+ * Tempersensor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tempersensor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tempersensor.  If not, see <https://www.gnu.org/licenses/>.
+ */
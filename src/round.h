@@ -0,0 +1,113 @@
+/*
+ * round queries a set of devices in one sampling round: the commands
+ * for all devices are sent first, then the responses are collected
+ * as they arrive. With io_uring all writes and reads of a round are
+ * submitted in batches with linked timeouts, otherwise epoll is used.
+ * Additional infos (including a license notice) are at the end of this file.
+ */
+
+#ifndef ROUND_H
+#define ROUND_H
+
+#include "temper.h"
+
+/* backends to query devices */
+#define TEMPER_BACKEND_SEQUENTIAL 0 /* one device after the other, temper_query */
+#define TEMPER_BACKEND_AUTO 1 /* io_uring if available, else epoll */
+#define TEMPER_BACKEND_URING 2
+#define TEMPER_BACKEND_EPOLL 3
+
+struct temper_round_stats
+{
+	unsigned long rounds;
+	unsigned long syscalls; /* system calls used for the rounds */
+	unsigned long timeouts; /* devices not answering in time */
+	uint64_t capture_us; /* last round: when the commands were sent, microseconds since the epoch */
+	uint32_t spread_us; /* last round: time from sending the first to the last command */
+};
+
+struct temper_round;
+
+/*
+ * temper_round_new
+ *
+ * prepares rounds over amount identified devices, each response
+ * has to arrive within timeout_ms. If io_uring is requested but not
+ * available, epoll is used, see temper_round_backend.
+ * Returns NULL if out of memory.
+ */
+TEMPER_LIB_EXPORT struct temper_round *temper_round_new(struct temper_ctx **ctxs, int amount, int backend, int timeout_ms);
+
+/*
+ * temper_round_reset
+ *
+ * replaces the devices of the round by amount others, at most as many
+ * as it was created for, without allocating memory. The stats start
+ * over. Needed whenever a
+ * device got a new file descriptor (e.g. by temper_recover). Returns
+ * TEMPER_ERR_PARAM if the round is too small (it stays as it is) or
+ * TEMPER_ERR_OPEN if the devices can't be registered, the round has
+ * to be freed then.
+ */
+TEMPER_LIB_EXPORT int temper_round_reset(struct temper_round *r, struct temper_ctx **ctxs, int amount);
+
+/*
+ * temper_round_backend
+ *
+ * returns the backend in use, TEMPER_BACKEND_URING or TEMPER_BACKEND_EPOLL
+ */
+TEMPER_LIB_EXPORT int temper_round_backend(const struct temper_round *r);
+
+/*
+ * temper_round_run
+ *
+ * queries all devices once, values[n] and status[n] receive the
+ * readings and TEMPER_OK or the error code of device n. There are
+ * no retries within a round, a device failing is reported and
+ * queried again in the next round. The commands are sent back to
+ * back, the stats tell when and within which spread (with io_uring
+ * the duration of their submission).
+ */
+TEMPER_LIB_EXPORT int temper_round_run(struct temper_round *r, float (*values)[TEMPER_CHANNELS], int *status);
+
+/*
+ * temper_round_stats
+ *
+ * copies the counters of the rounds run so far to stats
+ */
+TEMPER_LIB_EXPORT void temper_round_stats(const struct temper_round *r, struct temper_round_stats *stats);
+
+/*
+ * temper_round_free
+ *
+ * releases the round, the devices stay open
+ */
+TEMPER_LIB_EXPORT void temper_round_free(struct temper_round *r);
+
+/*
+ * temper_backend_name
+ *
+ * returns a printable name of a backend
+ */
+TEMPER_LIB_EXPORT const char *temper_backend_name(int backend);
+
+#endif // ROUND_H
+
+/*
+ * round Copyright (C) 2020-2021 Armin Fuerst (armin@fuerst.priv.at)
+ *
+ * This file is part of tempersensor.
+ *
+ * Tempersensor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tempersensor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tempersensor.  If not, see <https://www.gnu.org/licenses/>.
+ */
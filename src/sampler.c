@@ -0,0 +1,1864 @@
+/*
+ * sampler is a multi-threaded sampling engine for libtempersensor.
+ * Worker threads each own a set of devices and push timestamped
+ * samples into their own lock-free queue, one aggregator thread
+ * collects them and hands them to a callback for output and storage.
+ * Additional infos (including a license notice) are at the end of this file.
+ */
+
+#define _GNU_SOURCE /* ppoll */
+#include "sampler.h"
+#include "hotplug.h"
+#include "oversample.h"
+#include "round.h"
+#include "spsc.h"
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+
+#define DEFAULT_QUEUE_SIZE 256
+#define DEFAULT_TIMEOUT_MS 1000
+#define DEFAULT_BUDGET_MS 500
+#define DEFAULT_RECOVER_TIMEOUT_MS 5000
+
+/* hotplug: devices whose node can't be opened yet (udev still sets
+ * permissions) are retried in this interval for some time */
+#define HOTPLUG_PENDING 8
+#define HOTPLUG_RETRY_MS 200
+#define HOTPLUG_SETTLE_MS 3000
+
+/* recovery of a device, reset by the recovery thread while away */
+#define RECOVERY_IDLE 0
+#define RECOVERY_REQUESTED 1 /* by the worker, the device is out of its rounds */
+#define RECOVERY_RUNNING 2 /* temper_recover running */
+#define RECOVERY_DONE 3 /* back (or not), for the worker to take again */
+
+/* hotplug: a device removed is retired by the aggregator, its worker
+ * releases the slot when done with it, a device plugged in may take it */
+#define SLOT_ACTIVE 0
+#define SLOT_RETIRED 1
+#define SLOT_RELEASED 2
+
+/* adaptive sampling: a bit more than 1/16, the coarsest resolution of the devices */
+#define ADAPT_NOISE 0.07
+/* adaptive sampling: flat samples in a row before slowing down */
+#define ADAPT_FLAT_SAMPLES 4
+
+/* the counters of a device as words, copied with relaxed atomics */
+#define STATS_WORDS ((sizeof(struct temper_sampler_stats) + sizeof(unsigned long) - 1) / sizeof(unsigned long))
+
+union stats_words
+{
+	struct temper_sampler_stats stats;
+	unsigned long words[STATS_WORDS];
+};
+
+struct sampler_device
+{
+	struct temper_ctx *ctx;
+	int worker;
+	int standby; /* device taking over, -1 = none */
+	uint64_t next_due; /* CLOCK_MONOTONIC */
+	bool oversampling;
+	struct temper_oversample os; /* part of the slot, hotplug needs no allocation */
+	uint64_t interval; /* current interval in microseconds */
+	/* adaptive sampling: last value of a channel which changed more than noise */
+	float reference[TEMPER_RAW_CHANNELS];
+	uint64_t reference_us[TEMPER_RAW_CHANNELS];
+	int flat; /* samples in a row without relevant change */
+	int failures; /* timeouts in a row, any errors once recovering */
+	bool recovering; /* recovery attempted, device not answering yet */
+	uint64_t failing_since; /* due time of the first failed sample, CLOCK_MONOTONIC */
+	char devpath[261]; /* hidraw node, matched against remove events */
+	bool owned; /* opened on a hotplug event, freed with the sampler */
+	bool remove_pending; /* removed while being reset, decided once it is back */
+	struct temper_devinfo removal; /* the remove event then */
+	/* written by the owning worker only */
+	struct temper_sampler_stats stats;
+	/* the members from here on survive the reuse of the slot */
+	atomic_int recovery; /* RECOVERY_*, the worker leaves ctx alone unless idle */
+	atomic_int retired; /* SLOT_*, workers skip released slots without looking further */
+	/* copy of stats for temper_sampler_stats, published by the
+	 * worker under a sequence lock, odd while being written */
+	atomic_uint stats_seq;
+	atomic_ulong stats_shared[STATS_WORDS];
+};
+
+struct sampler_worker
+{
+	struct temper_sampler *sampler;
+	int id;
+	pthread_t thread;
+	struct spsc queue;
+	unsigned long round_syscalls; /* syscalls of the last round */
+	bool reopened; /* a device was recovered, the round needs its new descriptor */
+	int kickfd; /* eventfd waking the worker if its devices change */
+	int timerfd; /* low-wakeup: expires at the tick the worker waits for, -1 = ppoll timeout */
+	bool wake_pending; /* low-wakeup: samples queued since the aggregator was woken */
+	atomic_int changed; /* devices were added or retired by hotplug */
+	atomic_int backend; /* see struct temper_worker_stats */
+	atomic_ulong context_switches;
+};
+
+struct hotplug_pending
+{
+	struct temper_devinfo info;
+	uint64_t deadline; /* CLOCK_MONOTONIC */
+};
+
+struct temper_sampler
+{
+	struct temper_sampler_config cfg;
+	struct sampler_device *devices;
+	atomic_int amount; /* grows while running with hotplug */
+	int capacity; /* devices allocated */
+	struct sampler_worker *workers;
+	pthread_t aggregator;
+	int wakefd; /* eventfd waking the aggregator */
+	int stopfd; /* eventfd waking the workers on stop */
+	atomic_int running;
+	atomic_int workers_done;
+	bool started;
+	int workers_started; /* worker threads running, joined by stop */
+	pthread_t recovery; /* resets devices for the workers */
+	bool recovery_started;
+	int recoverfd; /* eventfd waking the recovery thread */
+	pthread_mutex_t devpath_lock; /* devpath of the devices, changed by recoveries */
+	int uevent_fd; /* hotplug: source of uevents, -1 = no hotplug */
+	bool own_uevent_fd;
+	struct hotplug_pending pending[HOTPLUG_PENDING];
+	int amount_pending;
+	int removals_pending; /* devices with remove_pending */
+};
+
+TEMPER_LIB_EXPORT uint64_t temper_time_us(int clock)
+{
+	struct timespec ts;
+
+	clock_gettime((clockid_t) clock, &ts);
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+TEMPER_LIB_EXPORT uint64_t temper_tick_next(uint64_t time_us, int tick_ms)
+{
+	uint64_t tick = (uint64_t) tick_ms * 1000;
+
+	if (tick == 0)
+	{
+		return time_us;
+	}
+	return ((time_us + tick - 1) / tick) * tick;
+}
+
+TEMPER_LIB_EXPORT struct temper_sampler *temper_sampler_new(const struct temper_sampler_config *cfg)
+{
+	struct temper_sampler *s;
+	int cnt;
+
+	if ((cfg->workers < 1) || (cfg->interval_ms < 0) || (cfg->callback == NULL))
+	{
+		return NULL;
+	}
+	if ((cfg->min_interval_ms > 0) &&
+		((cfg->max_interval_ms < cfg->min_interval_ms) || (cfg->adapt_rate <= 0.0)))
+	{
+		return NULL;
+	}
+	if (((cfg->sched_policy != SCHED_OTHER) && (cfg->sched_policy != SCHED_FIFO) &&
+		(cfg->sched_policy != SCHED_RR)) || ((cfg->sched_policy != SCHED_OTHER) &&
+		((cfg->sched_priority < sched_get_priority_min(cfg->sched_policy)) ||
+		(cfg->sched_priority > sched_get_priority_max(cfg->sched_policy)))))
+	{
+		return NULL;
+	}
+	s = (struct temper_sampler *) calloc(1, sizeof(struct temper_sampler));
+	if (s == NULL)
+	{
+		return NULL;
+	}
+	s->cfg = *cfg;
+	pthread_mutex_init(&s->devpath_lock, NULL);
+	if (s->cfg.queue_size <= 0)
+	{
+		s->cfg.queue_size = DEFAULT_QUEUE_SIZE;
+	}
+	if (s->cfg.timeout_ms <= 0)
+	{
+		s->cfg.timeout_ms = DEFAULT_TIMEOUT_MS;
+	}
+	if (s->cfg.budget_ms <= 0)
+	{
+		s->cfg.budget_ms = DEFAULT_BUDGET_MS;
+	}
+	if (s->cfg.recover_timeout_ms <= 0)
+	{
+		s->cfg.recover_timeout_ms = DEFAULT_RECOVER_TIMEOUT_MS;
+	}
+	if (s->cfg.oversample > TEMPER_OVERSAMPLE_MAX)
+	{
+		s->cfg.oversample = TEMPER_OVERSAMPLE_MAX;
+	}
+	if (s->cfg.tick_ms < 0)
+	{
+		s->cfg.tick_ms = 0;
+	}
+	s->wakefd = eventfd(0, EFD_CLOEXEC);
+	s->stopfd = eventfd(0, EFD_CLOEXEC);
+	s->recoverfd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	s->workers = (struct sampler_worker *) calloc(cfg->workers, sizeof(struct sampler_worker));
+	if ((s->wakefd < 0) || (s->stopfd < 0) || (s->recoverfd < 0) || (s->workers == NULL))
+	{
+		temper_sampler_free(s);
+		return NULL;
+	}
+	s->uevent_fd = -1;
+	for (cnt = 0; cnt < cfg->workers; cnt++)
+	{
+		s->workers[cnt].kickfd = -1;
+		s->workers[cnt].timerfd = -1;
+	}
+	for (cnt = 0; cnt < cfg->workers; cnt++)
+	{
+		s->workers[cnt].sampler = s;
+		s->workers[cnt].id = cnt;
+		s->workers[cnt].kickfd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+		if (s->workers[cnt].kickfd < 0)
+		{
+			temper_sampler_free(s);
+			return NULL;
+		}
+		if (s->cfg.tick_ms > 0)
+		{
+			s->workers[cnt].timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+			if (s->workers[cnt].timerfd < 0)
+			{
+				temper_sampler_free(s);
+				return NULL;
+			}
+		}
+		atomic_init(&s->workers[cnt].backend, s->cfg.backend);
+		if (!spsc_init(&s->workers[cnt].queue, sizeof(struct temper_sample), s->cfg.queue_size))
+		{
+			temper_sampler_free(s);
+			return NULL;
+		}
+	}
+	atomic_init(&s->running, 0);
+	atomic_init(&s->workers_done, 0);
+
+	return s;
+}
+
+/*
+ * publish_stats
+ *
+ * copies the counters of dev for readers in other threads, called by
+ * the owning worker (or before the device is handed to it)
+ */
+static void publish_stats(struct sampler_device *dev)
+{
+	union stats_words copy;
+	unsigned int seq = atomic_load_explicit(&dev->stats_seq, memory_order_relaxed);
+	size_t cnt;
+
+	memset(&copy, 0, sizeof(copy));
+	copy.stats = dev->stats;
+	atomic_store_explicit(&dev->stats_seq, seq + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	for (cnt = 0; cnt < STATS_WORDS; cnt++)
+	{
+		atomic_store_explicit(&dev->stats_shared[cnt], copy.words[cnt], memory_order_relaxed);
+	}
+	atomic_store_explicit(&dev->stats_seq, seq + 2, memory_order_release);
+}
+
+/*
+ * init_device
+ *
+ * sets up the slot of a new device
+ */
+static int init_device(struct temper_sampler *s, struct sampler_device *dev, struct temper_ctx *ctx, int worker)
+{
+	memset(dev, 0, offsetof(struct sampler_device, recovery));
+	atomic_store(&dev->recovery, RECOVERY_IDLE);
+	if (s->cfg.oversample > 1)
+	{
+		dev->oversampling = true;
+		temper_oversample_init(&dev->os, s->cfg.reduce, s->cfg.max_deviation);
+	}
+	dev->ctx = ctx;
+	dev->standby = -1;
+	(void)snprintf(dev->devpath, sizeof(dev->devpath), "%s", temper_devpath(ctx));
+	dev->interval = (uint64_t) s->cfg.interval_ms * 1000;
+	if (s->cfg.min_interval_ms > 0)
+	{
+		if (s->cfg.interval_ms < s->cfg.min_interval_ms)
+			dev->interval = (uint64_t) s->cfg.min_interval_ms * 1000;
+		else if (s->cfg.interval_ms > s->cfg.max_interval_ms)
+			dev->interval = (uint64_t) s->cfg.max_interval_ms * 1000;
+	}
+	dev->stats.interval_ms = dev->interval / 1000;
+	dev->worker = worker;
+	publish_stats(dev);
+
+	return TEMPER_OK;
+}
+
+TEMPER_LIB_EXPORT int temper_sampler_add(struct temper_sampler *s, struct temper_ctx *ctx, int worker)
+{
+	struct sampler_device *devices;
+	int r;
+
+	if (s->started || (worker >= s->cfg.workers))
+	{
+		return TEMPER_ERR_PARAM;
+	}
+	devices = (struct sampler_device *) realloc(s->devices,
+		sizeof(struct sampler_device) * (s->amount + 1));
+	if (devices == NULL)
+	{
+		return TEMPER_ERR_NOMEM;
+	}
+	s->devices = devices;
+	memset(&devices[s->amount], 0, sizeof(struct sampler_device));
+	s->capacity = s->amount + 1;
+	r = init_device(s, &devices[s->amount], ctx, (worker < 0) ? (s->amount % s->cfg.workers) : worker);
+	if (r != TEMPER_OK)
+	{
+		return r;
+	}
+
+	return s->amount++;
+}
+
+TEMPER_LIB_EXPORT int temper_sampler_standby(struct temper_sampler *s, int device, int standby)
+{
+	if (s->started || (device < 0) || (device >= s->amount) || (standby < 0) ||
+		(standby >= s->amount) || (standby == device) ||
+		(s->cfg.backend == TEMPER_BACKEND_SEQUENTIAL))
+	{
+		return TEMPER_ERR_PARAM;
+	}
+	// queried in the same round
+	s->devices[standby].worker = s->devices[device].worker;
+	s->devices[device].standby = standby;
+
+	return TEMPER_OK;
+}
+
+/*
+ * wait_until
+ *
+ * sleeps until the given CLOCK_MONOTONIC time, until the
+ * sampler is stopped or the devices of the worker change
+ */
+static void wait_until(struct sampler_worker *w, uint64_t until)
+{
+	struct temper_sampler *s = w->sampler;
+	struct pollfd pfd[3];
+	struct itimerspec its;
+	struct timespec timeout;
+	uint64_t now = temper_time_us(CLOCK_MONOTONIC);
+	uint64_t counter;
+	uint64_t one = 1;
+
+	if (w->wake_pending)
+	{
+		/* one wakeup of the aggregator for the samples of this one */
+		w->wake_pending = false;
+		(void)write(s->wakefd, &one, sizeof(one));
+	}
+	if (until <= now)
+	{
+		return;
+	}
+	pfd[0].fd = s->stopfd;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = w->kickfd;
+	pfd[1].events = POLLIN;
+	pfd[1].revents = 0;
+	if (w->timerfd >= 0)
+	{
+		until = temper_tick_next(until, s->cfg.tick_ms);
+		memset(&its, 0, sizeof(its));
+		its.it_value.tv_sec = until / 1000000;
+		its.it_value.tv_nsec = (until % 1000000) * 1000;
+		(void)timerfd_settime(w->timerfd, TFD_TIMER_ABSTIME, &its, NULL);
+		pfd[2].fd = w->timerfd;
+		pfd[2].events = POLLIN;
+		if ((ppoll(pfd, 3, NULL, NULL) > 0) && (pfd[2].revents & POLLIN))
+		{
+			(void)read(w->timerfd, &counter, sizeof(counter));
+		}
+	}
+	else
+	{
+		timeout.tv_sec = (until - now) / 1000000;
+		timeout.tv_nsec = ((until - now) % 1000000) * 1000;
+		(void)ppoll(pfd, 2, &timeout, NULL);
+	}
+	if (pfd[1].revents & POLLIN)
+	{
+		(void)read(w->kickfd, &counter, sizeof(counter));
+	}
+}
+
+/*
+ * set_slack
+ *
+ * applies the timer slack of the configuration to the calling thread
+ */
+static void set_slack(const struct temper_sampler *s)
+{
+	if (s->cfg.slack_ms > 0)
+	{
+		(void)prctl(PR_SET_TIMERSLACK, (unsigned long) s->cfg.slack_ms * 1000000UL, 0, 0, 0);
+	}
+}
+
+/*
+ * adapt
+ *
+ * halves the interval of a device whose values change fast and
+ * doubles it once they have been flat for a while, see sampler.h
+ */
+static void adapt(struct temper_sampler *s, struct sampler_device *dev, const struct temper_sample *sample)
+{
+	const float *values = sample->values;
+	float fastest = 0.0;
+	float change;
+	float rate;
+	int channel;
+	int fastest_channel = -1;
+
+	for (channel = 0; channel < TEMPER_RAW_CHANNELS; channel++)
+	{
+		if ((values[channel] <= TEMPER_INVALID) || (dev->reference_us[channel] == 0) ||
+			(dev->reference[channel] <= TEMPER_INVALID))
+		{
+			dev->reference[channel] = values[channel];
+			dev->reference_us[channel] = sample->timestamp_us;
+			continue;
+		}
+		change = (values[channel] > dev->reference[channel]) ?
+			values[channel] - dev->reference[channel] :
+			dev->reference[channel] - values[channel];
+		if ((change <= ADAPT_NOISE) || (sample->timestamp_us <= dev->reference_us[channel]))
+		{
+			continue;
+		}
+		/* slow drifts add up until they exceed the noise */
+		rate = change * 60000000.0 / (sample->timestamp_us - dev->reference_us[channel]);
+		dev->reference[channel] = values[channel];
+		dev->reference_us[channel] = sample->timestamp_us;
+		if (rate > fastest)
+		{
+			fastest = rate;
+			fastest_channel = channel;
+		}
+	}
+
+	if ((fastest > s->cfg.adapt_rate) && (dev->interval > (uint64_t) s->cfg.min_interval_ms * 1000))
+	{
+		dev->interval /= 2;
+		if (dev->interval < (uint64_t) s->cfg.min_interval_ms * 1000)
+		{
+			dev->interval = (uint64_t) s->cfg.min_interval_ms * 1000;
+		}
+		dev->stats.faster++;
+		dev->stats.last_change = 1;
+	}
+	else if ((fastest < s->cfg.adapt_rate / 2) && (++dev->flat >= ADAPT_FLAT_SAMPLES) &&
+		(dev->interval < (uint64_t) s->cfg.max_interval_ms * 1000))
+	{
+		dev->interval *= 2;
+		if (dev->interval > (uint64_t) s->cfg.max_interval_ms * 1000)
+		{
+			dev->interval = (uint64_t) s->cfg.max_interval_ms * 1000;
+		}
+		dev->stats.slower++;
+		dev->stats.last_change = -1;
+	}
+	else
+	{
+		if (fastest >= s->cfg.adapt_rate / 2)
+			dev->flat = 0;
+		else if (dev->flat > ADAPT_FLAT_SAMPLES)
+			dev->flat = ADAPT_FLAT_SAMPLES;
+		return;
+	}
+	dev->flat = 0;
+	dev->stats.last_channel = fastest_channel;
+	dev->stats.last_rate = fastest;
+	dev->stats.interval_ms = dev->interval / 1000;
+}
+
+/*
+ * recover
+ *
+ * counts the timeouts of a device in a row and hands it to the
+ * recovery thread after recover_after of them, the worker goes on
+ * with its other devices. Until the device answers again, every
+ * error counts, so a failed attempt is repeated after as many more.
+ */
+static void recover(struct sampler_worker *w, struct sampler_device *dev, int status, uint64_t due)
+{
+	struct temper_sampler *s = w->sampler;
+	uint64_t took;
+	uint64_t one = 1;
+
+	if (atomic_load(&dev->recovery) != RECOVERY_IDLE)
+	{
+		/* away, its samples tell nothing */
+		return;
+	}
+	if (status == TEMPER_OK)
+	{
+		if (dev->recovering)
+		{
+			took = (temper_time_us(CLOCK_MONOTONIC) - dev->failing_since) / 1000;
+			dev->stats.recovered++;
+			dev->stats.recovery_ms = took;
+			dev->stats.recovery_ms_total += took;
+			dev->recovering = false;
+		}
+		dev->failures = 0;
+		return;
+	}
+	if ((status != TEMPER_ERR_TIMEOUT) && !dev->recovering)
+	{
+		return;
+	}
+	if ((dev->failures == 0) && !dev->recovering)
+	{
+		dev->failing_since = due;
+	}
+	if (++dev->failures < s->cfg.recover_after)
+	{
+		return;
+	}
+	dev->failures = 0;
+	dev->recovering = true;
+	dev->stats.recoveries++;
+	atomic_store(&dev->recovery, RECOVERY_REQUESTED);
+	(void)write(s->recoverfd, &one, sizeof(one));
+	/* out of the round until it is back */
+	w->reopened = true;
+}
+
+/*
+ * deliver
+ *
+ * hands a sample to the aggregator and schedules the next query,
+ * status is the one of the query of the device itself, also if its
+ * standby took over
+ */
+static void deliver(struct sampler_worker *w, struct temper_sample *sample, int status)
+{
+	struct temper_sampler *s = w->sampler;
+	struct sampler_device *dev = &s->devices[sample->device];
+	uint64_t start;
+	uint64_t interval;
+	uint64_t one = 1;
+
+	if (status != TEMPER_OK)
+	{
+		dev->stats.errors++;
+	}
+	if (spsc_push(&w->queue, sample))
+	{
+		dev->stats.samples++;
+		if (s->cfg.tick_ms > 0)
+		{
+			/* woken by wait_until, after the other devices due */
+			w->wake_pending = true;
+		}
+		else
+		{
+			(void)write(s->wakefd, &one, sizeof(one));
+		}
+	}
+	else
+	{
+		dev->stats.dropped++;
+	}
+	if ((s->cfg.min_interval_ms > 0) && (status == TEMPER_OK) && (sample->source == sample->device))
+	{
+		adapt(s, dev, sample);
+	}
+	if (s->cfg.recover_after > 0)
+	{
+		recover(w, dev, status, sample->due_us);
+	}
+
+	/* keep the schedule aligned, skip intervals already missed */
+	interval = dev->interval;
+	start = temper_time_us(CLOCK_MONOTONIC);
+	dev->next_due += interval;
+	while ((interval > 0) && (dev->next_due <= start))
+	{
+		dev->next_due += interval;
+		dev->stats.late++;
+	}
+	if (interval == 0)
+	{
+		dev->next_due = start;
+	}
+	publish_stats(dev);
+}
+
+/*
+ * record_jitter
+ *
+ * counts how late a query of dev due at due started (CLOCK_MONOTONIC)
+ */
+static void record_jitter(const struct temper_sampler *s, struct sampler_device *dev, uint64_t due, uint64_t start)
+{
+	uint64_t jitter;
+	int bucket = 0;
+
+	due = temper_tick_next(due, s->cfg.tick_ms);
+	jitter = (start > due) ? start - due : 0;
+	while ((bucket < TEMPER_JITTER_BUCKETS - 1) && (jitter >= (1ULL << bucket)))
+	{
+		bucket++;
+	}
+	dev->stats.jitter[bucket]++;
+	dev->stats.jitter_us_total += jitter;
+	if (jitter > dev->stats.jitter_us_max)
+	{
+		dev->stats.jitter_us_max = jitter;
+	}
+}
+
+/*
+ * sample_device
+ *
+ * queries one device and hands the result to the aggregator
+ */
+static void sample_device(struct sampler_worker *w, int index)
+{
+	struct sampler_device *dev = &w->sampler->devices[index];
+	struct temper_sample sample;
+	unsigned long syscalls = temper_syscalls(dev->ctx);
+	uint64_t start;
+
+	sample.device = index;
+	sample.source = index;
+	sample.spread_us = 0;
+	sample.due_us = dev->next_due;
+	sample.timestamp_us = temper_time_us(CLOCK_REALTIME);
+	start = temper_time_us(CLOCK_MONOTONIC);
+	record_jitter(w->sampler, dev, dev->next_due, start);
+	if (dev->oversampling)
+	{
+		sample.status = temper_query_oversampled(dev->ctx, &dev->os,
+			w->sampler->cfg.oversample, w->sampler->cfg.budget_ms, sample.values);
+		sample.readings = dev->os.readings;
+		dev->stats.rejected = dev->os.rejected;
+	}
+	else
+	{
+		sample.status = temper_query(dev->ctx, sample.values);
+		sample.readings = (sample.status == TEMPER_OK);
+	}
+	sample.latency_us = temper_time_us(CLOCK_MONOTONIC) - start;
+	dev->stats.readings += sample.readings;
+	dev->stats.syscalls += temper_syscalls(dev->ctx) - syscalls;
+
+	deliver(w, &sample, sample.status);
+}
+
+/*
+ * run_rounds
+ *
+ * queries the devices of a round worker once or, if oversampling,
+ * as often as configured and the budget allows
+ */
+static void run_rounds(struct sampler_worker *w, struct temper_round *round,
+	const int *index, int amount,
+	float (*values)[TEMPER_CHANNELS], int *status, int *readings)
+{
+	struct temper_sampler *s = w->sampler;
+	struct sampler_device *dev;
+	uint64_t budget = (uint64_t) s->cfg.budget_ms * 1000;
+	uint64_t start = temper_time_us(CLOCK_MONOTONIC);
+	uint64_t before;
+	uint64_t longest = 0;
+	int round_nr;
+	int cnt;
+
+	if (s->cfg.oversample <= 1)
+	{
+		temper_round_run(round, values, status);
+		for (cnt = 0; cnt < amount; cnt++)
+		{
+			readings[cnt] = (status[cnt] == TEMPER_OK);
+		}
+		return;
+	}
+	for (cnt = 0; cnt < amount; cnt++)
+	{
+		temper_oversample_reset(&s->devices[index[cnt]].os);
+	}
+	for (round_nr = 0; round_nr < s->cfg.oversample; round_nr++)
+	{
+		before = temper_time_us(CLOCK_MONOTONIC);
+		/* stop if another round as slow as the slowest one would exceed the budget */
+		if ((round_nr > 0) && (before - start + longest > budget))
+		{
+			break;
+		}
+		temper_round_run(round, values, status);
+		if (temper_time_us(CLOCK_MONOTONIC) - before > longest)
+		{
+			longest = temper_time_us(CLOCK_MONOTONIC) - before;
+		}
+		for (cnt = 0; cnt < amount; cnt++)
+		{
+			if (status[cnt] == TEMPER_OK)
+			{
+				temper_oversample_feed(&s->devices[index[cnt]].os, values[cnt]);
+			}
+		}
+	}
+	for (cnt = 0; cnt < amount; cnt++)
+	{
+		dev = &s->devices[index[cnt]];
+		readings[cnt] = dev->os.readings;
+		if (readings[cnt] > 0)
+		{
+			status[cnt] = TEMPER_OK;
+			temper_oversample_reduce(&dev->os, values[cnt]);
+		}
+		dev->stats.rejected = dev->os.rejected;
+	}
+}
+
+/*
+ * lost_sample
+ *
+ * fills sample for a device without a file descriptor (lost by a
+ * failed recovery) or being reset, its ctx is not touched
+ */
+static void lost_sample(struct temper_sample *sample, int index, uint64_t due, uint64_t timestamp)
+{
+	sample->device = index;
+	sample->source = index;
+	sample->due_us = due;
+	sample->timestamp_us = timestamp;
+	sample->spread_us = 0;
+	sample->latency_us = 0;
+	sample->status = TEMPER_ERR_OPEN;
+	sample->readings = 0;
+	temper_invalidate(sample->values);
+}
+
+/*
+ * take_over
+ *
+ * gives the sample of a device which failed or reported an invalid
+ * IN channel the values of its standby from the same round
+ */
+static void take_over(struct temper_sampler *s, struct temper_sample *sample, const int *live, int alive,
+	float (*values)[TEMPER_CHANNELS], const int *status, const int *readings)
+{
+	struct sampler_device *dev = &s->devices[sample->device];
+	int in;
+	int cnt;
+
+	/* the ctx of a device failed may be in the hands of the recovery thread */
+	if (sample->status == TEMPER_OK)
+	{
+		in = temper_default_sensor(dev->ctx, TEMPER_REPORT_IN);
+		if ((in < 0) || (sample->values[in] > TEMPER_INVALID))
+		{
+			return;
+		}
+	}
+	for (cnt = 0; cnt < alive; cnt++)
+	{
+		if ((live[cnt] != dev->standby) || (status[cnt] != TEMPER_OK))
+		{
+			continue;
+		}
+		in = temper_default_sensor(s->devices[live[cnt]].ctx, TEMPER_REPORT_IN);
+		if ((in >= 0) && (values[cnt][in] <= TEMPER_INVALID))
+		{
+			return;
+		}
+		memcpy(sample->values, values[cnt], sizeof(sample->values));
+		sample->status = TEMPER_OK;
+		sample->readings = readings[cnt];
+		sample->source = live[cnt];
+		dev->stats.failovers++;
+		return;
+	}
+}
+
+/*
+ * share_schedule
+ *
+ * the devices of a round are queried together, with adaptive
+ * sampling the device needing the shortest interval sets the pace
+ */
+static void share_schedule(struct temper_sampler *s, const int *index, int amount)
+{
+	struct sampler_device *fastest = &s->devices[index[0]];
+	int cnt;
+
+	for (cnt = 1; cnt < amount; cnt++)
+	{
+		if (s->devices[index[cnt]].interval < fastest->interval)
+		{
+			fastest = &s->devices[index[cnt]];
+		}
+	}
+	for (cnt = 0; cnt < amount; cnt++)
+	{
+		s->devices[index[cnt]].interval = fastest->interval;
+		s->devices[index[cnt]].next_due = fastest->next_due;
+		s->devices[index[cnt]].stats.interval_ms = fastest->interval / 1000;
+	}
+}
+
+/*
+ * build_round
+ *
+ * collects the devices of the worker into index and prepares a
+ * round over those which are open, devices lost by a failed recovery
+ * or being reset are listed in dead. Retired devices are closed and
+ * left out. The previous round is reused if it is large enough, so
+ * recoveries don't allocate.
+ */
+static struct temper_round *build_round(struct sampler_worker *w, struct temper_round *round,
+	struct temper_ctx **ctxs, int *index, int *amount, int *live, int *alive, int *dead)
+{
+	struct temper_sampler *s = w->sampler;
+	struct sampler_device *dev;
+	int devices = s->amount;
+	int recovery;
+	int retired;
+	int cnt;
+
+	*amount = 0;
+	*alive = 0;
+	for (cnt = 0; cnt < devices; cnt++)
+	{
+		dev = &s->devices[cnt];
+		retired = atomic_load(&dev->retired);
+		if ((retired == SLOT_RELEASED) || (dev->worker != w->id))
+		{
+			continue;
+		}
+		recovery = atomic_load(&dev->recovery);
+		if (recovery == RECOVERY_DONE)
+		{
+			atomic_store(&dev->recovery, RECOVERY_IDLE);
+			recovery = RECOVERY_IDLE;
+		}
+		if ((retired == SLOT_RETIRED) && (recovery == RECOVERY_IDLE))
+		{
+			temper_close(dev->ctx);
+			atomic_store(&dev->retired, SLOT_RELEASED);
+			continue;
+		}
+		index[(*amount)++] = cnt;
+		if ((recovery == RECOVERY_IDLE) && (temper_fd(dev->ctx) >= 0))
+		{
+			ctxs[*alive] = dev->ctx;
+			live[(*alive)++] = cnt;
+		}
+		else
+		{
+			dead[*amount - 1 - *alive] = cnt;
+		}
+	}
+	/* devices plugged in join the schedule of the others */
+	for (cnt = 1; cnt < *amount; cnt++)
+	{
+		s->devices[index[cnt]].next_due = s->devices[index[0]].next_due;
+	}
+
+	if ((round != NULL) && ((*alive == 0) || (temper_round_reset(round, ctxs, *alive) != TEMPER_OK)))
+	{
+		temper_round_free(round);
+		round = NULL;
+	}
+	if ((round == NULL) && (*alive > 0))
+	{
+		round = temper_round_new(ctxs, *alive, s->cfg.backend, s->cfg.timeout_ms);
+	}
+	if ((round == NULL) && (*alive > 0))
+	{
+		/* out of memory, deliver errors until a recovery rebuilds the round */
+		memcpy(dead, index, *amount * sizeof(int));
+		*alive = 0;
+	}
+
+	return round;
+}
+
+/*
+ * round_worker
+ *
+ * queries all devices of the worker in batched rounds, the devices
+ * of a worker share one schedule
+ */
+static void round_worker(struct sampler_worker *w)
+{
+	struct temper_sampler *s = w->sampler;
+	struct temper_round *round = NULL;
+	struct temper_round_stats stats;
+	struct temper_ctx **ctxs;
+	struct temper_sample sample;
+	float (*values)[TEMPER_CHANNELS];
+	int *status;
+	int *readings;
+	int *index;
+	int *live;
+	int *dead;
+	unsigned long syscalls = 0;
+	uint64_t timestamp;
+	uint64_t start;
+	uint64_t due;
+	int amount = 0;
+	int alive = 0;
+	int cnt;
+
+	ctxs = (struct temper_ctx **) calloc(s->capacity, sizeof(struct temper_ctx *));
+	index = (int *) calloc(s->capacity, sizeof(int));
+	live = (int *) calloc(s->capacity, sizeof(int));
+	dead = (int *) calloc(s->capacity, sizeof(int));
+	values = calloc(s->capacity, sizeof(*values));
+	status = (int *) calloc(s->capacity, sizeof(int));
+	readings = (int *) calloc(s->capacity, sizeof(int));
+	if ((ctxs == NULL) || (index == NULL) || (live == NULL) || (dead == NULL) ||
+		(values == NULL) || (status == NULL) || (readings == NULL))
+	{
+		/* out of memory, wait to be stopped */
+		while (atomic_load(&s->running))
+		{
+			wait_until(w, temper_time_us(CLOCK_MONOTONIC) + 3600000000ULL);
+		}
+	}
+	else
+	{
+		round = build_round(w, NULL, ctxs, index, &amount, live, &alive, dead);
+	}
+	if (round != NULL)
+	{
+		atomic_store_explicit(&w->backend, temper_round_backend(round), memory_order_relaxed);
+	}
+
+	while ((index != NULL) && atomic_load_explicit(&s->running, memory_order_relaxed))
+	{
+		due = (amount > 0) ? s->devices[index[0]].next_due :
+			temper_time_us(CLOCK_MONOTONIC) + 3600000000ULL;
+		wait_until(w, due);
+		if (!atomic_load_explicit(&s->running, memory_order_relaxed))
+		{
+			break;
+		}
+		if (atomic_exchange(&w->changed, 0))
+		{
+			/* devices were plugged in or removed */
+			round = build_round(w, round, ctxs, index, &amount, live, &alive, dead);
+			syscalls = 0;
+			continue;
+		}
+		if (amount == 0)
+		{
+			continue;
+		}
+		start = temper_time_us(CLOCK_MONOTONIC);
+		timestamp = temper_time_us(CLOCK_REALTIME);
+		stats.spread_us = 0;
+		if (round != NULL)
+		{
+			run_rounds(w, round, live, alive, values, status, readings);
+			temper_round_stats(round, &stats);
+			/* all devices of the round share one capture time */
+			timestamp = stats.capture_us;
+			w->round_syscalls = stats.syscalls - syscalls;
+			syscalls = stats.syscalls;
+			atomic_store_explicit(&w->backend, temper_round_backend(round), memory_order_relaxed);
+		}
+		for (cnt = 0; cnt < alive; cnt++)
+		{
+			/* the commands of a round are sent back to back */
+			record_jitter(s, &s->devices[live[cnt]], due, start);
+			sample.device = live[cnt];
+			sample.source = live[cnt];
+			sample.due_us = due;
+			sample.timestamp_us = timestamp;
+			sample.spread_us = stats.spread_us;
+			sample.latency_us = temper_time_us(CLOCK_MONOTONIC) - start;
+			sample.status = status[cnt];
+			sample.readings = readings[cnt];
+			s->devices[live[cnt]].stats.readings += readings[cnt];
+			memcpy(sample.values, values[cnt], sizeof(sample.values));
+			/* the syscalls of a round are shared by its devices,
+			 * the first ones get the remainder */
+			s->devices[live[cnt]].stats.syscalls += w->round_syscalls / alive
+				+ ((unsigned long) cnt < w->round_syscalls % alive);
+			if (s->devices[live[cnt]].standby >= 0)
+			{
+				take_over(s, &sample, live, alive, values, status, readings);
+			}
+			deliver(w, &sample, status[cnt]);
+		}
+		for (cnt = 0; cnt < amount - alive; cnt++)
+		{
+			/* being reset or lost by a failed recovery, retried by deliver */
+			lost_sample(&sample, dead[cnt], due, timestamp);
+			if (s->devices[dead[cnt]].standby >= 0)
+			{
+				take_over(s, &sample, live, alive, values, status, readings);
+			}
+			deliver(w, &sample, TEMPER_ERR_OPEN);
+		}
+		if (s->cfg.min_interval_ms > 0)
+		{
+			share_schedule(s, index, amount);
+		}
+		if (w->reopened)
+		{
+			/* a device went to the recovery thread */
+			w->reopened = false;
+			syscalls = 0;
+			round = build_round(w, round, ctxs, index, &amount, live, &alive, dead);
+		}
+	}
+
+	temper_round_free(round);
+	free(readings);
+	free(status);
+	free(values);
+	free(dead);
+	free(live);
+	free(index);
+	free(ctxs);
+}
+
+/*
+ * record_usage
+ *
+ * stores the context switches of the calling worker thread
+ */
+static void record_usage(struct sampler_worker *w)
+{
+	struct rusage usage;
+
+	if (getrusage(RUSAGE_THREAD, &usage) == 0)
+	{
+		atomic_store(&w->context_switches, usage.ru_nvcsw + usage.ru_nivcsw);
+	}
+}
+
+static void *worker_thread(void *arg)
+{
+	struct sampler_worker *w = (struct sampler_worker *) arg;
+	struct temper_sampler *s = w->sampler;
+	struct temper_sample sample;
+	uint64_t now;
+	uint64_t next;
+	int recovery;
+	int retired;
+	int cnt;
+
+	set_slack(s);
+	if (s->cfg.backend != TEMPER_BACKEND_SEQUENTIAL)
+	{
+		round_worker(w);
+	}
+	while (atomic_load_explicit(&s->running, memory_order_relaxed))
+	{
+		now = temper_time_us(CLOCK_MONOTONIC);
+		next = UINT64_MAX;
+		for (cnt = 0; cnt < s->amount; cnt++)
+		{
+			retired = atomic_load(&s->devices[cnt].retired);
+			if ((retired == SLOT_RELEASED) || (s->devices[cnt].worker != w->id))
+			{
+				continue;
+			}
+			recovery = atomic_load(&s->devices[cnt].recovery);
+			if (recovery == RECOVERY_DONE)
+			{
+				atomic_store(&s->devices[cnt].recovery, RECOVERY_IDLE);
+				recovery = RECOVERY_IDLE;
+			}
+			if ((retired == SLOT_RETIRED) && (recovery == RECOVERY_IDLE))
+			{
+				/* removed, release the node and the slot */
+				temper_close(s->devices[cnt].ctx);
+				atomic_store(&s->devices[cnt].retired, SLOT_RELEASED);
+				continue;
+			}
+			if ((s->devices[cnt].next_due <= now) && (recovery != RECOVERY_IDLE))
+			{
+				/* being reset, keeps its schedule without a query */
+				lost_sample(&sample, cnt, s->devices[cnt].next_due, temper_time_us(CLOCK_REALTIME));
+				deliver(w, &sample, TEMPER_ERR_OPEN);
+			}
+			else if (s->devices[cnt].next_due <= now)
+			{
+				sample_device(w, cnt);
+				if (!atomic_load_explicit(&s->running, memory_order_relaxed))
+				{
+					break;
+				}
+			}
+			if (s->devices[cnt].next_due < next)
+			{
+				next = s->devices[cnt].next_due;
+			}
+		}
+		if (next == UINT64_MAX)
+		{
+			/* worker without devices, wait to be stopped or for a device plugged in */
+			wait_until(w, now + 3600000000ULL);
+		}
+		else
+		{
+			wait_until(w, next);
+		}
+	}
+	record_usage(w);
+
+	return NULL;
+}
+
+/*
+ * drain
+ *
+ * delivers all samples waiting in the worker queues,
+ * returns the amount of samples delivered
+ */
+static int drain(struct temper_sampler *s)
+{
+	struct temper_sample sample;
+	int delivered = 0;
+	int cnt;
+
+	for (cnt = 0; cnt < s->cfg.workers; cnt++)
+	{
+		while (spsc_pop(&s->workers[cnt].queue, &sample))
+		{
+			s->cfg.callback(&sample, s->cfg.userdata);
+			delivered++;
+		}
+	}
+	return delivered;
+}
+
+/*
+ * kick
+ *
+ * lets a worker pick up the changes of its devices
+ */
+static void kick(struct temper_sampler *s, int worker)
+{
+	uint64_t one = 1;
+
+	atomic_store(&s->workers[worker].changed, 1);
+	(void)write(s->workers[worker].kickfd, &one, sizeof(one));
+}
+
+/*
+ * recovery_thread
+ *
+ * resets the devices the workers handed over one after another, so
+ * a reset only keeps its own device away
+ */
+static void *recovery_thread(void *arg)
+{
+	struct temper_sampler *s = (struct temper_sampler *) arg;
+	struct sampler_device *dev;
+	struct pollfd pfd[2];
+	uint64_t counter;
+	int expected;
+	int cnt;
+
+	pfd[0].fd = s->stopfd;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = s->recoverfd;
+	pfd[1].events = POLLIN;
+	while (atomic_load(&s->running))
+	{
+		if ((poll(pfd, 2, -1) < 0) && (errno != EINTR))
+		{
+			break;
+		}
+		(void)read(s->recoverfd, &counter, sizeof(counter));
+		for (cnt = 0; (cnt < s->amount) && atomic_load(&s->running); cnt++)
+		{
+			dev = &s->devices[cnt];
+			expected = RECOVERY_REQUESTED;
+			if (!atomic_compare_exchange_strong(&dev->recovery, &expected, RECOVERY_RUNNING))
+			{
+				continue;
+			}
+			(void)temper_recover(dev->ctx, s->cfg.recover_timeout_ms);
+			if (temper_devpath(dev->ctx)[0] != 0)
+			{
+				/* the node may have a new name after the reset */
+				pthread_mutex_lock(&s->devpath_lock);
+				(void)snprintf(dev->devpath, sizeof(dev->devpath), "%s", temper_devpath(dev->ctx));
+				pthread_mutex_unlock(&s->devpath_lock);
+			}
+			atomic_store(&dev->recovery, RECOVERY_DONE);
+			kick(s, dev->worker);
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * resetting
+ *
+ * tells if the device is with the recovery thread, its node may
+ * vanish and come back meanwhile
+ */
+static bool resetting(struct sampler_device *dev)
+{
+	int recovery = atomic_load(&dev->recovery);
+
+	return (recovery == RECOVERY_REQUESTED) || (recovery == RECOVERY_RUNNING);
+}
+
+/*
+ * same_node
+ *
+ * tells if devpath is the node of the device, recoveries rename it
+ */
+static bool same_node(struct temper_sampler *s, const struct sampler_device *dev, const char *devpath)
+{
+	bool same;
+
+	pthread_mutex_lock(&s->devpath_lock);
+	same = !strcmp(dev->devpath, devpath);
+	pthread_mutex_unlock(&s->devpath_lock);
+
+	return same;
+}
+
+/*
+ * gone
+ *
+ * tells if the node of a device is gone. A reset removes the node and
+ * creates it again, its remove event may only arrive after the
+ * recovery thread reopened it.
+ */
+static bool gone(struct temper_sampler *s, const struct sampler_device *dev)
+{
+	struct stat st;
+	bool gone;
+
+	pthread_mutex_lock(&s->devpath_lock);
+	gone = stat(dev->devpath, &st) != 0;
+	pthread_mutex_unlock(&s->devpath_lock);
+
+	return gone;
+}
+
+/*
+ * free_slot
+ *
+ * returns a slot for a device plugged in: one released by its worker
+ * (not part of a standby pair, those keep their indices) or a new one.
+ * Returns -1 if all are taken, sets busy if a retired one is not
+ * released yet.
+ */
+static int free_slot(struct temper_sampler *s, bool *busy)
+{
+	int slot;
+	int cnt;
+
+	*busy = false;
+	for (slot = 0; slot < s->amount; slot++)
+	{
+		if (atomic_load(&s->devices[slot].retired) == SLOT_ACTIVE)
+		{
+			continue;
+		}
+		for (cnt = 0; cnt < s->amount; cnt++)
+		{
+			if ((s->devices[cnt].standby == slot) || ((cnt == slot) && (s->devices[cnt].standby >= 0)))
+			{
+				break;
+			}
+		}
+		if (cnt < s->amount)
+		{
+			continue;
+		}
+		if (atomic_load(&s->devices[slot].retired) == SLOT_RELEASED)
+		{
+			return slot;
+		}
+		*busy = true;
+	}
+
+	return (s->amount < s->capacity) ? s->amount : -1;
+}
+
+/*
+ * hotplug_add
+ *
+ * opens, identifies and starts sampling a device plugged in. Returns
+ * false if the node can't be opened (yet) or no slot is free yet,
+ * the caller retries then.
+ */
+static bool hotplug_add(struct temper_sampler *s, const struct temper_devinfo *info)
+{
+	struct sampler_device *dev;
+	struct temper_ctx *ctx;
+	bool busy;
+	bool reset = false;
+	int slot;
+	int r;
+	int cnt;
+
+	for (cnt = 0; cnt < s->amount; cnt++)
+	{
+		if (atomic_load(&s->devices[cnt].retired) != SLOT_ACTIVE)
+		{
+			continue;
+		}
+		if (same_node(s, &s->devices[cnt], info->devpath))
+		{
+			/* already known, e.g. added before the sampler was started */
+			return true;
+		}
+		reset = reset || resetting(&s->devices[cnt]);
+	}
+	if (reset)
+	{
+		/* may be a device coming back under a new name, known once its reset is done */
+		return false;
+	}
+	slot = free_slot(s, &busy);
+	if (slot < 0)
+	{
+		/* full, unless a device removed is about to be released */
+		return !busy;
+	}
+	ctx = temper_new();
+	if (ctx == NULL)
+	{
+		return true;
+	}
+	r = (s->cfg.open != NULL) ? s->cfg.open(ctx, info, s->cfg.userdata) : temper_open(ctx, info);
+	if (r != TEMPER_OK)
+	{
+		temper_free(ctx);
+		return false;
+	}
+	if (temper_identify(ctx) != TEMPER_OK)
+	{
+		temper_free(ctx);
+		return true;
+	}
+	dev = &s->devices[slot];
+	if (slot < s->amount)
+	{
+		/* samples of the previous device first, its worker is done with it */
+		drain(s);
+		if (dev->owned)
+		{
+			temper_free(dev->ctx);
+		}
+	}
+	if (init_device(s, dev, ctx, slot % s->cfg.workers) != TEMPER_OK)
+	{
+		temper_free(ctx);
+		return true;
+	}
+	(void)snprintf(dev->devpath, sizeof(dev->devpath), "%s", info->devpath);
+	dev->owned = true;
+	dev->next_due = temper_time_us(CLOCK_MONOTONIC);
+	/* publishes the slot to the workers */
+	if (slot < s->amount)
+	{
+		atomic_store(&dev->retired, SLOT_ACTIVE);
+	}
+	else
+	{
+		s->amount++;
+	}
+	kick(s, dev->worker);
+	if (s->cfg.hotplug_callback != NULL)
+	{
+		s->cfg.hotplug_callback(slot, info, TEMPER_HOTPLUG_ADD, s->cfg.userdata);
+	}
+
+	return true;
+}
+
+/*
+ * retire
+ *
+ * stops sampling a device removed, its worker closes it
+ */
+static void retire(struct temper_sampler *s, int device, const struct temper_devinfo *info)
+{
+	atomic_store(&s->devices[device].retired, SLOT_RETIRED);
+	kick(s, s->devices[device].worker);
+	if (s->cfg.hotplug_callback != NULL)
+	{
+		s->cfg.hotplug_callback(device, info, TEMPER_HOTPLUG_REMOVE, s->cfg.userdata);
+	}
+}
+
+/*
+ * hotplug_remove
+ *
+ * retires a device removed. The decision on a device being reset
+ * waits until it is back, see settle_removals.
+ */
+static void hotplug_remove(struct temper_sampler *s, const struct temper_devinfo *info)
+{
+	struct sampler_device *dev;
+	int devices = s->amount;
+	int cnt;
+
+	for (cnt = 0; cnt < s->amount_pending; cnt++)
+	{
+		if (!strcmp(s->pending[cnt].info.devpath, info->devpath))
+		{
+			s->pending[cnt--] = s->pending[--s->amount_pending];
+		}
+	}
+	for (cnt = 0; cnt < devices; cnt++)
+	{
+		dev = &s->devices[cnt];
+		if ((atomic_load(&dev->retired) != SLOT_ACTIVE) || !same_node(s, dev, info->devpath))
+		{
+			continue;
+		}
+		if (resetting(dev))
+		{
+			s->removals_pending += !dev->remove_pending;
+			dev->remove_pending = true;
+			dev->removal = *info;
+		}
+		else if (gone(s, dev))
+		{
+			retire(s, cnt, info);
+		}
+	}
+}
+
+/*
+ * settle_removals
+ *
+ * decides on the devices removed while being reset: those whose node
+ * did not come back are retired
+ */
+static void settle_removals(struct temper_sampler *s)
+{
+	struct sampler_device *dev;
+	int cnt;
+
+	for (cnt = 0; (cnt < s->amount) && (s->removals_pending > 0); cnt++)
+	{
+		dev = &s->devices[cnt];
+		if (!dev->remove_pending || resetting(dev))
+		{
+			continue;
+		}
+		dev->remove_pending = false;
+		s->removals_pending--;
+		if (gone(s, dev))
+		{
+			retire(s, cnt, &dev->removal);
+		}
+	}
+}
+
+/*
+ * hotplug_events
+ *
+ * handles the uevents waiting and retries devices which could
+ * not be opened yet
+ */
+static void hotplug_events(struct temper_sampler *s)
+{
+	struct temper_uevent ev;
+	uint64_t now;
+	bool reset = false;
+	int r;
+	int cnt;
+
+	while ((r = temper_hotplug_read(s->uevent_fd, &ev)) != TEMPER_ERR_TIMEOUT)
+	{
+		if (r < 0)
+		{
+			break;
+		}
+		if (r == 0)
+		{
+			continue;
+		}
+		if (ev.action == TEMPER_HOTPLUG_REMOVE)
+		{
+			hotplug_remove(s, &ev.info);
+		}
+		else if (!hotplug_add(s, &ev.info) && (s->amount_pending < HOTPLUG_PENDING))
+		{
+			s->pending[s->amount_pending].info = ev.info;
+			s->pending[s->amount_pending++].deadline = temper_time_us(CLOCK_MONOTONIC) +
+				(uint64_t) HOTPLUG_SETTLE_MS * 1000;
+		}
+	}
+	if (s->removals_pending > 0)
+	{
+		settle_removals(s);
+	}
+	now = temper_time_us(CLOCK_MONOTONIC);
+	for (cnt = 0; cnt < s->amount; cnt++)
+	{
+		reset = reset || resetting(&s->devices[cnt]);
+	}
+	for (cnt = 0; cnt < s->amount_pending; cnt++)
+	{
+		/* nodes are not given up on while a reset may be about to claim them */
+		if (hotplug_add(s, &s->pending[cnt].info) || ((s->pending[cnt].deadline < now) && !reset))
+		{
+			s->pending[cnt--] = s->pending[--s->amount_pending];
+		}
+	}
+}
+
+/*
+ * wait_events
+ *
+ * waits for samples or, with hotplug, uevents. Without devices
+ * pending nothing is polled.
+ */
+static int wait_events(struct temper_sampler *s)
+{
+	struct pollfd pfd[2];
+	uint64_t counter;
+
+	if (s->uevent_fd < 0)
+	{
+		return ((read(s->wakefd, &counter, sizeof(counter)) < 0) && (errno != EINTR)) ? -1 : 0;
+	}
+	pfd[0].fd = s->wakefd;
+	pfd[0].events = POLLIN;
+	pfd[0].revents = 0;
+	pfd[1].fd = s->uevent_fd;
+	pfd[1].events = POLLIN;
+	pfd[1].revents = 0;
+	if ((poll(pfd, 2, ((s->amount_pending > 0) || (s->removals_pending > 0)) ? HOTPLUG_RETRY_MS : -1) < 0) &&
+		(errno != EINTR))
+	{
+		return -1;
+	}
+	if (pfd[0].revents & POLLIN)
+	{
+		(void)read(s->wakefd, &counter, sizeof(counter));
+	}
+	if ((pfd[1].revents & POLLIN) || (s->amount_pending > 0) || (s->removals_pending > 0))
+	{
+		hotplug_events(s);
+	}
+
+	return 0;
+}
+
+static void *aggregator_thread(void *arg)
+{
+	struct temper_sampler *s = (struct temper_sampler *) arg;
+
+	set_slack(s);
+	while (1)
+	{
+		if (drain(s) > 0)
+		{
+			continue;
+		}
+		if (atomic_load(&s->workers_done))
+		{
+			/* workers are gone, a last round catches late pushes */
+			drain(s);
+			break;
+		}
+		if (wait_events(s) < 0)
+		{
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * worker_attr
+ *
+ * sets up the attributes of the worker threads: scheduling policy,
+ * priority and CPUs of the configuration
+ */
+static void worker_attr(const struct temper_sampler *s, pthread_attr_t *attr)
+{
+	struct sched_param param;
+	cpu_set_t set;
+	int cpu;
+
+	pthread_attr_init(attr);
+	if (s->cfg.sched_policy != SCHED_OTHER)
+	{
+		memset(&param, 0, sizeof(param));
+		param.sched_priority = s->cfg.sched_priority;
+		pthread_attr_setinheritsched(attr, PTHREAD_EXPLICIT_SCHED);
+		pthread_attr_setschedpolicy(attr, s->cfg.sched_policy);
+		pthread_attr_setschedparam(attr, &param);
+	}
+	if (s->cfg.cpus != 0)
+	{
+		CPU_ZERO(&set);
+		for (cpu = 0; cpu < 64; cpu++)
+		{
+			if (s->cfg.cpus & (1ULL << cpu))
+			{
+				CPU_SET(cpu, &set);
+			}
+		}
+		pthread_attr_setaffinity_np(attr, sizeof(set), &set);
+	}
+}
+
+TEMPER_LIB_EXPORT int temper_sampler_start(struct temper_sampler *s)
+{
+	struct sampler_device *devices;
+	pthread_attr_t attr;
+	int cnt;
+	int r;
+	uint64_t now = temper_time_us(CLOCK_MONOTONIC);
+
+	if (s->started)
+	{
+		return TEMPER_ERR_PARAM;
+	}
+	if (s->cfg.hotplug && (s->uevent_fd < 0))
+	{
+		devices = (struct sampler_device *) realloc(s->devices,
+			sizeof(struct sampler_device) * (s->amount + TEMPER_HOTPLUG_DEVICES));
+		if (devices == NULL)
+		{
+			return TEMPER_ERR_NOMEM;
+		}
+		s->devices = devices;
+		memset(&devices[s->amount], 0, sizeof(struct sampler_device) * TEMPER_HOTPLUG_DEVICES);
+		s->capacity = s->amount + TEMPER_HOTPLUG_DEVICES;
+		if (s->cfg.uevent_fd > 0)
+		{
+			s->uevent_fd = s->cfg.uevent_fd;
+		}
+		else if (temper_hotplug_open(&s->uevent_fd) != TEMPER_OK)
+		{
+			return TEMPER_ERR_OPEN;
+		}
+		else
+		{
+			s->own_uevent_fd = true;
+		}
+	}
+	for (cnt = 0; cnt < s->amount; cnt++)
+	{
+		s->devices[cnt].next_due = now;
+	}
+	atomic_store(&s->running, 1);
+	atomic_store(&s->workers_done, 0);
+	s->workers_started = 0;
+	s->started = true;
+	if (pthread_create(&s->aggregator, NULL, aggregator_thread, s) != 0)
+	{
+		s->started = false;
+		return TEMPER_ERR_NOMEM;
+	}
+	if (s->cfg.recover_after > 0)
+	{
+		if (pthread_create(&s->recovery, NULL, recovery_thread, s) != 0)
+		{
+			temper_sampler_stop(s);
+			return TEMPER_ERR_NOMEM;
+		}
+		s->recovery_started = true;
+	}
+	worker_attr(s, &attr);
+	for (cnt = 0; cnt < s->cfg.workers; cnt++)
+	{
+		r = pthread_create(&s->workers[cnt].thread, &attr, worker_thread, &s->workers[cnt]);
+		if (r != 0)
+		{
+			pthread_attr_destroy(&attr);
+			temper_sampler_stop(s);
+			return (r == EPERM) ? TEMPER_ERR_PERMISSION :
+				((r == EINVAL) ? TEMPER_ERR_PARAM : TEMPER_ERR_NOMEM);
+		}
+		s->workers_started++;
+	}
+	pthread_attr_destroy(&attr);
+
+	return TEMPER_OK;
+}
+
+TEMPER_LIB_EXPORT void temper_sampler_stop(struct temper_sampler *s)
+{
+	int cnt;
+	uint64_t one = 1;
+
+	if (!s->started)
+	{
+		return;
+	}
+	atomic_store(&s->running, 0);
+	(void)write(s->stopfd, &one, sizeof(one));
+	/* after a failed start only the workers already running */
+	for (cnt = 0; cnt < s->workers_started; cnt++)
+	{
+		pthread_join(s->workers[cnt].thread, NULL);
+	}
+	s->workers_started = 0;
+	if (s->recovery_started)
+	{
+		/* a reset running is finished first */
+		pthread_join(s->recovery, NULL);
+		s->recovery_started = false;
+	}
+	atomic_store(&s->workers_done, 1);
+	(void)write(s->wakefd, &one, sizeof(one));
+	pthread_join(s->aggregator, NULL);
+	s->started = false;
+}
+
+TEMPER_LIB_EXPORT int temper_sampler_stats(const struct temper_sampler *s, int device, struct temper_sampler_stats *stats)
+{
+	struct sampler_device *dev;
+	union stats_words copy;
+	unsigned int before;
+	unsigned int after;
+	size_t cnt;
+
+	if ((device < 0) || (device >= s->amount))
+	{
+		return TEMPER_ERR_PARAM;
+	}
+	dev = &s->devices[device];
+	/* retried while the worker publishes, never blocks it */
+	do
+	{
+		before = atomic_load_explicit(&dev->stats_seq, memory_order_acquire);
+		for (cnt = 0; cnt < STATS_WORDS; cnt++)
+		{
+			copy.words[cnt] = atomic_load_explicit(&dev->stats_shared[cnt], memory_order_relaxed);
+		}
+		atomic_thread_fence(memory_order_acquire);
+		after = atomic_load_explicit(&dev->stats_seq, memory_order_relaxed);
+	} while ((before & 1) || (before != after));
+	*stats = copy.stats;
+
+	return TEMPER_OK;
+}
+
+TEMPER_LIB_EXPORT int temper_sampler_worker(const struct temper_sampler *s, int worker, struct temper_worker_stats *stats)
+{
+	if ((worker < 0) || (worker >= s->cfg.workers))
+	{
+		return TEMPER_ERR_PARAM;
+	}
+	stats->backend = atomic_load_explicit(&s->workers[worker].backend, memory_order_relaxed);
+	stats->context_switches = atomic_load(&s->workers[worker].context_switches);
+
+	return TEMPER_OK;
+}
+
+TEMPER_LIB_EXPORT void temper_sampler_free(struct temper_sampler *s)
+{
+	int cnt;
+
+	if (s == NULL)
+	{
+		return;
+	}
+	temper_sampler_stop(s);
+	if (s->workers != NULL)
+	{
+		for (cnt = 0; cnt < s->cfg.workers; cnt++)
+		{
+			spsc_destroy(&s->workers[cnt].queue);
+			if (s->workers[cnt].kickfd >= 0)
+			{
+				close(s->workers[cnt].kickfd);
+			}
+			if (s->workers[cnt].timerfd >= 0)
+			{
+				close(s->workers[cnt].timerfd);
+			}
+		}
+		free(s->workers);
+	}
+	for (cnt = 0; cnt < s->amount; cnt++)
+	{
+		if (s->devices[cnt].owned)
+		{
+			temper_free(s->devices[cnt].ctx);
+		}
+	}
+	if (s->own_uevent_fd)
+	{
+		close(s->uevent_fd);
+	}
+	if (s->wakefd >= 0)
+	{
+		close(s->wakefd);
+	}
+	if (s->stopfd >= 0)
+	{
+		close(s->stopfd);
+	}
+	if (s->recoverfd >= 0)
+	{
+		close(s->recoverfd);
+	}
+	pthread_mutex_destroy(&s->devpath_lock);
+	free(s->devices);
+	free(s);
+}
+
+/*
+ * sampler Copyright (C) 2020-2021 Armin Fuerst (armin@fuerst.priv.at)
+ *
+ * This file is part of tempersensor.
+ *
+ * Tempersensor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tempersensor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tempersensor.  If not, see <https://www.gnu.org/licenses/>.
+ */
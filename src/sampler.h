@@ -0,0 +1,315 @@
+/*
+ * sampler is a multi-threaded sampling engine for libtempersensor.
+ * Worker threads each own a set of devices and push timestamped
+ * samples into their own lock-free queue, one aggregator thread
+ * collects them and hands them to a callback for output and storage.
+ * Additional infos (including a license notice) are at the end of this file.
+ */
+
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <stdbool.h>
+
+#include "temper.h"
+#include "hotplug.h"
+
+/* devices a running sampler holds at a time on hotplug events */
+#define TEMPER_HOTPLUG_DEVICES 32
+/* bucket 0 counts queries started less than 1 microsecond after their
+ * scheduled time, bucket n (n > 0) those from 2^(n-1) up to below 2^n
+ * microseconds later, the last one all later than that */
+#define TEMPER_JITTER_BUCKETS 24
+
+/*
+ * struct temper_sample
+ *
+ * one reading of one device
+ */
+struct temper_sample
+{
+	uint64_t timestamp_us; /* capture time, microseconds since the epoch */
+	uint64_t due_us; /* scheduled time, CLOCK_MONOTONIC */
+	uint32_t latency_us; /* duration of the query */
+	uint32_t spread_us; /* batched rounds: time between the commands to the first and last device */
+	int readings; /* successful queries reduced into this sample */
+	int device; /* index returned by temper_sampler_add */
+	int source; /* device the values are from, the standby of device if it took over */
+	int status; /* TEMPER_OK or the error code of the query */
+	float values[TEMPER_CHANNELS];
+};
+
+/*
+ * temper_sample_cb
+ *
+ * called from the aggregator thread for every sample
+ */
+typedef void (*temper_sample_cb)(const struct temper_sample *sample, void *userdata);
+
+/*
+ * temper_device_open_cb
+ *
+ * opens a device plugged in, like temper_open does by default
+ */
+typedef int (*temper_device_open_cb)(struct temper_ctx *ctx, const struct temper_devinfo *info, void *userdata);
+
+/*
+ * temper_hotplug_cb
+ *
+ * called from the aggregator thread when a device was added
+ * (TEMPER_HOTPLUG_ADD) or retired (TEMPER_HOTPLUG_REMOVE)
+ */
+typedef void (*temper_hotplug_cb)(int device, const struct temper_devinfo *info, int action, void *userdata);
+
+struct temper_sampler_config
+{
+	int workers; /* amount of worker threads */
+	int interval_ms; /* sampling interval per device, 0 = as fast as possible */
+	int queue_size; /* entries per worker queue */
+	int backend; /* TEMPER_BACKEND_*, see round.h */
+	int timeout_ms; /* response timeout of batched rounds */
+	int oversample; /* queries per sample, 0 or 1 = no oversampling */
+	int budget_ms; /* time the queries of one sample may take */
+	int reduce; /* TEMPER_REDUCE_*, see oversample.h */
+	float max_deviation; /* outlier limit, see oversample.h */
+	int min_interval_ms; /* adaptive sampling: fastest interval, 0 = fixed interval_ms */
+	int max_interval_ms; /* adaptive sampling: slowest interval */
+	float adapt_rate; /* change per minute of a channel above which sampling speeds up */
+	int recover_after; /* timeouts in a row before a device is reset, 0 = never */
+	int recover_timeout_ms; /* time a reset device may take to come back */
+	int tick_ms; /* low-wakeup: queries wait for the next multiple of tick_ms, 0 = exact due times */
+	int slack_ms; /* timer slack of the sampling threads, 0 = default of the kernel */
+	int sched_policy; /* of the workers: SCHED_OTHER (0), SCHED_FIFO or SCHED_RR */
+	int sched_priority; /* with SCHED_FIFO or SCHED_RR, see sched_get_priority_min/max */
+	uint64_t cpus; /* CPUs the workers run on, bit n = CPU n, 0 = any */
+	bool hotplug; /* follow hidraw nodes plugged in and removed */
+	int uevent_fd; /* source of uevents, 0 = open NETLINK_KOBJECT_UEVENT */
+	temper_device_open_cb open; /* NULL = temper_open */
+	temper_hotplug_cb hotplug_callback; /* NULL = not interested */
+	temper_sample_cb callback;
+	void *userdata;
+};
+
+/*
+ * struct temper_sampler_stats
+ *
+ * counters of one device
+ */
+struct temper_sampler_stats
+{
+	unsigned long samples; /* samples handed to the aggregator */
+	unsigned long errors; /* queries returning an error */
+	unsigned long dropped; /* samples lost because the queue was full */
+	unsigned long late; /* intervals skipped because a query took too long */
+	unsigned long syscalls; /* system calls to talk to the device */
+	unsigned long readings; /* successful queries, more than samples if oversampling */
+	unsigned long rejected; /* readings rejected as outliers */
+	unsigned long interval_ms; /* current sampling interval */
+	unsigned long faster; /* adaptive sampling: interval halved */
+	unsigned long slower; /* adaptive sampling: interval doubled */
+	int last_change; /* +1 faster, -1 slower, 0 not changed yet */
+	int last_channel; /* channel causing the last change */
+	float last_rate; /* its change per minute at that time */
+	unsigned long recoveries; /* recovery attempts (temper_recover) */
+	unsigned long recovered; /* recoveries after which the device answered again */
+	unsigned long recovery_ms; /* last recovery: time from the first failed sample to the next good one */
+	unsigned long recovery_ms_total;
+	unsigned long jitter[TEMPER_JITTER_BUCKETS]; /* queries by delay after their scheduled time */
+	uint64_t jitter_us_total; /* sum of the delays */
+	unsigned long jitter_us_max;
+	unsigned long failovers; /* samples with the values of the standby */
+};
+
+/*
+ * struct temper_worker_stats
+ *
+ * counters of one worker thread
+ */
+struct temper_worker_stats
+{
+	int backend; /* backend in use, io_uring falls back to epoll */
+	unsigned long context_switches; /* voluntary and involuntary */
+};
+
+struct temper_sampler;
+
+/*
+ * temper_sampler_new
+ *
+ * creates a sampler, returns NULL on invalid configuration
+ * or if out of memory
+ */
+TEMPER_LIB_EXPORT struct temper_sampler *temper_sampler_new(const struct temper_sampler_config *cfg);
+
+/*
+ * temper_sampler_add
+ *
+ * adds an identified device to the worker with the given number,
+ * a negative worker distributes the devices round robin. Must be
+ * called before temper_sampler_start, the sampler does not take
+ * ownership of ctx. Returns the index of the device or an error code.
+ */
+TEMPER_LIB_EXPORT int temper_sampler_add(struct temper_sampler *s, struct temper_ctx *ctx, int worker);
+
+/*
+ * temper_sampler_standby
+ *
+ * makes standby take over for device, see redundancy below. Both
+ * must be added already, standby is moved to the worker of device.
+ * Must be called before temper_sampler_start, needs a batched backend.
+ */
+TEMPER_LIB_EXPORT int temper_sampler_standby(struct temper_sampler *s, int device, int standby);
+
+/*
+ * temper_sampler_start
+ *
+ * starts the worker and aggregator threads
+ */
+TEMPER_LIB_EXPORT int temper_sampler_start(struct temper_sampler *s);
+
+/*
+ * temper_sampler_stop
+ *
+ * stops all workers, delivers the samples still queued and
+ * waits for all threads to finish
+ */
+TEMPER_LIB_EXPORT void temper_sampler_stop(struct temper_sampler *s);
+
+/*
+ * adaptive sampling
+ *
+ * with min_interval_ms and max_interval_ms set, every device starts
+ * at interval_ms (kept within the bounds). When a raw channel changes
+ * faster than adapt_rate per minute, the interval of the device is
+ * halved, after some samples below half of adapt_rate it is doubled.
+ * Changes up to one step of the resolution of the devices are noise.
+ */
+
+/*
+ * hotplug
+ *
+ * with hotplug set, the aggregator thread listens for uevents (see
+ * hotplug.h) next to the samples, without any polling. A supported
+ * hidraw node plugged in is opened, identified and handed to a worker
+ * round robin, up to TEMPER_HOTPLUG_DEVICES more than added before
+ * the start at a time.
+ * A node which can't be opened yet (udev still setting permissions)
+ * is retried for some seconds. A device removed is retired: its
+ * worker closes it and no more samples are delivered. Once the worker
+ * is done with it, its index may be given to a device plugged in
+ * later (announced by TEMPER_HOTPLUG_ADD), except for devices with a
+ * standby and standbys. A device removed while being reset (see
+ * recovery) is retired only if its node did not come back with the
+ * reset. Devices added on hotplug events are owned by the sampler.
+ */
+
+/*
+ * recovery
+ *
+ * with recover_after set, a device not answering recover_after times
+ * in a row is handed to a recovery thread, which closes, resets and
+ * identifies it again by temper_recover. Its worker goes on with the
+ * other devices and delivers TEMPER_ERR_OPEN for it in the meantime.
+ * While it stays away every error counts, a failed recovery is
+ * retried after another recover_after samples. Batched rounds are
+ * rebuilt with the new file descriptor, a device lost by a failed
+ * recovery delivers TEMPER_ERR_OPEN until it is back.
+ */
+
+/*
+ * redundancy
+ *
+ * a device with a standby is queried in the same round as the
+ * standby. If it fails (timeout of the round, error, lost) or its
+ * default IN channel is invalid, its sample gets the values of the
+ * standby from that round, source tells. The standby still delivers
+ * its own samples, recovery and adaptive sampling of the device only
+ * look at its own answers.
+ */
+
+/*
+ * low-wakeup
+ *
+ * with tick_ms set, the workers sleep on a timerfd armed at the next
+ * multiple of tick_ms (CLOCK_MONOTONIC) after a device is due, so all
+ * devices due within one tick are queried in one wakeup and the
+ * workers wake together. The aggregator is woken once per wakeup of a
+ * worker, not per sample. Intervals should be multiples of tick_ms.
+ * timerfd expiries are exact, slack_ms widens the remaining timed
+ * waits of the sampling threads (PR_SET_TIMERSLACK), so the kernel
+ * may fold them into other wakeups.
+ */
+
+/*
+ * real-time
+ *
+ * sched_policy, sched_priority and cpus apply to the worker threads
+ * only, the aggregator and the callback keep the scheduling of the
+ * caller. temper_sampler_start returns TEMPER_ERR_PERMISSION if the
+ * process may not use the policy (CAP_SYS_NICE or RLIMIT_RTPRIO) and
+ * TEMPER_ERR_PARAM if a CPU does not exist. The jitter counts in the
+ * stats tell how late the queries start: the time the worker woke up
+ * for (the due time, with tick_ms the tick after it) up to sending
+ * the command, the earlier devices of the same wakeup included.
+ */
+
+/*
+ * temper_sampler_stats
+ *
+ * copies the counters of the given device to stats, also while the
+ * sampler runs: the workers publish them after every sample and the
+ * copy is retried if it overlaps, so readers never block a worker
+ */
+TEMPER_LIB_EXPORT int temper_sampler_stats(const struct temper_sampler *s, int device, struct temper_sampler_stats *stats);
+
+/*
+ * temper_sampler_worker
+ *
+ * copies the counters of the given worker to stats, the context
+ * switches are known after temper_sampler_stop only
+ */
+TEMPER_LIB_EXPORT int temper_sampler_worker(const struct temper_sampler *s, int worker, struct temper_worker_stats *stats);
+
+/*
+ * temper_sampler_free
+ *
+ * stops the sampler if still running and releases it
+ */
+TEMPER_LIB_EXPORT void temper_sampler_free(struct temper_sampler *s);
+
+/*
+ * temper_time_us
+ *
+ * returns the current time of the given clock in microseconds
+ */
+TEMPER_LIB_EXPORT uint64_t temper_time_us(int clock);
+
+/*
+ * temper_tick_next
+ *
+ * returns the first multiple of tick_ms at or after time_us, time_us
+ * itself if tick_ms is 0. Timers of a clock aligned to the same tick
+ * expire together.
+ */
+TEMPER_LIB_EXPORT uint64_t temper_tick_next(uint64_t time_us, int tick_ms);
+
+#endif // SAMPLER_H
+
+/*
+ * sampler Copyright (C) 2020-2021 Armin Fuerst (armin@fuerst.priv.at)
+ *
+ * This file is part of tempersensor.
+ *
+ * Tempersensor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tempersensor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tempersensor.  If not, see <https://www.gnu.org/licenses/>.
+ */
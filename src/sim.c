@@ -0,0 +1,274 @@
+/*
+ * sim provides simulated TEMPer devices for libtempersensor. A simulated
+ * device answers the same commands as the real hardware on a file
+ * descriptor, so everything above the transport can be tested and
+ * benchmarked without USB devices.
+ * Additional infos (including a license notice) are at the end of this file.
+ */
+
+#include "sim.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#define REPORTSIZE 8
+
+/*
+ * simulated devices, the values are what the real devices
+ * report in an office at room temperature
+ */
+const static struct
+{
+	const char *firmware;
+	struct temper_sim sim;
+} presets[] =
+{
+	{ "TEMPer1F_V1.3", { "TEMPer1F_V1.3r1F", 0x0c45, 0x7401, 1, 1,
+		{ { 0.0, 21.5 }, { 0.0, 0.0 } }, 8000, -1 } },
+	{ "TEMPerF1.4", { "TEMPerF1.4      ", 0x0c45, 0x7401, 1, 1,
+		{ { 22.0, 0.0 }, { 0.0, 0.0 } }, 8000, -1 } },
+	{ "TEMPerX_V3.1", { "TEMPerX_V3.1    ", 0x413d, 0x2107, 2, 2,
+		{ { 23.5, 41.0 }, { 19.0, 55.0 } }, 4000, -1 } },
+	{ "TEMPerX_V3.3", { "TEMPerX_V3.3    ", 0x413d, 0x2107, 2, 1,
+		{ { 23.5, 41.0 }, { 0.0, 0.0 } }, 4000, -1 } },
+};
+
+struct sim_device
+{
+	struct temper_sim sim;
+	int fd;
+	unsigned long queries;
+};
+
+TEMPER_LIB_EXPORT int temper_sim_defaults(struct temper_sim *sim, const char *firmware)
+{
+	int cnt;
+
+	for (cnt = 0; cnt < sizeof(presets) / sizeof(presets[0]); cnt++)
+	{
+		if (!strcmp(presets[cnt].firmware, firmware))
+		{
+			*sim = presets[cnt].sim;
+			return TEMPER_OK;
+		}
+	}
+	return TEMPER_ERR_UNKNOWN;
+}
+
+/*
+ * encode
+ *
+ * stores value in the representation of the conversion method
+ */
+static void encode(unsigned char *report, float value, int conversion_method)
+{
+	int raw;
+	float scale = (conversion_method == 1) ? 16.0 : 100.0;
+
+	raw = (int)(value * scale + ((value < 0) ? -0.5 : 0.5));
+	if (conversion_method == 1)
+	{
+		raw <<= 4;
+	}
+	report[0] = (raw >> 8) & 0xFF;
+	report[1] = raw & 0xFF;
+}
+
+/*
+ * drift
+ *
+ * lets the values wander by up to half a degree in steps of
+ * the resolution of the devices, so consumers see changes
+ */
+static float drift(unsigned long n)
+{
+	int t = n % 32;
+
+	return (((t < 16) ? t : (32 - t)) - 8) * 0.0625;
+}
+
+/*
+ * wait_latency
+ *
+ * real devices need some time for every answer, not only for values
+ */
+static void wait_latency(const struct sim_device *dev)
+{
+	struct timespec delay;
+
+	if (dev->sim.latency_us > 0)
+	{
+		delay.tv_sec = dev->sim.latency_us / 1000000;
+		delay.tv_nsec = (dev->sim.latency_us % 1000000) * 1000;
+		nanosleep(&delay, NULL);
+	}
+}
+
+static void answer_values(struct sim_device *dev)
+{
+	unsigned char report[REPORTSIZE];
+	int response;
+	int sensor;
+
+	if ((dev->sim.answers >= 0) && (dev->queries >= (unsigned long) dev->sim.answers))
+	{
+		/* hung, the request is swallowed */
+		return;
+	}
+	wait_latency(dev);
+	for (response = 0; response < dev->sim.responses; response++)
+	{
+		memset(report, 0, sizeof(report));
+		report[0] = 0x80;
+		report[1] = 0x04;
+		for (sensor = 0; sensor < 2; sensor++)
+		{
+			encode(report + 2 + (sensor * 2),
+				dev->sim.base[response][sensor] + drift(dev->queries),
+				dev->sim.conversion_method);
+		}
+		if (write(dev->fd, report, sizeof(report)) < 0)
+		{
+			return;
+		}
+	}
+	dev->queries++;
+}
+
+static void answer_firmware(struct sim_device *dev)
+{
+	wait_latency(dev);
+	if (write(dev->fd, dev->sim.firmware, REPORTSIZE) < 0)
+	{
+		return;
+	}
+	(void)write(dev->fd, dev->sim.firmware + REPORTSIZE, REPORTSIZE);
+}
+
+/*
+ * sim_thread
+ *
+ * answers commands until the library side closes its end
+ */
+static void *sim_thread(void *arg)
+{
+	struct sim_device *dev = (struct sim_device *) arg;
+	unsigned char command[REPORTSIZE];
+
+	while (read(dev->fd, command, sizeof(command)) == sizeof(command))
+	{
+		if (command[1] == 0x86)
+		{
+			answer_firmware(dev);
+		}
+		else if (command[1] == 0x80)
+		{
+			answer_values(dev);
+		}
+	}
+	close(dev->fd);
+	free(dev);
+
+	return NULL;
+}
+
+/*
+ * start_sim
+ *
+ * starts the thread of a simulated device, returns the file
+ * descriptor of the library side or a negative error code
+ */
+static int start_sim(const struct temper_sim *sim)
+{
+	int fds[2];
+	pthread_t thread;
+	struct sim_device *dev;
+
+	dev = (struct sim_device *) calloc(1, sizeof(struct sim_device));
+	if (dev == NULL)
+	{
+		return TEMPER_ERR_NOMEM;
+	}
+	/* SOCK_SEQPACKET keeps the boundaries of the reports like hidraw */
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds) < 0)
+	{
+		free(dev);
+		return TEMPER_ERR_OPEN;
+	}
+	dev->sim = *sim;
+	dev->fd = fds[1];
+	if (pthread_create(&thread, NULL, sim_thread, dev) != 0)
+	{
+		close(fds[0]);
+		close(fds[1]);
+		free(dev);
+		return TEMPER_ERR_OPEN;
+	}
+	pthread_detach(thread);
+
+	return fds[0];
+}
+
+/*
+ * reset_sim
+ *
+ * replaces the device like a USB reset does: the old thread ends
+ * with its closed descriptor, a new one starts with fresh counters
+ */
+static int reset_sim(void *data)
+{
+	const struct temper_sim *sim = (const struct temper_sim *) data;
+	struct timespec delay = { sim->reset_ms / 1000, (sim->reset_ms % 1000) * 1000000L };
+
+	if (sim->reset_ms > 0)
+	{
+		nanosleep(&delay, NULL);
+	}
+	return start_sim(sim);
+}
+
+TEMPER_LIB_EXPORT int temper_open_sim(struct temper_ctx *ctx, const struct temper_sim *sim)
+{
+	struct temper_sim *copy;
+	int fd;
+
+	copy = (struct temper_sim *) malloc(sizeof(struct temper_sim));
+	if (copy == NULL)
+	{
+		return TEMPER_ERR_NOMEM;
+	}
+	*copy = *sim;
+	fd = start_sim(sim);
+	if (fd < 0)
+	{
+		free(copy);
+		return fd;
+	}
+	(void)temper_open_fd(ctx, fd, sim->vendor_id, sim->product_id);
+	temper_set_reset(ctx, reset_sim, copy);
+
+	return TEMPER_OK;
+}
+
+/*
+ * sim Copyright (C) 2020-2021 Armin Fuerst (armin@fuerst.priv.at)
+ *
+ * This file is part of tempersensor.
+ *
+ * Tempersensor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tempersensor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tempersensor.  If not, see <https://www.gnu.org/licenses/>.
+ */
@@ -0,0 +1,68 @@
+/*
+ * sim provides simulated TEMPer devices for libtempersensor. A simulated
+ * device answers the same commands as the real hardware on a file
+ * descriptor, so everything above the transport can be tested and
+ * benchmarked without USB devices.
+ * Additional infos (including a license notice) are at the end of this file.
+ */
+
+#ifndef SIM_H
+#define SIM_H
+
+#include "temper.h"
+
+/*
+ * struct temper_sim
+ *
+ * describes the behaviour of a simulated device
+ */
+struct temper_sim
+{
+	char firmware[17]; /* reported as answer to the firmware query */
+	uint16_t vendor_id;
+	uint16_t product_id;
+	int conversion_method; /* encoding of the values */
+	int responses; /* amount of reports per value query */
+	float base[2][2]; /* value per report and sensor slot */
+	int latency_us; /* delay before answering a value query */
+	long answers; /* value queries answered before the device hangs, -1 = forever */
+	int reset_ms; /* time a reset by temper_recover takes */
+};
+
+/*
+ * temper_sim_defaults
+ *
+ * initialises sim to behave like a device with the given firmware,
+ * known are TEMPer1F_V1.3, TEMPerF1.4, TEMPerX_V3.1 and TEMPerX_V3.3.
+ * Returns TEMPER_ERR_UNKNOWN for other firmware strings.
+ */
+TEMPER_LIB_EXPORT int temper_sim_defaults(struct temper_sim *sim, const char *firmware);
+
+/*
+ * temper_open_sim
+ *
+ * starts a simulated device and opens the context on it,
+ * temper_recover restarts it with fresh counters
+ */
+TEMPER_LIB_EXPORT int temper_open_sim(struct temper_ctx *ctx, const struct temper_sim *sim);
+
+#endif // SIM_H
+
+/*
+ * sim Copyright (C) 2020-2021 Armin Fuerst (armin@fuerst.priv.at)
+ *
+ * This file is part of tempersensor.
+ *
+ * Tempersensor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tempersensor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tempersensor.  If not, see <https://www.gnu.org/licenses/>.
+ */
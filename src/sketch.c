@@ -0,0 +1,278 @@
+/*
+ * sketch estimates quantiles (p50, p95, p99, ...) of a stream of
+ * values in fixed memory using a merging t-digest. Sketches can be
+ * merged, so windows of an hour, a day or a week are built from
+ * rings of shorter sub-window sketches, and devices can be combined.
+ * Additional infos (including a license notice) are at the end of this file.
+ */
+
+#include "sketch.h"
+#include <stdlib.h>
+
+/*
+ * compression of the t-digest: a centroid at quantile q may hold up
+ * to count * 2 * pi / COMPRESSION * sqrt(q * (1 - q)) values (the
+ * slope of the k1 scale function). Centroids at the tails stay small,
+ * so p99 remains accurate, and there are about COMPRESSION / 2 of them.
+ * Comparing squares avoids sqrt, so no libm is needed.
+ */
+#define COMPRESSION 80.0
+#define LIMIT_FACTOR ((2.0 * 3.14159265358979 / COMPRESSION) * (2.0 * 3.14159265358979 / COMPRESSION))
+
+static const struct
+{
+	uint64_t slot_us; /* length of a sub-window */
+	int slots;
+	int first; /* index of the first slot in struct temper_windowed */
+	const char *name;
+} windows[TEMPER_WINDOWS] =
+{
+	{ 300 * 1000000ULL, 13, 0, "hour" },
+	{ 3600 * 1000000ULL, 25, 13, "day" },
+	{ 86400 * 1000000ULL, 8, 38, "week" },
+};
+
+TEMPER_LIB_EXPORT void temper_sketch_init(struct temper_sketch *s)
+{
+	s->count = 0;
+	s->min = 0.0;
+	s->max = 0.0;
+	s->used = 0;
+	s->buffered = 0;
+}
+
+static int compare_centroids(const void *a, const void *b)
+{
+	float ma = ((const struct temper_centroid *) a)->mean;
+	float mb = ((const struct temper_centroid *) b)->mean;
+
+	return (ma > mb) - (ma < mb);
+}
+
+/*
+ * compress
+ *
+ * sorts centroids and buffer together and merges neighbours
+ * as long as the size limit allows
+ */
+static void compress(struct temper_sketch *s)
+{
+	int amount = s->used + s->buffered;
+	double total = 0.0;
+	double before = 0.0; /* weight left of the current centroid */
+	double weight;
+	double q;
+	int out = 0;
+	int cnt;
+
+	if (s->buffered == 0)
+	{
+		return;
+	}
+	qsort(s->c, amount, sizeof(s->c[0]), compare_centroids);
+	for (cnt = 0; cnt < amount; cnt++)
+	{
+		total += s->c[cnt].weight;
+	}
+	for (cnt = 1; cnt < amount; cnt++)
+	{
+		weight = s->c[out].weight + s->c[cnt].weight;
+		q = (before + weight / 2.0) / total;
+		// the last slot takes everything left to keep memory fixed
+		if ((weight * weight <= total * total * LIMIT_FACTOR * q * (1.0 - q)) ||
+			(out == TEMPER_SKETCH_CENTROIDS - 1))
+		{
+			s->c[out].mean += (s->c[cnt].mean - s->c[out].mean) *
+				s->c[cnt].weight / weight;
+			s->c[out].weight = weight;
+		}
+		else
+		{
+			before += s->c[out].weight;
+			s->c[++out] = s->c[cnt];
+		}
+	}
+	s->used = out + 1;
+	s->buffered = 0;
+}
+
+static void add_weighted(struct temper_sketch *s, float mean, float weight)
+{
+	if (s->buffered == TEMPER_SKETCH_BUFFER)
+	{
+		compress(s);
+	}
+	s->c[s->used + s->buffered].mean = mean;
+	s->c[s->used + s->buffered].weight = weight;
+	s->buffered++;
+}
+
+TEMPER_LIB_EXPORT void temper_sketch_add(struct temper_sketch *s, float value)
+{
+	if ((s->count == 0) || (value < s->min))
+	{
+		s->min = value;
+	}
+	if ((s->count == 0) || (value > s->max))
+	{
+		s->max = value;
+	}
+	s->count++;
+	add_weighted(s, value, 1.0);
+}
+
+TEMPER_LIB_EXPORT void temper_sketch_merge(struct temper_sketch *dst, const struct temper_sketch *src)
+{
+	int cnt;
+
+	if (src->count == 0)
+	{
+		return;
+	}
+	if ((dst->count == 0) || (src->min < dst->min))
+	{
+		dst->min = src->min;
+	}
+	if ((dst->count == 0) || (src->max > dst->max))
+	{
+		dst->max = src->max;
+	}
+	dst->count += src->count;
+	for (cnt = 0; cnt < src->used + src->buffered; cnt++)
+	{
+		add_weighted(dst, src->c[cnt].mean, src->c[cnt].weight);
+	}
+}
+
+TEMPER_LIB_EXPORT float temper_sketch_quantile(struct temper_sketch *s, double q)
+{
+	double index;
+	double before;
+	double step;
+	const struct temper_centroid *c = s->c;
+	int cnt;
+
+	if (s->count == 0)
+	{
+		return TEMPER_INVALID;
+	}
+	compress(s);
+	if (q <= 0.0)
+	{
+		return s->min;
+	}
+	if (q >= 1.0)
+	{
+		return s->max;
+	}
+	index = q * s->count;
+	// between the minimum and the center of the first centroid
+	if (index < c[0].weight / 2.0)
+	{
+		return s->min + (c[0].mean - s->min) * index / (c[0].weight / 2.0);
+	}
+	// interpolate between the centers of neighbouring centroids
+	before = c[0].weight / 2.0;
+	for (cnt = 0; cnt < s->used - 1; cnt++)
+	{
+		step = (c[cnt].weight + c[cnt + 1].weight) / 2.0;
+		if (before + step > index)
+		{
+			return c[cnt].mean + (c[cnt + 1].mean - c[cnt].mean) *
+				(index - before) / step;
+		}
+		before += step;
+	}
+	// between the center of the last centroid and the maximum
+	step = c[s->used - 1].weight / 2.0;
+	if (step <= 0.0)
+	{
+		return s->max;
+	}
+	return c[s->used - 1].mean + (s->max - c[s->used - 1].mean) *
+		(index - before) / step;
+}
+
+TEMPER_LIB_EXPORT void temper_windowed_init(struct temper_windowed *w)
+{
+	int cnt;
+
+	for (cnt = 0; cnt < TEMPER_WINDOW_SLOTS; cnt++)
+	{
+		w->epoch[cnt] = 0;
+		temper_sketch_init(&w->slot[cnt]);
+	}
+}
+
+TEMPER_LIB_EXPORT void temper_windowed_add(struct temper_windowed *w, uint64_t timestamp_us, float value)
+{
+	uint64_t epoch;
+	int window;
+	int slot;
+
+	for (window = 0; window < TEMPER_WINDOWS; window++)
+	{
+		// epoch 0 marks unused slots, so count from 1
+		epoch = timestamp_us / windows[window].slot_us + 1;
+		slot = windows[window].first + epoch % windows[window].slots;
+		if (w->epoch[slot] != epoch)
+		{
+			// the slot held a sub-window that has left the window
+			w->epoch[slot] = epoch;
+			temper_sketch_init(&w->slot[slot]);
+		}
+		temper_sketch_add(&w->slot[slot], value);
+	}
+}
+
+TEMPER_LIB_EXPORT int temper_windowed_query(const struct temper_windowed *w, int window, uint64_t now_us, struct temper_sketch *result)
+{
+	uint64_t epoch;
+	int slot;
+
+	if ((window < 0) || (window >= TEMPER_WINDOWS))
+	{
+		return TEMPER_ERR_PARAM;
+	}
+	epoch = now_us / windows[window].slot_us + 1;
+	for (slot = windows[window].first;
+		slot < windows[window].first + windows[window].slots; slot++)
+	{
+		if ((w->epoch[slot] != 0) && (w->epoch[slot] <= epoch) &&
+			(w->epoch[slot] + windows[window].slots > epoch))
+		{
+			temper_sketch_merge(result, &w->slot[slot]);
+		}
+	}
+
+	return TEMPER_OK;
+}
+
+TEMPER_LIB_EXPORT const char *temper_window_name(int window)
+{
+	if ((window < 0) || (window >= TEMPER_WINDOWS))
+	{
+		return "unknown";
+	}
+	return windows[window].name;
+}
+
+
+/*
+ * sketch Copyright (C) 2020-2021 Armin Fuerst (armin@fuerst.priv.at)
+ *
+ * This file is part of tempersensor.
+ *
+ * Tempersensor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tempersensor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tempersensor.  If not, see <https://www.gnu.org/licenses/>.
+ */
@@ -0,0 +1,141 @@
+/*
+ * sketch estimates quantiles (p50, p95, p99, ...) of a stream of
+ * values in fixed memory using a merging t-digest. Sketches can be
+ * merged, so windows of an hour, a day or a week are built from
+ * rings of shorter sub-window sketches, and devices can be combined.
+ * Additional infos (including a license notice) are at the end of this file.
+ */
+
+#ifndef SKETCH_H
+#define SKETCH_H
+
+#include <stdint.h>
+
+#include "temper.h"
+
+/* centroids kept after compressing, values buffered before */
+#define TEMPER_SKETCH_CENTROIDS 64
+#define TEMPER_SKETCH_BUFFER 32
+
+struct temper_centroid
+{
+	float mean;
+	float weight;
+};
+
+/*
+ * struct temper_sketch
+ *
+ * the first used entries of c are the centroids sorted by mean,
+ * followed by buffered values not merged yet
+ */
+struct temper_sketch
+{
+	uint64_t count;
+	float min;
+	float max;
+	int used;
+	int buffered;
+	struct temper_centroid c[TEMPER_SKETCH_CENTROIDS + TEMPER_SKETCH_BUFFER];
+};
+
+/*
+ * temper_sketch_init
+ *
+ * empties the sketch
+ */
+TEMPER_LIB_EXPORT void temper_sketch_init(struct temper_sketch *s);
+
+/*
+ * temper_sketch_add
+ *
+ * adds one value
+ */
+TEMPER_LIB_EXPORT void temper_sketch_add(struct temper_sketch *s, float value);
+
+/*
+ * temper_sketch_merge
+ *
+ * adds all values of src to dst
+ */
+TEMPER_LIB_EXPORT void temper_sketch_merge(struct temper_sketch *dst, const struct temper_sketch *src);
+
+/*
+ * temper_sketch_quantile
+ *
+ * returns the estimated value at quantile q (0.0 - 1.0) or
+ * TEMPER_INVALID if the sketch is empty
+ */
+TEMPER_LIB_EXPORT float temper_sketch_quantile(struct temper_sketch *s, double q);
+
+/*
+ * windows
+ *
+ * struct temper_windowed keeps the values of the last hour (in
+ * sub-windows of 5 minutes), day (hourly) and week (daily), with
+ * one sub-window more than the length takes. A window therefore
+ * covers its full length plus the part of the current sub-window
+ * that has already passed.
+ */
+#define TEMPER_WINDOW_HOUR 0
+#define TEMPER_WINDOW_DAY 1
+#define TEMPER_WINDOW_WEEK 2
+#define TEMPER_WINDOWS 3
+#define TEMPER_WINDOW_SLOTS (13 + 25 + 8)
+
+struct temper_windowed
+{
+	uint64_t epoch[TEMPER_WINDOW_SLOTS]; /* sub-window stored in slot */
+	struct temper_sketch slot[TEMPER_WINDOW_SLOTS];
+};
+
+/*
+ * temper_windowed_init
+ *
+ * empties all windows
+ */
+TEMPER_LIB_EXPORT void temper_windowed_init(struct temper_windowed *w);
+
+/*
+ * temper_windowed_add
+ *
+ * adds a value captured at timestamp_us (microseconds since the epoch)
+ */
+TEMPER_LIB_EXPORT void temper_windowed_add(struct temper_windowed *w, uint64_t timestamp_us, float value);
+
+/*
+ * temper_windowed_query
+ *
+ * merges the values of window (TEMPER_WINDOW_*) as seen at now_us
+ * into result, which can already hold values of other devices
+ */
+TEMPER_LIB_EXPORT int temper_windowed_query(const struct temper_windowed *w, int window, uint64_t now_us, struct temper_sketch *result);
+
+/*
+ * temper_window_name
+ *
+ * returns "hour", "day" or "week"
+ */
+TEMPER_LIB_EXPORT const char *temper_window_name(int window);
+
+#endif // SKETCH_H
+
+
+/*
+ * sketch Copyright (C) 2020-2021 Armin Fuerst (armin@fuerst.priv.at)
+ *
+ * This file is part of tempersensor.
+ *
+ * Tempersensor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tempersensor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tempersensor.  If not, see <https://www.gnu.org/licenses/>.
+ */
@@ -0,0 +1,255 @@
+/*
+ * snmp answers the pass_persist requests of net-snmp: snmpd hands the
+ * get, getnext and set requests below a base OID to a program on its
+ * stdin and reads the answers from its stdout. The objects form a
+ * table, the caller provides their values.
+ * Additional infos (including a license notice) are at the end of this file.
+ */
+
+#include "snmp.h"
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+TEMPER_LIB_EXPORT int temper_snmp_parse_oid(const char *s, uint32_t *oid, int max)
+{
+	unsigned long sub;
+	char *end;
+	int len = 0;
+
+	if (*s == '.')
+	{
+		s++;
+	}
+	while (*s != '\0')
+	{
+		if (!isdigit((unsigned char) *s) || (len == max))
+		{
+			return -1;
+		}
+		sub = strtoul(s, &end, 10);
+		if ((sub > UINT32_MAX) || ((*end != '.') && (*end != '\0')) || ((*end == '.') && (end[1] == '\0')))
+		{
+			return -1;
+		}
+		oid[len++] = sub;
+		s = (*end == '.') ? end + 1 : end;
+	}
+	return (len > 0) ? len : -1;
+}
+
+TEMPER_LIB_EXPORT int temper_snmp_init(struct temper_snmp *snmp, const char *base, const int *columns, int amount_columns, temper_snmp_object_cb object, void *userdata)
+{
+	memset(snmp, 0, sizeof(struct temper_snmp));
+	// room for .1.COLUMN.ROW
+	snmp->base_len = temper_snmp_parse_oid(base, snmp->base, TEMPER_SNMP_MAX_OID - 3);
+	if (snmp->base_len < 0)
+	{
+		return TEMPER_ERR_PARAM;
+	}
+	snmp->columns = columns;
+	snmp->amount_columns = amount_columns;
+	snmp->object = object;
+	snmp->userdata = userdata;
+
+	return TEMPER_OK;
+}
+
+/*
+ * compare_oid
+ *
+ * orders OIDs lexicographically, a prefix first
+ */
+static int compare_oid(const uint32_t *a, int alen, const uint32_t *b, int blen)
+{
+	int cnt;
+
+	for (cnt = 0; (cnt < alen) && (cnt < blen); cnt++)
+	{
+		if (a[cnt] != b[cnt])
+		{
+			return (a[cnt] < b[cnt]) ? -1 : 1;
+		}
+	}
+	return (alen > blen) - (alen < blen);
+}
+
+/*
+ * object
+ *
+ * formats the answer (OID, type and value line) for the object in
+ * column of row, returns false if it does not exist
+ */
+static bool object(const struct temper_snmp *snmp, int column, int row, char *answer, size_t size)
+{
+	char value[256];
+	int cnt;
+	size_t len = 0;
+
+	if (!snmp->object(column, row, value, sizeof(value), snmp->userdata))
+	{
+		return false;
+	}
+	for (cnt = 0; cnt < snmp->base_len; cnt++)
+	{
+		len += snprintf(answer + len, size - len, ".%u", snmp->base[cnt]);
+	}
+	(void)snprintf(answer + len, size - len, ".1.%i.%i\n%s", column, row, value);
+	return true;
+}
+
+/*
+ * lookup
+ *
+ * answers get (next = false) or getnext for the OID given
+ */
+static void lookup(const struct temper_snmp *snmp, int rows, const char *request, bool next, char *answer, size_t size)
+{
+	uint32_t oid[TEMPER_SNMP_MAX_OID];
+	uint32_t candidate[TEMPER_SNMP_MAX_OID];
+	int len;
+	int column;
+	int row;
+
+	(void)snprintf(answer, size, "NONE\n");
+	len = temper_snmp_parse_oid(request, oid, TEMPER_SNMP_MAX_OID);
+	if (len < 0)
+	{
+		return;
+	}
+	memcpy(candidate, snmp->base, snmp->base_len * sizeof(uint32_t));
+	candidate[snmp->base_len] = 1;
+	if (!next)
+	{
+		if ((len == snmp->base_len + 3) && !compare_oid(oid, snmp->base_len + 1, candidate, snmp->base_len + 1) &&
+			(oid[len - 1] >= 1) && (oid[len - 1] <= rows))
+		{
+			(void)object(snmp, oid[len - 2], oid[len - 1], answer, size);
+		}
+		return;
+	}
+	// walking in this order visits the OIDs in ascending order
+	for (column = 0; column < snmp->amount_columns; column++)
+	{
+		candidate[snmp->base_len + 1] = snmp->columns[column];
+		for (row = 1; row <= rows; row++)
+		{
+			candidate[snmp->base_len + 2] = row;
+			if ((compare_oid(candidate, snmp->base_len + 3, oid, len) > 0) &&
+				object(snmp, snmp->columns[column], row, answer, size))
+			{
+				return;
+			}
+		}
+	}
+}
+
+/*
+ * handle_line
+ *
+ * handles one line of input, answers are written to out
+ */
+static void handle_line(struct temper_snmp *snmp, int rows, const char *line, int out)
+{
+	char answer[512];
+	size_t len;
+	size_t done = 0;
+	ssize_t r;
+
+	answer[0] = '\0';
+	if (snmp->arguments == 0)
+	{
+		if (!strcmp(line, "PING"))
+		{
+			strcpy(answer, "PONG\n");
+		}
+		else if (!strcmp(line, "get") || !strcmp(line, "getnext"))
+		{
+			strcpy(snmp->command, line);
+			snmp->arguments = 1;
+		}
+		else if (!strcmp(line, "set"))
+		{
+			// OID and value
+			strcpy(snmp->command, line);
+			snmp->arguments = 2;
+		}
+	}
+	else if (--snmp->arguments == 0)
+	{
+		if (!strcmp(snmp->command, "set"))
+			strcpy(answer, "not-writable\n");
+		else
+			lookup(snmp, rows, line, !strcmp(snmp->command, "getnext"), answer, sizeof(answer));
+	}
+	len = strlen(answer);
+	while (done < len)
+	{
+		r = write(out, answer + done, len - done);
+		if ((r < 0) && (errno != EINTR))
+		{
+			return;
+		}
+		done += (r > 0) ? r : 0;
+	}
+}
+
+TEMPER_LIB_EXPORT bool temper_snmp_input(struct temper_snmp *snmp, int rows, int in, int out)
+{
+	ssize_t r;
+	char *start;
+	char *end;
+
+	if (snmp->used == sizeof(snmp->buf))
+	{
+		// a line this long is no request
+		snmp->used = 0;
+	}
+	r = read(in, snmp->buf + snmp->used, sizeof(snmp->buf) - snmp->used);
+	if (r < 0)
+	{
+		return (errno == EINTR) || (errno == EAGAIN);
+	}
+	if (r == 0)
+	{
+		return false;
+	}
+	snmp->used += r;
+	start = snmp->buf;
+	while ((end = memchr(start, '\n', snmp->buf + snmp->used - start)) != NULL)
+	{
+		*end = '\0';
+		if ((end > start) && (end[-1] == '\r'))
+		{
+			end[-1] = '\0';
+		}
+		handle_line(snmp, rows, start, out);
+		start = end + 1;
+	}
+	snmp->used -= start - snmp->buf;
+	memmove(snmp->buf, start, snmp->used);
+
+	return true;
+}
+
+/*
+ * snmp Copyright (C) 2020-2021 Armin Fuerst (armin@fuerst.priv.at)
+ *
+ * This file is part of tempersensor.
+ *
+ * Tempersensor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tempersensor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tempersensor.  If not, see <https://www.gnu.org/licenses/>.
+ */
@@ -0,0 +1,105 @@
+/*
+ * snmp answers the pass_persist requests of net-snmp: snmpd hands the
+ * get, getnext and set requests below a base OID to a program on its
+ * stdin and reads the answers from its stdout. The objects form a
+ * table, the caller provides their values.
+ * Additional infos (including a license notice) are at the end of this file.
+ */
+
+#ifndef SNMP_H
+#define SNMP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "temper.h"
+
+#define TEMPER_SNMP_MAX_OID 128 /* sub-identifiers of an OID */
+
+/*
+ * table
+ *
+ * the object in column of row is BASE.1.COLUMN.ROW, rows count from 1.
+ * getnext walks the columns in the order given (ascending), the rows
+ * of a column in ascending order and skips objects which don't exist.
+ * set is refused with not-writable.
+ */
+
+/*
+ * temper_snmp_object_cb
+ *
+ * formats the type and value lines of the object in column of row
+ * into value (e.g. "integer\n2350\n"), returns false if it does not
+ * exist
+ */
+typedef bool (*temper_snmp_object_cb)(int column, int row, char *value, size_t size, void *userdata);
+
+/*
+ * struct temper_snmp
+ *
+ * state of the pass_persist protocol, set up by temper_snmp_init:
+ * commands and their arguments arrive as lines, every command is
+ * answered
+ */
+struct temper_snmp
+{
+	uint32_t base[TEMPER_SNMP_MAX_OID];
+	int base_len;
+	const int *columns;
+	int amount_columns;
+	temper_snmp_object_cb object;
+	void *userdata;
+	char buf[1024]; /* input not processed yet */
+	size_t used;
+	char command[16];
+	int arguments; /* lines still expected for command */
+};
+
+/*
+ * temper_snmp_parse_oid
+ *
+ * parses a numeric OID with or without leading dot into oid (max
+ * sub-identifiers), returns the amount of sub-identifiers or -1 if s
+ * is not an OID
+ */
+TEMPER_LIB_EXPORT int temper_snmp_parse_oid(const char *s, uint32_t *oid, int max);
+
+/*
+ * temper_snmp_init
+ *
+ * sets up snmp to answer for the table below base with the columns
+ * given (amount_columns, the array is not copied), returns
+ * TEMPER_ERR_PARAM if base is not an OID or too long
+ */
+TEMPER_LIB_EXPORT int temper_snmp_init(struct temper_snmp *snmp, const char *base, const int *columns, int amount_columns, temper_snmp_object_cb object, void *userdata);
+
+/*
+ * temper_snmp_input
+ *
+ * reads what is available on in and answers every complete request
+ * on out, for a table of rows rows. Returns false at the end of the
+ * input (snmpd went away).
+ */
+TEMPER_LIB_EXPORT bool temper_snmp_input(struct temper_snmp *snmp, int rows, int in, int out);
+
+#endif // SNMP_H
+
+/*
+ * snmp Copyright (C) 2020-2021 Armin Fuerst (armin@fuerst.priv.at)
+ *
+ * This file is part of tempersensor.
+ *
+ * Tempersensor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tempersensor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tempersensor.  If not, see <https://www.gnu.org/licenses/>.
+ */
@@ -0,0 +1,119 @@
+/*
+ * spsc is a lock-free single-producer single-consumer ring buffer
+ * with fixed size slots, used to hand samples from one thread to
+ * another without any mutex.
+ * Additional infos (including a license notice) are at the end of this file.
+ */
+
+#ifndef SPSC_H
+#define SPSC_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SPSC_CACHELINE 64
+
+struct spsc
+{
+	/* written by the producer only */
+	_Alignas(SPSC_CACHELINE) atomic_size_t head;
+	/* written by the consumer only */
+	_Alignas(SPSC_CACHELINE) atomic_size_t tail;
+	_Alignas(SPSC_CACHELINE) size_t mask;
+	size_t elem_size;
+	unsigned char *slots;
+};
+
+/*
+ * spsc_init
+ *
+ * allocates room for capacity elements of elem_size bytes,
+ * capacity is rounded up to the next power of 2.
+ * Returns 0 if out of memory.
+ */
+static inline int spsc_init(struct spsc *q, size_t elem_size, size_t capacity)
+{
+	size_t size = 2;
+
+	while (size < capacity)
+	{
+		size <<= 1;
+	}
+	q->slots = (unsigned char *) malloc(size * elem_size);
+	if (q->slots == NULL)
+	{
+		return 0;
+	}
+	q->mask = size - 1;
+	q->elem_size = elem_size;
+	atomic_init(&q->head, 0);
+	atomic_init(&q->tail, 0);
+	return 1;
+}
+
+static inline void spsc_destroy(struct spsc *q)
+{
+	free(q->slots);
+	q->slots = NULL;
+}
+
+/*
+ * spsc_push
+ *
+ * called by the producer, returns false if the queue is full
+ */
+static inline bool spsc_push(struct spsc *q, const void *elem)
+{
+	size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+	size_t tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+
+	if (head - tail > q->mask)
+	{
+		return false;
+	}
+	memcpy(q->slots + (head & q->mask) * q->elem_size, elem, q->elem_size);
+	atomic_store_explicit(&q->head, head + 1, memory_order_release);
+	return true;
+}
+
+/*
+ * spsc_pop
+ *
+ * called by the consumer, returns false if the queue is empty
+ */
+static inline bool spsc_pop(struct spsc *q, void *elem)
+{
+	size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+	size_t head = atomic_load_explicit(&q->head, memory_order_acquire);
+
+	if (head == tail)
+	{
+		return false;
+	}
+	memcpy(elem, q->slots + (tail & q->mask) * q->elem_size, q->elem_size);
+	atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+	return true;
+}
+
+#endif // SPSC_H
+
+/*
+ * spsc Copyright (C) 2020-2021 Armin Fuerst (armin@fuerst.priv.at)
+ *
+ * This file is part of tempersensor.
+ *
+ * Tempersensor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tempersensor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tempersensor.  If not, see <https://www.gnu.org/licenses/>.
+ */
@@ -0,0 +1,608 @@
+/*
+ * stream pushes samples to local subscribers over a Unix socket. A
+ * sample is encoded once and written to every subscriber wanting it
+ * from that buffer, subscribers falling behind get only the latest
+ * sample of a device or are dropped, sampling never waits for them.
+ * Additional infos (including a license notice) are at the end of this file.
+ */
+
+#define _GNU_SOURCE /* accept4 */
+#include "stream.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
+#define SUBSCRIBE_SIZE 9
+#define SAMPLE_HEADER_SIZE 17 /* without values */
+
+/*
+ * struct temper_stream_client
+ *
+ * a subscriber and the frames it is behind
+ */
+struct temper_stream_client
+{
+	int fd;
+	uint16_t mask[TEMPER_STREAM_DEVICES];
+	struct temper_deadband deadband;
+	struct temper_deadband_state state[TEMPER_STREAM_DEVICES];
+	uint32_t pending[TEMPER_STREAM_BACKLOG]; /* seq of the frames, oldest first */
+	int amount_pending;
+	size_t offset; /* bytes of the first pending frame written */
+	bool writing; /* waiting for the socket to take more */
+	unsigned char in[TEMPER_STREAM_FRAME];
+	size_t in_used;
+};
+
+static void put16(unsigned char *p, uint16_t v)
+{
+	p[0] = v >> 8;
+	p[1] = v;
+}
+
+static uint16_t get16(const unsigned char *p)
+{
+	return ((uint16_t) p[0] << 8) | p[1];
+}
+
+static void drop_client(struct temper_stream *stream, struct temper_stream_client *client)
+{
+	int cnt;
+
+	for (cnt = 0; cnt < stream->amount_clients; cnt++)
+	{
+		if (stream->clients[cnt] == client)
+		{
+			stream->clients[cnt] = stream->clients[--stream->amount_clients];
+			break;
+		}
+	}
+	// closing removes it from epoll_fd
+	close(client->fd);
+	free(client);
+}
+
+static void watch_output(struct temper_stream *stream, struct temper_stream_client *client, bool writing)
+{
+	struct epoll_event ev;
+
+	if (client->writing != writing)
+	{
+		ev.events = EPOLLIN | (writing ? EPOLLOUT : 0);
+		ev.data.ptr = client;
+		(void)epoll_ctl(stream->epoll_fd, EPOLL_CTL_MOD, client->fd, &ev);
+		client->writing = writing;
+	}
+}
+
+/*
+ * flush_client
+ *
+ * writes the pending frames of client straight from the ring with one
+ * gathering call, returns false if the client has to be dropped
+ */
+static bool flush_client(struct temper_stream *stream, struct temper_stream_client *client)
+{
+	struct iovec iov[TEMPER_STREAM_BACKLOG];
+	struct temper_stream_frame *frame;
+	struct msghdr msg;
+	ssize_t r;
+	int cnt;
+
+	while (client->amount_pending > 0)
+	{
+		for (cnt = 0; cnt < client->amount_pending; cnt++)
+		{
+			frame = &stream->ring[client->pending[cnt] % TEMPER_STREAM_RING];
+			if (frame->seq != client->pending[cnt])
+			{
+				// overwritten, the client is too far behind
+				return false;
+			}
+			iov[cnt].iov_base = frame->data + ((cnt == 0) ? client->offset : 0);
+			iov[cnt].iov_len = frame->len - ((cnt == 0) ? client->offset : 0);
+		}
+		// writev, but without SIGPIPE if the client went away
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = iov;
+		msg.msg_iovlen = client->amount_pending;
+		r = sendmsg(client->fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+		if (r < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+			{
+				return false;
+			}
+			watch_output(stream, client, true);
+			return true;
+		}
+		stream->writes++;
+		for (cnt = 0; (cnt < client->amount_pending) && (r >= (ssize_t) iov[cnt].iov_len); cnt++)
+		{
+			r -= iov[cnt].iov_len;
+		}
+		stream->sent += cnt;
+		client->offset = (cnt == 0) ? client->offset + r : r;
+		client->amount_pending -= cnt;
+		memmove(client->pending, client->pending + cnt, client->amount_pending * sizeof(uint32_t));
+	}
+	watch_output(stream, client, false);
+
+	return true;
+}
+
+/*
+ * enqueue
+ *
+ * adds frame to the pending ones of client. A sample not started yet
+ * of the same device is replaced, so a client behind gets the latest
+ * one. Returns false if the client is too far behind.
+ */
+static bool enqueue(struct temper_stream *stream, struct temper_stream_client *client, const struct temper_stream_frame *frame)
+{
+	const struct temper_stream_frame *older;
+	int cnt;
+
+	if (frame->data[2] == TEMPER_STREAM_SAMPLE)
+	{
+		for (cnt = (client->offset > 0) ? 1 : 0; cnt < client->amount_pending; cnt++)
+		{
+			older = &stream->ring[client->pending[cnt] % TEMPER_STREAM_RING];
+			if ((older->seq == client->pending[cnt]) && (older->device == frame->device) &&
+				(older->data[2] == TEMPER_STREAM_SAMPLE))
+			{
+				client->pending[cnt] = frame->seq;
+				stream->coalesced++;
+				return true;
+			}
+		}
+	}
+	if (client->amount_pending == TEMPER_STREAM_BACKLOG)
+	{
+		return false;
+	}
+	client->pending[client->amount_pending++] = frame->seq;
+
+	return true;
+}
+
+/*
+ * wants
+ *
+ * returns true if client subscribed to the sample in frame and it
+ * passes the deadband of the client. Without a deadband and with an
+ * error every sample passes, the deadband still sees it.
+ */
+static bool wants(struct temper_stream_client *client, const struct temper_stream_frame *frame, const struct temper_sample *sample)
+{
+	float values[TEMPER_CHANNELS];
+	uint16_t mask;
+	bool pass;
+	int channel;
+
+	if (frame->data[2] != TEMPER_STREAM_SAMPLE)
+	{
+		return true;
+	}
+	if ((frame->device >= TEMPER_STREAM_DEVICES) || (client->mask[frame->device] == 0))
+	{
+		return false;
+	}
+	// channels not subscribed stay invalid, so they never pass
+	mask = client->mask[frame->device];
+	for (channel = 0; channel < TEMPER_CHANNELS; channel++)
+	{
+		values[channel] = ((mask & (1 << channel)) && (sample->status == TEMPER_OK)) ?
+			sample->values[channel] : TEMPER_INVALID;
+	}
+	// a threshold of 0 lets changes pass only, the same on every channel
+	pass = temper_deadband_pass(&client->deadband, &client->state[frame->device],
+		sample->timestamp_us, values);
+	return pass || (client->deadband.threshold[0] == 0) || (sample->status != TEMPER_OK);
+}
+
+/*
+ * fan_out
+ *
+ * queues frame for the clients wanting it and writes to the ones not
+ * behind, sample is NULL for frames other than samples
+ */
+static void fan_out(struct temper_stream *stream, const struct temper_stream_frame *frame, const struct temper_sample *sample)
+{
+	struct temper_stream_client *client;
+	int cnt;
+
+	// backwards, dropping moves the last client into the gap
+	for (cnt = stream->amount_clients - 1; cnt >= 0; cnt--)
+	{
+		client = stream->clients[cnt];
+		if (!wants(client, frame, sample))
+		{
+			continue;
+		}
+		if (!enqueue(stream, client, frame) ||
+			(!client->writing && !flush_client(stream, client)))
+		{
+			stream->dropped++;
+			drop_client(stream, client);
+		}
+	}
+}
+
+static struct temper_stream_frame *next_frame(struct temper_stream *stream, int device)
+{
+	struct temper_stream_frame *frame = &stream->ring[stream->seq % TEMPER_STREAM_RING];
+
+	frame->seq = stream->seq++;
+	frame->device = device;
+	stream->frames++;
+
+	return frame;
+}
+
+static size_t encode_name(unsigned char *buf, int device, const char *name)
+{
+	size_t len = strlen(name);
+
+	put16(buf, 3 + len);
+	buf[2] = TEMPER_STREAM_NAME;
+	put16(buf + 3, device);
+	memcpy(buf + 5, name, len);
+
+	return 5 + len;
+}
+
+/*
+ * accept_clients
+ *
+ * accepts the waiting clients and sends them the known names
+ */
+static void accept_clients(struct temper_stream *stream)
+{
+	struct temper_stream_client *client;
+	struct epoll_event ev;
+	unsigned char buf[TEMPER_STREAM_DEVICES * TEMPER_STREAM_FRAME];
+	size_t len = 0;
+	int sndbuf = TEMPER_STREAM_SNDBUF;
+	int device;
+	int fd;
+
+	for (device = 0; device < TEMPER_STREAM_DEVICES; device++)
+	{
+		if (stream->names[device][0] != '\0')
+		{
+			len += encode_name(buf + len, device, stream->names[device]);
+		}
+	}
+	while ((fd = accept4(stream->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+	{
+		client = (stream->amount_clients < TEMPER_STREAM_CLIENTS) ?
+			(struct temper_stream_client *) calloc(1, sizeof(*client)) : NULL;
+		// a fresh socket takes the names in one go
+		(void)setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+		if ((client == NULL) || ((len > 0) && (send(fd, buf, len, MSG_NOSIGNAL) != (ssize_t) len)))
+		{
+			free(client);
+			close(fd);
+			continue;
+		}
+		client->fd = fd;
+		ev.events = EPOLLIN;
+		ev.data.ptr = client;
+		if (epoll_ctl(stream->epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0)
+		{
+			free(client);
+			close(fd);
+			continue;
+		}
+		stream->clients[stream->amount_clients++] = client;
+	}
+}
+
+/*
+ * read_client
+ *
+ * handles the subscriptions of client, returns false if it went away
+ * or sent something else
+ */
+static bool read_client(struct temper_stream_client *client)
+{
+	unsigned char *p;
+	uint16_t device;
+	uint16_t mask;
+	ssize_t r;
+	int channel;
+
+	for (;;)
+	{
+		r = recv(client->fd, client->in + client->in_used, sizeof(client->in) - client->in_used, 0);
+		if (r == 0)
+		{
+			return false;
+		}
+		if (r < 0)
+		{
+			return (errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR);
+		}
+		client->in_used += r;
+		for (p = client->in; client->in + client->in_used - p >= 3; p += SUBSCRIBE_SIZE)
+		{
+			if ((get16(p) != SUBSCRIBE_SIZE - 2) || (p[2] != TEMPER_STREAM_SUBSCRIBE))
+			{
+				return false;
+			}
+			if (client->in + client->in_used - p < SUBSCRIBE_SIZE)
+			{
+				break;
+			}
+			device = get16(p + 3);
+			mask = get16(p + 5) & ((1 << TEMPER_CHANNELS) - 1);
+			if (device == TEMPER_STREAM_ALL)
+			{
+				for (device = 0; device < TEMPER_STREAM_DEVICES; device++)
+				{
+					client->mask[device] = mask;
+				}
+			}
+			else if (device < TEMPER_STREAM_DEVICES)
+			{
+				client->mask[device] = mask;
+			}
+			for (channel = 0; channel < TEMPER_CHANNELS; channel++)
+			{
+				client->deadband.threshold[channel] = get16(p + 7) / 100.0;
+			}
+		}
+		client->in_used -= p - client->in;
+		memmove(client->in, p, client->in_used);
+	}
+}
+
+TEMPER_LIB_EXPORT int temper_stream_open(struct temper_stream *stream, const char *path)
+{
+	struct sockaddr_un addr;
+	struct epoll_event ev;
+	struct stat st;
+
+	memset(stream, 0, sizeof(*stream));
+	stream->listen_fd = -1;
+	stream->epoll_fd = -1;
+	if (strlen(path) >= sizeof(addr.sun_path))
+	{
+		return TEMPER_ERR_PARAM;
+	}
+	strcpy(stream->path, path);
+	// a socket left by an earlier run, but nothing else
+	if ((lstat(path, &st) == 0) && S_ISSOCK(st.st_mode))
+	{
+		(void)unlink(path);
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	stream->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	stream->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL;
+	if ((stream->listen_fd < 0) || (stream->epoll_fd < 0) ||
+		(bind(stream->listen_fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) ||
+		(listen(stream->listen_fd, 128) != 0) ||
+		(epoll_ctl(stream->epoll_fd, EPOLL_CTL_ADD, stream->listen_fd, &ev) != 0))
+	{
+		temper_stream_close(stream);
+		return TEMPER_ERR_OPEN;
+	}
+
+	return TEMPER_OK;
+}
+
+TEMPER_LIB_EXPORT void temper_stream_name(struct temper_stream *stream, int device, const char *name)
+{
+	struct temper_stream_frame *frame;
+
+	if ((device < 0) || (device >= TEMPER_STREAM_DEVICES))
+	{
+		return;
+	}
+	(void)snprintf(stream->names[device], TEMPER_STREAM_NAME_SIZE, "%s", name);
+	frame = next_frame(stream, device);
+	frame->len = encode_name(frame->data, device, stream->names[device]);
+	fan_out(stream, frame, NULL);
+}
+
+TEMPER_LIB_EXPORT void temper_stream_sample(struct temper_stream *stream, const struct temper_sample *sample)
+{
+	struct temper_stream_frame *frame;
+	unsigned char *p;
+	float hundredths;
+	uint16_t mask = 0;
+	int channel;
+
+	if (stream->amount_clients == 0)
+	{
+		return;
+	}
+	frame = next_frame(stream, sample->device);
+	p = frame->data;
+	p[2] = TEMPER_STREAM_SAMPLE;
+	put16(p + 3, sample->device);
+	p[5] = (uint8_t)(int8_t) sample->status;
+	p[6] = 0;
+	put16(p + 7, sample->timestamp_us >> 48);
+	put16(p + 9, sample->timestamp_us >> 32);
+	put16(p + 11, sample->timestamp_us >> 16);
+	put16(p + 13, sample->timestamp_us);
+	frame->len = SAMPLE_HEADER_SIZE;
+	for (channel = 0; channel < TEMPER_CHANNELS; channel++)
+	{
+		hundredths = sample->values[channel] * 100.0;
+		if ((sample->values[channel] <= TEMPER_INVALID) || (hundredths < -32767.0) || (hundredths > 32767.0))
+		{
+			continue;
+		}
+		mask |= 1 << channel;
+		put16(p + frame->len, (int16_t)(hundredths + ((hundredths < 0) ? -0.5 : 0.5)));
+		frame->len += 2;
+	}
+	put16(p + 15, mask);
+	put16(p, frame->len - 2);
+	fan_out(stream, frame, sample);
+}
+
+TEMPER_LIB_EXPORT int temper_stream_tick(struct temper_stream *stream)
+{
+	struct epoll_event events[64];
+	struct temper_stream_client *client;
+	int handled = 0;
+	int n;
+	int cnt;
+
+	do
+	{
+		n = epoll_wait(stream->epoll_fd, events, sizeof(events) / sizeof(events[0]), 0);
+		for (cnt = 0; cnt < n; cnt++)
+		{
+			client = (struct temper_stream_client *) events[cnt].data.ptr;
+			if (client == NULL)
+			{
+				accept_clients(stream);
+				continue;
+			}
+			if ((events[cnt].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && !read_client(client))
+			{
+				// gone or not speaking the protocol
+				drop_client(stream, client);
+			}
+			else if ((events[cnt].events & EPOLLOUT) && !flush_client(stream, client))
+			{
+				stream->dropped++;
+				drop_client(stream, client);
+			}
+		}
+		handled += (n > 0) ? n : 0;
+	} while (n == sizeof(events) / sizeof(events[0]));
+
+	return handled;
+}
+
+TEMPER_LIB_EXPORT void temper_stream_poll(struct temper_stream *stream, struct pollfd *pfd)
+{
+	pfd->fd = stream->epoll_fd;
+	pfd->events = POLLIN;
+}
+
+TEMPER_LIB_EXPORT void temper_stream_close(struct temper_stream *stream)
+{
+	while (stream->amount_clients > 0)
+	{
+		drop_client(stream, stream->clients[0]);
+	}
+	if (stream->listen_fd >= 0)
+	{
+		close(stream->listen_fd);
+		(void)unlink(stream->path);
+		stream->listen_fd = -1;
+	}
+	if (stream->epoll_fd >= 0)
+	{
+		close(stream->epoll_fd);
+		stream->epoll_fd = -1;
+	}
+}
+
+TEMPER_LIB_EXPORT size_t temper_stream_subscribe(unsigned char *buf, int device, uint16_t mask, float deadband)
+{
+	put16(buf, SUBSCRIBE_SIZE - 2);
+	buf[2] = TEMPER_STREAM_SUBSCRIBE;
+	put16(buf + 3, device);
+	put16(buf + 5, mask);
+	put16(buf + 7, (uint16_t)(deadband * 100.0 + 0.5));
+
+	return SUBSCRIBE_SIZE;
+}
+
+TEMPER_LIB_EXPORT int temper_stream_decode(const unsigned char *buf, size_t len, struct temper_stream_message *msg)
+{
+	const unsigned char *p;
+	size_t size;
+	uint16_t mask;
+	int channel;
+
+	if ((len < 3) || (len < 2 + (size_t) get16(buf)))
+	{
+		return 0;
+	}
+	size = 2 + get16(buf);
+	memset(msg, 0, sizeof(*msg));
+	msg->type = buf[2];
+	if ((size < 5) || (size > TEMPER_STREAM_FRAME))
+	{
+		return TEMPER_ERR_PARAM;
+	}
+	msg->device = get16(buf + 3);
+	if (msg->type == TEMPER_STREAM_NAME)
+	{
+		if (size - 5 >= TEMPER_STREAM_NAME_SIZE)
+		{
+			return TEMPER_ERR_PARAM;
+		}
+		memcpy(msg->name, buf + 5, size - 5);
+		return size;
+	}
+	if ((msg->type != TEMPER_STREAM_SAMPLE) || (size < SAMPLE_HEADER_SIZE))
+	{
+		return TEMPER_ERR_PARAM;
+	}
+	msg->status = (int8_t) buf[5];
+	msg->timestamp_us = ((uint64_t) get16(buf + 7) << 48) | ((uint64_t) get16(buf + 9) << 32) |
+		((uint64_t) get16(buf + 11) << 16) | get16(buf + 13);
+	mask = get16(buf + 15);
+	p = buf + SAMPLE_HEADER_SIZE;
+	for (channel = 0; channel < TEMPER_CHANNELS; channel++)
+	{
+		msg->values[channel] = TEMPER_INVALID;
+		if (!(mask & (1 << channel)))
+		{
+			continue;
+		}
+		if (p + 2 > buf + size)
+		{
+			return TEMPER_ERR_PARAM;
+		}
+		msg->values[channel] = (int16_t) get16(p) / 100.0;
+		p += 2;
+	}
+
+	return (p == buf + size) ? (int) size : TEMPER_ERR_PARAM;
+}
+
+
+/*
+ * stream Copyright (C) 2020-2021 Armin Fuerst (armin@fuerst.priv.at)
+ *
+ * This file is part of tempersensor.
+ *
+ * Tempersensor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tempersensor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tempersensor.  If not, see <https://www.gnu.org/licenses/>.
+ */
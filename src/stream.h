@@ -0,0 +1,190 @@
+/*
+ * stream pushes samples to local subscribers over a Unix socket. A
+ * sample is encoded once and written to every subscriber wanting it
+ * from that buffer, subscribers falling behind get only the latest
+ * sample of a device or are dropped, sampling never waits for them.
+ * Additional infos (including a license notice) are at the end of this file.
+ */
+
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <poll.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "deadband.h"
+#include "sampler.h"
+#include "temper.h"
+
+/*
+ * frame format
+ *
+ * all numbers in network byte order, every frame starts with its
+ * length (u16, bytes following) and type (u8):
+ *
+ *   SUBSCRIBE  client to server: device (u16, TEMPER_STREAM_ALL = every
+ *              device), channel mask (u16, 0 = unsubscribe), deadband
+ *              (u16, hundredths, 0 = every sample). The deadband applies
+ *              to all devices of the client, the last one sent wins.
+ *   NAME       server to client: device (u16), name (the rest), sent for
+ *              every known device on connect and when a device is added
+ *   SAMPLE     server to client: device (u16), status (i8, TEMPER_OK or
+ *              TEMPER_ERR_*), 0 (u8), timestamp (u64, microseconds since
+ *              the epoch), channel mask (u16), one value (i16, hundredths)
+ *              per bit set, lowest channel first
+ *
+ * a sample is sent if a subscribed channel moved by the deadband, every
+ * sample without a deadband and every sample with an error status, a
+ * client gets all channels of it
+ */
+#define TEMPER_STREAM_SUBSCRIBE 1
+#define TEMPER_STREAM_NAME 2
+#define TEMPER_STREAM_SAMPLE 3
+#define TEMPER_STREAM_ALL 0xffff
+
+#define TEMPER_STREAM_FRAME 64 /* largest frame */
+#define TEMPER_STREAM_NAME_SIZE 48 /* longest name sent, with '\0' */
+#define TEMPER_STREAM_RING 1024 /* frames kept for clients not reading */
+#define TEMPER_STREAM_BACKLOG 64 /* frames a client may be behind */
+#define TEMPER_STREAM_DEVICES 64 /* devices a client can subscribe to */
+#define TEMPER_STREAM_CLIENTS 1024
+#define TEMPER_STREAM_SNDBUF 16384 /* socket buffer per client */
+
+/*
+ * struct temper_stream_frame
+ *
+ * an encoded frame in the ring
+ */
+struct temper_stream_frame
+{
+	uint32_t seq; /* number of the frame, tells if it was overwritten */
+	int device;
+	size_t len;
+	unsigned char data[TEMPER_STREAM_FRAME];
+};
+
+struct temper_stream_client;
+
+/*
+ * struct temper_stream
+ *
+ * the socket and its subscribers, set up by temper_stream_open
+ */
+struct temper_stream
+{
+	int listen_fd;
+	int epoll_fd; /* listen_fd and the clients */
+	char path[108];
+	struct temper_stream_frame ring[TEMPER_STREAM_RING];
+	uint32_t seq; /* of the next frame */
+	char names[TEMPER_STREAM_DEVICES][TEMPER_STREAM_NAME_SIZE];
+	struct temper_stream_client *clients[TEMPER_STREAM_CLIENTS];
+	int amount_clients;
+	unsigned long frames; /* frames encoded */
+	unsigned long sent; /* frames written to clients */
+	unsigned long writes; /* system calls writing them */
+	unsigned long coalesced; /* samples replaced by a newer one before sent */
+	unsigned long dropped; /* clients disconnected for falling behind or errors */
+};
+
+/*
+ * struct temper_stream_message
+ *
+ * decoded frame, channels not sent are TEMPER_INVALID
+ */
+struct temper_stream_message
+{
+	int type;
+	int device;
+	int status;
+	uint64_t timestamp_us;
+	float values[TEMPER_CHANNELS];
+	char name[TEMPER_STREAM_NAME_SIZE];
+};
+
+/*
+ * temper_stream_open
+ *
+ * listens at the Unix socket path, replacing a socket left there
+ */
+TEMPER_LIB_EXPORT int temper_stream_open(struct temper_stream *stream, const char *path);
+
+/*
+ * temper_stream_name
+ *
+ * names device for the clients, sent to the ones connected and to the
+ * ones connecting later
+ */
+TEMPER_LIB_EXPORT void temper_stream_name(struct temper_stream *stream, int device, const char *name);
+
+/*
+ * temper_stream_sample
+ *
+ * encodes sample once and writes it to the clients subscribed, without
+ * waiting for any of them
+ */
+TEMPER_LIB_EXPORT void temper_stream_sample(struct temper_stream *stream, const struct temper_sample *sample);
+
+/*
+ * temper_stream_tick
+ *
+ * accepts clients, reads their subscriptions and writes to the ones
+ * behind which can take more. Returns the amount of events handled,
+ * due when the descriptor set by temper_stream_poll is ready.
+ */
+TEMPER_LIB_EXPORT int temper_stream_tick(struct temper_stream *stream);
+
+/*
+ * temper_stream_poll
+ *
+ * sets pfd to wait for events of stream
+ */
+TEMPER_LIB_EXPORT void temper_stream_poll(struct temper_stream *stream, struct pollfd *pfd);
+
+/*
+ * temper_stream_close
+ *
+ * disconnects the clients and removes the socket
+ */
+TEMPER_LIB_EXPORT void temper_stream_close(struct temper_stream *stream);
+
+/*
+ * temper_stream_subscribe
+ *
+ * encodes a SUBSCRIBE frame into buf (at least 9 bytes), returns
+ * its size
+ */
+TEMPER_LIB_EXPORT size_t temper_stream_subscribe(unsigned char *buf, int device, uint16_t mask, float deadband);
+
+/*
+ * temper_stream_decode
+ *
+ * decodes the frame at the start of buf (len bytes) into msg, returns
+ * its size, 0 if it is not complete or TEMPER_ERR_PARAM if it is
+ * malformed
+ */
+TEMPER_LIB_EXPORT int temper_stream_decode(const unsigned char *buf, size_t len, struct temper_stream_message *msg);
+
+#endif // STREAM_H
+
+
+/*
+ * stream Copyright (C) 2020-2021 Armin Fuerst (armin@fuerst.priv.at)
+ *
+ * This file is part of tempersensor.
+ *
+ * Tempersensor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tempersensor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tempersensor.  If not, see <https://www.gnu.org/licenses/>.
+ */
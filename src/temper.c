@@ -0,0 +1,1218 @@
+/*
+ * libtempersensor is a library to read values from TEMPer USB devices
+ * from RDing (www.pcsensor.com). It keeps all state in a context
+ * handle, so several devices can be used in parallel and from threads.
+ * Additional infos (including a license notice) are at the end of this file.
+ */
+
+// https://github.com/urwen/temper - probably additional infos...
+
+#include "temper.h"
+#include "decode.h"
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/select.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/usbdevice_fs.h>
+
+/*
+ * Temper magic strings
+ *
+ */
+
+//const static unsigned char query_vals[] = { 0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+const static unsigned char query_vals[] = { 0x01, 0x80, 0x33, 0x01, 0x00, 0x00, 0x00, 0x00 };
+#ifndef TEMPER_SINGLE_PROFILE
+const static unsigned char query_firmware[] = { 0x01, 0x86, 0xff, 0x01, 0x00, 0x00, 0x00, 0x00 };
+#endif
+#define ANSWERSIZE TEMPER_REPORT_SIZE
+#define RETRIES 10
+#define READ_TIMEOUT_MS 1000
+#define RECOVER_POLL_MS 100 /* checks for the hidraw node after a reset */
+
+/*
+ * list of vendor IDs and product IDs being supported
+ * the order of the two arrays is relevant, only the
+ * nth entry of both arrays in combination define a
+ * supported device.
+ */
+const static unsigned short vendorId[] =
+{
+	0x1130, // Tenx Technology, Inc. Foot Pedal/Thermometer (untested)
+	0x0c45, // TEMPer / TEMPer1F_V1.3r1F (tested),
+		// TEMPer / TEMPerF1.4 (some tests)
+	0x413d, // TEMPer / TEMPerGold_V3.1 (untested),
+		// TEMPerHUM / TEMPerX_V3.1 (untested),
+		// TEMPerHUM / TEMPerX_V3.3 (tested),
+		// TEMPer2 / TEMPerX_V3.3 (untested)
+		// TEMPer1F / TEMPerX_V3.3 (untested)
+	0x1a86  // TEMPerX232 / TEMPerX232_V2.0 (untested)
+};
+const static unsigned short productId[] =
+{
+	0x660c,
+	0x7401,
+	0x2107,
+	0x5523
+};
+
+/*
+ * profiles
+ *
+ * The software is only tested with TEMPer1F_V1.3, TEMPerF1.4
+ * and TEMPerHUM reporting as 'TEMPerX_V3.3'. Configuration of
+ * all other devices is collected from several forums and from
+ * https://github.com/urwen/temper
+ * The first profile matching vendor ID, product ID and the
+ * beginning of the firmware string is used, a firmware of
+ * NULL matches every firmware.
+ */
+struct temper_profile
+{
+	uint16_t vendor_id;
+	uint16_t product_id;
+	const char *firmware;
+	size_t firmware_len; /* amount of characters to compare */
+	const char *detected; /* description for debug output */
+	int amount_value_responses; /* amount of responses to value-request */
+	int conversion_method; /* 0 = device not supported */
+	int sensors[2][2]; /* define which part of the response defines which sensor */
+	int in_sensor; /* default sensor to report as "IN" */
+	int out_sensor; /* default sensor to report as "OUT" */
+};
+
+const static struct temper_profile profiles[] =
+{
+#if !defined(TEMPER_SINGLE_PROFILE) || defined(TEMPER_PROFILE_TEMPer1F_V1_3)
+	{ 0x0c45, 0x7401, "TEMPer1F_V1.3r1F", 13, "TEMPer1F_V1.3", 1, 1,
+		{ { TEMPER_NO_SENSOR, TEMPER_EXT_TEMP }, { TEMPER_NO_SENSOR, TEMPER_NO_SENSOR } },
+		TEMPER_EXT_TEMP, TEMPER_EXT_TEMP },
+#endif
+#if !defined(TEMPER_SINGLE_PROFILE) || defined(TEMPER_PROFILE_TEMPerF1_4)
+	{ 0x0c45, 0x7401, "TEMPerF1.4", 10, "TEMPer1F1.4", 1, 1,
+		{ { TEMPER_INT_TEMP, TEMPER_NO_SENSOR }, { TEMPER_NO_SENSOR, TEMPER_NO_SENSOR } },
+		TEMPER_INT_TEMP, TEMPER_INT_TEMP },
+#endif
+#ifndef TEMPER_SINGLE_PROFILE
+	/*
+	 * TODO: learn details about this device
+	 *  - does it reply properly to the firmware?
+	 *  - which firmware-replies are known
+	 *  - from some postings the sensors are assumed to be
+	 *    identical to "TEMPer1F_V1.3", but there is no confirmation
+	 */
+	{ 0x1130, 0x660c, NULL, 0, "Tenx Technology, Inc. Foot Pedal/Thermometer (untested)", 1, 1,
+		{ { TEMPER_NO_SENSOR, TEMPER_INT_TEMP }, { TEMPER_NO_SENSOR, TEMPER_NO_SENSOR } },
+		TEMPER_INT_TEMP, TEMPER_INT_TEMP },
+	/*
+	 * TODO: https://github.com/urwen/temper has a description
+	 * how these devices can be interacted with - they seem to be
+	 * very different, probably they are too different to be
+	 * implemented?
+	 */
+	{ 0x1a86, 0x5523, NULL, 0, "TEMPerX232 / TEMPerX232_V2.0 (1a86:5523)", 0, 0,
+		{ { TEMPER_NO_SENSOR, TEMPER_NO_SENSOR }, { TEMPER_NO_SENSOR, TEMPER_NO_SENSOR } },
+		TEMPER_NO_SENSOR, TEMPER_NO_SENSOR },
+#endif
+	/*
+	 * configuration based on the implementation of
+	 * https://github.com/urwen/temper/blob/master/temper.py
+	 */
+#if !defined(TEMPER_SINGLE_PROFILE) || defined(TEMPER_PROFILE_TEMPerGold_V3_1)
+	{ 0x413d, 0x2107, "TEMPerGold_V3.1", 15, "TEMPerGold_V3.1 (untested!)", 1, 2,
+		{ { TEMPER_INT_TEMP, TEMPER_NO_SENSOR }, { TEMPER_NO_SENSOR, TEMPER_NO_SENSOR } },
+		TEMPER_INT_TEMP, TEMPER_INT_TEMP },
+#endif
+#if !defined(TEMPER_SINGLE_PROFILE) || defined(TEMPER_PROFILE_TEMPerX_V3_1)
+	{ 0x413d, 0x2107, "TEMPerX_V3.1", 12, "TEMPerX_V3.1 (untested!)", 2, 2,
+		{ { TEMPER_INT_TEMP, TEMPER_INT_HUM }, { TEMPER_EXT_TEMP, TEMPER_EXT_HUM } },
+		TEMPER_INT_HUM, TEMPER_INT_TEMP },
+#endif
+#if !defined(TEMPER_SINGLE_PROFILE) || defined(TEMPER_PROFILE_TEMPerX_V3_3)
+	{ 0x413d, 0x2107, "TEMPerX_V3.3", 12, "TEMPerX_V3.3", 1, 2,
+		{ { TEMPER_INT_TEMP, TEMPER_INT_HUM }, { TEMPER_NO_SENSOR, TEMPER_NO_SENSOR } },
+		TEMPER_INT_HUM, TEMPER_INT_TEMP },
+#endif
+};
+
+/*
+ * struct decoder
+ *
+ * converts a raw value with one table lookup: raw values with
+ * any invalid bit set are invalid, the others are looked up
+ * at raw >> shift
+ */
+struct decoder
+{
+	const float *table;
+	uint16_t invalid;
+	int shift;
+};
+
+/* shifting out all 16 bits maps every raw value to this entry */
+static const float invalid_table[] = { TEMPER_INVALID };
+#define INVALID_DECODER { invalid_table, 0, 16 }
+
+/*
+ * The table of method 2 takes 256 KiB, more than everything else
+ * together. Single profile builds are meant for small flash, so they
+ * calculate method 2 (a decoder without table) instead, which gives
+ * exactly the same results.
+ */
+#if defined(TEMPER_SINGLE_PROFILE) && (TEMPER_PROFILE_METHOD == 2)
+	#define CALCULATE_METHOD2
+#endif
+
+/*
+ * indexed by conversion method, a single profile build only
+ * references (and links) the table of its own method
+ */
+static const struct decoder decoders[] =
+{
+	INVALID_DECODER,
+#if !defined(TEMPER_SINGLE_PROFILE) || (TEMPER_PROFILE_METHOD == 1)
+	{ temper_decode_method1, DECODE_METHOD1_INVALID, DECODE_METHOD1_SHIFT },
+#else
+	INVALID_DECODER,
+#endif
+#if defined(CALCULATE_METHOD2)
+	{ NULL, 0, 0 },
+#elif !defined(TEMPER_SINGLE_PROFILE)
+	{ temper_decode_method2, 0, 0 },
+#else
+	INVALID_DECODER,
+#endif
+};
+
+struct temper_ctx
+{
+	int debug;
+	int fd;
+	uint16_t vendor_id;
+	uint16_t product_id;
+	char firmware[17];
+	int conversion_override; /* -1 = use conversion method of profile */
+	const struct temper_profile *profile;
+	int conversion_method;
+	struct decoder decoder; /* table for conversion_method */
+	unsigned long syscalls; /* system calls used to talk to the device */
+	char devpath[261]; /* hidraw node, empty if opened by temper_open_fd */
+	temper_reset_cb reset; /* replaces the USB reset in temper_recover */
+	void *reset_data;
+	char errmsg[128];
+};
+
+/*
+ * debug_print
+ */
+
+static void debug_print(const struct temper_ctx *ctx, const char *format, ...)
+{
+	va_list args;
+	va_start(args, format);
+
+	if (ctx->debug > 0)
+	{
+		vfprintf(stderr, format, args);
+	}
+
+	va_end(args);
+}
+
+/*
+ * debug_print_byte
+ */
+static void debug_print_byte(const struct temper_ctx *ctx, const unsigned char *string, size_t ssize, const char *format, ...)
+{
+	int c = 0;
+	va_list args;
+
+	if (ctx->debug <= 0)
+	{
+		return;
+	}
+	va_start(args, format);
+	while (c<ssize)
+	{
+		fprintf(stderr, "%02x ", string[c] & 0xFF);
+		c++;
+	}
+	fprintf(stderr, "(");
+	vfprintf(stderr, format, args);
+	fprintf(stderr, ")\n");
+
+	va_end(args);
+}
+
+/*
+ * set_error
+ *
+ * stores the errormessage in the context, if errnum is not 0
+ * the textual representation of the errno error is appended
+ */
+
+static int set_error(struct temper_ctx *ctx, int err, int errnum, const char *format, ...)
+{
+	va_list args;
+	size_t len;
+	char errtext[64];
+
+	va_start(args, format);
+	(void)vsnprintf(ctx->errmsg, sizeof(ctx->errmsg), format, args);
+	va_end(args);
+	if (errnum != 0)
+	{
+		if (strerror_r(errnum, errtext, sizeof(errtext)) != 0)
+		{
+			(void)snprintf(errtext, sizeof(errtext), "error %i", errnum);
+		}
+		len = strlen(ctx->errmsg);
+		(void)snprintf(ctx->errmsg + len, sizeof(ctx->errmsg) - len, ": %s", errtext);
+	}
+	debug_print(ctx, "%s\n", ctx->errmsg);
+
+	return err;
+}
+
+/*
+ * set_conversion
+ *
+ * selects the decoder once, so parsing a report does not need
+ * to look at the conversion method again
+ */
+
+static void set_conversion(struct temper_ctx *ctx, int conversion_method)
+{
+	ctx->conversion_method = conversion_method;
+	if ((conversion_method < 1) || (conversion_method > 2))
+	{
+		conversion_method = 0;
+	}
+	ctx->decoder = decoders[conversion_method];
+}
+
+TEMPER_LIB_EXPORT bool temper_is_supported(uint16_t vendor_id, uint16_t product_id)
+{
+	int known_devices;
+	int cnt = 0;
+
+	// calculate how many devices are in the list of supported devices
+	known_devices = sizeof(vendorId) / sizeof(vendorId[0]);
+
+	while (cnt < known_devices)
+	{
+		if ((vendor_id == vendorId[cnt])
+			&& (product_id == productId[cnt]))
+		{
+			return true;
+		}
+		cnt++;
+	}
+	return false;
+}
+
+/*
+ * discovery
+ *
+ * uses /sys-dirstructure to find the appropriate hidraw devices
+ */
+
+struct discovery
+{
+	struct temper_devinfo *list;
+	int max;
+	int found;
+};
+
+/*
+ * struct dir_reader
+ *
+ * reads a directory with getdents64 into a buffer on the stack. Unlike
+ * opendir nothing is allocated, the search runs again while a device
+ * is recovered.
+ */
+
+struct dir_reader
+{
+	int fd;
+	uint64_t buf[256]; /* aligned for the entries */
+	long used;
+	long pos;
+};
+
+struct dir_entry
+{
+	uint64_t d_ino;
+	int64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+
+static int dir_open(struct dir_reader *dir, const char *path)
+{
+	dir->fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	dir->used = 0;
+	dir->pos = 0;
+	return dir->fd >= 0;
+}
+
+static struct dir_entry *dir_read(struct dir_reader *dir)
+{
+	struct dir_entry *entry;
+
+	if (dir->pos >= dir->used)
+	{
+		dir->used = syscall(__NR_getdents64, dir->fd, dir->buf, sizeof(dir->buf));
+		dir->pos = 0;
+		if (dir->used <= 0)
+		{
+			return NULL;
+		}
+	}
+	entry = (struct dir_entry *)((char *) dir->buf + dir->pos);
+	dir->pos += entry->d_reclen;
+	return entry;
+}
+
+static int read_id(const char *base_path, const char *name, uint16_t *id)
+{
+	int fd;
+	int r;
+	char filepath[PATH_MAX];
+	char buf[16];
+
+	(void)snprintf(filepath, sizeof(filepath), "%s/../../../%s", base_path, name);
+	fd = open(filepath, O_RDONLY);
+	if (fd < 0)
+	{
+		return 0;
+	}
+	r = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (r < 0)
+	{
+		return 0;
+	}
+	buf[r] = 0;
+	*id = strtol(buf, NULL, 16);
+	return 1;
+}
+
+static int add_hiddev(struct discovery *disc, const char *base_path)
+{
+	struct temper_devinfo dev;
+	struct dir_reader dir;
+	struct dir_entry *dp;
+
+	/* hidraw devices not connected by USB have no IDs, skip them */
+	if (!read_id(base_path, "idVendor", &dev.vendor_id)
+		|| !read_id(base_path, "idProduct", &dev.product_id)
+		|| !temper_is_supported(dev.vendor_id, dev.product_id))
+	{
+		return 1;
+	}
+
+	/* get device name */
+	dev.devpath[0] = 0;
+	if (!dir_open(&dir, base_path))
+	{
+		return 0;
+	}
+	while ((dp = dir_read(&dir)) != NULL)
+	{
+		if (strstr(dp->d_name, "hidraw"))
+		{
+			(void)snprintf(dev.devpath, sizeof(dev.devpath), "/dev/%s", dp->d_name);
+		}
+	}
+	close(dir.fd);
+
+	if (disc->found < disc->max)
+	{
+		disc->list[disc->found] = dev;
+	}
+	disc->found++;
+	return 1;
+}
+
+static int find_hidraw(struct discovery *disc, const char *base_path)
+{
+	char path[PATH_MAX];
+	struct dir_reader dir;
+	struct dir_entry *dp;
+
+	if (!dir_open(&dir, base_path))
+		return 1;
+
+	while ((dp = dir_read(&dir)) != NULL)
+	{
+		if ((strcmp(dp->d_name, ".") != 0 && strcmp(dp->d_name, "..") != 0)
+			&& (dp->d_type != DT_LNK))
+		{
+			(void)snprintf(path, sizeof(path), "%s/%s", base_path, dp->d_name);
+			if (!strcmp(dp->d_name, "hidraw"))
+			{
+				if (!add_hiddev(disc, path))
+				{
+					close(dir.fd);
+					return 0;
+				}
+			}
+			else if (!find_hidraw(disc, path))
+			{
+				close(dir.fd);
+				return 0;
+			}
+		}
+	}
+
+	close(dir.fd);
+	return 1;
+}
+
+TEMPER_LIB_EXPORT int temper_discover(struct temper_devinfo *list, int max, int *found)
+{
+	struct discovery disc;
+
+	if ((list == NULL) && (max > 0))
+	{
+		return TEMPER_ERR_PARAM;
+	}
+	disc.list = list;
+	disc.max = max;
+	disc.found = 0;
+	if (!find_hidraw(&disc, "/sys/devices"))
+	{
+		return TEMPER_ERR_SCAN;
+	}
+	if (found != NULL)
+	{
+		*found = disc.found;
+	}
+	if (disc.found == 0)
+	{
+		return TEMPER_ERR_NODEVICE;
+	}
+	return TEMPER_OK;
+}
+
+TEMPER_LIB_EXPORT struct temper_ctx *temper_new()
+{
+	struct temper_ctx *ctx;
+
+	ctx = (struct temper_ctx *) calloc(1, sizeof(struct temper_ctx));
+	if (ctx == NULL)
+	{
+		return NULL;
+	}
+	ctx->fd = -1;
+	ctx->conversion_override = -1;
+	set_conversion(ctx, -1);
+
+	return ctx;
+}
+
+TEMPER_LIB_EXPORT void temper_free(struct temper_ctx *ctx)
+{
+	if (ctx == NULL)
+	{
+		return;
+	}
+	temper_close(ctx);
+	free(ctx);
+}
+
+TEMPER_LIB_EXPORT void temper_set_debug(struct temper_ctx *ctx, int debug)
+{
+	ctx->debug = debug;
+}
+
+TEMPER_LIB_EXPORT int temper_set_conversion_method(struct temper_ctx *ctx, int method)
+{
+	if ((method != -1) && ((method < 1) || (method > 2)))
+	{
+		return set_error(ctx, TEMPER_ERR_PARAM, 0,
+			"Invalid value for conversion-method: '%i'", method);
+	}
+	ctx->conversion_override = method;
+	if (ctx->profile != NULL)
+	{
+		set_conversion(ctx, (method == -1) ?
+			ctx->profile->conversion_method : method);
+	}
+
+	return TEMPER_OK;
+}
+
+TEMPER_LIB_EXPORT int temper_open_fd(struct temper_ctx *ctx, int fd, uint16_t vendor_id, uint16_t product_id)
+{
+	temper_close(ctx);
+	ctx->fd = fd;
+	ctx->vendor_id = vendor_id;
+	ctx->product_id = product_id;
+
+	return TEMPER_OK;
+}
+
+TEMPER_LIB_EXPORT int temper_open(struct temper_ctx *ctx, const struct temper_devinfo *info)
+{
+	int fd;
+
+	fd = open(info->devpath, O_RDWR);
+	if (fd < 0)
+	{
+		return set_error(ctx, TEMPER_ERR_OPEN, errno, "Error opening device");
+	}
+	debug_print(ctx, "Will use '%s'\n", info->devpath);
+	(void)temper_open_fd(ctx, fd, info->vendor_id, info->product_id);
+	(void)snprintf(ctx->devpath, sizeof(ctx->devpath), "%s", info->devpath);
+
+	return TEMPER_OK;
+}
+
+TEMPER_LIB_EXPORT void temper_close(struct temper_ctx *ctx)
+{
+	if (ctx->fd >= 0)
+	{
+		close(ctx->fd);
+	}
+	ctx->fd = -1;
+	ctx->profile = NULL;
+	set_conversion(ctx, -1);
+	ctx->firmware[0] = 0;
+	ctx->devpath[0] = 0;
+	free(ctx->reset_data);
+	ctx->reset = NULL;
+	ctx->reset_data = NULL;
+}
+
+TEMPER_LIB_EXPORT void temper_set_reset(struct temper_ctx *ctx, temper_reset_cb reset, void *data)
+{
+	free(ctx->reset_data);
+	ctx->reset = reset;
+	ctx->reset_data = data;
+}
+
+static int send_command(struct temper_ctx *ctx, const char *cmdname, const unsigned char *question, size_t qsize)
+{
+	int r;
+
+	debug_print_byte(ctx, question, qsize, "command '%s' sent", cmdname);
+	ctx->syscalls++;
+	r = write(ctx->fd, question, qsize);
+	if (r < 0)
+	{
+		return set_error(ctx, TEMPER_ERR_WRITE, errno,
+			"Error sending command '%s'", cmdname);
+	}
+
+	return TEMPER_OK;
+}
+
+static int read_timeout(struct temper_ctx *ctx, void *buf, size_t count)
+{
+	fd_set set;
+	struct timeval timeout;
+	int rv;
+	int r;
+
+	FD_ZERO(&set);
+	FD_SET(ctx->fd, &set);
+
+	timeout.tv_sec = READ_TIMEOUT_MS / 1000;
+	timeout.tv_usec = (READ_TIMEOUT_MS % 1000) * 1000;
+
+	ctx->syscalls++;
+	rv = select(ctx->fd + 1, &set, NULL, NULL, &timeout);
+	if (rv == -1)
+		return -1;
+	else if (rv == 0)
+		return -2;
+
+	ctx->syscalls++;
+	r = read(ctx->fd, buf, count);
+	if (r < 0)
+		return -1;
+
+	return r;
+}
+
+static int read_answer(struct temper_ctx *ctx, const char *cmdname, unsigned char *answer)
+{
+	int r;
+
+	r = read_timeout(ctx, answer, ANSWERSIZE);
+	if (r == -2)
+	{
+		return set_error(ctx, TEMPER_ERR_TIMEOUT, 0,
+			"Error reading response to '%s': Timeout", cmdname);
+	}
+	else if (r < 0)
+	{
+		return set_error(ctx, TEMPER_ERR_READ, errno,
+			"Error reading response to '%s'", cmdname);
+	}
+	debug_print_byte(ctx, answer, ANSWERSIZE, "response to '%s'", cmdname);
+
+	return TEMPER_OK;
+}
+
+#ifndef TEMPER_SINGLE_PROFILE
+static int get_firmware_string(struct temper_ctx *ctx)
+{
+	int r;
+	unsigned char answer[ANSWERSIZE + 1];
+	int cnt = 0;
+
+	ctx->firmware[0] = 0;
+	r = send_command(ctx, "query firmware", query_firmware, sizeof(query_firmware));
+	if (r != TEMPER_OK)
+	{
+		return r;
+	}
+	while (cnt < 2)
+	{
+		r = read_answer(ctx, "query firmware", answer);
+		if (r != TEMPER_OK)
+		{
+			return r;
+		}
+		strncat(ctx->firmware, (char *)answer, ANSWERSIZE);
+		cnt++;
+	}
+
+	return TEMPER_OK;
+}
+#endif
+
+/*
+ * find_profile
+ *
+ * based of the details collected about the device, define
+ * how to interact with the device
+ */
+
+static int find_profile(struct temper_ctx *ctx)
+{
+	int cnt = 0;
+	bool known_ids = false;
+	const struct temper_profile *p;
+
+	while (cnt < sizeof(profiles) / sizeof(profiles[0]))
+	{
+		p = &profiles[cnt];
+		cnt++;
+		if ((p->vendor_id != ctx->vendor_id) ||
+			(p->product_id != ctx->product_id))
+		{
+			continue;
+		}
+		known_ids = true;
+		if ((p->firmware != NULL) &&
+			strncmp(ctx->firmware, p->firmware, p->firmware_len))
+		{
+			continue;
+		}
+		if (p->conversion_method == 0)
+		{
+			return set_error(ctx, TEMPER_ERR_UNSUPPORTED, 0,
+				"%s detected - unsupported yet", p->detected);
+		}
+		debug_print(ctx, "Detected %s\n", p->detected);
+		ctx->profile = p;
+		set_conversion(ctx, (ctx->conversion_override == -1) ?
+			p->conversion_method : ctx->conversion_override);
+		return TEMPER_OK;
+	}
+
+	debug_print(ctx, "Unknown firmware '%s'\n", ctx->firmware);
+	if (known_ids)
+	{
+		return set_error(ctx, TEMPER_ERR_UNKNOWN, 0, "Unknown %04x:%04x device",
+			ctx->vendor_id, ctx->product_id);
+	}
+	return set_error(ctx, TEMPER_ERR_UNKNOWN, 0, "Unknown device");
+}
+
+/*
+ * open device and query firmware to deduce device capabilities
+ *
+ */
+
+TEMPER_LIB_EXPORT int temper_identify(struct temper_ctx *ctx)
+{
+	const struct temper_profile *cached = ctx->profile;
+	char firmware[sizeof(ctx->firmware)];
+#ifndef TEMPER_SINGLE_PROFILE
+	int r;
+#endif
+
+	if (ctx->fd < 0)
+	{
+		return set_error(ctx, TEMPER_ERR_PARAM, 0, "Device not open");
+	}
+	memcpy(firmware, ctx->firmware, sizeof(firmware));
+	ctx->profile = NULL;
+#ifdef TEMPER_SINGLE_PROFILE
+	/* only one profile is built in, the firmware has nothing to tell */
+	(void)snprintf(ctx->firmware, sizeof(ctx->firmware), "%s", profiles[0].firmware);
+#else
+	r = get_firmware_string(ctx);
+	if (r != TEMPER_OK)
+	{
+		return r;
+	}
+	debug_print(ctx, "Found firmware: '%s'\n", ctx->firmware);
+#endif
+	if ((cached != NULL) && !strcmp(firmware, ctx->firmware))
+	{
+		/* same device as before (e.g. after temper_recover) */
+		ctx->profile = cached;
+		return TEMPER_OK;
+	}
+
+	return find_profile(ctx);
+}
+
+/*
+ * read_number
+ *
+ * reads a decimal number from the sysfs attribute dir/name
+ */
+
+static int read_number(const char *dir, const char *name, int *value)
+{
+	char path[PATH_MAX];
+	char buf[16];
+	int fd;
+	int r;
+
+	(void)snprintf(path, sizeof(path), "%s/%s", dir, name);
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+	{
+		return 0;
+	}
+	r = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (r <= 0)
+	{
+		return 0;
+	}
+	buf[r] = 0;
+	*value = atoi(buf);
+	return 1;
+}
+
+/*
+ * reset_usb
+ *
+ * closes the device, resets the USB device behind its hidraw node
+ * and reopens the node once it is back. The USB interface stays at
+ * the same place in sysfs, the hidraw node below it may get
+ * another number.
+ */
+
+static int reset_usb(struct temper_ctx *ctx, int timeout_ms)
+{
+	struct temper_devinfo info;
+	struct discovery disc;
+	struct timespec pause = { RECOVER_POLL_MS / 1000, (RECOVER_POLL_MS % 1000) * 1000000L };
+	char path[PATH_MAX];
+	char interface[PATH_MAX];
+	char usbdev[PATH_MAX];
+	const char *node = strrchr(ctx->devpath, '/');
+	char *slash;
+	int busnum;
+	int devnum;
+	int waited;
+	int err = 0;
+	int fd;
+
+	/* /sys/class/hidraw/NODE/device is .../USB device/interface/HID device */
+	(void)snprintf(path, sizeof(path), "/sys/class/hidraw/%s/device",
+		(node == NULL) ? ctx->devpath : node + 1);
+	if (realpath(path, interface) == NULL)
+	{
+		return set_error(ctx, TEMPER_ERR_OPEN, errno, "Can't find USB device of '%s'", ctx->devpath);
+	}
+	slash = strrchr(interface, '/');
+	*slash = 0;
+	strcpy(usbdev, interface);
+	slash = strrchr(usbdev, '/');
+	*slash = 0;
+	if (!read_number(usbdev, "busnum", &busnum) || !read_number(usbdev, "devnum", &devnum))
+	{
+		return set_error(ctx, TEMPER_ERR_OPEN, 0, "Can't find USB device of '%s'", ctx->devpath);
+	}
+
+	close(ctx->fd);
+	ctx->fd = -1;
+	(void)snprintf(path, sizeof(path), "/dev/bus/usb/%03i/%03i", busnum, devnum);
+	debug_print(ctx, "Resetting '%s'\n", path);
+	fd = open(path, O_WRONLY);
+	if ((fd < 0) || (ioctl(fd, USBDEVFS_RESET, 0) < 0))
+	{
+		/* reopen anyway, the context stays usable */
+		err = errno;
+	}
+	if (fd >= 0)
+	{
+		close(fd);
+	}
+
+	for (waited = 0; waited <= timeout_ms; waited += RECOVER_POLL_MS)
+	{
+		disc.list = &info;
+		disc.max = 1;
+		disc.found = 0;
+		if (find_hidraw(&disc, interface) && (disc.found > 0))
+		{
+			ctx->fd = open(info.devpath, O_RDWR);
+			if (ctx->fd >= 0)
+			{
+				debug_print(ctx, "Reopened as '%s'\n", info.devpath);
+				strcpy(ctx->devpath, info.devpath);
+				break;
+			}
+		}
+		nanosleep(&pause, NULL);
+	}
+	if (ctx->fd < 0)
+	{
+		return set_error(ctx, TEMPER_ERR_OPEN, 0, "'%s' did not come back after the reset", ctx->devpath);
+	}
+	if (err != 0)
+	{
+		return set_error(ctx, TEMPER_ERR_OPEN, err, "Error resetting '%s'", path);
+	}
+
+	return TEMPER_OK;
+}
+
+TEMPER_LIB_EXPORT int temper_recover(struct temper_ctx *ctx, int timeout_ms)
+{
+	const struct temper_profile *cached = ctx->profile;
+	char firmware[sizeof(ctx->firmware)];
+	int r;
+
+	if (cached == NULL)
+	{
+		return set_error(ctx, TEMPER_ERR_PARAM, 0, "Device not identified");
+	}
+	if (ctx->reset != NULL)
+	{
+		if (ctx->fd >= 0)
+		{
+			close(ctx->fd);
+		}
+		ctx->fd = ctx->reset(ctx->reset_data);
+		if (ctx->fd < 0)
+		{
+			r = ctx->fd;
+			ctx->fd = -1;
+			return set_error(ctx, r, 0, "Error resetting device");
+		}
+	}
+	else if (ctx->devpath[0] != 0)
+	{
+		r = reset_usb(ctx, timeout_ms);
+		if (r != TEMPER_OK)
+		{
+			return r;
+		}
+	}
+	else
+	{
+		return set_error(ctx, TEMPER_ERR_UNSUPPORTED, 0, "Device can't be reset");
+	}
+	memcpy(firmware, ctx->firmware, sizeof(firmware));
+	r = temper_identify(ctx);
+	if (r != TEMPER_OK)
+	{
+		/* keep the profile, so the next attempt can reuse it */
+		ctx->profile = cached;
+		memcpy(ctx->firmware, firmware, sizeof(firmware));
+	}
+
+	return r;
+}
+
+static inline float decode(const struct decoder *d, const unsigned char *valuestring, int startchar)
+{
+	uint16_t raw = (valuestring[startchar] << 8) | valuestring[startchar + 1];
+
+	if ((raw & d->invalid) != 0)
+	{
+		return TEMPER_INVALID;
+	}
+#ifdef CALCULATE_METHOD2
+	if (d->table == NULL)
+	{
+		return (float)(((raw & 0x8000) ? raw - 0x10000 : raw) / 100.0);
+	}
+#endif
+	return d->table[raw >> d->shift];
+}
+
+/*
+ * temper_decode
+ *
+ * calculates value from response from given starting character,
+ * the tables are generated by gentables from the formulas in decode.h
+ */
+
+TEMPER_LIB_EXPORT float temper_decode(int conversion_method, const unsigned char *valuestring, int startchar)
+{
+	if ((conversion_method < 1) || (conversion_method > 2))
+	{
+		return TEMPER_INVALID;
+	}
+	return decode(&decoders[conversion_method], valuestring, startchar);
+}
+
+TEMPER_LIB_EXPORT void temper_invalidate(float *values)
+{
+	int channel;
+
+	/*
+	 * Since not all devices support all sensors, assume all
+	 * possible sensors to return invalid values, existing
+	 * sensors will overwrite with real values later.
+	 */
+	for (channel = 0; channel < TEMPER_CHANNELS; channel++)
+	{
+		values[channel] = TEMPER_INVALID;
+	}
+}
+
+TEMPER_LIB_EXPORT const unsigned char *temper_request(size_t *size)
+{
+	*size = sizeof(query_vals);
+	return query_vals;
+}
+
+TEMPER_LIB_EXPORT int temper_responses(const struct temper_ctx *ctx)
+{
+	if (ctx->profile == NULL)
+	{
+		return 0;
+	}
+	return ctx->profile->amount_value_responses;
+}
+
+TEMPER_LIB_EXPORT int temper_parse(const struct temper_ctx *ctx, int response, const unsigned char *report, float *values)
+{
+	int sensor = 0;
+	int channel;
+	const struct temper_profile *p = ctx->profile;
+
+	if ((p == NULL) || (response < 0) || (response >= p->amount_value_responses))
+	{
+		return TEMPER_ERR_PARAM;
+	}
+	// per response there are up to 2 sensors
+	while (sensor < 2)
+	{
+		channel = p->sensors[response][sensor];
+		if (channel >= 0)
+		{
+			values[channel] = decode(&ctx->decoder,
+				report, (2 + (sensor * 2)));
+			if (values[channel] <= TEMPER_INVALID)
+			{
+				debug_print(ctx, "invalid result received\n");
+			}
+		}
+		sensor++;
+	}
+	// the sample is complete, derive the other channels once
+	if (response == p->amount_value_responses - 1)
+	{
+		temper_derive(values);
+	}
+
+	return TEMPER_OK;
+}
+
+/*
+ * read values from temper
+ *
+ */
+TEMPER_LIB_EXPORT int temper_query(struct temper_ctx *ctx, float *values)
+{
+	int r = TEMPER_OK;
+	unsigned char answer[ANSWERSIZE + 1];
+	int response;
+	int cnt = 0;
+	int received_responses;
+	const struct temper_profile *p = ctx->profile;
+
+	if (p == NULL)
+	{
+		return set_error(ctx, TEMPER_ERR_PARAM, 0, "Device not identified");
+	}
+
+	temper_invalidate(values);
+
+	while (cnt < RETRIES)
+	{
+		response = 0;
+		received_responses = 0;
+		r = send_command(ctx, "query values", query_vals, sizeof(query_vals));
+		if (r != TEMPER_OK)
+		{
+			if ((cnt + 1) >= RETRIES)
+			{
+				return r;
+			}
+			debug_print(ctx, "retry %i/%i\n", cnt + 1, RETRIES);
+		}
+		while (response < p->amount_value_responses)
+		{
+			r = read_answer(ctx, "query values", answer);
+			if (r != TEMPER_OK)
+			{
+				debug_print(ctx, "failed on try %i/%i\n", cnt + 1, RETRIES);
+				if ((cnt + 1) >= RETRIES)
+				{
+					return r;
+				}
+			}
+			else
+			{
+				temper_parse(ctx, response, answer, values);
+				received_responses++;
+			}
+
+			response++;
+		}
+		if (received_responses >= p->amount_value_responses)
+		{
+			break;
+		}
+		cnt++;
+	}
+
+	return TEMPER_OK;
+}
+
+TEMPER_LIB_EXPORT const char *temper_firmware(const struct temper_ctx *ctx)
+{
+	return ctx->firmware;
+}
+
+TEMPER_LIB_EXPORT const char *temper_devpath(const struct temper_ctx *ctx)
+{
+	return ctx->devpath;
+}
+
+TEMPER_LIB_EXPORT int temper_fd(const struct temper_ctx *ctx)
+{
+	return ctx->fd;
+}
+
+TEMPER_LIB_EXPORT unsigned long temper_syscalls(const struct temper_ctx *ctx)
+{
+	return ctx->syscalls;
+}
+
+TEMPER_LIB_EXPORT int temper_default_sensor(const struct temper_ctx *ctx, int which)
+{
+	if (ctx->profile == NULL)
+	{
+		return TEMPER_NO_SENSOR;
+	}
+	if (which == TEMPER_REPORT_IN)
+	{
+		return ctx->profile->in_sensor;
+	}
+	return ctx->profile->out_sensor;
+}
+
+TEMPER_LIB_EXPORT const char *temper_errmsg(const struct temper_ctx *ctx)
+{
+	return ctx->errmsg;
+}
+
+TEMPER_LIB_EXPORT const char *temper_strerror(int err)
+{
+	switch (err)
+	{
+		case TEMPER_OK:
+			return "Success";
+		case TEMPER_ERR_NODEVICE:
+			return "No supported device found";
+		case TEMPER_ERR_SCAN:
+			return "Error scanning for hidraw devices";
+		case TEMPER_ERR_OPEN:
+			return "Error opening device";
+		case TEMPER_ERR_WRITE:
+			return "Error sending command";
+		case TEMPER_ERR_READ:
+			return "Error reading response";
+		case TEMPER_ERR_TIMEOUT:
+			return "Timeout";
+		case TEMPER_ERR_UNKNOWN:
+			return "Unknown device";
+		case TEMPER_ERR_UNSUPPORTED:
+			return "Device not supported";
+		case TEMPER_ERR_PARAM:
+			return "Invalid parameter";
+		case TEMPER_ERR_NOMEM:
+			return "Out of memory";
+		case TEMPER_ERR_PERMISSION:
+			return "Not permitted";
+	}
+	return "Unknown error";
+}
+
+TEMPER_LIB_EXPORT char *libtempersensor_version()
+{
+	return LIBTEMPERSENSOR_VERSION;
+}
+
+/*
+ * libtempersensor Copyright (C) 2020-2021 Armin Fuerst (armin@fuerst.priv.at)
+ * libtempersensor is based on tempersensor, which is a complete rewrite
+ * based on the ideas from pcsensor.c which was written by
+ * Juan Carlos Perez (cray@isp-sl.com) based on Temper.c by
+ * Robert Kavaler (kavaler@diva.com)
+ *
+ * This file is part of tempersensor.
+ *
+ * Tempersensor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tempersensor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tempersensor.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *
+ * Why did I put the license notice at the bottom of the file?
+ * Because most of the time, when you open the file, the probability
+ * you want to know about the license is very little. If you open the
+ * file to learn about the license, it is still easy to find.
+ *
+ * Perhaps you want to have a look at the talk "Clean Coders Hate What
+ * Happens to Your Code When You Use These Enterprise Programming Tricks"
+ * from Kevlin Henney at the NDC Conferences in London, January 16th-20th
+ * 2017. While watching the whole talk is a good idea, starting at around
+ * 27:50 provides some input what to put on the top of source code files.
+ */
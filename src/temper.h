@@ -0,0 +1,367 @@
+/*
+ * libtempersensor is a library to read values from TEMPer USB devices
+ * from RDing (www.pcsensor.com). It keeps all state in a context
+ * handle, so several devices can be used in parallel and from threads.
+ * Additional infos (including a license notice) are at the end of this file.
+ */
+
+#ifndef TEMPER_H
+#define TEMPER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define LIBTEMPERSENSOR_VERSION "0.1.0"
+
+#ifdef _WIN32
+	#define TEMPER_LIB_EXPORT __declspec(dllexport)
+#else
+	#define TEMPER_LIB_EXPORT
+#endif
+
+/*
+ * error codes
+ *
+ * all functions returning an int return TEMPER_OK on success
+ * or one of the negative error codes below
+ */
+#define TEMPER_OK 0
+#define TEMPER_ERR_NODEVICE -1 /* no supported device found */
+#define TEMPER_ERR_SCAN -2 /* error scanning /sys for hidraw devices */
+#define TEMPER_ERR_OPEN -3 /* error opening the hidraw device */
+#define TEMPER_ERR_WRITE -4 /* error sending a command */
+#define TEMPER_ERR_READ -5 /* error reading a response */
+#define TEMPER_ERR_TIMEOUT -6 /* no response within the timeout */
+#define TEMPER_ERR_UNKNOWN -7 /* device or firmware not known */
+#define TEMPER_ERR_UNSUPPORTED -8 /* device known, but not supported yet */
+#define TEMPER_ERR_PARAM -9 /* invalid parameter */
+#define TEMPER_ERR_NOMEM -10 /* out of memory */
+#define TEMPER_ERR_PERMISSION -11 /* not permitted, e.g. real-time scheduling without privileges */
+
+/* where in the values-array to find which sensor */
+#define TEMPER_NO_SENSOR -1
+#define TEMPER_INT_TEMP 0
+#define TEMPER_INT_HUM 1
+#define TEMPER_EXT_TEMP 2
+#define TEMPER_EXT_HUM 3
+#define TEMPER_RAW_CHANNELS 4 /* channels read from the device */
+#define TEMPER_INT_DEWPOINT 4 /* derived by temper_derive */
+#define TEMPER_INT_ABSHUM 5
+#define TEMPER_INT_HEATINDEX 6
+#define TEMPER_EXT_DEWPOINT 7
+#define TEMPER_EXT_ABSHUM 8
+#define TEMPER_EXT_HEATINDEX 9
+#define TEMPER_CHANNELS 10
+
+/* size of commands and responses */
+#define TEMPER_REPORT_SIZE 8
+
+/* value reported for sensors without a valid reading */
+#define TEMPER_INVALID -999.0
+
+/* selectors for temper_default_sensor */
+#define TEMPER_REPORT_IN 0
+#define TEMPER_REPORT_OUT 1
+
+/*
+ * single profile builds
+ *
+ * make PROFILE=<firmware> defines TEMPER_PROFILE_<firmware> (dots
+ * replaced by underscores). Only this profile and its conversion
+ * method are built in and temper_identify does not ask the device
+ * for its firmware.
+ */
+#if defined(TEMPER_PROFILE_TEMPer1F_V1_3) || defined(TEMPER_PROFILE_TEMPerF1_4)
+	#define TEMPER_SINGLE_PROFILE
+	#define TEMPER_PROFILE_METHOD 1
+#elif defined(TEMPER_PROFILE_TEMPerGold_V3_1) || defined(TEMPER_PROFILE_TEMPerX_V3_1) \
+	|| defined(TEMPER_PROFILE_TEMPerX_V3_3)
+	#define TEMPER_SINGLE_PROFILE
+	#define TEMPER_PROFILE_METHOD 2
+#endif
+
+/*
+ * struct temper_devinfo
+ *
+ * describes a hidraw device found by temper_discover
+ */
+struct temper_devinfo
+{
+	uint16_t vendor_id;
+	uint16_t product_id;
+	char devpath[261];
+};
+
+/*
+ * struct temper_ctx
+ *
+ * opaque handle for one device, created by temper_new
+ */
+struct temper_ctx;
+
+/*
+ * temper_discover
+ *
+ * scans /sys for hidraw devices and stores up to max supported
+ * devices in list. The amount of supported devices found (which
+ * may be more than max) is stored in found.
+ */
+TEMPER_LIB_EXPORT int temper_discover(struct temper_devinfo *list, int max, int *found);
+
+/*
+ * temper_is_supported
+ *
+ * returns true if the given vendor and product ID belong to
+ * a supported device
+ */
+TEMPER_LIB_EXPORT bool temper_is_supported(uint16_t vendor_id, uint16_t product_id);
+
+/*
+ * temper_new
+ *
+ * creates a new context, returns NULL if out of memory
+ */
+TEMPER_LIB_EXPORT struct temper_ctx *temper_new();
+
+/*
+ * temper_free
+ *
+ * closes the device (if open) and releases the context
+ */
+TEMPER_LIB_EXPORT void temper_free(struct temper_ctx *ctx);
+
+/*
+ * temper_set_debug
+ *
+ * enables (debug > 0) or disables debug output to stderr
+ */
+TEMPER_LIB_EXPORT void temper_set_debug(struct temper_ctx *ctx, int debug);
+
+/*
+ * temper_set_conversion_method
+ *
+ * overrides the conversion method derived from the firmware,
+ * -1 restores autodetection
+ */
+TEMPER_LIB_EXPORT int temper_set_conversion_method(struct temper_ctx *ctx, int method);
+
+/*
+ * temper_open
+ *
+ * opens the hidraw device described by info
+ */
+TEMPER_LIB_EXPORT int temper_open(struct temper_ctx *ctx, const struct temper_devinfo *info);
+
+/*
+ * temper_open_fd
+ *
+ * uses an already opened file descriptor as device, the context
+ * takes ownership of fd
+ */
+TEMPER_LIB_EXPORT int temper_open_fd(struct temper_ctx *ctx, int fd, uint16_t vendor_id, uint16_t product_id);
+
+/*
+ * temper_reset_cb
+ *
+ * resets the transport of a device opened by temper_open_fd and
+ * returns the new file descriptor or a negative error code
+ */
+typedef int (*temper_reset_cb)(void *data);
+
+/*
+ * temper_set_reset
+ *
+ * lets temper_recover use reset instead of a USB reset, the context
+ * takes ownership of data and releases it with free() when closed
+ */
+TEMPER_LIB_EXPORT void temper_set_reset(struct temper_ctx *ctx, temper_reset_cb reset, void *data);
+
+/*
+ * temper_identify
+ *
+ * queries the firmware and deduces how to interact with the device,
+ * a device identified before keeps its profile if the firmware is
+ * still the same
+ */
+TEMPER_LIB_EXPORT int temper_identify(struct temper_ctx *ctx);
+
+/*
+ * temper_query
+ *
+ * reads all sensors of the device into values, which must have
+ * room for TEMPER_CHANNELS entries. Sensors not present or
+ * returning an error are set to TEMPER_INVALID.
+ */
+TEMPER_LIB_EXPORT int temper_query(struct temper_ctx *ctx, float *values);
+
+/*
+ * split-phase access
+ *
+ * temper_query waits for every response on its own. To drive many
+ * devices from one event loop, send the command returned by
+ * temper_request to each device, read temper_responses reports of
+ * TEMPER_REPORT_SIZE bytes and pass them in order to temper_parse.
+ * Call temper_invalidate on values before the first report.
+ */
+
+/*
+ * temper_request
+ *
+ * returns the command requesting values and stores its size
+ */
+TEMPER_LIB_EXPORT const unsigned char *temper_request(size_t *size);
+
+/*
+ * temper_responses
+ *
+ * returns the amount of reports the device answers to a
+ * request, 0 if the device is not identified yet
+ */
+TEMPER_LIB_EXPORT int temper_responses(const struct temper_ctx *ctx);
+
+/*
+ * temper_parse
+ *
+ * decodes report number response into values, the last response
+ * also fills the derived channels (see temper_derive)
+ */
+TEMPER_LIB_EXPORT int temper_parse(const struct temper_ctx *ctx, int response, const unsigned char *report, float *values);
+
+/*
+ * temper_invalidate
+ *
+ * sets all TEMPER_CHANNELS values to TEMPER_INVALID
+ */
+TEMPER_LIB_EXPORT void temper_invalidate(float *values);
+
+/*
+ * temper_derive
+ *
+ * calculates the derived channels of values from the raw ones:
+ * dew point (°C, within 0.005 °C of the Magnus formula), absolute
+ * humidity (g/m³, within 0.04%) and heat index (°C, NWS algorithm).
+ * Channels without temperature and humidity are TEMPER_INVALID.
+ * temper_query and temper_parse already call it for every sample.
+ */
+TEMPER_LIB_EXPORT void temper_derive(float *values);
+
+/*
+ * temper_decode
+ *
+ * calculates a value from a response starting at startchar
+ * using the given conversion method, returns TEMPER_INVALID
+ * for invalid results (and in single profile builds for all
+ * conversion methods not built in)
+ */
+TEMPER_LIB_EXPORT float temper_decode(int conversion_method, const unsigned char *valuestring, int startchar);
+
+/*
+ * temper_recover
+ *
+ * brings back a device which stopped answering: closes it, resets
+ * the USB device behind the hidraw node (USBDEVFS_RESET), waits up to
+ * timeout_ms for the hidraw node to reappear, reopens and identifies
+ * it again. The node may come back under another name. Contexts
+ * opened by temper_open_fd need a reset callback (temper_set_reset).
+ */
+TEMPER_LIB_EXPORT int temper_recover(struct temper_ctx *ctx, int timeout_ms);
+
+/*
+ * temper_close
+ *
+ * closes the device, the context can be reused by temper_open
+ */
+TEMPER_LIB_EXPORT void temper_close(struct temper_ctx *ctx);
+
+/*
+ * temper_firmware
+ *
+ * returns the firmware string read by temper_identify
+ */
+TEMPER_LIB_EXPORT const char *temper_firmware(const struct temper_ctx *ctx);
+
+/*
+ * temper_devpath
+ *
+ * returns the hidraw node opened by temper_open (after temper_recover
+ * maybe another one), an empty string for temper_open_fd
+ */
+TEMPER_LIB_EXPORT const char *temper_devpath(const struct temper_ctx *ctx);
+
+/*
+ * temper_fd
+ *
+ * returns the file descriptor of the open device or -1
+ */
+TEMPER_LIB_EXPORT int temper_fd(const struct temper_ctx *ctx);
+
+/*
+ * temper_syscalls
+ *
+ * returns the amount of system calls temper_identify and
+ * temper_query used to talk to the device
+ */
+TEMPER_LIB_EXPORT unsigned long temper_syscalls(const struct temper_ctx *ctx);
+
+/*
+ * temper_default_sensor
+ *
+ * returns the sensor to report as IN (TEMPER_REPORT_IN) or
+ * OUT (TEMPER_REPORT_OUT) if nothing else is configured
+ */
+TEMPER_LIB_EXPORT int temper_default_sensor(const struct temper_ctx *ctx, int which);
+
+/*
+ * temper_errmsg
+ *
+ * returns a description of the last error of the context
+ */
+TEMPER_LIB_EXPORT const char *temper_errmsg(const struct temper_ctx *ctx);
+
+/*
+ * temper_strerror
+ *
+ * returns a generic description of an error code
+ */
+TEMPER_LIB_EXPORT const char *temper_strerror(int err);
+
+/*
+ * libtempersensor_version
+ *
+ * returns the version of the library
+ */
+TEMPER_LIB_EXPORT char *libtempersensor_version();
+
+#endif // TEMPER_H
+
+/*
+ * libtempersensor Copyright (C) 2020-2021 Armin Fuerst (armin@fuerst.priv.at)
+ *
+ * This file is part of tempersensor.
+ *
+ * Tempersensor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tempersensor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tempersensor.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *
+ * Why did I put the license notice at the bottom of the file?
+ * Because most of the time, when you open the file, the probability
+ * you want to know about the license is very little. If you open the
+ * file to learn about the license, it is still easy to find.
+ *
+ * Perhaps you want to have a look at the talk "Clean Coders Hate What
+ * Happens to Your Code When You Use These Enterprise Programming Tricks"
+ * from Kevlin Henney at the NDC Conferences in London, January 16th-20th
+ * 2017. While watching the whole talk is a good idea, starting at around
+ * 27:50 provides some input what to put on the top of source code files.
+ */
@@ -0,0 +1,1218 @@
+/*
+ * tempercollector receives the samples pushed by many tempersensor
+ * nodes (tempersensor --push) and writes them to one history file.
+ * Additional infos (including a license notice) are at the end of this file.
+ */
+
+#define _GNU_SOURCE /* recvmmsg */
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include "mrtg.h"
+#include "temper.h"
+#include "push.h"
+#include "sampler.h"
+#include "spsc.h"
+
+#define PROGRAMNAME "tempercollector"
+#define VERSION "0.1.0"
+#define RECV_BATCH 64 /* datagrams per recvmmsg */
+#define RING_SIZE 256 /* datagrams between one receiver and one shard */
+#define OUTPUT_SIZE 65536 /* lines a shard collects before writing them */
+#define RCVBUF_SIZE (4 * 1024 * 1024)
+#define BENCHMARK_SECONDS 2
+#define BENCHMARK_NODES 64 /* per sender thread */
+
+struct config
+{
+	int debug;
+	const char *listen; /* [HOST:]PORT */
+	int receivers; /* receiving threads, each with its own socket */
+	int shards; /* threads decoding and writing, 0 = one per receiver */
+	const char *history; /* file to append samples to, NULL = stdout */
+	int precision;
+	bool stats;
+	bool benchmark;
+	int senders; /* threads generating load in the benchmark */
+};
+
+/*
+ * struct datagram
+ *
+ * a datagram handed from a receiver to a shard
+ */
+struct datagram
+{
+	uint16_t len;
+	unsigned char buf[TEMPER_PUSH_SIZE];
+};
+
+/*
+ * struct node
+ *
+ * what a shard knows about one node, to notice lost datagrams
+ */
+struct node
+{
+	uint32_t id;
+	bool used;
+	bool synced; /* a datagram was seen, next is valid */
+	uint32_t next; /* sequence expected next */
+	uint64_t missing; /* bit n: sequence next - 1 - n was skipped and not seen since */
+};
+
+struct collector;
+
+struct receiver
+{
+	pthread_t thread;
+	struct collector *c;
+	int index;
+	int fd;
+	bool started;
+	bool *touched; /* shards to wake after a batch */
+	atomic_ulong datagrams;
+	atomic_ulong dropped; /* ring of the shard full */
+	atomic_ulong malformed;
+};
+
+struct shard
+{
+	pthread_t thread;
+	struct collector *c;
+	int wakefd;
+	bool started;
+	struct spsc *rings; /* one per receiver */
+	/* nodes, open addressing, only used by the thread of the shard */
+	struct node *nodes;
+	size_t capacity;
+	size_t amount_nodes;
+	char *out;
+	size_t used;
+	atomic_ulong datagrams;
+	atomic_ulong samples;
+	atomic_ulong malformed;
+	atomic_ulong lost; /* gaps in the sequences */
+	atomic_ulong late; /* datagrams arriving after a later one */
+	atomic_ulong duplicates; /* datagrams seen before */
+	atomic_ulong restarts; /* nodes starting again at sequence 0 */
+	atomic_ulong nodes_seen;
+};
+
+struct collector
+{
+	int amount_receivers;
+	int amount_shards;
+	struct receiver *receivers;
+	struct shard *shards;
+	int stopfd; /* ends the receivers */
+	int drainfd; /* ends the shards once the receivers are gone */
+	int outfd;
+	int precision;
+};
+
+/*
+ * global vars
+ */
+
+struct config config;
+atomic_bool benchmark_running;
+
+void printVersion()
+{
+	printf("%s version %s, libtempersensor version %s\n",
+		PROGRAMNAME, VERSION, libtempersensor_version());
+}
+
+void usage()
+{
+	printVersion();
+	printf("\t--benchmark\t\t\tmeasure received samples per second and\n");
+	printf("\t\t\t\t\tdrop rates on localhost for 1 ... N\n");
+	printf("\t\t\t\t\treceivers (N from --receivers)\n");
+	printf("\t-d, --debug\t\t\tshow debug output\n");
+	printf("\t-h, --help\t\t\thelp\n");
+	printf("\t--history=FILE\t\t\tappend samples to FILE (default=stdout)\n");
+	printf("\t-l, --listen=[HOST:]PORT\treceive on PORT (default=%s)\n", TEMPER_PUSH_PORT);
+	printf("\t-p, --precision=LEN\t\tamount of decimal places (default=2)\n");
+	printf("\t--receivers=N\t\t\treceiving threads (default=one per CPU)\n");
+	printf("\t--senders=N\t\t\tthreads sending in the benchmark\n");
+	printf("\t\t\t\t\t(default=1)\n");
+	printf("\t--shards=N\t\t\tthreads writing samples, nodes are\n");
+	printf("\t\t\t\t\tdistributed by their ID (default=one\n");
+	printf("\t\t\t\t\tper receiver)\n");
+	printf("\t--stats\t\t\t\tprint statistics at the end, SIGUSR1\n");
+	printf("\t\t\t\t\tprints them at any time\n");
+	printf("\t-V, --version\t\t\tdisplay version information\n");
+}
+
+/*
+ * numeric_argument
+ *
+ * parses a numeric option and exits if it is not numeric
+ * or smaller than min
+ */
+
+int numeric_argument(const char *name, const char *arg, int min)
+{
+	int value;
+
+	if (!(sscanf(arg, "%i", &value) == 1))
+	{
+		fprintf(stderr, "Error: '%s' is not numeric.\n", arg);
+		exit(EXIT_FAILURE);
+	}
+	if (value < min)
+	{
+		fprintf(stderr, "Invalid value for %s: '%s'\n", name, arg);
+		exit(EXIT_FAILURE);
+	}
+	return value;
+}
+
+void parse_parameters(int argc, char **argv)
+{
+	int c;
+	int option_index;
+
+	/* set default values */
+	config.debug = 0;
+	config.listen = TEMPER_PUSH_PORT;
+	config.receivers = sysconf(_SC_NPROCESSORS_ONLN);
+	if (config.receivers < 1)
+	{
+		config.receivers = 1;
+	}
+	config.shards = 0;
+	config.history = NULL;
+	config.precision = 2;
+	config.stats = false;
+	config.benchmark = false;
+	config.senders = 1;
+
+	/* create structure of options */
+	static struct option collector_options[] =
+	{
+		{"debug", no_argument, 0, 'd'},
+		{"help", no_argument, 0, 'h'},
+		{"listen", required_argument, 0, 'l'},
+		{"precision", required_argument, 0, 'p'},
+		{"version", no_argument, 0, 'V'},
+		{"receivers", required_argument, 0, 0},
+		{"shards", required_argument, 0, 1},
+		{"history", required_argument, 0, 2},
+		{"stats", no_argument, 0, 3},
+		{"benchmark", no_argument, 0, 4},
+		{"senders", required_argument, 0, 5},
+		{0, 0, 0, 0}
+	};
+
+	while ((c = getopt_long(argc, argv, "dhl:p:V", collector_options, &option_index)) != -1)
+	{
+		switch (c)
+		{
+			case 0: // receivers
+				config.receivers = numeric_argument("receivers", optarg, 1);
+				break;
+			case 1: // shards
+				config.shards = numeric_argument("shards", optarg, 1);
+				break;
+			case 2: // history
+				config.history = optarg;
+				break;
+			case 3: // stats
+				config.stats = true;
+				break;
+			case 4: // benchmark
+				config.benchmark = true;
+				break;
+			case 5: // senders
+				config.senders = numeric_argument("senders", optarg, 1);
+				break;
+			case 'd':
+				config.debug = 1;
+				break;
+			case 'l':
+				config.listen = optarg;
+				break;
+			case 'p':
+				config.precision = numeric_argument("precision", optarg, 0);
+				break;
+			case 'V':
+				printVersion();
+				exit(EXIT_SUCCESS);
+				break;
+			case '?':
+			case 'h':
+				usage();
+				exit(EXIT_SUCCESS);
+				break;
+			default:
+				exit(EXIT_FAILURE);
+		}
+	}
+}
+
+/*
+ * debug_print
+ */
+
+void debug_print(const char *format, ...)
+{
+	va_list args;
+	va_start(args, format);
+
+	if (config.debug > 0)
+	{
+		vfprintf(stderr, format, args);
+	}
+	va_end(args);
+}
+
+/*
+ * resolve_listen
+ *
+ * looks up the address to receive on, given as [HOST:]PORT
+ */
+
+bool resolve_listen(const char *listen, struct sockaddr_storage *addr, socklen_t *addrlen)
+{
+	struct addrinfo hints;
+	struct addrinfo *result;
+	char host[256];
+	const char *port;
+	const char *colon;
+	size_t len;
+	bool ok;
+
+	colon = strrchr(listen, ':');
+	port = (colon != NULL) ? colon + 1 : listen;
+	len = (colon != NULL) ? colon - listen : 0;
+	if (len >= sizeof(host))
+	{
+		return false;
+	}
+	memcpy(host, listen, len);
+	host[len] = '\0';
+	if ((len >= 2) && (host[0] == '[') && (host[len - 1] == ']'))
+	{
+		// [IPV6]:PORT
+		memmove(host, host + 1, len - 2);
+		host[len - 2] = '\0';
+	}
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+	hints.ai_flags = AI_PASSIVE;
+	if (getaddrinfo((host[0] != '\0') ? host : NULL, port, &hints, &result) != 0)
+	{
+		return false;
+	}
+	ok = (result->ai_addrlen <= sizeof(*addr));
+	if (ok)
+	{
+		memcpy(addr, result->ai_addr, result->ai_addrlen);
+		*addrlen = result->ai_addrlen;
+	}
+	freeaddrinfo(result);
+
+	return ok;
+}
+
+/*
+ * open_socket
+ *
+ * opens one of the sockets sharing the port (SO_REUSEPORT), the
+ * kernel distributes the datagrams by the address of the sender
+ */
+
+int open_socket(const struct sockaddr_storage *addr, socklen_t addrlen)
+{
+	int size = RCVBUF_SIZE;
+	int on = 1;
+	int fd;
+
+	fd = socket(addr->ss_family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+	{
+		return -1;
+	}
+	(void)setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+	if ((setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) != 0) ||
+		(bind(fd, (const struct sockaddr *) addr, addrlen) != 0))
+	{
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/*
+ * node_of
+ *
+ * returns the node ID of a datagram without decoding it
+ */
+
+uint32_t node_of(const struct datagram *d)
+{
+	return ((uint32_t) d->buf[4] << 24) | ((uint32_t) d->buf[5] << 16) |
+		((uint32_t) d->buf[6] << 8) | d->buf[7];
+}
+
+/*
+ * receive_thread
+ *
+ * reads batches of datagrams and hands each one to the shard of
+ * its node, every shard receiving something is woken once per batch
+ */
+
+void *receive_thread(void *arg)
+{
+	struct receiver *r = (struct receiver *) arg;
+	struct collector *c = r->c;
+	struct mmsghdr msgs[RECV_BATCH];
+	struct iovec iov[RECV_BATCH];
+	struct datagram *batch;
+	struct pollfd fds[2];
+	struct shard *shard;
+	uint64_t one = 1;
+	int n;
+	int cnt;
+
+	batch = (struct datagram *) malloc(RECV_BATCH * sizeof(struct datagram));
+	if (batch == NULL)
+	{
+		return NULL;
+	}
+	memset(msgs, 0, sizeof(msgs));
+	for (cnt = 0; cnt < RECV_BATCH; cnt++)
+	{
+		iov[cnt].iov_base = batch[cnt].buf;
+		iov[cnt].iov_len = sizeof(batch[cnt].buf);
+		msgs[cnt].msg_hdr.msg_iov = &iov[cnt];
+		msgs[cnt].msg_hdr.msg_iovlen = 1;
+	}
+	fds[0].fd = r->fd;
+	fds[0].events = POLLIN;
+	fds[1].fd = c->stopfd;
+	fds[1].events = POLLIN;
+
+	for (;;)
+	{
+		n = recvmmsg(r->fd, msgs, RECV_BATCH, MSG_DONTWAIT, NULL);
+		if (n <= 0)
+		{
+			if ((n < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))
+			{
+				break;
+			}
+			if ((poll(fds, 2, -1) < 0) && (errno != EINTR))
+			{
+				break;
+			}
+			if (fds[1].revents & POLLIN)
+			{
+				break;
+			}
+			continue;
+		}
+		for (cnt = 0; cnt < n; cnt++)
+		{
+			batch[cnt].len = msgs[cnt].msg_len;
+			if (batch[cnt].len < TEMPER_PUSH_HEADER_SIZE)
+			{
+				atomic_fetch_add_explicit(&r->malformed, 1, memory_order_relaxed);
+				continue;
+			}
+			shard = &c->shards[node_of(&batch[cnt]) % c->amount_shards];
+			if (!spsc_push(&shard->rings[r->index], &batch[cnt]))
+			{
+				atomic_fetch_add_explicit(&r->dropped, 1, memory_order_relaxed);
+				continue;
+			}
+			r->touched[shard - c->shards] = true;
+		}
+		atomic_fetch_add_explicit(&r->datagrams, n, memory_order_relaxed);
+		for (cnt = 0; cnt < c->amount_shards; cnt++)
+		{
+			if (r->touched[cnt])
+			{
+				r->touched[cnt] = false;
+				(void)write(c->shards[cnt].wakefd, &one, sizeof(one));
+			}
+		}
+	}
+	free(batch);
+
+	return NULL;
+}
+
+/*
+ * find_node
+ *
+ * returns the state of node id, a node not seen before is added
+ */
+
+struct node *find_node(struct shard *s, uint32_t id)
+{
+	struct node *old = s->nodes;
+	size_t capacity = s->capacity;
+	size_t slot;
+	size_t cnt;
+
+	if (s->amount_nodes * 2 >= s->capacity)
+	{
+		// grow, at most half of the slots are used
+		s->capacity = (capacity > 0) ? capacity * 2 : 256;
+		s->nodes = (struct node *) calloc(s->capacity, sizeof(struct node));
+		if (s->nodes == NULL)
+		{
+			s->nodes = old;
+			s->capacity = capacity;
+			return NULL;
+		}
+		s->amount_nodes = 0;
+		for (cnt = 0; cnt < capacity; cnt++)
+		{
+			if (old[cnt].used)
+			{
+				*find_node(s, old[cnt].id) = old[cnt];
+			}
+		}
+		free(old);
+	}
+	slot = (id * 2654435761u) & (s->capacity - 1);
+	while (s->nodes[slot].used && (s->nodes[slot].id != id))
+	{
+		slot = (slot + 1) & (s->capacity - 1);
+	}
+	if (!s->nodes[slot].used)
+	{
+		s->nodes[slot].used = true;
+		s->nodes[slot].id = id;
+		s->nodes[slot].synced = false;
+		s->amount_nodes++;
+	}
+	return &s->nodes[slot];
+}
+
+/*
+ * track_sequence
+ *
+ * counts the datagrams of a node lost, arriving late, duplicated or
+ * starting again after a restart of the node. A datagram arriving
+ * late is no more lost if its sequence was skipped at most 63
+ * datagrams before, older ones stay lost.
+ */
+
+void track_sequence(struct shard *s, uint32_t id, uint32_t sequence)
+{
+	struct node *node = find_node(s, id);
+	uint32_t age;
+	int32_t gap;
+
+	if (node == NULL)
+	{
+		return;
+	}
+	atomic_store_explicit(&s->nodes_seen, s->amount_nodes, memory_order_relaxed);
+	if (!node->synced)
+	{
+		// the node may have been running before the collector
+		node->synced = true;
+		node->next = sequence + 1;
+		node->missing = 0;
+		return;
+	}
+	gap = (int32_t)(sequence - node->next);
+	if (gap >= 0)
+	{
+		atomic_fetch_add_explicit(&s->lost, gap, memory_order_relaxed);
+		node->next = sequence + 1;
+		// bit 0 is this one, bits 1 to gap the ones skipped
+		node->missing = (gap >= 63) ? ~1ULL : (node->missing << (gap + 1)) | ((1ULL << (gap + 1)) - 2);
+		return;
+	}
+	if (sequence == 0)
+	{
+		atomic_fetch_add_explicit(&s->restarts, 1, memory_order_relaxed);
+		node->next = 1;
+		node->missing = 0;
+		return;
+	}
+	age = node->next - 1 - sequence;
+	if ((age < 64) && (node->missing & (1ULL << age)))
+	{
+		// counted as lost before, it made it after all
+		node->missing &= ~(1ULL << age);
+		atomic_fetch_add_explicit(&s->late, 1, memory_order_relaxed);
+		atomic_fetch_sub_explicit(&s->lost, 1, memory_order_relaxed);
+	}
+	else if (age < 64)
+	{
+		atomic_fetch_add_explicit(&s->duplicates, 1, memory_order_relaxed);
+	}
+	else
+	{
+		// too old to tell, stays lost
+		atomic_fetch_add_explicit(&s->late, 1, memory_order_relaxed);
+	}
+}
+
+/*
+ * flush_output
+ *
+ * writes the lines collected, one write per batch keeps the lines of
+ * the shards from mixing in a file opened with O_APPEND
+ */
+
+void flush_output(struct shard *s)
+{
+	size_t done = 0;
+	ssize_t r;
+
+	while (done < s->used)
+	{
+		r = write(s->c->outfd, s->out + done, s->used - done);
+		if (r < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			break;
+		}
+		done += r;
+	}
+	s->used = 0;
+}
+
+/*
+ * format_sample
+ *
+ * appends the line of a sample in the history format of
+ * tempersensor, the device is named NODE/DEVICE
+ */
+
+void format_sample(struct shard *s, uint32_t node, const struct temper_push_sample *sample)
+{
+	char *line;
+	size_t size;
+	size_t len;
+	int channel;
+
+	if (OUTPUT_SIZE - s->used < 512)
+	{
+		flush_output(s);
+	}
+	line = s->out + s->used;
+	size = OUTPUT_SIZE - s->used;
+	len = snprintf(line, size, "%llu.%03llu %u/%i",
+		(unsigned long long)(sample->timestamp_us / 1000000),
+		(unsigned long long)((sample->timestamp_us / 1000) % 1000),
+		node, sample->device);
+	for (channel = 0; channel < TEMPER_CHANNELS; channel++)
+	{
+		if (sample->values[channel] <= TEMPER_INVALID)
+			len += snprintf(line + len, size - len, " %s", INVALID_VALUE);
+		else
+			len += snprintf(line + len, size - len, " %.*f", s->c->precision, sample->values[channel]);
+	}
+	len += snprintf(line + len, size - len, "\n");
+	s->used += len;
+}
+
+/*
+ * handle_datagram
+ *
+ * decodes a datagram and writes its samples
+ */
+
+void handle_datagram(struct shard *s, const struct datagram *d)
+{
+	struct temper_push_sample samples[TEMPER_PUSH_MAX_SAMPLES];
+	struct temper_push_header header;
+	int n;
+	int cnt;
+
+	n = temper_push_decode(d->buf, d->len, &header, samples, TEMPER_PUSH_MAX_SAMPLES);
+	if (n < 0)
+	{
+		atomic_fetch_add_explicit(&s->malformed, 1, memory_order_relaxed);
+		return;
+	}
+	track_sequence(s, header.node, header.sequence);
+	for (cnt = 0; cnt < n; cnt++)
+	{
+		format_sample(s, header.node, &samples[cnt]);
+	}
+	atomic_fetch_add_explicit(&s->datagrams, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&s->samples, n, memory_order_relaxed);
+}
+
+/*
+ * shard_thread
+ *
+ * drains the rings of all receivers, sleeps on its eventfd when they
+ * are empty. Ends when drainfd is signalled and the rings are empty.
+ */
+
+void *shard_thread(void *arg)
+{
+	struct shard *s = (struct shard *) arg;
+	struct collector *c = s->c;
+	struct datagram d;
+	struct pollfd fds[2];
+	uint64_t counter;
+	bool got;
+	int cnt;
+
+	fds[0].fd = s->wakefd;
+	fds[0].events = POLLIN;
+	fds[1].fd = c->drainfd;
+	fds[1].events = POLLIN;
+	for (;;)
+	{
+		got = false;
+		for (cnt = 0; cnt < c->amount_receivers; cnt++)
+		{
+			while (spsc_pop(&s->rings[cnt], &d))
+			{
+				handle_datagram(s, &d);
+				got = true;
+			}
+		}
+		flush_output(s);
+		if (got)
+		{
+			continue;
+		}
+		if ((poll(fds, 2, -1) < 0) && (errno != EINTR))
+		{
+			break;
+		}
+		if (fds[1].revents & POLLIN)
+		{
+			break;
+		}
+		(void)read(s->wakefd, &counter, sizeof(counter));
+	}
+	return NULL;
+}
+
+/*
+ * collector_stop
+ *
+ * stops the receivers, then the shards once they wrote what is left,
+ * the counters stay valid
+ */
+
+void collector_stop(struct collector *c)
+{
+	uint64_t one = 1;
+	int cnt;
+
+	(void)write(c->stopfd, &one, sizeof(one));
+	for (cnt = 0; cnt < c->amount_receivers; cnt++)
+	{
+		if (c->receivers[cnt].started)
+		{
+			pthread_join(c->receivers[cnt].thread, NULL);
+			c->receivers[cnt].started = false;
+		}
+	}
+	(void)write(c->drainfd, &one, sizeof(one));
+	for (cnt = 0; cnt < c->amount_shards; cnt++)
+	{
+		if (c->shards[cnt].started)
+		{
+			pthread_join(c->shards[cnt].thread, NULL);
+			c->shards[cnt].started = false;
+		}
+	}
+}
+
+/*
+ * collector_free
+ *
+ * stops the threads (if running) and releases everything
+ */
+
+void collector_free(struct collector *c)
+{
+	int cnt;
+	int ring;
+
+	collector_stop(c);
+	for (cnt = 0; cnt < c->amount_receivers; cnt++)
+	{
+		if (c->receivers[cnt].fd >= 0)
+		{
+			close(c->receivers[cnt].fd);
+		}
+		free(c->receivers[cnt].touched);
+	}
+	for (cnt = 0; cnt < c->amount_shards; cnt++)
+	{
+		for (ring = 0; (c->shards[cnt].rings != NULL) && (ring < c->amount_receivers); ring++)
+		{
+			spsc_destroy(&c->shards[cnt].rings[ring]);
+		}
+		free(c->shards[cnt].rings);
+		free(c->shards[cnt].nodes);
+		free(c->shards[cnt].out);
+		if (c->shards[cnt].wakefd >= 0)
+		{
+			close(c->shards[cnt].wakefd);
+		}
+	}
+	free(c->receivers);
+	free(c->shards);
+	if (c->stopfd >= 0)
+	{
+		close(c->stopfd);
+	}
+	if (c->drainfd >= 0)
+	{
+		close(c->drainfd);
+	}
+	free(c);
+}
+
+/*
+ * collector_start
+ *
+ * opens receivers sockets on listen and starts the threads, samples
+ * go to outfd. Returns NULL (after printing why) on errors.
+ */
+
+struct collector *collector_start(const char *listen, int receivers, int shards, int outfd)
+{
+	struct sockaddr_storage addr;
+	socklen_t addrlen = sizeof(addr);
+	struct collector *c;
+	struct shard *s;
+	int cnt;
+	int ring;
+
+	if (!resolve_listen(listen, &addr, &addrlen))
+	{
+		fprintf(stderr, "Invalid address to listen on '%s'\n", listen);
+		return NULL;
+	}
+	c = (struct collector *) calloc(1, sizeof(struct collector));
+	if (c == NULL)
+	{
+		fprintf(stderr, "%s\n", temper_strerror(TEMPER_ERR_NOMEM));
+		return NULL;
+	}
+	c->amount_receivers = receivers;
+	c->amount_shards = shards;
+	c->outfd = outfd;
+	c->precision = config.precision;
+	c->stopfd = eventfd(0, EFD_CLOEXEC);
+	c->drainfd = eventfd(0, EFD_CLOEXEC);
+	c->receivers = (struct receiver *) calloc(receivers, sizeof(struct receiver));
+	c->shards = (struct shard *) calloc(shards, sizeof(struct shard));
+	if ((c->receivers == NULL) || (c->shards == NULL) || (c->stopfd < 0) || (c->drainfd < 0))
+	{
+		fprintf(stderr, "%s\n", temper_strerror(TEMPER_ERR_NOMEM));
+		c->amount_receivers = 0;
+		c->amount_shards = 0;
+		collector_free(c);
+		return NULL;
+	}
+	for (cnt = 0; cnt < receivers; cnt++)
+	{
+		c->receivers[cnt].fd = -1;
+	}
+	for (cnt = 0; cnt < shards; cnt++)
+	{
+		c->shards[cnt].wakefd = -1;
+	}
+	for (cnt = 0; cnt < shards; cnt++)
+	{
+		s = &c->shards[cnt];
+		s->c = c;
+		s->wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		s->out = (char *) malloc(OUTPUT_SIZE);
+		s->rings = (struct spsc *) calloc(receivers, sizeof(struct spsc));
+		if ((s->wakefd < 0) || (s->out == NULL) || (s->rings == NULL))
+		{
+			fprintf(stderr, "%s\n", temper_strerror(TEMPER_ERR_NOMEM));
+			collector_free(c);
+			return NULL;
+		}
+		for (ring = 0; ring < receivers; ring++)
+		{
+			if (!spsc_init(&s->rings[ring], sizeof(struct datagram), RING_SIZE))
+			{
+				fprintf(stderr, "%s\n", temper_strerror(TEMPER_ERR_NOMEM));
+				collector_free(c);
+				return NULL;
+			}
+		}
+	}
+	for (cnt = 0; cnt < receivers; cnt++)
+	{
+		c->receivers[cnt].c = c;
+		c->receivers[cnt].index = cnt;
+		c->receivers[cnt].touched = (bool *) calloc(shards, sizeof(bool));
+		c->receivers[cnt].fd = open_socket(&addr, addrlen);
+		if (c->receivers[cnt].fd < 0)
+		{
+			perror(listen);
+			collector_free(c);
+			return NULL;
+		}
+		if (cnt == 0)
+		{
+			// with port 0 the others have to use the port chosen now
+			addrlen = sizeof(addr);
+			(void)getsockname(c->receivers[0].fd, (struct sockaddr *) &addr, &addrlen);
+		}
+	}
+	for (cnt = 0; cnt < shards; cnt++)
+	{
+		c->shards[cnt].started = (pthread_create(&c->shards[cnt].thread, NULL,
+			shard_thread, &c->shards[cnt]) == 0);
+	}
+	for (cnt = 0; cnt < receivers; cnt++)
+	{
+		c->receivers[cnt].started = (c->receivers[cnt].touched != NULL) &&
+			(pthread_create(&c->receivers[cnt].thread, NULL,
+			receive_thread, &c->receivers[cnt]) == 0);
+		if (!c->receivers[cnt].started)
+		{
+			fprintf(stderr, "Error starting receiver threads\n");
+			collector_free(c);
+			return NULL;
+		}
+	}
+	debug_print("%i receivers, %i shards\n", receivers, shards);
+
+	return c;
+}
+
+/*
+ * collector_totals
+ *
+ * sums up the counters of all threads
+ */
+
+void collector_totals(const struct collector *c, unsigned long *datagrams, unsigned long *samples,
+	unsigned long *dropped, unsigned long *lost)
+{
+	int cnt;
+
+	*datagrams = 0;
+	*samples = 0;
+	*dropped = 0;
+	*lost = 0;
+	for (cnt = 0; cnt < c->amount_receivers; cnt++)
+	{
+		*dropped += atomic_load(&c->receivers[cnt].dropped);
+	}
+	for (cnt = 0; cnt < c->amount_shards; cnt++)
+	{
+		*datagrams += atomic_load(&c->shards[cnt].datagrams);
+		*samples += atomic_load(&c->shards[cnt].samples);
+		*lost += atomic_load(&c->shards[cnt].lost);
+	}
+}
+
+void print_stats(const struct collector *c)
+{
+	const struct receiver *r;
+	const struct shard *s;
+	int cnt;
+
+	for (cnt = 0; cnt < c->amount_receivers; cnt++)
+	{
+		r = &c->receivers[cnt];
+		fprintf(stderr, "receiver %i: %lu datagrams, %lu dropped (shard busy), %lu malformed\n",
+			cnt, atomic_load(&r->datagrams), atomic_load(&r->dropped),
+			atomic_load(&r->malformed));
+	}
+	for (cnt = 0; cnt < c->amount_shards; cnt++)
+	{
+		s = &c->shards[cnt];
+		fprintf(stderr, "shard %i: %lu nodes, %lu datagrams, %lu samples, %lu malformed, "
+			"%lu lost, %lu late, %lu duplicates, %lu restarts\n",
+			cnt, atomic_load(&s->nodes_seen), atomic_load(&s->datagrams),
+			atomic_load(&s->samples), atomic_load(&s->malformed), atomic_load(&s->lost),
+			atomic_load(&s->late), atomic_load(&s->duplicates), atomic_load(&s->restarts));
+	}
+}
+
+/*
+ * block_signals
+ *
+ * blocks the signals the main thread waits for, called before
+ * any thread is created so all threads inherit the mask
+ */
+
+void block_signals(sigset_t *signals)
+{
+	sigemptyset(signals);
+	sigaddset(signals, SIGINT);
+	sigaddset(signals, SIGTERM);
+	sigaddset(signals, SIGHUP);
+	sigaddset(signals, SIGUSR1);
+	pthread_sigmask(SIG_BLOCK, signals, NULL);
+}
+
+/*
+ * run_collector
+ *
+ * receives samples until stopped by a signal
+ */
+
+int run_collector()
+{
+	struct collector *c;
+	sigset_t signals;
+	int outfd = STDOUT_FILENO;
+	int sig;
+
+	block_signals(&signals);
+	if (config.history != NULL)
+	{
+		outfd = open(config.history, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+		if (outfd < 0)
+		{
+			perror(config.history);
+			return 0;
+		}
+	}
+	c = collector_start(config.listen, config.receivers,
+		(config.shards > 0) ? config.shards : config.receivers, outfd);
+	if (c == NULL)
+	{
+		return 0;
+	}
+	while (sigwait(&signals, &sig) == 0)
+	{
+		if (sig == SIGUSR1)
+		{
+			print_stats(c);
+			continue;
+		}
+		break;
+	}
+	collector_stop(c);
+	if (config.stats)
+	{
+		print_stats(c);
+	}
+	collector_free(c);
+	if (outfd != STDOUT_FILENO)
+	{
+		close(outfd);
+	}
+
+	return 1;
+}
+
+struct sender
+{
+	pthread_t thread;
+	const char *collector;
+	int index;
+	unsigned long sent; /* samples */
+	unsigned long failed; /* datagrams */
+};
+
+/*
+ * send_thread
+ *
+ * pushes samples of BENCHMARK_NODES nodes as fast as possible
+ */
+
+void *send_thread(void *arg)
+{
+	struct sender *sender = (struct sender *) arg;
+	struct temper_push *nodes;
+	float values[TEMPER_CHANNELS];
+	uint64_t now;
+	int cnt;
+	int device;
+
+	nodes = (struct temper_push *) calloc(BENCHMARK_NODES, sizeof(struct temper_push));
+	if (nodes == NULL)
+	{
+		return NULL;
+	}
+	for (cnt = 0; cnt < BENCHMARK_NODES; cnt++)
+	{
+		if (temper_push_open(&nodes[cnt], sender->collector,
+			sender->index * BENCHMARK_NODES + cnt + 1, 32, 1000) != TEMPER_OK)
+		{
+			nodes[cnt].fd = -1;
+		}
+	}
+	temper_invalidate(values);
+	values[TEMPER_INT_TEMP] = 23.5;
+	values[TEMPER_INT_HUM] = 41.0;
+	temper_derive(values);
+	while (atomic_load_explicit(&benchmark_running, memory_order_relaxed))
+	{
+		now = temper_time_us(CLOCK_REALTIME);
+		// one round of two devices per node
+		for (cnt = 0; cnt < BENCHMARK_NODES; cnt++)
+		{
+			for (device = 0; (device < 2) && (nodes[cnt].fd >= 0); device++)
+			{
+				(void)temper_push_add(&nodes[cnt], device, now, TEMPER_OK, values);
+			}
+		}
+	}
+	for (cnt = 0; cnt < BENCHMARK_NODES; cnt++)
+	{
+		// the partial batches are not sent, the counters are final
+		nodes[cnt].count = 0;
+		sender->sent += nodes[cnt].samples;
+		sender->failed += nodes[cnt].failed;
+		temper_push_close(&nodes[cnt]);
+	}
+	free(nodes);
+
+	return NULL;
+}
+
+/*
+ * benchmark_run
+ *
+ * floods a collector with receivers threads on localhost and
+ * prints the samples sent and received per second
+ */
+
+void benchmark_run(int receivers)
+{
+	struct sockaddr_storage addr;
+	socklen_t addrlen = sizeof(addr);
+	struct sender senders[config.senders];
+	struct collector *c;
+	char collector[64];
+	unsigned long sent = 0;
+	unsigned long failed = 0;
+	unsigned long datagrams;
+	unsigned long samples;
+	unsigned long dropped;
+	unsigned long lost;
+	int outfd;
+	int cnt;
+
+	outfd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+	c = collector_start("127.0.0.1:0", receivers,
+		(config.shards > 0) ? config.shards : receivers, outfd);
+	if (c == NULL)
+	{
+		exit(EXIT_FAILURE);
+	}
+	(void)getsockname(c->receivers[0].fd, (struct sockaddr *) &addr, &addrlen);
+	(void)snprintf(collector, sizeof(collector), "127.0.0.1:%i",
+		ntohs(((struct sockaddr_in *) &addr)->sin_port));
+
+	atomic_store(&benchmark_running, true);
+	memset(senders, 0, sizeof(senders));
+	for (cnt = 0; cnt < config.senders; cnt++)
+	{
+		senders[cnt].collector = collector;
+		senders[cnt].index = cnt;
+		if (pthread_create(&senders[cnt].thread, NULL, send_thread, &senders[cnt]) != 0)
+		{
+			fprintf(stderr, "Error starting sender threads\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	sleep(BENCHMARK_SECONDS);
+	atomic_store(&benchmark_running, false);
+	for (cnt = 0; cnt < config.senders; cnt++)
+	{
+		pthread_join(senders[cnt].thread, NULL);
+		sent += senders[cnt].sent;
+		failed += senders[cnt].failed;
+	}
+	// let the receivers empty the socket buffers
+	usleep(200000);
+	collector_stop(c);
+	collector_totals(c, &datagrams, &samples, &dropped, &lost);
+	collector_free(c);
+	close(outfd);
+
+	printf("%9i %6i %12.0f %12.0f %8.2f%% %8lu %8lu\n", receivers,
+		(config.shards > 0) ? config.shards : receivers,
+		(double) sent / BENCHMARK_SECONDS, (double) samples / BENCHMARK_SECONDS,
+		(sent > 0) ? 100.0 * (sent - samples) / sent : 0.0, dropped, lost);
+}
+
+/*
+ * run_benchmark
+ *
+ * compares the samples received per second for increasing
+ * amounts of receiver threads
+ */
+
+void run_benchmark()
+{
+	int receivers;
+
+	printf("%i sender threads, %i nodes each, %i seconds per run\n",
+		config.senders, BENCHMARK_NODES, BENCHMARK_SECONDS);
+	printf("receivers shards       sent/s   received/s  dropped    shard     gaps\n");
+	for (receivers = 1; receivers < config.receivers; receivers *= 2)
+	{
+		benchmark_run(receivers);
+	}
+	benchmark_run(config.receivers);
+}
+
+int main(int argc, char **argv)
+{
+	parse_parameters(argc, argv);
+
+	if (config.benchmark)
+	{
+		run_benchmark();
+		exit(EXIT_SUCCESS);
+	}
+	exit(run_collector() ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+/*
+ * tempercollector Copyright (C) 2020-2021 Armin Fuerst (armin@fuerst.priv.at)
+ *
+ * This file is part of tempersensor.
+ *
+ * Tempersensor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tempersensor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tempersensor.  If not, see <https://www.gnu.org/licenses/>.
+ */
@@ -7,79 +7,69 @@
 // https://github.com/urwen/temper - probably additional infos...
 
 #include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <getopt.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
-#include <math.h>
-#include <linux/hidraw.h>
-#include <sys/select.h>
-#include <fcntl.h>
-#include <errno.h>
-#include <dirent.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
 #include "mrtg.h"
+#include "temper.h"
+#include "alert.h"
+#include "cache.h"
+#include "deadband.h"
+#include "hotplug.h"
+#include "oversample.h"
+#include "round.h"
+#include "sampler.h"
+#ifndef TEMPER_SINGLE_PROFILE
+#include "collectd.h"
+#include "mqtt.h"
+#include "push.h"
+#include "sketch.h"
+#include "snmp.h"
+#include "stream.h"
+#include "decode.h"
+#include "derive.h"
+#include "sim.h"
+#endif
+#ifdef TEMPER_ALLOC_TEST
+#include "alloctest.h"
+#endif
 
 #define PROGRAMNAME "tempersensor"
 #define VERSION "0.1.8"
-#define USBCommunicationTimeout 5000
-
-/*
- * some USB definitions
- *
- * https://www.codeproject.com/Tips/1007522/Temper-USB-Thermometer-in-Csharp
- */
-
-#define USB_request_type 0x21
-#define USB_set_report 0x09
-#define USB_output_report 0x0200 // add report to this
-#define USB_report0 0x00
-#define USB_report1 0x01
-
-/*
- * Temper magic strings
- *
- */
-
-//const static unsigned char query_vals[] = { 0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
-const static unsigned char query_vals[] = { 0x01, 0x80, 0x33, 0x01, 0x00, 0x00, 0x00, 0x00 };
-const static unsigned char query_firmware[] = { 0x01, 0x86, 0xff, 0x01, 0x00, 0x00, 0x00, 0x00 };
-#define ENDPOINT_INTERRUPT_IN 0x82 // comment from pcsensor.c: endpoint 0x81 address for IN
-#define ENDPOINT_INTERRUPT_OUT 0x02 // comment from pcsensor.c: endpoint 1 address for OUT
-#define ENDPOINT_BULK_IN 0x82 // comment from pcsensor.c: endpoint 0x81 address for IN
-#define ENDPOINT_BULK_OUT 0x00 // comment from pcsensor.c: endpoint 1 address for OUT
-#define INTERFACE1 0x00
-#define INTERFACE2 0x01
-#define ANSWERSIZE 8
-
-/*
- * list of vendor IDs and product IDs being supported
- * the order of the two arrays is relevant, only the
- * nth entry of both arrays in combination define a
- * supported device.
- */
-const static unsigned short vendorId[] =
-{
-	0x1130, // Tenx Technology, Inc. Foot Pedal/Thermometer (untested)
-	0x0c45, // TEMPer / TEMPer1F_V1.3r1F (tested), 
-		// TEMPer / TEMPerF1.4 (some tests)
-	0x413d, // TEMPer / TEMPerGold_V3.1 (untested),
-		// TEMPerHUM / TEMPerX_V3.1 (untested),
-		// TEMPerHUM / TEMPerX_V3.3 (tested),
-		// TEMPer2 / TEMPerX_V3.3 (untested)
-		// TEMPer1F / TEMPerX_V3.3 (untested)
-	0x1a86  // TEMPerX232 / TEMPerX232_V2.0 (untested)
-};
-const static unsigned short productId[] =
-{
-	0x660c,
-	0x7401,
-	0x2107,
-	0x5523
-};
+#define MAX_DEVICES 16
+#define BENCHMARK_DEVICES 12
+#define BENCHMARK_SECONDS 3
+#define STREAM_BENCHMARK_FRAMES 500000 /* per run, spread over the subscribers */
+#define MAX_ALERTS 16
+#define FAILOVER_TIMEOUT_MS 1000 /* read timeout of device and standby in one-shot mode */
+#define SNMP_INTERVAL 5000 /* default sampling interval when serving SNMP */
+#define COLLECTD_INTERVAL 10000 /* default if COLLECTD_INTERVAL is not set */
+#define MQTT_KEEPALIVE 60 /* seconds without traffic before pinging the broker */
+#define REALTIME_PRIORITY 10 /* of the sampling threads with --realtime */
 
 struct config
 {
@@ -90,26 +80,84 @@ struct config
 	int out_sensor; /* which sensor to report as "OUT" */
 	float calibration_in;
 	float calibration_out;
+	int conversion_method; /* -1 = autodetect from firmware */
+	int interval; /* sampling interval in ms, -1 = one-shot MRTG output */
+	int workers; /* worker threads in continuous mode, 0 = one per device */
+	int count; /* samples per device in continuous mode, 0 = unlimited */
+	int simulate; /* amount of simulated devices, 0 = use hardware */
+	int backend; /* TEMPER_BACKEND_* used in continuous mode */
+	bool benchmark;
+	bool stats;
+	bool quantiles; /* collect p50/p95/p99 per channel in continuous mode */
+	char *history; /* file to append samples to in continuous mode */
+	const char *cache_dir; /* directory for lock files in one-shot mode */
+	int cache_max_age; /* reuse results of other processes up to this age in ms */
+	int oversample; /* queries per reading, 1 = no oversampling */
+	int budget; /* time for the queries of one reading in ms */
+	int reduce; /* TEMPER_REDUCE_* */
+	float max_deviation; /* reject readings this far from the history, 0 = off */
+	struct temper_alert_rule alerts[MAX_ALERTS];
+	const char *alert_devices[MAX_ALERTS]; /* device a rule is limited to, NULL = all */
+	int amount_alerts;
+	const char *alert_output; /* events go to stderr if NULL */
+	bool use_deadband; /* write only samples passing config.deadband */
+	struct temper_deadband deadband;
+	int min_interval; /* adaptive sampling bounds in ms, 0 = fixed interval */
+	int max_interval;
+	float adapt_rate; /* change per minute speeding up adaptive sampling */
+	bool snapshot; /* query all devices in one round, report the spread */
+	const char *standby; /* device taking over if the selected one fails, NULL = none */
+	int simulate_hang; /* value queries sim0 answers before it hangs, -1 = forever */
+	int recover_after; /* timeouts in a row before a device is reset, 0 = never */
+	int recover_timeout; /* time in ms a reset device may take to come back */
+	bool hotplug; /* take devices plugged in while running continuous mode */
+	const char *push; /* collector receiving the samples, NULL = none */
+	uint32_t push_node; /* ID of this node at the collector */
+	int push_batch; /* samples per datagram */
+	int push_flush; /* time in ms a sample may wait for a datagram */
+	const char *snmp_base; /* answer net-snmp pass_persist requests below this OID, NULL = off */
+	bool collectd; /* print PUTVAL lines for the exec plugin of collectd */
+	const char *mqtt; /* broker receiving the samples, NULL = none */
+	const char *mqtt_topic; /* first level of the topics */
+	const char *mqtt_client; /* client ID, NULL = derived from the host name */
+	int mqtt_qos; /* 0 or 1 */
+	bool mqtt_retain; /* broker keeps the last value of each topic */
+	const char *stream; /* Unix socket streaming the samples to subscribers, NULL = none */
+	int tick; /* low-wakeup: all timers wait for multiples of tick ms, 0 = off */
+	int slack; /* timer slack of all threads in ms, 0 = default of the kernel */
+	int sched_policy; /* of the sampling threads, SCHED_OTHER = not real-time */
+	int sched_priority;
+	uint64_t cpus; /* CPUs of the sampling threads, bit n = CPU n, 0 = any */
+	bool mlock; /* lock all memory of the process */
 };
 
-/* where in the values-array to find which sensor */
-#define NO_SENSOR -1
-#define INT_TEMP 0
-#define INT_HUM 1
-#define EXT_TEMP 2
-#define EXT_HUM 3
+/*
+ * struct sensor
+ *
+ * a device used in continuous mode
+ */
+struct sensor
+{
+	char name[261];
+	struct temper_ctx *ctx;
+	struct temper_windowed *quantiles; /* one per channel, NULL if not collected */
+	struct temper_alert_state alerts[MAX_ALERTS]; /* one per rule in config.alerts */
+	uint32_t alert_rules; /* bit per rule applying to this device */
+	struct temper_deadband_state deadband;
+	struct temper_sample latest; /* served to SNMP, under latest_lock */
+	bool has_latest;
+};
 
-struct device
+/*
+ * struct continuous
+ *
+ * state of continuous mode shared with the callbacks of the sampler
+ */
+struct continuous
 {
-	char firmware[17];
-	uint16_t vendor_id;
-	uint16_t product_id;
-	char *hidraw_devpath;
-	int fd;
-	int amount_value_responses; /* amount of bytes expected to value-request */
-	int conversion_method; /* devices have different types of representation */
-	float values[4]; /* the values read from the device */
-	int sensors[2][2]; /* define which part of the response defines which sensor */
+	FILE *history;
+	int *counts; /* samples per device */
+	int complete; /* devices having reached config.count */
 };
 
 /*
@@ -117,17 +165,63 @@ struct device
  */
 
 struct config config;
-struct device device;
+struct sensor *sensors;
+int amount_sensors;
+/* the aggregator thread feeds the quantiles, the main thread prints them */
+pthread_mutex_t quantiles_lock = PTHREAD_MUTEX_INITIALIZER;
+const char *channel_names[TEMPER_CHANNELS] =
+	{ "it", "ih", "et", "eh", "dp", "ah", "hi", "edp", "eah", "ehi" };
+struct temper_alert_sink alert_sink;
+/* the aggregator thread stores the latest samples, the main thread answers SNMP */
+pthread_mutex_t latest_lock = PTHREAD_MUTEX_INITIALIZER;
+#ifndef TEMPER_SINGLE_PROFILE
+/* the aggregator thread adds samples, the main thread sends batches due */
+struct temper_push push;
+pthread_mutex_t push_lock = PTHREAD_MUTEX_INITIALIZER;
+struct temper_snmp snmp;
+/* columns of the table below the base OID, in the order of the OIDs */
+#define SNMP_CHANNELS(first) first, first + 1, first + 2, first + 3, first + 4, \
+	first + 5, first + 6, first + 7, first + 8, first + 9
+const int snmp_columns[] = { 1, 2, 3, 4, SNMP_CHANNELS(10), SNMP_CHANNELS(30),
+	SNMP_CHANNELS(50), SNMP_CHANNELS(60), SNMP_CHANNELS(70), SNMP_CHANNELS(80), SNMP_CHANNELS(90),
+	SNMP_CHANNELS(100), SNMP_CHANNELS(110), SNMP_CHANNELS(120), SNMP_CHANNELS(130) };
+/* the aggregator thread publishes, the main thread keeps the connection */
+struct temper_mqtt mqtt;
+pthread_mutex_t mqtt_lock = PTHREAD_MUTEX_INITIALIZER;
+/* the aggregator thread fans samples out, the main thread serves the socket */
+struct temper_stream stream;
+pthread_mutex_t stream_lock = PTHREAD_MUTEX_INITIALIZER;
+/* only used by the aggregator thread once the sampler runs */
+struct temper_collectd collectd;
+#endif
+/* spread of snapshots, written by the aggregator thread */
+uint32_t snapshot_spread_max;
+uint64_t snapshot_spread_sum;
+unsigned long snapshot_samples;
+/* the aggregator thread wakes the main thread when a push batch starts */
+int main_wakefd = -1;
+/* low-wakeup: timer of the main thread, expires on ticks only */
+int tick_fd = -1;
+/* wakeups are counted from the start of continuous mode */
+struct rusage start_usage;
+uint64_t start_us;
 
 /*
  * forward declarations
  */
 
-void test_calc();
+#ifndef TEMPER_SINGLE_PROFILE
+void run_tests();
+bool snmp_object(int column, int row, char *value, size_t size, void *userdata);
+void collectd_sample(const struct temper_sample *sample);
+bool alloc_quantiles(struct sensor *sensor);
+#endif
+void continuous_callback(const struct temper_sample *sample, void *userdata);
 
 void printVersion()
 {
-	printf("%s version %s, libmrtg version %s\n", PROGRAMNAME, VERSION, libmrtg_version());
+	printf("%s version %s, libmrtg version %s, libtempersensor version %s\n",
+		PROGRAMNAME, VERSION, libmrtg_version(), libtempersensor_version());
 }
 
 /*
@@ -179,18 +273,133 @@ char *option_string(const struct option *long_options)
 void usage()
 {
 	printVersion();
+	printf("\t--adaptive=MIN:MAX\t\tin continuous mode, sample between every\n");
+	printf("\t\t\t\t\tMIN and MAX milliseconds depending on how\n");
+	printf("\t\t\t\t\tfast the values change, starting at the\n");
+	printf("\t\t\t\t\tinterval given by -i (default=MAX)\n");
+	printf("\t--adapt-rate=N.N\t\tspeed up when a value changes more than\n");
+	printf("\t\t\t\t\tN.N per minute (default=1.0)\n");
+	printf("\t--alert=RULE\t\t\tcheck every sample in continuous mode,\n");
+	printf("\t\t\t\t\tRULE is CHANNEL[@DEVICE]:CHECK=N[,...]\n");
+	printf("\t\t\t\t\twith CHANNEL as SENSOR of --report-in\n");
+	printf("\t\t\t\t\tvalues for CHECK:\n");
+	printf("\t\t\t\t\t high, low = thresholds\n");
+	printf("\t\t\t\t\t hysteresis = clear when N back inside\n");
+	printf("\t\t\t\t\t duration = raise after N ms (default=0)\n");
+	printf("\t\t\t\t\t rate = maximum change per minute\n");
+	printf("\t--alert-output=TARGET\t\twhere alert events go (default=stderr)\n");
+	printf("\t\t\t\t\tvalues for TARGET:\n");
+	printf("\t\t\t\t\t fifo:PATH = named pipe\n");
+	printf("\t\t\t\t\t unix:PATH = Unix datagram socket\n");
+	printf("\t\t\t\t\t exec:COMMAND = run COMMAND with the\n");
+	printf("\t\t\t\t\t     event fields as $1 ... $6\n");
 	printf("\t--calibration-in=[-]n.n\tmodify result for IN\n");
 	printf("\t--calibration-out=[-]n.n\tmodify result for OUT\n");
+	printf("\t--cache-dir=DIR\t\t\tdirectory for the lock files shared by\n");
+	printf("\t\t\t\t\tconcurrent calls (default=%s)\n", TEMPER_CACHE_DIR);
+	printf("\t--cache-max-age=MS\t\treuse a result of another call if it is\n");
+	printf("\t\t\t\t\tnot older than MS milliseconds\n");
+	printf("\t\t\t\t\t(default=1000, 0 = always query)\n");
+#ifndef TEMPER_SINGLE_PROFILE
+	printf("\t--collectd\t\t\tsample continuously and print PUTVAL lines\n");
+	printf("\t\t\t\t\tfor the exec plugin of collectd, interval\n");
+	printf("\t\t\t\t\tand host from COLLECTD_INTERVAL and\n");
+	printf("\t\t\t\t\tCOLLECTD_HOSTNAME, all samples of a tick\n");
+	printf("\t\t\t\t\tare written at once\n");
+#endif
 	printf("\t--conversion-method=METHOD\toverride conversion from response\n");
 	printf("\t\t\t\t\tvalues for METHOD:\n");
 	printf("\t\t\t\t\t 1 = two's complement with 4 bits used\n");
 	printf("\t\t\t\t\t     for fraction\n");
 	printf("\t\t\t\t\t 2 = two's complement with 16 bits,\n");
 	printf("\t\t\t\t\t     value assumed multiplied by 100\n");
+	printf("\t--cpu=N[,N...]\t\t\tin continuous mode, run the sampling\n");
+	printf("\t\t\t\t\tthreads on these CPUs only (0 ... 63)\n");
+	printf("\t--deadband=[CHANNEL:]N[%%]\tin continuous mode, write a sample only if\n");
+	printf("\t\t\t\t\ta channel changed by more than N (or N\n");
+	printf("\t\t\t\t\tpercent) since the last one written,\n");
+	printf("\t\t\t\t\twithout CHANNEL for all channels, channels\n");
+	printf("\t\t\t\t\tnot given report every change\n");
 	printf("\t-d, --debug\t\t\tshow debug output\n");
 	printf("\t-f, --fahrenheit\t\treport temperatures in Fahrenheit\n");
 	printf("\t-h, --help\t\t\thelp\n");
+	printf("\t--heartbeat=MS\t\t\twith --deadband, write a sample at least\n");
+	printf("\t\t\t\t\tevery MS milliseconds (default=0 = off)\n");
+	printf("\t--backend=BACKEND\t\thow to query devices in continuous mode\n");
+	printf("\t\t\t\t\tvalues for BACKEND:\n");
+	printf("\t\t\t\t\t sequential = one after the other (default)\n");
+	printf("\t\t\t\t\t io_uring = batched rounds, falls back to\n");
+	printf("\t\t\t\t\t     epoll if io_uring is not available\n");
+	printf("\t\t\t\t\t epoll = batched rounds using epoll\n");
+#ifndef TEMPER_SINGLE_PROFILE
+	printf("\t--benchmark\t\t\tmeasure sampling throughput and latency\n");
+	printf("\t\t\t\t\twith simulated devices, with --stream the\n");
+	printf("\t\t\t\t\tcost of streaming to many subscribers\n");
+#endif
+	printf("\t--count=N\t\t\tstop continuous mode after N samples\n");
+	printf("\t\t\t\t\tper device\n");
+	printf("\t--hotplug\t\t\tin continuous mode, sample devices plugged\n");
+	printf("\t\t\t\t\tin while running too (up to %i), start\n", TEMPER_HOTPLUG_DEVICES);
+	printf("\t\t\t\t\teven without devices\n");
+	printf("\t--history=FILE\t\t\tappend samples to FILE in continuous mode\n");
+	printf("\t-i, --interval=MS\t\tsample all devices every MS milliseconds\n");
+	printf("\t\t\t\t\tand print one line per sample\n");
+	printf("\t--low-power=TICK[:SLACK]\tin continuous mode, wake up only every\n");
+	printf("\t\t\t\t\tTICK milliseconds: sampling, flushes and\n");
+	printf("\t\t\t\t\tpings share these wakeups, other timed\n");
+	printf("\t\t\t\t\twaits may be delayed by SLACK milliseconds\n");
+	printf("\t\t\t\t\t(default=TICK/10), --stats reports the\n");
+	printf("\t\t\t\t\twakeups per minute\n");
+	printf("\t--max-deviation=N.N\t\twhen oversampling in continuous mode, reject\n");
+	printf("\t\t\t\t\treadings differing more than N.N from the\n");
+	printf("\t\t\t\t\trecent results (default=0 = off)\n");
+	printf("\t--oversample=K\t\t\tquery K times per reading and reduce the\n");
+	printf("\t\t\t\t\tresults (default=1, maximum=%i)\n", TEMPER_OVERSAMPLE_MAX);
+	printf("\t--budget=MS\t\t\tstop oversampling before MS milliseconds\n");
+	printf("\t\t\t\t\tare exceeded (default=500)\n");
+	printf("\t--mlock\t\t\t\tin continuous mode, keep all memory of the\n");
+	printf("\t\t\t\t\tprocess in RAM (mlockall)\n");
+#ifndef TEMPER_SINGLE_PROFILE
+	printf("\t--mqtt=HOST[:PORT]\t\tin continuous mode, publish the samples\n");
+	printf("\t\t\t\t\twritten to an MQTT broker as\n");
+	printf("\t\t\t\t\tTOPIC/DEVICE/CHANNEL (default port=%s)\n", TEMPER_MQTT_PORT);
+	printf("\t--mqtt-client=ID\t\tclient ID at the broker, up to 23\n");
+	printf("\t\t\t\t\tcharacters (default=derived from the\n");
+	printf("\t\t\t\t\thost name)\n");
+	printf("\t--mqtt-qos=N\t\t\tpublish with QoS 0 or 1 (default=0)\n");
+	printf("\t--mqtt-retain\t\t\tthe broker keeps the latest values\n");
+	printf("\t--mqtt-topic=TOPIC\t\tfirst level of the topics\n");
+	printf("\t\t\t\t\t(default=tempersensor)\n");
+#endif
 	printf("\t-p, --precision=LEN\t\tamount of decimal places (default=0)\n");
+#ifndef TEMPER_SINGLE_PROFILE
+	printf("\t--push=HOST[:PORT]\t\tin continuous mode, send the samples\n");
+	printf("\t\t\t\t\twritten to a collector over UDP\n");
+	printf("\t\t\t\t\t(default port=%s)\n", TEMPER_PUSH_PORT);
+	printf("\t--push-batch=N\t\t\tsamples per datagram (default=32,\n");
+	printf("\t\t\t\t\tmaximum=%i)\n", TEMPER_PUSH_MAX_SAMPLES);
+	printf("\t--push-flush=MS\t\t\tsend a datagram at the latest MS\n");
+	printf("\t\t\t\t\tmilliseconds after its first sample\n");
+	printf("\t\t\t\t\t(default=1000)\n");
+	printf("\t--push-node=ID\t\t\tID of this node at the collector\n");
+	printf("\t\t\t\t\t(default=derived from the host name)\n");
+	printf("\t--quantiles\t\t\tcollect p50/p95/p99 of the last hour, day\n");
+	printf("\t\t\t\t\tand week in continuous mode, printed at\n");
+	printf("\t\t\t\t\tthe end and on SIGUSR1\n");
+#endif
+	printf("\t--realtime=POLICY[:PRIORITY]\tin continuous mode, run the sampling\n");
+	printf("\t\t\t\t\tthreads with real-time scheduling, POLICY\n");
+	printf("\t\t\t\t\tis fifo or rr (default PRIORITY=%i),\n", REALTIME_PRIORITY);
+	printf("\t\t\t\t\t--stats shows the jitter of the queries\n");
+	printf("\t--recover=N\t\t\tin continuous mode, reset a device after N\n");
+	printf("\t\t\t\t\ttimeouts in a row and reopen it\n");
+	printf("\t--recover-timeout=MS\t\ttime a reset device may take to come\n");
+	printf("\t\t\t\t\tback (default=5000)\n");
+	printf("\t--reduce=METHOD\t\t\thow to reduce oversampled readings\n");
+	printf("\t\t\t\t\tvalues for METHOD:\n");
+	printf("\t\t\t\t\t median = median (default)\n");
+	printf("\t\t\t\t\t trimmed = mean without lowest and\n");
+	printf("\t\t\t\t\t     highest quarter\n");
 	printf("\t--report-in=SENSOR\t\treport sensor SENSOR as IN value\n");
 	printf("\t--report-out=SENSOR\t\treport sensor SENSOR as OUT value\n");
 	printf("\t\t\t\t\tvalues for SENSOR:\n");
@@ -198,8 +407,224 @@ void usage()
 	printf("\t\t\t\t\t et = external temperature\n");
 	printf("\t\t\t\t\t ih = internal humitity\n");
 	printf("\t\t\t\t\t eh = external humitity\n");
-	printf("\t-t, --test\t\t\trun tests for temperature calculation\n");
+	printf("\t\t\t\t\t dp = internal dew point\n");
+	printf("\t\t\t\t\t ah = internal absolute humidity (g/m³)\n");
+	printf("\t\t\t\t\t hi = internal heat index\n");
+	printf("\t\t\t\t\t edp, eah, ehi = the same for the\n");
+	printf("\t\t\t\t\t     external sensor\n");
+#ifndef TEMPER_SINGLE_PROFILE
+	printf("\t--simulate=N\t\t\tuse N simulated devices instead of hardware\n");
+	printf("\t--simulate-hang=N\t\tsimulated device sim0 stops answering\n");
+	printf("\t\t\t\t\tafter N value queries (again after\n");
+	printf("\t\t\t\t\teach reset)\n");
+#endif
+#ifndef TEMPER_SINGLE_PROFILE
+	printf("\t--snmp-pass-persist=BASEOID\tsample continuously and answer the\n");
+	printf("\t\t\t\t\tpass_persist requests of snmpd below\n");
+	printf("\t\t\t\t\tBASEOID from the latest samples (interval\n");
+	printf("\t\t\t\t\tdefault=%i ms), per device N:\n", SNMP_INTERVAL);
+	printf("\t\t\t\t\t BASEOID.1.1.N = index\n");
+	printf("\t\t\t\t\t BASEOID.1.2.N = name\n");
+	printf("\t\t\t\t\t BASEOID.1.3.N = status (0 = ok)\n");
+	printf("\t\t\t\t\t BASEOID.1.4.N = age of the sample\n");
+	printf("\t\t\t\t\t BASEOID.1.10+C.N = channel C (order of\n");
+	printf("\t\t\t\t\t     --report-in) in hundredths\n");
+	printf("\t\t\t\t\t BASEOID.1.30+C.N = channel C as string\n");
+	printf("\t\t\t\t\t BASEOID.1.50+C.N = with --quantiles, p50\n");
+	printf("\t\t\t\t\t     of channel C in hundredths over the\n");
+	printf("\t\t\t\t\t     last hour, 60+C p95, 70+C p99, the\n");
+	printf("\t\t\t\t\t     same for the day from 80 and for the\n");
+	printf("\t\t\t\t\t     week from 110\n");
+#endif
+	printf("\t--snapshot\t\t\tin continuous mode, send the command to all\n");
+	printf("\t\t\t\t\tdevices back to back, all values of a\n");
+	printf("\t\t\t\t\tsnapshot get one time, the spread between\n");
+	printf("\t\t\t\t\tthe devices in microseconds is appended\n");
+	printf("\t--standby=DEVICE\t\tquery DEVICE (hidraw node, or simN with\n");
+	printf("\t\t\t\t\t--simulate) together with the selected\n");
+	printf("\t\t\t\t\tdevice and report its values if the\n");
+	printf("\t\t\t\t\tselected one fails. In continuous mode\n");
+	printf("\t\t\t\t\tthe source of the values is appended\n");
+#ifndef TEMPER_SINGLE_PROFILE
+	printf("\t--stream=PATH\t\t\tin continuous mode, stream the samples to\n");
+	printf("\t\t\t\t\tsubscribers of the Unix socket PATH, see\n");
+	printf("\t\t\t\t\tstream.h for the protocol\n");
+#endif
+	printf("\t--stats\t\t\t\tprint statistics when continuous mode ends,\n");
+	printf("\t\t\t\t\tSIGUSR1 prints them at any time\n");
+#ifndef TEMPER_SINGLE_PROFILE
+	printf("\t-t, --test\t\t\trun the self tests of the library and exports\n");
+#endif
 	printf("\t-V, --version\t\t\tdisplay version information\n");
+	printf("\t--workers=N\t\t\tamount of sampling threads (default=one\n");
+	printf("\t\t\t\t\tper device)\n");
+}
+
+/*
+ * numeric_argument
+ *
+ * parses a numeric option and exits if it is not numeric
+ * or smaller than min
+ */
+
+int numeric_argument(const char *name, const char *arg, int min, char *os)
+{
+	int value;
+
+	if (!(sscanf(arg, "%i", &value) == 1))
+	{
+		fprintf(stderr, "Error: '%s' is not numeric.\n", arg);
+		free(os);
+		exit(EXIT_FAILURE);
+	}
+	if (value < min)
+	{
+		fprintf(stderr, "Invalid value for %s: '%s'\n", name, arg);
+		free(os);
+		exit(EXIT_FAILURE);
+	}
+	return value;
+}
+
+/*
+ * parse_cpus
+ *
+ * parses a comma separated list of CPUs into a mask, returns false
+ * if it is not valid
+ */
+
+bool parse_cpus(const char *arg, uint64_t *cpus)
+{
+	const char *p = arg;
+	char *end;
+	long cpu;
+
+	*cpus = 0;
+	do
+	{
+		cpu = strtol(p, &end, 10);
+		if ((end == p) || (cpu < 0) || (cpu > 63) || ((*end != ',') && (*end != '\0')))
+		{
+			return false;
+		}
+		*cpus |= 1ULL << cpu;
+		p = end + 1;
+	} while (*end == ',');
+
+	return true;
+}
+
+/*
+ * parse_deadband
+ *
+ * parses [CHANNEL:]N[%] into db, returns false if spec is not valid
+ */
+
+bool parse_deadband(const char *spec, struct temper_deadband *db)
+{
+	const char *colon = strchr(spec, ':');
+	char percent = '\0';
+	float threshold;
+	int channel = 0;
+	int last = TEMPER_CHANNELS - 1;
+
+	if (colon != NULL)
+	{
+		for (channel = 0; channel < TEMPER_CHANNELS; channel++)
+		{
+			if ((strlen(channel_names[channel]) == (size_t)(colon - spec)) &&
+				!strncmp(spec, channel_names[channel], colon - spec))
+				break;
+		}
+		if (channel == TEMPER_CHANNELS)
+		{
+			return false;
+		}
+		last = channel;
+		spec = colon + 1;
+	}
+	if ((sscanf(spec, "%f%c", &threshold, &percent) < 1) ||
+		((percent != '\0') && (percent != '%')) || (threshold < 0.0))
+	{
+		return false;
+	}
+	for (; channel <= last; channel++)
+	{
+		db->threshold[channel] = threshold;
+		db->relative[channel] = (percent == '%');
+	}
+	return true;
+}
+
+/*
+ * parse_alert
+ *
+ * parses CHANNEL[@DEVICE]:CHECK=N[,CHECK=N...] into rule and device,
+ * device points into spec. Returns false if spec is not valid.
+ */
+
+bool parse_alert(char *spec, struct temper_alert_rule *rule, const char **device)
+{
+	char *checks = strchr(spec, ':');
+	char *at;
+	char *check;
+	char *saveptr;
+	float value;
+	int channel;
+
+	memset(rule, 0, sizeof(*rule));
+	*device = NULL;
+	if (checks == NULL)
+	{
+		return false;
+	}
+	*checks++ = '\0';
+	at = strchr(spec, '@');
+	if (at != NULL)
+	{
+		*at = '\0';
+		*device = at + 1;
+	}
+	for (channel = 0; channel < TEMPER_CHANNELS; channel++)
+	{
+		if (!strcmp(spec, channel_names[channel]))
+			break;
+	}
+	if (channel == TEMPER_CHANNELS)
+	{
+		return false;
+	}
+	rule->channel = channel;
+	for (check = strtok_r(checks, ",", &saveptr); check != NULL;
+		check = strtok_r(NULL, ",", &saveptr))
+	{
+		if (sscanf(strchr(check, '=') ? strchr(check, '=') + 1 : "", "%f", &value) != 1)
+		{
+			return false;
+		}
+		if (!strncmp(check, "high=", 5))
+		{
+			rule->checks |= TEMPER_ALERT_HIGH;
+			rule->high = value;
+		}
+		else if (!strncmp(check, "low=", 4))
+		{
+			rule->checks |= TEMPER_ALERT_LOW;
+			rule->low = value;
+		}
+		else if (!strncmp(check, "rate=", 5) && (value > 0.0))
+		{
+			rule->checks |= TEMPER_ALERT_RATE;
+			rule->rate = value;
+		}
+		else if (!strncmp(check, "hysteresis=", 11) && (value >= 0.0))
+			rule->hysteresis = value;
+		else if (!strncmp(check, "duration=", 9) && (value >= 0.0))
+			rule->duration_ms = value;
+		else
+			return false;
+	}
+	return rule->checks != 0;
 }
 
 void parse_parameters(int argc, char **argv)
@@ -216,8 +641,47 @@ void parse_parameters(int argc, char **argv)
 	config.out_sensor = -1;
 	config.calibration_in = 0.0;
 	config.calibration_out = 0.0;
-	device.conversion_method = -1;
-	device.fd = -1;
+	config.conversion_method = -1;
+	config.interval = -1;
+	config.workers = 0;
+	config.count = 0;
+	config.simulate = 0;
+	config.backend = TEMPER_BACKEND_SEQUENTIAL;
+	config.benchmark = false;
+	config.stats = false;
+	config.quantiles = false;
+	config.history = NULL;
+	config.cache_dir = TEMPER_CACHE_DIR;
+	config.cache_max_age = 1000;
+	config.oversample = 1;
+	config.budget = 500;
+	config.reduce = TEMPER_REDUCE_MEDIAN;
+	config.max_deviation = 0.0;
+	config.amount_alerts = 0;
+	config.alert_output = NULL;
+	config.use_deadband = false;
+	memset(&config.deadband, 0, sizeof(config.deadband));
+	config.min_interval = 0;
+	config.max_interval = 0;
+	config.adapt_rate = 1.0;
+	config.snapshot = false;
+	config.standby = NULL;
+	config.simulate_hang = -1;
+	config.recover_after = 0;
+	config.recover_timeout = 5000;
+	config.hotplug = false;
+	config.push = NULL;
+	config.push_node = 0;
+	config.push_batch = 32;
+	config.push_flush = 1000;
+	config.snmp_base = NULL;
+	config.collectd = false;
+	config.mqtt = NULL;
+	config.mqtt_topic = "tempersensor";
+	config.mqtt_client = NULL;
+	config.mqtt_qos = 0;
+	config.mqtt_retain = false;
+	config.stream = NULL;
 
 	/* create structure of options */
 	static struct option temper_options[] =
@@ -231,9 +695,60 @@ void parse_parameters(int argc, char **argv)
 		{"precision", required_argument, 0, 'p'},
 		{"report-in", required_argument, 0, 3},
 		{"report-out", required_argument, 0, 4},
+#ifndef TEMPER_SINGLE_PROFILE
 		{"test", no_argument, 0, 't'},
+#endif
 		{"version", no_argument, 0, 'V'},
-
+		{"interval", required_argument, 0, 'i'},
+		{"workers", required_argument, 0, 5},
+		{"count", required_argument, 0, 6},
+#ifndef TEMPER_SINGLE_PROFILE
+		{"simulate", required_argument, 0, 7},
+		{"benchmark", no_argument, 0, 8},
+		{"simulate-hang", required_argument, 0, 27},
+#endif
+		{"history", required_argument, 0, 9},
+		{"stats", no_argument, 0, 10},
+#ifndef TEMPER_SINGLE_PROFILE
+		{"quantiles", no_argument, 0, 14},
+#endif
+		{"oversample", required_argument, 0, 15},
+		{"budget", required_argument, 0, 16},
+		{"reduce", required_argument, 0, 17},
+		{"max-deviation", required_argument, 0, 18},
+		{"alert", required_argument, 0, 19},
+		{"alert-output", required_argument, 0, 20},
+		{"deadband", required_argument, 0, 21},
+		{"heartbeat", required_argument, 0, 22},
+		{"adaptive", required_argument, 0, 23},
+		{"adapt-rate", required_argument, 0, 24},
+		{"snapshot", no_argument, 0, 25},
+		{"standby", required_argument, 0, 26},
+		{"recover", required_argument, 0, 28},
+		{"recover-timeout", required_argument, 0, 29},
+		{"hotplug", no_argument, 0, 30},
+#ifndef TEMPER_SINGLE_PROFILE
+		{"push", required_argument, 0, 31},
+		{"push-node", required_argument, 0, 32},
+		{"push-batch", required_argument, 0, 33},
+		{"push-flush", required_argument, 0, 34},
+		{"snmp-pass-persist", required_argument, 0, 35},
+		{"collectd", no_argument, 0, 36},
+		{"mqtt", required_argument, 0, 37},
+		{"mqtt-topic", required_argument, 0, 38},
+		{"mqtt-qos", required_argument, 0, 39},
+		{"mqtt-retain", no_argument, 0, 40},
+		{"mqtt-client", required_argument, 0, 41},
+		{"stream", required_argument, 0, 42},
+#endif
+		{"low-power", required_argument, 0, 43},
+		{"realtime", required_argument, 0, 44},
+		{"cpu", required_argument, 0, 45},
+		{"mlock", no_argument, 0, 46},
+		{"backend", required_argument, 0, 11},
+		{"cache-dir", required_argument, 0, 12},
+		{"cache-max-age", required_argument, 0, 13},
+		{0, 0, 0, 0}
 	};
 	os = option_string(temper_options);
 
@@ -267,14 +782,14 @@ void parse_parameters(int argc, char **argv)
 				}
 				break;
 			case 2: // conversion-method
-				if (!(sscanf(optarg, "%i", &device.conversion_method) == 1))
+				if (!(sscanf(optarg, "%i", &config.conversion_method) == 1))
 				{
 					fprintf(stderr, "Error: '%s' is not numeric.\n", optarg);
 					free(os);
 					exit(EXIT_FAILURE);
 				}
-				if ((device.conversion_method < 1) ||
-					(device.conversion_method > 2))
+				if ((config.conversion_method < 1) ||
+					(config.conversion_method > 2))
 				{
 					fprintf(stderr, "Invalid value for conversion-method: '%s'\n", optarg);
 					free(os);
@@ -283,15 +798,12 @@ void parse_parameters(int argc, char **argv)
 				break;
 			case 3: // report-in
 			case 4: // report-out
-				if (!strcmp(optarg, "it"))
-					itmp = INT_TEMP;
-				else if (!strcmp(optarg, "et"))
-					itmp = EXT_TEMP;
-				else if (!strcmp(optarg, "ih"))
-					itmp = INT_HUM;
-				else if (!strcmp(optarg, "eh"))
-					itmp = EXT_HUM;
-				else
+				for (itmp = 0; itmp < TEMPER_CHANNELS; itmp++)
+				{
+					if (!strcmp(optarg, channel_names[itmp]))
+						break;
+				}
+				if (itmp == TEMPER_CHANNELS)
 				{
 					fprintf(stderr, "Invalid value '%s' for option '%s'\n",
 						optarg, temper_options[option_index].name);
@@ -304,9 +816,254 @@ void parse_parameters(int argc, char **argv)
 				else
 					config.out_sensor = itmp;
 				break;
+			case 5: // workers
+				config.workers = numeric_argument("workers", optarg, 1, os);
+				break;
+			case 6: // count
+				config.count = numeric_argument("count", optarg, 1, os);
+				break;
+#ifndef TEMPER_SINGLE_PROFILE
+			case 7: // simulate
+				config.simulate = numeric_argument("simulate", optarg, 1, os);
+				break;
+			case 8: // benchmark
+				config.benchmark = true;
+				break;
+			case 27: // simulate-hang
+				config.simulate_hang = numeric_argument("simulate-hang", optarg, 0, os);
+				break;
+#endif
+			case 9: // history
+				config.history = optarg;
+				break;
+			case 10: // stats
+				config.stats = true;
+				break;
+#ifndef TEMPER_SINGLE_PROFILE
+			case 14: // quantiles
+				config.quantiles = true;
+				break;
+#endif
+			case 15: // oversample
+				config.oversample = numeric_argument("oversample", optarg, 1, os);
+				if (config.oversample > TEMPER_OVERSAMPLE_MAX)
+				{
+					config.oversample = TEMPER_OVERSAMPLE_MAX;
+				}
+				break;
+			case 16: // budget
+				config.budget = numeric_argument("budget", optarg, 1, os);
+				break;
+			case 17: // reduce
+				if (!strcmp(optarg, "median"))
+					config.reduce = TEMPER_REDUCE_MEDIAN;
+				else if (!strcmp(optarg, "trimmed"))
+					config.reduce = TEMPER_REDUCE_TRIMMED;
+				else
+				{
+					fprintf(stderr, "Invalid value '%s' for option '%s'\n",
+						optarg, temper_options[option_index].name);
+					usage();
+					free(os);
+					exit(EXIT_FAILURE);
+				}
+				break;
+			case 18: // max-deviation
+				if (!(sscanf(optarg, "%f", &config.max_deviation) == 1) ||
+					(config.max_deviation < 0.0))
+				{
+					fprintf(stderr, "Error: '%s' is not a valid deviation.\n", optarg);
+					free(os);
+					exit(EXIT_FAILURE);
+				}
+				break;
+			case 19: // alert
+				if (config.amount_alerts == MAX_ALERTS)
+				{
+					fprintf(stderr, "Error: more than %i alert rules.\n", MAX_ALERTS);
+					free(os);
+					exit(EXIT_FAILURE);
+				}
+				if (!parse_alert(optarg, &config.alerts[config.amount_alerts],
+					&config.alert_devices[config.amount_alerts]))
+				{
+					fprintf(stderr, "Error: '%s' is not a valid alert rule.\n", optarg);
+					usage();
+					free(os);
+					exit(EXIT_FAILURE);
+				}
+				config.amount_alerts++;
+				break;
+			case 20: // alert-output
+				config.alert_output = optarg;
+				break;
+			case 21: // deadband
+				if (!parse_deadband(optarg, &config.deadband))
+				{
+					fprintf(stderr, "Error: '%s' is not a valid deadband.\n", optarg);
+					usage();
+					free(os);
+					exit(EXIT_FAILURE);
+				}
+				config.use_deadband = true;
+				break;
+			case 22: // heartbeat
+				config.deadband.heartbeat_ms = numeric_argument("heartbeat", optarg, 0, os);
+				break;
+			case 23: // adaptive
+				if ((sscanf(optarg, "%i:%i", &config.min_interval, &config.max_interval) != 2) ||
+					(config.min_interval < 1) || (config.max_interval < config.min_interval))
+				{
+					fprintf(stderr, "Error: '%s' is not a valid interval range.\n", optarg);
+					free(os);
+					exit(EXIT_FAILURE);
+				}
+				break;
+			case 24: // adapt-rate
+				if (!(sscanf(optarg, "%f", &config.adapt_rate) == 1) ||
+					(config.adapt_rate <= 0.0))
+				{
+					fprintf(stderr, "Error: '%s' is not a valid rate.\n", optarg);
+					free(os);
+					exit(EXIT_FAILURE);
+				}
+				break;
+			case 25: // snapshot
+				config.snapshot = true;
+				break;
+			case 26: // standby
+				config.standby = optarg;
+				break;
+			case 28: // recover
+				config.recover_after = numeric_argument("recover", optarg, 1, os);
+				break;
+			case 29: // recover-timeout
+				config.recover_timeout = numeric_argument("recover-timeout", optarg, 1, os);
+				break;
+			case 30: // hotplug
+				config.hotplug = true;
+				break;
+#ifndef TEMPER_SINGLE_PROFILE
+			case 31: // push
+				config.push = optarg;
+				break;
+			case 32: // push-node
+				config.push_node = numeric_argument("push-node", optarg, 1, os);
+				break;
+			case 33: // push-batch
+				config.push_batch = numeric_argument("push-batch", optarg, 1, os);
+				if (config.push_batch > TEMPER_PUSH_MAX_SAMPLES)
+				{
+					config.push_batch = TEMPER_PUSH_MAX_SAMPLES;
+				}
+				break;
+			case 34: // push-flush
+				config.push_flush = numeric_argument("push-flush", optarg, 0, os);
+				break;
+			case 35: // snmp-pass-persist
+				config.snmp_base = optarg;
+				break;
+			case 36: // collectd
+				config.collectd = true;
+				break;
+			case 37: // mqtt
+				config.mqtt = optarg;
+				break;
+			case 38: // mqtt-topic
+				config.mqtt_topic = optarg;
+				break;
+			case 39: // mqtt-qos
+				config.mqtt_qos = numeric_argument("mqtt-qos", optarg, 0, os);
+				if (config.mqtt_qos > 1)
+				{
+					fprintf(stderr, "Only QoS 0 and 1 are supported\n");
+					exit(EXIT_FAILURE);
+				}
+				break;
+			case 40: // mqtt-retain
+				config.mqtt_retain = true;
+				break;
+			case 41: // mqtt-client
+				config.mqtt_client = optarg;
+				break;
+			case 42: // stream
+				config.stream = optarg;
+				break;
+#endif
+			case 43: // low-power
+				itmp = sscanf(optarg, "%i:%i", &config.tick, &config.slack);
+				if ((itmp < 1) || (config.tick < 1) || ((itmp == 2) && (config.slack < 0)))
+				{
+					fprintf(stderr, "Error: '%s' is not a valid tick.\n", optarg);
+					free(os);
+					exit(EXIT_FAILURE);
+				}
+				if (itmp == 1)
+				{
+					config.slack = config.tick / 10;
+				}
+				break;
+			case 44: // realtime
+				if (!strncmp(optarg, "fifo", 4) && ((optarg[4] == '\0') || (optarg[4] == ':')))
+					config.sched_policy = SCHED_FIFO;
+				else if (!strncmp(optarg, "rr", 2) && ((optarg[2] == '\0') || (optarg[2] == ':')))
+					config.sched_policy = SCHED_RR;
+				else
+				{
+					fprintf(stderr, "Invalid value '%s' for option '%s'\n",
+						optarg, temper_options[option_index].name);
+					usage();
+					free(os);
+					exit(EXIT_FAILURE);
+				}
+				config.sched_priority = (strchr(optarg, ':') != NULL) ?
+					numeric_argument("realtime", strchr(optarg, ':') + 1, 1, os) : REALTIME_PRIORITY;
+				if (config.sched_priority > sched_get_priority_max(config.sched_policy))
+				{
+					fprintf(stderr, "Invalid value for realtime: '%s'\n", optarg);
+					free(os);
+					exit(EXIT_FAILURE);
+				}
+				break;
+			case 45: // cpu
+				if (!parse_cpus(optarg, &config.cpus))
+				{
+					fprintf(stderr, "Error: '%s' is not a valid list of CPUs.\n", optarg);
+					free(os);
+					exit(EXIT_FAILURE);
+				}
+				break;
+			case 46: // mlock
+				config.mlock = true;
+				break;
+			case 11: // backend
+				if (!strcmp(optarg, "sequential"))
+					config.backend = TEMPER_BACKEND_SEQUENTIAL;
+				else if (!strcmp(optarg, "io_uring"))
+					config.backend = TEMPER_BACKEND_URING;
+				else if (!strcmp(optarg, "epoll"))
+					config.backend = TEMPER_BACKEND_EPOLL;
+				else
+				{
+					fprintf(stderr, "Invalid value '%s' for option '%s'\n",
+						optarg, temper_options[option_index].name);
+					usage();
+					free(os);
+					exit(EXIT_FAILURE);
+				}
+				break;
+			case 12: // cache-dir
+				config.cache_dir = optarg;
+				break;
+			case 13: // cache-max-age
+				config.cache_max_age = numeric_argument("cache-max-age", optarg, 0, os);
+				break;
 			case 'd':
 				config.debug = 1;
 				break;
+			case 'i':
+				config.interval = numeric_argument("interval", optarg, 0, os);
+				break;
 			case 'f':
 				config.fahrenheit = true;
 				break;
@@ -324,11 +1081,13 @@ void parse_parameters(int argc, char **argv)
 					exit(EXIT_FAILURE);
 				}
 				break;
+#ifndef TEMPER_SINGLE_PROFILE
 			case 't':
-				test_calc();
+				run_tests();
 				free(os);
 				exit(EXIT_SUCCESS);
 				break;
+#endif
 			case 'V':
 				printVersion();
 				free(os);
@@ -348,6 +1107,26 @@ void parse_parameters(int argc, char **argv)
 		}
 	}
 	free(os);
+	if ((config.min_interval > 0) && (config.interval < 0))
+	{
+		// adaptive sampling implies continuous mode, start slow
+		config.interval = config.max_interval;
+	}
+	if ((config.snmp_base != NULL) && (config.interval < 0))
+	{
+		// serving SNMP is continuous mode without output
+		config.interval = SNMP_INTERVAL;
+	}
+	if (config.collectd && (config.interval < 0))
+	{
+		// seconds, maybe with fraction
+		config.interval = (getenv("COLLECTD_INTERVAL") != NULL) ?
+			(int)(atof(getenv("COLLECTD_INTERVAL")) * 1000) : COLLECTD_INTERVAL;
+		if (config.interval <= 0)
+		{
+			config.interval = COLLECTD_INTERVAL;
+		}
+	}
 }
 
 /* 
@@ -372,26 +1151,6 @@ float fahrenheit(float celsius)
 	return ((celsius * (9.0 / 5.0)) + 32.0);
 }
 
-/*
- * extend_errormessage
- *
- * extends the given errormessage with the textual representation
- * of the errno error
- */
-
-char *extend_errormessage(const char* errormessage, int errnum)
-{
-	char *fullmsg;
-	
-	fullmsg = (char *) malloc(strlen(errormessage) +
-		strlen(strerror(errnum)) + 3);
-	sprintf(fullmsg, "%s: %s", errormessage,
-		strerror(errnum));
-	
-	return fullmsg;
-}
-
-
 /*
  * print_error
  *
@@ -407,9 +1166,10 @@ void print_error(const char *errormessage)
 /*
  * print_values
  *
- * simplify printing values by just having to specify the values
+ * simplify printing values by just having to specify the values,
+ * a note (e.g. the device that took over) is added to the 4th line
  */
-void print_values(float in, float out, int precision)
+void print_values(float in, float out, int precision, const char *note)
 {
 	char instr[30];
 	char outstr[30];
@@ -421,948 +1181,4208 @@ void print_values(float in, float out, int precision)
 		in = fahrenheit(in);
 		out = fahrenheit(out);
 	}
-	if (in > -999.0)
+	if (in > TEMPER_INVALID)
 	{
 		in += config.calibration_in;
 		(void)sprintf(instr, fmtstr, in);
 	}
 	else
 		(void)sprintf(instr, INVALID_VALUE);
-	if (out > -999.0)
+	if (out > TEMPER_INVALID)
 	{
 		out += config.calibration_out;
 		(void)sprintf(outstr, fmtstr, out);
 	}
 	else
 		(void)sprintf(outstr, INVALID_VALUE);
-	print_mrtg_values(PROGRAMNAME, VERSION, instr, outstr);
+	printf("%s\n%s\n", instr, outstr);
+	print_mrtg_signature(PROGRAMNAME, VERSION, note);
 }
 
 
-/* 
- * debug_print_byte
+#ifndef TEMPER_SINGLE_PROFILE
+/*
+ * test_sketch
+ *
+ * feeds 0 .. 99999 in scrambled order into two sketches, merges
+ * them and checks the quantiles, returns the amount of failures
  */
-void debug_print_byte(const unsigned char *string, size_t ssize, const char *format, ...)
-{
-	int c = 0;
-	va_list args;
-	va_start(args, format);
 
-	if (config.debug <= 0)
+int test_sketch()
+{
+	const double q[] = { 0.5, 0.95, 0.99 };
+	struct temper_sketch half[2];
+	float value;
+	int failures = 0;
+	int cnt;
+
+	temper_sketch_init(&half[0]);
+	temper_sketch_init(&half[1]);
+	for (cnt = 0; cnt < 100000; cnt++)
 	{
-		return;
+		temper_sketch_add(&half[cnt % 2], (float)((cnt * 7919L) % 100000));
 	}
-	while (c<ssize)
+	temper_sketch_merge(&half[0], &half[1]);
+	for (cnt = 0; cnt < 3; cnt++)
 	{
-		fprintf(stderr, "%02x ", string[c] & 0xFF);
-		c++;
+		value = temper_sketch_quantile(&half[0], q[cnt]);
+		debug_print("sketch p%g: %.0f / expected: %.0f +- 500\n",
+			q[cnt] * 100, value, q[cnt] * 100000);
+		if ((value < q[cnt] * 100000 - 500) || (value > q[cnt] * 100000 + 500))
+		{
+			failures++;
+		}
 	}
-	fprintf(stderr, "(");
-	vfprintf(stderr, format, args);
-	fprintf(stderr, ")\n");
 
-	va_end(args);
+	return failures;
 }
 
 /*
- * is_device_supported
+ * test_deadband
  *
- * returns true if the given device is in the list of
- * supported devices, otherwise returns false
+ * feeds an hour of 1 Hz readings flickering by one step of the
+ * resolution, with one real change, through a deadband of 0.1 and
+ * checks that few samples pass, including the change
  */
-bool is_device_supported(uint16_t idVendor, uint16_t idProduct)
-{
-	int known_devices;
-	int cnt = 0;
 
-	// calculate how many devices are in the list of supported devices
-	known_devices = sizeof(vendorId) / sizeof(vendorId[0]);
-
-	while (cnt < known_devices)
+int test_deadband()
+{
+	struct temper_deadband db;
+	struct temper_deadband_state state;
+	float values[TEMPER_CHANNELS];
+	bool step_passed = false;
+	int failures = 0;
+	int cnt;
+
+	memset(&db, 0, sizeof(db));
+	memset(&state, 0, sizeof(state));
+	for (cnt = 0; cnt < TEMPER_CHANNELS; cnt++)
 	{
-		if ((idVendor == vendorId[cnt])
-			&& (idProduct == productId[cnt]))
+		db.threshold[cnt] = 0.1;
+	}
+	db.heartbeat_ms = 300000;
+	for (cnt = 0; cnt < 3600; cnt++)
+	{
+		temper_invalidate(values);
+		values[TEMPER_INT_TEMP] = ((cnt < 1800) ? 21.0 : 23.0) + (cnt % 2) * 0.0625;
+		values[TEMPER_INT_HUM] = 45.0 + (cnt % 3) * 0.01;
+		temper_derive(values);
+		if (temper_deadband_pass(&db, &state, (cnt + 1) * 1000000ULL, values) &&
+			(cnt == 1800))
 		{
-			debug_print("Device %04x:%04x found\n", vendorId[cnt], productId[cnt]);
-			return true;
+			step_passed = true;
 		}
-		cnt++;
 	}
-	return false;
-}
+	debug_print("deadband: %lu passed, %lu suppressed, step %s / expected: less than 360 passed, step passed\n",
+		state.passed, state.suppressed, step_passed ? "passed" : "suppressed");
+	failures += (state.passed >= 360) || !step_passed;
 
+	return failures;
+}
 
 /*
- * cleanup
+ * test_cache
  *
- * close and exit everything
+ * holds the lock of a device in a scratch directory and checks that
+ * a second caller gives up after its wait instead of hanging, and
+ * that results are not used from a file of another user
  */
 
-void cleanup()
+int test_cache()
 {
-	if (device.hidraw_devpath != NULL)
+	char dir[] = "/tmp/tempersensor-test-XXXXXX";
+	char path[64];
+	struct temper_cached cached;
+	struct temper_cached got;
+	uint64_t start;
+	uint64_t waited;
+	int holder = -1;
+	int waiter = -1;
+	int failures = 0;
+	int r;
+
+	if (mkdtemp(dir) == NULL)
 	{
-		free(device.hidraw_devpath);
+		debug_print("cache: no scratch directory\n");
+		return 1;
 	}
-	if (device.fd >= 0)
+	memset(&cached, 0, sizeof(cached));
+	temper_invalidate(cached.values);
+	cached.values[TEMPER_INT_TEMP] = 21.5;
+	cached.timestamp_us = temper_time_us(CLOCK_REALTIME);
+	r = temper_cache_lock(dir, "/dev/hidraw0", 100, &holder);
+	failures += (r != TEMPER_OK) || (temper_cache_put(holder, &cached) != TEMPER_OK);
+
+	start = temper_time_us(CLOCK_MONOTONIC);
+	r = temper_cache_lock(dir, "/dev/hidraw0", 100, &waiter);
+	waited = (temper_time_us(CLOCK_MONOTONIC) - start) / 1000;
+	debug_print("cache lock held: %s after %lu ms / expected: %s after 100 ms\n",
+		temper_strerror(r), (unsigned long) waited, temper_strerror(TEMPER_ERR_TIMEOUT));
+	failures += (r != TEMPER_ERR_TIMEOUT) || (waiter >= 0) || (waited < 100) || (waited > 1000);
+
+	r = temper_cache_get(holder, 1000, &got);
+	debug_print("cache own file: %s / expected: used\n", r ? "used" : "ignored");
+	failures += !r || (got.values[TEMPER_INT_TEMP] != cached.values[TEMPER_INT_TEMP]);
+	// only root can hand the file to somebody else
+	if ((geteuid() == 0) && (fchown(holder, 65534, 65534) == 0))
 	{
-		close(device.fd);
+		r = temper_cache_get(holder, 1000, &got);
+		debug_print("cache foreign file: %s / expected: ignored\n", r ? "used" : "ignored");
+		failures += r;
 	}
+	temper_cache_unlock(holder);
+
+	(void)snprintf(path, sizeof(path), "%s/tempersensor-hidraw0", dir);
+	(void)unlink(path);
+	(void)rmdir(dir);
+
+	return failures;
 }
 
-char *send_command(const char *cmdname, const unsigned char *question, size_t qsize)
+/*
+ * hotplug tests
+ *
+ * synthetic uevents are sent to the sampler through a socket pair,
+ * the devices "plugged in" are simulated
+ */
+
+struct hotplug_test
 {
-	int r;
-	char errmsg[45];
-	char *fullerr = NULL;
+	int samples;
+	int samples_removed; /* samples when the device was retired */
+	int added;
+	int removed;
+	int last; /* device added last */
+	int samples_last; /* its samples */
+};
+
+void hotplug_test_sample(const struct temper_sample *sample, void *userdata)
+{
+	struct hotplug_test *h = (struct hotplug_test *) userdata;
 
-	debug_print_byte(question, qsize, "command '%s' sent", cmdname);
-	r = write(device.fd, question, qsize);
-	if (r < 0)
+	if ((sample->device == 0) && (sample->status == TEMPER_OK))
 	{
-		sprintf(errmsg, "Error sending command '%s'", cmdname);
-		fullerr = extend_errormessage(errmsg, errno);
-		return fullerr;
+		h->samples++;
+	}
+	if ((sample->device == h->last) && (sample->status == TEMPER_OK))
+	{
+		h->samples_last++;
 	}
-
-	return fullerr;
 }
 
-int read_timeout(int fd, void *buf, size_t count)
+void hotplug_test_event(int device, const struct temper_devinfo *info, int action, void *userdata)
 {
-	fd_set set;
-	struct timeval timeout;
-	int rv;
-	int r;
+	struct hotplug_test *h = (struct hotplug_test *) userdata;
 
-	FD_ZERO(&set);
-	FD_SET(fd, &set);
+	if (action == TEMPER_HOTPLUG_ADD)
+	{
+		h->added++;
+		h->last = device;
+		h->samples_last = 0;
+	}
+	else
+	{
+		h->removed++;
+		h->samples_removed = h->samples;
+	}
+}
 
-	timeout.tv_sec = 0;
-	/* set a timeout of 1 second */
-	timeout.tv_usec = 1*1000*1000;
+int hotplug_test_open(struct temper_ctx *ctx, const struct temper_devinfo *info, void *userdata)
+{
+	struct temper_sim sim;
 
-	rv = select(fd + 1, &set, NULL, NULL, &timeout);
-	if (rv == -1)
-		return -1;
-	else if (rv == 0)
-		return -2;
+	(void)temper_sim_defaults(&sim, "TEMPerX_V3.1");
+	sim.latency_us = 1000;
+	return temper_open_sim(ctx, &sim);
+}
 
-	r = read(fd, buf, count);
-	if (r < 0)
-		return -1;
+/*
+ * uevent_message
+ *
+ * builds a uevent as sent by the kernel for the hidraw node of the
+ * HID device hid (BUS:VENDOR:PRODUCT.INSTANCE), returns its length
+ */
 
-	return r;
+size_t uevent_message(char *msg, size_t size, const char *action, const char *hid, const char *node)
+{
+	char devpath[200];
+
+	(void)snprintf(devpath, sizeof(devpath),
+		"/devices/pci0000:00/0000:00:14.0/usb1/1-2/1-2:1.1/%s/hidraw/%s", hid, node);
+	return snprintf(msg, size, "%s@%s%cACTION=%s%cDEVPATH=%s%cSUBSYSTEM=hidraw%cDEVNAME=%s%cSEQNUM=4711%c",
+		action, devpath, 0, action, 0, devpath, 0, 0, node, 0, 0);
 }
 
-char *read_answer_cond(const char *cmdname, unsigned char *answer, bool ignore_readerror)
-{
-	int r;
-	char *errmsg = NULL;
-	char *fullerr = NULL;
+/*
+ * test_hotplug
+ *
+ * checks parsing of uevents, then plugs a device into a running
+ * sampler of each kind and removes it again. Replugging it more
+ * often than there are slots must reuse those of the devices
+ * removed. Returns the amount of failures.
+ */
 
-	r = read_timeout(device.fd, answer, ANSWERSIZE);
-	if (r < 0)
+int test_hotplug()
+{
+	const int backends[] = { TEMPER_BACKEND_SEQUENTIAL, TEMPER_BACKEND_EPOLL };
+	struct temper_sampler_config cfg;
+	struct temper_sampler *sampler;
+	struct temper_uevent ev;
+	struct hotplug_test h;
+	char msg[512];
+	size_t len;
+	int fds[2];
+	int failures = 0;
+	int cnt;
+	int plug;
+
+	len = uevent_message(msg, sizeof(msg), "add", "0003:413D:2107.0004", "hidraw7");
+	memset(&ev, 0, sizeof(ev));
+	failures += !temper_hotplug_parse(msg, len, &ev) || (ev.action != TEMPER_HOTPLUG_ADD) ||
+		(ev.info.vendor_id != 0x413d) || (ev.info.product_id != 0x2107) ||
+		strcmp(ev.info.devpath, "/dev/hidraw7");
+	debug_print("uevent add: %04x:%04x %s / expected: 413d:2107 /dev/hidraw7\n",
+		ev.info.vendor_id, ev.info.product_id, ev.info.devpath);
+	len = uevent_message(msg, sizeof(msg), "remove", "0003:0C45:7401.0005", "hidraw2");
+	failures += !temper_hotplug_parse(msg, len, &ev) || (ev.action != TEMPER_HOTPLUG_REMOVE);
+	len = uevent_message(msg, sizeof(msg), "add", "0003:046D:C52B.0006", "hidraw3");
+	failures += temper_hotplug_parse(msg, len, &ev);
+	len = uevent_message(msg, sizeof(msg), "change", "0003:413D:2107.0004", "hidraw7");
+	failures += temper_hotplug_parse(msg, len, &ev);
+	len = uevent_message(msg, sizeof(msg), "add", "0003:413D:2107.0004", "hidraw7");
+	// cut before DEVNAME
+	failures += temper_hotplug_parse(msg, len - strlen("DEVNAME=hidraw7") - strlen("SEQNUM=4711") - 2, &ev);
+
+	for (cnt = 0; cnt < sizeof(backends) / sizeof(backends[0]); cnt++)
 	{
-		if (! ignore_readerror)
+		if (socketpair(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0, fds) < 0)
 		{
-			errmsg = (char *) malloc (29 + strlen(cmdname));
-			sprintf(errmsg, "Error reading response to '%s'", cmdname);
-			if (r == -2)
-			{
-				fullerr = malloc (strlen(errmsg) + 10);
-				fullerr[0] = 0;
-				strcat(fullerr, errmsg);
-				strcat(fullerr, ": Timeout");
-			}
-			else
-			{
-				fullerr = extend_errormessage(errmsg, errno);
-			}
-			free(errmsg);
+			return failures + 1;
+		}
+		memset(&h, 0, sizeof(h));
+		memset(&cfg, 0, sizeof(cfg));
+		cfg.workers = 1;
+		cfg.interval_ms = 20;
+		cfg.backend = backends[cnt];
+		cfg.hotplug = true;
+		cfg.uevent_fd = fds[0];
+		cfg.open = hotplug_test_open;
+		cfg.hotplug_callback = hotplug_test_event;
+		cfg.callback = hotplug_test_sample;
+		cfg.userdata = &h;
+		sampler = temper_sampler_new(&cfg);
+		if ((sampler == NULL) || (temper_sampler_start(sampler) != TEMPER_OK))
+		{
+			temper_sampler_free(sampler);
+			close(fds[0]);
+			close(fds[1]);
+			return failures + 1;
+		}
+		// a supported device, another device and the first one again
+		len = uevent_message(msg, sizeof(msg), "add", "0003:413D:2107.0004", "hidraw7");
+		(void)send(fds[1], msg, len, 0);
+		len = uevent_message(msg, sizeof(msg), "add", "0003:046D:C52B.0006", "hidraw3");
+		(void)send(fds[1], msg, len, 0);
+		len = uevent_message(msg, sizeof(msg), "add", "0003:413D:2107.0004", "hidraw7");
+		(void)send(fds[1], msg, len, 0);
+		usleep(200000);
+		len = uevent_message(msg, sizeof(msg), "remove", "0003:413D:2107.0004", "hidraw7");
+		(void)send(fds[1], msg, len, 0);
+		usleep(100000);
+		debug_print("hotplug %s: %i added, %i removed, %i samples, %i after removal "
+			"/ expected: 1 added, 1 removed, 5 or more samples, at most 1 after removal\n",
+			temper_backend_name(backends[cnt]), h.added, h.removed,
+			h.samples_removed, h.samples - h.samples_removed);
+		failures += (h.added != 1) || (h.removed != 1) || (h.samples_removed < 5) ||
+			(h.samples - h.samples_removed > 1);
+		for (plug = 0; plug < TEMPER_HOTPLUG_DEVICES + 8; plug++)
+		{
+			len = uevent_message(msg, sizeof(msg), "add", "0003:413D:2107.0004", "hidraw7");
+			(void)send(fds[1], msg, len, 0);
+			usleep(10000);
+			len = uevent_message(msg, sizeof(msg), "remove", "0003:413D:2107.0004", "hidraw7");
+			(void)send(fds[1], msg, len, 0);
+			usleep(10000);
 		}
-		return fullerr;
+		len = uevent_message(msg, sizeof(msg), "add", "0003:413D:2107.0004", "hidraw7");
+		(void)send(fds[1], msg, len, 0);
+		usleep(200000);
+		temper_sampler_stop(sampler);
+		temper_sampler_free(sampler);
+		close(fds[0]);
+		close(fds[1]);
+		debug_print("hotplug %s replugged: %i added, %i removed, device %i last, %i samples "
+			"/ expected: %i added, %i removed, 5 or more samples\n",
+			temper_backend_name(backends[cnt]), h.added, h.removed, h.last, h.samples_last,
+			TEMPER_HOTPLUG_DEVICES + 10, TEMPER_HOTPLUG_DEVICES + 9);
+		failures += (h.added != TEMPER_HOTPLUG_DEVICES + 10) || (h.removed != TEMPER_HOTPLUG_DEVICES + 9) ||
+			(h.samples_last < 5);
 	}
-	debug_print_byte(answer, ANSWERSIZE, "response to '%s'", cmdname);
 
-	return fullerr;
+	return failures;
 }
 
-char *read_answer(const char *cmdname, unsigned char *answer)
+/*
+ * struct low_power_test
+ *
+ * what the callback of test_low_power saw
+ */
+struct low_power_test
 {
-	return read_answer_cond(cmdname, answer, false);
-}
-
+	int samples;
+	int off_tick; /* wakeups more than half a tick after a tick */
+	uint64_t last_end; /* end of the previous query, CLOCK_MONOTONIC */
+};
 
-int get_firmware_string()
+void low_power_test_sample(const struct temper_sample *sample, void *userdata)
 {
-	char *errmsg = NULL;
-	unsigned char answer[9];
-	int cnt = 0;
-
-	device.firmware[0] = 0;
-	errmsg = send_command("query firmware", query_firmware, sizeof(query_firmware));
-	if (errmsg != NULL) 
+	struct low_power_test *l = (struct low_power_test *) userdata;
+	uint64_t start;
+
+	l->samples++;
+	// start of the query on the clock of the ticks, delivery waits for the wakeup to end
+	start = temper_time_us(CLOCK_MONOTONIC) - (temper_time_us(CLOCK_REALTIME) - sample->timestamp_us);
+	// a device due again while another one was read is queried in the same wakeup
+	if ((start > l->last_end + 5000) && (start % 50000 > 25000))
 	{
-		print_error(errmsg);
-		free(errmsg);
-		return 0;
+		l->off_tick++;
 	}
-	while (cnt < 2)
+	l->last_end = start + sample->latency_us;
+}
+
+/*
+ * test_low_power
+ *
+ * checks the alignment to ticks and samples two simulated devices due
+ * every 10 ms with a tick of 50 ms, they have to be queried together
+ * on the ticks. Returns the amount of failures.
+ */
+
+int test_low_power()
+{
+	const int backends[] = { TEMPER_BACKEND_SEQUENTIAL, TEMPER_BACKEND_EPOLL };
+	struct temper_sampler_config cfg;
+	struct temper_sampler *sampler;
+	struct temper_ctx *ctxs[2];
+	struct temper_sim sim;
+	struct low_power_test l;
+	int failures = 0;
+	int cnt;
+	int dev;
+
+	failures += (temper_tick_next(1234, 0) != 1234) || (temper_tick_next(1, 10) != 10000) ||
+		(temper_tick_next(10000, 10) != 10000) || (temper_tick_next(10001, 10) != 20000);
+	debug_print("tick: %llu %llu / expected: 10000 20000\n",
+		(unsigned long long) temper_tick_next(10000, 10), (unsigned long long) temper_tick_next(10001, 10));
+
+	(void)temper_sim_defaults(&sim, "TEMPerX_V3.1");
+	for (cnt = 0; cnt < sizeof(backends) / sizeof(backends[0]); cnt++)
 	{
-		errmsg = read_answer("query firmware", answer);
-		if (errmsg != NULL)
+		memset(&l, 0, sizeof(l));
+		memset(&cfg, 0, sizeof(cfg));
+		cfg.workers = 1;
+		cfg.interval_ms = 10;
+		cfg.tick_ms = 50;
+		cfg.slack_ms = 5;
+		cfg.backend = backends[cnt];
+		cfg.callback = low_power_test_sample;
+		cfg.userdata = &l;
+		sampler = temper_sampler_new(&cfg);
+		for (dev = 0; dev < 2; dev++)
 		{
-			print_error(errmsg);
-			free(errmsg);
-			return 0;
+			ctxs[dev] = temper_new();
+			if ((ctxs[dev] == NULL) || (temper_open_sim(ctxs[dev], &sim) != TEMPER_OK) ||
+				(temper_identify(ctxs[dev]) != TEMPER_OK) || (sampler == NULL))
+			{
+				failures++;
+				continue;
+			}
+			temper_sampler_add(sampler, ctxs[dev], 0);
 		}
-		strncat(device.firmware, (char *)answer, 8);
-		cnt++;
+		if ((sampler != NULL) && (temper_sampler_start(sampler) == TEMPER_OK))
+		{
+			usleep(500000);
+			temper_sampler_stop(sampler);
+		}
+		temper_sampler_free(sampler);
+		for (dev = 0; dev < 2; dev++)
+		{
+			temper_free(ctxs[dev]);
+		}
+		// about 10 ticks, the first samples are taken right at the start, off the tick
+		debug_print("low power %s: %i samples, %i off the tick / expected: 12 to 40, at most 4\n",
+			temper_backend_name(backends[cnt]), l.samples, l.off_tick);
+		failures += (l.samples < 12) || (l.samples > 40) || (l.off_tick > 4);
 	}
 
-	return 1;
+	return failures;
 }
 
 /*
- * open device and query firmware to deduce device capabilities
+ * struct standby_test
  *
+ * what the callback of test_standby saw of the primary
  */
+struct standby_test
+{
+	int samples;
+	int failed; /* samples without values */
+	int taken_over; /* samples with the values of the standby */
+};
 
-int init_device()
+void standby_test_sample(const struct temper_sample *sample, void *userdata)
 {
-	char *errmsg;
+	struct standby_test *t = (struct standby_test *) userdata;
 
-	device.fd = open(device.hidraw_devpath, O_RDWR);
-	if (device.fd < 0)
+	if (sample->device != 0)
 	{
-		errmsg = extend_errormessage("Error opening device", errno);
-		print_error(errmsg);
-		free(errmsg);
-		return 0;
+		return;
 	}
-
-	if (!get_firmware_string())
+	t->samples++;
+	if (sample->status != TEMPER_OK)
 	{
-		return 0;
+		t->failed++;
+	}
+	else if (sample->source == 1)
+	{
+		t->taken_over++;
 	}
-	
-	return 1;
 }
 
 /*
- * evaluate_device_details
+ * test_standby
  *
- * based of the details collected about the device, define
- * how to interact with the device
+ * samples a simulated device hanging after 3 answers together with
+ * its standby: the samples after the hang have to carry the values
+ * of the standby, each one after a single round timeout. Returns the
+ * amount of failures.
  */
 
-int evaluate_device_details()
+int test_standby()
 {
-	int cnt = 0;
-	/*
-	 * The software is only tested with TEMPer1F_V1.3, TEMPerF1.4
-	 * and TEMPerHUM reporting as 'TEMPerX_V3.3'. Configuration of
-	 * all other devices is collected from several forums and from
-	 * https://github.com/urwen/temper
-	 * Idea:
-	 * - Probably provide a way to override detection / configure
-	 *   device through parameters
-	 */
-
-	/*
-	 * Since not all devices support all sensors, assume all
-	 * possible sensors to return invalid values, existing
-	 * sensors will overwrite with real values later.
-	 */
-	while (cnt < 4)
+	struct temper_sampler_config cfg;
+	struct temper_sampler *sampler;
+	struct temper_sampler_stats stats;
+	struct temper_ctx *ctxs[2] = { NULL, NULL };
+	struct temper_sim sim;
+	struct standby_test t;
+	int failures = 0;
+	int dev;
+
+	memset(&t, 0, sizeof(t));
+	memset(&stats, 0, sizeof(stats));
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.workers = 2;
+	cfg.interval_ms = 20;
+	cfg.timeout_ms = 50;
+	cfg.backend = TEMPER_BACKEND_EPOLL;
+	cfg.callback = standby_test_sample;
+	cfg.userdata = &t;
+	sampler = temper_sampler_new(&cfg);
+	(void)temper_sim_defaults(&sim, "TEMPerX_V3.1");
+	for (dev = 0; dev < 2; dev++)
 	{
-		device.values[cnt] = -999.0;
-		cnt++;
-	}
-	if ((device.vendor_id == 0x0c45) &&
-		(device.product_id == 0x7401))
-	{
-		if (!strncmp(device.firmware, "TEMPer1F_V1.3r1F", 13))
-		{
-			debug_print("Detected TEMPer1F_V1.3\n");
-			device.amount_value_responses = 1;
-			if (device.conversion_method == -1)
-				device.conversion_method = 1;
-			device.sensors[0][0] = NO_SENSOR;
-			device.sensors[0][1] = EXT_TEMP;
-			if (config.in_sensor == -1)
-				config.in_sensor = EXT_TEMP;
-			if (config.out_sensor == -1)
-				config.out_sensor = EXT_TEMP;
-		}
-		else if (!strncmp(device.firmware, "TEMPerF1.4", 10))
-		{
-			debug_print("Detected TEMPer1F1.4\n");
-			device.amount_value_responses = 1;
-			if (device.conversion_method == -1)
-				device.conversion_method = 1;
-			device.sensors[0][0] = INT_TEMP;
-			device.sensors[0][1] = NO_SENSOR;
-			if (config.in_sensor == -1)
-				config.in_sensor = INT_TEMP;
-			if (config.out_sensor == -1)
-				config.out_sensor = INT_TEMP;
-		}
-		else
+		sim.answers = (dev == 0) ? 3 : -1;
+		ctxs[dev] = temper_new();
+		if ((ctxs[dev] == NULL) || (temper_open_sim(ctxs[dev], &sim) != TEMPER_OK) ||
+			(temper_identify(ctxs[dev]) != TEMPER_OK) || (sampler == NULL))
 		{
-			debug_print("Unknown firmware '%s'\n", device.firmware);
-			print_error("Unknown 0c45:7401 device");
-			return 0;
+			failures++;
+			continue;
 		}
+		// on different workers, pairing moves the standby
+		temper_sampler_add(sampler, ctxs[dev], dev);
 	}
-	else if ((device.vendor_id == 0x1130) &&
-		(device.product_id == 0x660c))
-	{
-		/* 
-		 * TODO: learn details about this device
-		 *  - does it reply properly to the firmware?
-		 *  - which firmware-replies are known
-		 *  - from some postings the sensors are assumed to be 
-		 *    identical to "TEMPer1F_V1.3", but there is no confirmation
-		 */
-		debug_print("Detected Tenx Technology, Inc. Foot Pedal/Thermometer (untested)\n");
-		device.amount_value_responses = 1;
-		if (device.conversion_method == -1)
-			device.conversion_method = 1;
-		device.sensors[0][0] = NO_SENSOR;
-		device.sensors[0][1] = INT_TEMP;
-		if (config.in_sensor == -1)
-			config.in_sensor = INT_TEMP;
-		if (config.out_sensor == -1)
-			config.out_sensor = INT_TEMP;
-	}
-	else if ((device.vendor_id == 0x1a86) &&
-		(device.product_id == 0x5523))
-	{
-		/*
-		 * TODO: https://github.com/urwen/temper has a description
-		 * how these devices can be interacted with - they seem to be
-		 * very different, probably they are too different to be
-		 * implemented?
-		 */
-		print_error("TEMPerX232 / TEMPerX232_V2.0 (1a86:5523) detected - unsupported yet\n");
-		return 0;
+	if ((sampler != NULL) && (temper_sampler_standby(sampler, 0, 0) != TEMPER_ERR_PARAM))
+	{
+		failures++;
 	}
-	else if ((device.vendor_id == 0x413d) &&
-		(device.product_id == 0x2107))
-	{
-		/*
-		 * configuration based on the implementation of
-		 * https://github.com/urwen/temper/blob/master/temper.py
-		 */
-		if (!strncmp(device.firmware, "TEMPerGold_V3.1", 15))
-		{
-			debug_print("Detected TEMPerGold_V3.1 (untested!)\n");
-			device.amount_value_responses = 1;
-			if (device.conversion_method == -1)
-				device.conversion_method = 2;
-			device.sensors[0][0] = INT_TEMP;
-			device.sensors[0][1] = NO_SENSOR;
-			if (config.in_sensor == -1)
-				config.in_sensor = INT_TEMP;
-			if (config.out_sensor == -1)
-				config.out_sensor = INT_TEMP;
-		}
-		else if (!strncmp(device.firmware, "TEMPerX_V3.1", 12))
-		{
-			debug_print("Detected TEMPerX_V3.1 (untested!)\n");
-			device.amount_value_responses = 2;
-			if (device.conversion_method == -1)
-				device.conversion_method = 2;
-			device.sensors[0][0] = INT_TEMP;
-			device.sensors[0][1] = INT_HUM;
-			device.sensors[1][0] = EXT_TEMP;
-			device.sensors[1][1] = EXT_HUM;
-			if (config.in_sensor == -1)
-				config.in_sensor = INT_HUM;
-			if (config.out_sensor == -1)
-				config.out_sensor = INT_TEMP;
-		}
-		else if (!strncmp(device.firmware, "TEMPerX_V3.3", 12))
-		{
-			debug_print("Detected TEMPerX_V3.3\n");
-			device.amount_value_responses = 1;
-			if (device.conversion_method == -1)
-				device.conversion_method = 2;
-			device.sensors[0][0] = INT_TEMP;
-			device.sensors[0][1] = INT_HUM;
-			device.sensors[1][0] = NO_SENSOR;
-			device.sensors[1][1] = NO_SENSOR;
-			if (config.in_sensor == -1)
-				config.in_sensor = INT_HUM;
-			if (config.out_sensor == -1)
-				config.out_sensor = INT_TEMP;
-		}
-		else
-		{
-			debug_print("Unknown firmware '%s'\n", device.firmware);
-			print_error("Unknown 413d:2107 device");
-			return 0;
-		}
+	if ((sampler != NULL) && (temper_sampler_standby(sampler, 0, 1) == TEMPER_OK) &&
+		(temper_sampler_start(sampler) == TEMPER_OK))
+	{
+		usleep(500000);
+		temper_sampler_stop(sampler);
+		(void)temper_sampler_stats(sampler, 0, &stats);
 	}
-	else
+	temper_sampler_free(sampler);
+	for (dev = 0; dev < 2; dev++)
 	{
-		debug_print("Unknown firmware '%s'\n", device.firmware);
-		print_error("Unknown device\n");
-		return 0;
+		temper_free(ctxs[dev]);
 	}
-	return 1;
+	// 3 answers, then a timeout of 50 ms per round
+	debug_print("standby: %i samples, %i from the standby, %i without values, %lu failovers "
+		"/ expected: 8 or more, all but 3, none, as many\n",
+		t.samples, t.taken_over, t.failed, stats.failovers);
+	failures += (t.samples < 8) || (t.taken_over != t.samples - 3) || (t.failed != 0) ||
+		(stats.failovers != (unsigned long) t.taken_over);
+
+	return failures;
 }
 
 /*
- * calc_value
+ * struct recover_test
  *
- * calculates value from response from given starting character
+ * what the callback of test_recover saw of the healthy device
  */
-
-float calc_value(const unsigned char *valuestring, int startchar)
+struct recover_test
 {
-	/*
-	 * To be improved: send only a string with two characters
-	 * and make selection of the correct characters outside this
-	 * function, combine it with autodetection based on Firmware string.
-	 */
+	int samples;
+	uint64_t last_us; /* CLOCK_MONOTONIC of its last sample */
+	uint64_t max_gap_us; /* longest time between two of its samples */
+};
 
-	/*
-	   reverse engineering results for TEMPer 1.3:
-	    + relevant for this device are positions 4 + 5
-	    + in good case, the lower sigificant part of position 5
-	      is always 0
-	    + if error case, the lower sigificant part of position 5
-	      is F (or not zero?)
-	    + the value is represented in two's complement
-	    + position 4 is the part before the comma
-	    + the higher 4 bits of position 5 are after the comma
-	 */
+void recover_test_sample(const struct temper_sample *sample, void *userdata)
+{
+	struct recover_test *t = (struct recover_test *) userdata;
+	uint64_t now = temper_time_us(CLOCK_MONOTONIC);
 
-	if (device.conversion_method == 1)
+	if (sample->device != 1)
 	{
-		/*
-		 * conversion_method 1: value in two's complement with fraction
-		 * If MSB is set, the temperature is negative in 2'complement form.
-		 * Since we cannot know how negative numbers are on the system,
-		 * we calculate it manually. Since TEMPer only has 4 bits after the
-		 * comma and they are the higher part of the byte, we shift the two
-		 * bytes after concatinating 4 bits to the right, deal with 12 bits
-		 * (0xFFF) and divide by 16.
-		 * Alternatively, we could omit the shift to the right, deal with
-		 * 16 bits (0xFFFF) and divide by 256.
-		 */
+		return;
+	}
+	if ((t->samples > 0) && (now - t->last_us > t->max_gap_us))
+	{
+		t->max_gap_us = now - t->last_us;
+	}
+	t->last_us = now;
+	t->samples++;
+}
 
-		/* see whether we have valid result */
-		if ((valuestring[startchar + 1] & 0x0F) != 0)
-		{
-			debug_print("invalid result received\n");
-			return -999.0;
-		}
+/*
+ * test_recover
+ *
+ * samples a simulated device hanging after 3 answers, whose reset
+ * takes 300 ms, next to a healthy one on the same worker: the reset
+ * must not hold up the samples of the healthy device. Returns the
+ * amount of failures.
+ */
 
-		if ((valuestring[startchar] & 0x80) != 0)
+int test_recover()
+{
+	struct temper_sampler_config cfg;
+	struct temper_sampler *sampler;
+	struct temper_sampler_stats stats;
+	struct temper_ctx *ctxs[2] = { NULL, NULL };
+	struct temper_sim sim;
+	struct recover_test t;
+	int failures = 0;
+	int dev;
+
+	memset(&t, 0, sizeof(t));
+	memset(&stats, 0, sizeof(stats));
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.workers = 1;
+	cfg.interval_ms = 20;
+	cfg.timeout_ms = 50;
+	cfg.recover_after = 2;
+	cfg.recover_timeout_ms = 1000;
+	cfg.backend = TEMPER_BACKEND_EPOLL;
+	cfg.callback = recover_test_sample;
+	cfg.userdata = &t;
+	sampler = temper_sampler_new(&cfg);
+	(void)temper_sim_defaults(&sim, "TEMPerX_V3.1");
+	sim.reset_ms = 300;
+	for (dev = 0; dev < 2; dev++)
+	{
+		sim.answers = (dev == 0) ? 3 : -1;
+		ctxs[dev] = temper_new();
+		if ((ctxs[dev] == NULL) || (temper_open_sim(ctxs[dev], &sim) != TEMPER_OK) ||
+			(temper_identify(ctxs[dev]) != TEMPER_OK) || (sampler == NULL))
 		{
-			// convert fixed comma from 2'complement form, < 0
-			// 1. ignore comma
-			// 2. subtract 1
-			// 3. invert bits
-			// 4. multiply by -1
-			// 5. divide by amount of distinct values behind the comma
-			//    - here we calculate with 4 bits => 2 by power of 4
-
-			return (float)((((((valuestring[startchar] << 8) + 
-				valuestring[startchar + 1]) >> 4) - 1) ^ 0xFFF) * -1) / pow(2, 4);
+			failures++;
+			continue;
 		}
-		else
-		{
-			// convert fixed comma from 2'complement form, >= 0
-			// 1. ignore comma
-			// 2. divide by amount of distinct values behind the comma
-			//    - here we calculate with 4 bits => 2 by power of 4
+		temper_sampler_add(sampler, ctxs[dev], 0);
+	}
+	if ((sampler != NULL) && (temper_sampler_start(sampler) == TEMPER_OK))
+	{
+		usleep(800000);
+		temper_sampler_stop(sampler);
+		(void)temper_sampler_stats(sampler, 0, &stats);
+	}
+	temper_sampler_free(sampler);
+	for (dev = 0; dev < 2; dev++)
+	{
+		temper_free(ctxs[dev]);
+	}
+	// a round waits 50 ms for the hanging device at most
+	debug_print("recover: %lu recoveries, %lu recovered, healthy device %i samples, "
+		"longest gap %llu ms / expected: 1 or more, 1 or more, 10 or more, below 150 ms\n",
+		stats.recoveries, stats.recovered, t.samples, (unsigned long long)(t.max_gap_us / 1000));
+	failures += (stats.recoveries < 1) || (stats.recovered < 1) || (t.samples < 10) ||
+		(t.max_gap_us >= 150000);
+
+	return failures;
+}
 
-			return (float)(((valuestring[startchar] << 8) + valuestring[startchar + 1]) >> 4) / pow(2, 4);
+/*
+ * test_realtime
+ *
+ * checks the validation of the scheduling settings and samples a
+ * simulated device with a pinned and, if permitted, real-time worker:
+ * every query has to show up in the jitter histogram. Returns the
+ * amount of failures.
+ */
 
-		}
+int test_realtime()
+{
+	struct temper_sampler_config cfg;
+	struct temper_sampler *sampler;
+	struct temper_sampler_stats stats;
+	struct temper_ctx *ctx;
+	struct temper_sim sim;
+	struct low_power_test l;
+	unsigned long queries = 0;
+	uint64_t cpus = 0;
+	int failures = 0;
+	int r = TEMPER_ERR_NOMEM;
+	int bucket;
+
+	failures += !parse_cpus("0,3,63", &cpus) || (cpus != ((1ULL << 0) | (1ULL << 3) | (1ULL << 63)));
+	failures += parse_cpus("64", &cpus) + parse_cpus("1,", &cpus) + parse_cpus("-1", &cpus) + parse_cpus("a", &cpus);
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.workers = 1;
+	cfg.callback = low_power_test_sample;
+	cfg.sched_policy = SCHED_FIFO;
+	sampler = temper_sampler_new(&cfg);
+	failures += (sampler != NULL);
+	temper_sampler_free(sampler);
+	cfg.sched_policy = -1;
+	sampler = temper_sampler_new(&cfg);
+	failures += (sampler != NULL);
+	temper_sampler_free(sampler);
+	// the start fails at the workers, free releases all of them all the same
+	cfg.sched_policy = SCHED_OTHER;
+	cfg.workers = 2;
+	cfg.cpus = 1ULL << 63;
+	sampler = temper_sampler_new(&cfg);
+	failures += (sampler == NULL) || (temper_sampler_start(sampler) != TEMPER_ERR_PARAM);
+	temper_sampler_free(sampler);
+	cfg.workers = 1;
+
+	memset(&l, 0, sizeof(l));
+	cfg.interval_ms = 10;
+	cfg.userdata = &l;
+	cfg.cpus = 1;
+	cfg.sched_policy = SCHED_FIFO;
+	cfg.sched_priority = 1;
+	(void)temper_sim_defaults(&sim, "TEMPerX_V3.1");
+	ctx = temper_new();
+	if ((ctx == NULL) || (temper_open_sim(ctx, &sim) != TEMPER_OK) || (temper_identify(ctx) != TEMPER_OK))
+	{
+		temper_free(ctx);
+		return failures + 1;
 	}
-	else if (device.conversion_method == 2)
+	sampler = temper_sampler_new(&cfg);
+	if (sampler != NULL)
 	{
-		/*
-		 * conversion_method 2: value in two's complement multiplied
-		 * by 100, e.g. 22.06 °C = 2206
-		 */
-		if ((valuestring[startchar] & 0x80) != 0)
+		temper_sampler_add(sampler, ctx, 0);
+		r = temper_sampler_start(sampler);
+		if (r == TEMPER_ERR_PERMISSION)
 		{
-			// convert two's complement, < 0
-			// 1. convert two bytes to integer
-			// 2. subtract 1 from integer
-			// 3. invert bits
-			// 4. make negative
-			// 5. after conversion, divide by 100
-			return (float)(((((valuestring[startchar] << 8) + valuestring[startchar + 1])
-				- 1) ^ 0xFFFF) * -1) / 100.0;
+			// not privileged, pinned only
+			temper_sampler_free(sampler);
+			cfg.sched_policy = SCHED_OTHER;
+			cfg.sched_priority = 0;
+			sampler = temper_sampler_new(&cfg);
+			temper_sampler_add(sampler, ctx, 0);
+			r = temper_sampler_start(sampler);
 		}
-		else
+	}
+	if (r == TEMPER_OK)
+	{
+		usleep(200000);
+		temper_sampler_stop(sampler);
+		(void)temper_sampler_stats(sampler, 0, &stats);
+		for (bucket = 0; bucket < TEMPER_JITTER_BUCKETS; bucket++)
 		{
-			// convert two's complement, >= 0
-			// 1. convert to bytes to integer
-			// 2. after conversion, divide by 100
-			return (float)((valuestring[startchar] << 8) + valuestring[startchar + 1]) / 100.0;
+			queries += stats.jitter[bucket];
 		}
+		debug_print("realtime: %lu queries in the histogram, %lu samples, max %lu us "
+			"/ expected: every sample, 10 or more\n", queries, stats.samples, stats.jitter_us_max);
+		failures += (queries != stats.samples) || (queries < 10) ||
+			(stats.jitter_us_total > (uint64_t) queries * stats.jitter_us_max);
 	}
 	else
 	{
-		/*
-		 * if an unknown conversion_method is defined,
-		 * return invalid value
-		 */
-		return -999.0;
+		debug_print("realtime: %s / expected: %s\n", temper_strerror(r), temper_strerror(TEMPER_OK));
+		failures++;
 	}
-}
+	temper_sampler_free(sampler);
+	temper_free(ctx);
 
+	return failures;
+}
 
 /*
- * read values from temper
+ * test_push
  *
+ * sends samples to a local UDP socket and checks batching, sequence
+ * numbers and the decoded values, returns the amount of failures
  */
-int query_values()
+
+int test_push()
 {
-	#define RETRIES 10
-	char *errmsg = NULL;
-	unsigned char answer[9];
-	int response;
-	int sensor;
-	int cnt = 0;
-	int received_responses;
+	const int expected[] = { 5, 5, 2 };
+	struct temper_push_sample decoded[TEMPER_PUSH_MAX_SAMPLES];
+	struct temper_push_header header;
+	struct temper_push p;
+	struct sockaddr_in addr;
+	socklen_t addrlen = sizeof(addr);
+	unsigned char buf[TEMPER_PUSH_SIZE];
+	float values[TEMPER_CHANNELS];
+	uint64_t start_us = 1600000000000000ULL;
+	char collector[32];
+	size_t bytes = 0;
+	ssize_t len;
+	int failures = 0;
+	int fd;
+	int r;
+	int cnt;
+	int n;
+
+	fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if ((fd < 0) || (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) ||
+		(getsockname(fd, (struct sockaddr *) &addr, &addrlen) != 0))
+	{
+		return 1;
+	}
+	(void)snprintf(collector, sizeof(collector), "127.0.0.1:%i", ntohs(addr.sin_port));
+	if (temper_push_open(&p, collector, 7, 5, 50) != TEMPER_OK)
+	{
+		close(fd);
+		return 1;
+	}
+	for (cnt = 0; cnt < 12; cnt++)
+	{
+		temper_invalidate(values);
+		values[TEMPER_INT_TEMP] = -10.0 + cnt * 1.37;
+		values[TEMPER_INT_HUM] = 40.25;
+		(void)temper_push_add(&p, cnt % 3, start_us + cnt * 250000,
+			(cnt == 4) ? TEMPER_ERR_TIMEOUT : TEMPER_OK, values);
+	}
+	// two batches are full, the rest waits for the flush interval
+	failures += (p.datagrams != 2) || (temper_push_tick(&p) <= 0);
+	usleep(60000);
+	failures += (temper_push_tick(&p) != -1) || (p.datagrams != 3);
+	temper_push_close(&p);
 
-	while (cnt < RETRIES)
+	for (cnt = 0; cnt < 3; cnt++)
 	{
-		response = 0;
-		received_responses = 0;
-		errmsg = send_command("query values", query_vals, sizeof(query_vals));
-		if (errmsg != NULL) 
+		len = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+		if (len <= 0)
 		{
-			if ((cnt + 1) < RETRIES)
-			{
-				debug_print("%s, retry %i/%i\n", errmsg, cnt + 1, RETRIES);
-				free(errmsg);
-			}
-			else
-			{
-				print_error(errmsg);
-				free(errmsg);
-				return 0;
-			}
+			failures++;
+			break;
 		}
-		while (response < device.amount_value_responses)
+		bytes += len;
+		r = temper_push_decode(buf, len, &header, decoded, TEMPER_PUSH_MAX_SAMPLES);
+		failures += (r != expected[cnt]) || (header.node != 7) || (header.sequence != cnt);
+		for (n = 0; n < r; n++)
 		{
-			errmsg = read_answer("query values", answer);
-			if (errmsg != NULL)
-			{
-				debug_print("%s on try %i/%i\n", errmsg, cnt + 1, RETRIES);
-				if ((cnt + 1) >= RETRIES)
-				{
-					print_error(errmsg);
-					free(errmsg);
-					return 0;
-				}
-				free(errmsg);
-			}
-			else
-			{
-				// per response there are up to 2 sensors
-				sensor = 0;
-				while (sensor < 2)
-				{
-					if (device.sensors[response][sensor] >= 0)
-					{
-						device.values[device.sensors[response][sensor]] = 
-							calc_value(answer, (2 + (sensor * 2)));
-					}
-					sensor++;
-				}
-				received_responses++;
-			}
-
-			response++;
+			// values are sent in hundredths
+			failures += (decoded[n].values[TEMPER_INT_TEMP] - (-10.0 + (cnt * 5 + n) * 1.37) > 0.006) ||
+				(decoded[n].values[TEMPER_INT_TEMP] - (-10.0 + (cnt * 5 + n) * 1.37) < -0.006) ||
+				(decoded[n].values[TEMPER_INT_HUM] != 40.25) ||
+				(decoded[n].values[TEMPER_EXT_TEMP] != TEMPER_INVALID) ||
+				(decoded[n].device != (cnt * 5 + n) % 3) ||
+				(decoded[n].timestamp_us != start_us + (cnt * 5 + n) * 250000) ||
+				(decoded[n].status != ((cnt * 5 + n == 4) ? TEMPER_ERR_TIMEOUT : TEMPER_OK));
 		}
-		if (received_responses >= device.amount_value_responses)
+		if (cnt == 0)
 		{
-			break;
+			// truncated and with trailing garbage
+			failures += (temper_push_decode(buf, len - 1, &header, decoded, TEMPER_PUSH_MAX_SAMPLES) != TEMPER_ERR_PARAM);
+			buf[len] = 0;
+			failures += (temper_push_decode(buf, len + 1, &header, decoded, TEMPER_PUSH_MAX_SAMPLES) != TEMPER_ERR_PARAM);
 		}
-		cnt++;
-	}
-	/* 
-	 * TODO: this code is left from an experimental version
-	 * where only one value was supported.
-	 * probably there is a way to report this when at least one
-	 * sensor returns an error?
-	 */
-
-	/*
-	if (*tempC == -999.0)
-	{
-		print_error("Error received - external sensor disconnected?");
-		return 0;
 	}
-	*/
+	close(fd);
+	debug_print("push: 12 samples in %i datagrams, %lu bytes, %lu per sample / expected: 3 datagrams\n",
+		cnt, (unsigned long) bytes, (unsigned long) bytes / 12);
 
-	return 1;
+	return failures;
 }
 
-int char_index(const char *string, char c)
-{
-	for (int i = 0; string[i] != '\0'; i++)
-		if (string[i] == c)
-			return i;
+/*
+ * mock_broker_read
+ *
+ * reads n bytes the client sent to the mock broker at fd into buf,
+ * ticking the client while waiting. Returns false if they did not
+ * come within a second.
+ */
 
-	return -1;
+bool mock_broker_read(struct temper_mqtt *client, int fd, unsigned char *buf, size_t n)
+{
+	struct pollfd pfd;
+	size_t used = 0;
+	ssize_t r;
+	int tries;
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	for (tries = 0; (used < n) && (tries < 100); tries++)
+	{
+		(void)temper_mqtt_tick(client);
+		if (poll(&pfd, 1, 10) <= 0)
+		{
+			continue;
+		}
+		r = read(fd, buf + used, n - used);
+		if (r <= 0)
+		{
+			return false;
+		}
+		used += r;
+	}
+	return used == n;
 }
 
 /*
- * get_devnode
+ * mock_broker_packet
  *
- * uses /sys-dirstructure to find the appropriate hidraw device
+ * reads the next packet of the client into buf (at least 130 bytes),
+ * the mock broker knows remaining lengths of one byte only. Returns
+ * the size of the packet, -1 if none came.
  */
 
-int get_devnode()
+int mock_broker_packet(struct temper_mqtt *client, int fd, unsigned char *buf)
 {
-	struct hidraw_device
+	if (!mock_broker_read(client, fd, buf, 2) || (buf[1] & 0x80) ||
+		!mock_broker_read(client, fd, buf + 2, buf[1]))
 	{
-		uint16_t idVendor;
-		uint16_t idProduct;
-		char devname[261];
-	};
+		return -1;
+	}
+	return 2 + buf[1];
+}
 
-	struct hidraw_device *devlist;
-	int amount = 0;
+/*
+ * mock_broker_accept
+ *
+ * accepts the connection of the client at the listening socket fd and
+ * answers its CONNECT, returns the connection or -1
+ */
 
-	int add_hiddev(const char *base_path)
+int mock_broker_accept(struct temper_mqtt *client, int fd)
+{
+	const unsigned char connack[] = { 0x20, 2, 0, 0 };
+	size_t id_len = strlen(client->client_id);
+	unsigned char buf[130];
+	struct pollfd pfd;
+	int conn = -1;
+	int tries;
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	for (tries = 0; (conn < 0) && (tries < 100); tries++)
 	{
-		int fd;
-		int r;
-		char *filepath;
-		char buf[16];
-		struct hidraw_device dev;
-
-		//dev = malloc(sizeof(dev));
-
-		/* get Vendor ID */
-		filepath = malloc(strlen(base_path) + 19);
-		(void)sprintf(filepath, "%s/../../../idVendor", base_path);
-		fd = open(filepath, O_RDONLY);
-		r = read(fd, buf, 16);
-		if (r < 0)
+		(void)temper_mqtt_tick(client);
+		if (poll(&pfd, 1, 10) > 0)
 		{
-			print_error("Error reading idVendor");
-			close(fd);
-			free(filepath);
-			return 0;
-		}
-		dev.idVendor = strtol(buf, NULL,16);
-		close(fd);
-		free(filepath);
-
-		/* get Product ID */
-		filepath = malloc(strlen(base_path) + 20);
-		(void)sprintf(filepath, "%s/../../../idProduct", base_path);
-		fd = open(filepath, O_RDONLY);
-		r = read(fd, buf, 16);
-		if (r < 0)
-		{
-			print_error("Error reading idProduct");
-			close(fd);
-			free(filepath);
-			return 0;
+			conn = accept(fd, NULL, NULL);
 		}
-		dev.idProduct = strtol(buf, NULL,16);
-		close(fd);
-		free(filepath);
-
-		/* get device name */
-		DIR *dir = opendir(base_path);
-		struct dirent *dp;
-
-		while ((dp = readdir(dir)) != NULL)
+	}
+	// protocol level 4, clean session, keepalive 60, the client ID
+	if ((conn < 0) || (mock_broker_packet(client, conn, buf) != 14 + id_len) || (buf[0] != 0x10) ||
+		memcmp(buf + 2, "\0\4MQTT\4\2\0\74", 10) || (buf[12] != 0) || (buf[13] != id_len) ||
+		memcmp(buf + 14, client->client_id, id_len) ||
+		(write(conn, connack, sizeof(connack)) != sizeof(connack)))
+	{
+		if (conn >= 0)
 		{
-			if (strstr(dp->d_name, "hidraw"))
-			{
-				(void)sprintf(dev.devname, "/dev/%s", dp->d_name);
-			}
+			close(conn);
 		}
+		return -1;
+	}
+	return conn;
+}
 
-		/* copy the results to the array of structs */
-		devlist = realloc(devlist, sizeof(dev) * (amount + 1));
-		devlist[amount].idVendor = dev.idVendor;
-		devlist[amount].idProduct = dev.idProduct;
-		strcpy(devlist[amount].devname, dev.devname);
-		debug_print("VendorId: %04x / ", devlist[amount].idVendor);
-		debug_print("ProductId: %04x / ", devlist[amount].idProduct);
-		debug_print("Device: '%s'\n", devlist[amount].devname);
-		closedir(dir);
+/*
+ * mqtt_test_wait
+ *
+ * ticks client until it is in state with inflight QoS 1 publishes
+ * waiting, returns false if that does not happen within a second
+ */
+
+bool mqtt_test_wait(struct temper_mqtt *client, int state, int inflight)
+{
+	int tries;
+
+	for (tries = 0; tries < 100; tries++)
+	{
+		(void)temper_mqtt_tick(client);
+		if ((client->state == state) && (client->amount_inflight == inflight))
+		{
+			return true;
+		}
+		(void)poll(NULL, 0, 10);
+	}
+	return false;
+}
+
+/*
+ * mqtt_test_session
+ *
+ * the exchange of test_mqtt with the client connecting to the mock
+ * broker listening at fd, *conn is the connection of the broker.
+ * Returns the amount of failures.
+ */
+
+int mqtt_test_session(struct temper_mqtt *client, int fd, int *conn)
+{
+	const unsigned char pubacks[] = { 0x40, 2, 0, 1, 0x40, 2, 0, 2, 0x40, 2, 0, 3, 0x40, 2, 0, 4 };
+	const unsigned char pubacks2[] = { 0x40, 2, 0, 5, 0x40, 2, 0, 6 };
+	unsigned char buf[130];
+	char payload[8];
+	int failures = 0;
+	int cnt;
+
+	*conn = mock_broker_accept(client, fd);
+	if ((*conn < 0) || !mqtt_test_wait(client, TEMPER_MQTT_CONNECTED, 0))
+	{
+		return 1;
+	}
+
+	// pipelined: all five arrive before the first PUBACK
+	for (cnt = 0; cnt < 5; cnt++)
+	{
+		(void)snprintf(payload, sizeof(payload), "2%i.5", cnt);
+		failures += temper_mqtt_publish(client, "t/sim0/it", payload, 4) != TEMPER_OK;
+	}
+	temper_mqtt_flush(client);
+	for (cnt = 0; cnt < 5; cnt++)
+	{
+		failures += (mock_broker_packet(client, *conn, buf) != 19) || (buf[0] != 0x32) ||
+			memcmp(buf + 2, "\0\11t/sim0/it", 11) || (buf[13] != 0) || (buf[14] != cnt + 1) ||
+			(buf[16] != '0' + cnt);
+	}
+	failures += client->amount_inflight != 5;
+	failures += (write(*conn, pubacks, sizeof(pubacks)) != sizeof(pubacks)) ||
+		!mqtt_test_wait(client, TEMPER_MQTT_CONNECTED, 1) || (client->acked != 4);
+
+	// the broker goes away with publish 5 unacknowledged, 6 waits for the next connection
+	close(*conn);
+	*conn = -1;
+	failures += !mqtt_test_wait(client, TEMPER_MQTT_DISCONNECTED, 1) ||
+		(client->reconnect_us <= temper_time_us(CLOCK_MONOTONIC));
+	failures += temper_mqtt_publish(client, "t/sim0/it", "25.5", 4) != TEMPER_OK;
+	client->reconnect_us = 0;
+	if (((*conn = mock_broker_accept(client, fd)) < 0) ||
+		!mqtt_test_wait(client, TEMPER_MQTT_CONNECTED, 2))
+	{
+		return failures + 1;
+	}
+	failures += (mock_broker_packet(client, *conn, buf) != 19) || (buf[0] != 0x3a) || (buf[14] != 5);
+	failures += (mock_broker_packet(client, *conn, buf) != 19) || (buf[0] != 0x32) || (buf[14] != 6);
+	failures += (write(*conn, pubacks2, sizeof(pubacks2)) != sizeof(pubacks2)) ||
+		!mqtt_test_wait(client, TEMPER_MQTT_CONNECTED, 0) || (client->acked != 6) || (client->connects != 2);
+
+	// QoS 0 has no packet identifier
+	client->qos = 0;
+	(void)temper_mqtt_publish(client, "t/sim0/ih", "40.0", 4);
+	temper_mqtt_flush(client);
+	failures += (mock_broker_packet(client, *conn, buf) != 17) || (buf[0] != 0x30) || memcmp(buf + 13, "40.0", 4);
+	temper_mqtt_close(client);
+	failures += (mock_broker_packet(client, *conn, buf) != 2) || (buf[0] != 0xe0);
+	debug_print("mqtt: %lu published, %lu acknowledged, %lu connections / expected: 7, 6, 2\n",
+		client->published, client->acked, client->connects);
+	failures += (client->published != 7) || (client->dropped != 0);
+
+	return failures;
+}
+
+/*
+ * test_mqtt
+ *
+ * runs the client against a mock broker on a loopback socket: QoS 1
+ * publishes go out before any is acknowledged, the ones not
+ * acknowledged when the broker goes away are sent again as
+ * duplicates after reconnecting, with a client ID of the longest
+ * size allowed. Returns the amount of failures.
+ */
+
+int test_mqtt()
+{
+	struct temper_mqtt client;
+	struct sockaddr_in addr;
+	socklen_t addrlen = sizeof(addr);
+	char broker[32];
+	int failures = 0;
+	int conn = -1;
+	int fd;
+
+	failures += (temper_mqtt_open(&client, "", "test", 0, 60) != TEMPER_ERR_PARAM) ||
+		(temper_mqtt_open(&client, "localhost", "a-client-id-with-24-char", 0, 60) != TEMPER_ERR_PARAM) ||
+		(temper_mqtt_open(&client, "localhost", "test", 2, 60) != TEMPER_ERR_PARAM);
+
+	fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if ((fd < 0) || (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) || (listen(fd, 1) != 0) ||
+		(getsockname(fd, (struct sockaddr *) &addr, &addrlen) != 0))
+	{
+		return failures + 1;
+	}
+	(void)snprintf(broker, sizeof(broker), "127.0.0.1:%i", ntohs(addr.sin_port));
+	// the longest client ID, two characters more than the default tempersensor-XXXXXXXX
+	if (temper_mqtt_open(&client, broker, "tempersensor-0123456789", 1, 60) != TEMPER_OK)
+	{
+		close(fd);
+		return failures + 1;
+	}
+	failures += mqtt_test_session(&client, fd, &conn);
+
+	temper_mqtt_close(&client);
+	if (conn >= 0)
+	{
+		close(conn);
+	}
+	close(fd);
+	return failures;
+}
+
+/*
+ * stream_connect
+ *
+ * connects to the stream at path and subscribes to mask of device,
+ * returns the socket or -1
+ */
+
+int stream_connect(const char *path, int device, uint16_t mask, float deadband)
+{
+	struct sockaddr_un addr;
+	unsigned char buf[16];
+	size_t len = temper_stream_subscribe(buf, device, mask, deadband);
+	int fd;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	(void)snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if ((fd >= 0) && ((connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) ||
+		(write(fd, buf, len) != (ssize_t) len)))
+	{
+		close(fd);
+		fd = -1;
+	}
+	return fd;
+}
+
+/*
+ * struct stream_reader
+ *
+ * a subscriber of test_stream, keeping a frame not complete yet
+ */
+struct stream_reader
+{
+	int fd;
+	unsigned char buf[4096];
+	size_t used;
+};
+
+/*
+ * stream_receive
+ *
+ * decodes what the stream sent to the reader so far into msgs (room
+ * for STREAM_TEST_MESSAGES), returns their amount or -1 for a
+ * malformed frame
+ */
+
+#define STREAM_TEST_MESSAGES 1024
+
+int stream_receive(struct stream_reader *reader, struct temper_stream_message *msgs)
+{
+	ssize_t len = recv(reader->fd, reader->buf + reader->used, sizeof(reader->buf) - reader->used, MSG_DONTWAIT);
+	size_t pos = 0;
+	int amount = 0;
+	int r;
+
+	reader->used += (len > 0) ? len : 0;
+	while ((r = temper_stream_decode(reader->buf + pos, reader->used - pos, &msgs[amount])) > 0)
+	{
+		pos += r;
 		amount++;
+	}
+	reader->used -= pos;
+	memmove(reader->buf, reader->buf + pos, reader->used);
+	return (r < 0) ? -1 : amount;
+}
+
+/*
+ * test_stream
+ *
+ * streams samples of two devices to three subscribers: one to a device,
+ * one with a deadband and one not reading, which must neither block
+ * sampling nor lose the latest sample. Without a deadband repeated
+ * values pass, errors pass any deadband. Returns the amount of failures.
+ */
+
+int test_stream()
+{
+	const float series[] = { 20.0, 20.2, 20.7, 20.8 };
+	struct temper_stream_message msgs[STREAM_TEST_MESSAGES];
+	struct stream_reader readers[4];
+	struct temper_sample sample;
+	float latest[2] = { 0, 0 };
+	char path[64];
+	int failures = 0;
+	int amount;
+	int tries;
+	int cnt;
+
+	(void)snprintf(path, sizeof(path), "/tmp/tempersensor-test-%i.sock", (int) getpid());
+	if (temper_stream_open(&stream, path) != TEMPER_OK)
+	{
 		return 1;
 	}
-
-	int find_hidraw(const char *base_path)
+	memset(readers, 0, sizeof(readers));
+	temper_stream_name(&stream, 0, "sim0");
+	temper_stream_name(&stream, 1, "sim1");
+	readers[0].fd = stream_connect(path, 0, 1 << TEMPER_INT_TEMP | 1 << TEMPER_INT_HUM, 0);
+	readers[1].fd = stream_connect(path, TEMPER_STREAM_ALL, 1 << TEMPER_INT_TEMP, 0.5);
+	readers[2].fd = stream_connect(path, TEMPER_STREAM_ALL, 0x3ff, 0);
+	for (tries = 0; (tries < 100) && ((temper_stream_tick(&stream) > 0) || (stream.amount_clients < 3)); tries++)
+	{
+		(void)poll(NULL, 0, 1);
+	}
+
+	memset(&sample, 0, sizeof(sample));
+	temper_invalidate(sample.values);
+	for (cnt = 0; cnt < 4; cnt++)
+	{
+		sample.timestamp_us = 1600000000000000ULL + cnt * 1000000ULL;
+		sample.values[TEMPER_INT_TEMP] = series[cnt];
+		sample.values[TEMPER_INT_HUM] = 40.0;
+		temper_stream_sample(&stream, &sample);
+	}
+	sample.device = 1;
+	temper_stream_sample(&stream, &sample);
+	// names and four samples, names and the ones moving by 0.5
+	amount = stream_receive(&readers[0], msgs);
+	failures += (amount != 6) || (msgs[1].type != TEMPER_STREAM_NAME) || strcmp(msgs[1].name, "sim1") ||
+		(msgs[5].type != TEMPER_STREAM_SAMPLE) || (msgs[5].device != 0) ||
+		(msgs[5].values[TEMPER_INT_TEMP] != 20.8f) || (msgs[5].values[TEMPER_INT_HUM] != 40.0f) ||
+		(msgs[5].values[TEMPER_EXT_TEMP] > TEMPER_INVALID) || (msgs[5].timestamp_us != 1600000003000000ULL);
+	amount = stream_receive(&readers[1], msgs);
+	failures += (amount != 5) || (msgs[2].values[TEMPER_INT_TEMP] != 20.0f) ||
+		(msgs[3].values[TEMPER_INT_TEMP] != 20.7f) || (msgs[4].device != 1);
+
+	// the same values three times, then two timeouts: all without a deadband, the timeouts with one
+	sample.device = 0;
+	for (cnt = 0; cnt < 5; cnt++)
+	{
+		sample.timestamp_us += 1000000;
+		sample.status = (cnt < 3) ? TEMPER_OK : TEMPER_ERR_TIMEOUT;
+		temper_stream_sample(&stream, &sample);
+	}
+	sample.status = TEMPER_OK;
+	amount = stream_receive(&readers[0], msgs);
+	failures += (amount != 5) || (msgs[2].values[TEMPER_INT_TEMP] != 20.8f) ||
+		(msgs[3].status != TEMPER_ERR_TIMEOUT) || (msgs[4].status != TEMPER_ERR_TIMEOUT);
+	amount = stream_receive(&readers[1], msgs);
+	failures += (amount != 2) || (msgs[0].status != TEMPER_ERR_TIMEOUT) || (msgs[1].status != TEMPER_ERR_TIMEOUT);
+
+	// readers[2] does not read, the others now neither
+	for (cnt = 0; cnt < 20000; cnt++)
+	{
+		sample.device = cnt % 2;
+		sample.timestamp_us += 1000;
+		sample.values[TEMPER_INT_TEMP] = 10.0 + (cnt % 1000) / 100.0;
+		temper_stream_sample(&stream, &sample);
+	}
+	debug_print("stream: %lu frames, %lu sent in %lu writes, %lu coalesced, %lu dropped\n",
+		stream.frames, stream.sent, stream.writes, stream.coalesced, stream.dropped);
+	failures += (stream.coalesced == 0) || (stream.dropped != 0) || (stream.amount_clients != 3);
+	// once read, the socket takes the latest sample of each device
+	for (tries = 0; (tries < 100) && ((latest[0] != 19.98f) || (latest[1] != 19.99f)); tries++)
+	{
+		amount = stream_receive(&readers[2], msgs);
+		for (cnt = 0; cnt < amount; cnt++)
+		{
+			latest[msgs[cnt].device % 2] = msgs[cnt].values[TEMPER_INT_TEMP];
+		}
+		(void)temper_stream_tick(&stream);
+		(void)poll(NULL, 0, 1);
+	}
+	failures += (latest[0] != 19.98f) || (latest[1] != 19.99f);
+
+	// a client not speaking the protocol is dropped
+	readers[3].fd = stream_connect(path, 0, 1, 0);
+	if (readers[3].fd >= 0)
+	{
+		(void)write(readers[3].fd, "junk", 4);
+	}
+	for (tries = 0, amount = 0; (tries < 100) && ((amount < 4) || (stream.amount_clients != 3)); tries++)
+	{
+		(void)temper_stream_tick(&stream);
+		amount = (stream.amount_clients > amount) ? stream.amount_clients : amount;
+		(void)poll(NULL, 0, 1);
+	}
+	failures += (amount != 4) || (stream.amount_clients != 3);
+
+	temper_stream_close(&stream);
+	failures += access(path, F_OK) == 0;
+	for (cnt = 0; cnt < 4; cnt++)
+	{
+		if (readers[cnt].fd >= 0)
+		{
+			close(readers[cnt].fd);
+		}
+	}
+	return failures;
+}
+
+/*
+ * test_snmp
+ *
+ * scripts the pass_persist protocol over pipes, split in the middle
+ * of a line, against two devices, one without a sample yet. Returns
+ * the amount of failures.
+ */
+
+int test_snmp()
+{
+	const char *script[] = {
+		"PING\nget\n.1.3.6.1.4.1.8072.9999.1.10.1\ngetnext\n.1.3.6.1.4.1.8072.9999\ngetnext\n.1.3.6.1.4.",
+		"1.8072.9999.1.2.2\nget\n.1.3.6.1.4.1.8072.9999.1.10.2\nset\n.1.3.6.1.4.1.8072.9999.1.1.1\n"
+		"integer 5\ngetnext\n.1.3.6.1.4.1.8072.9999.1.30.1\ngetnext\n.1.3.6.1.4.1.8072.9999.1.39.1\n"
+		"get\n.1.3.6.1.4.1.8072.9999.1.90.1\nget\n.1.3.6.1.4.1.8072.9999.1.60.2\n"
+		"getnext\n.1.3.6.1.4.1.8072.10000\n" };
+	const char *expected =
+		"PONG\n"
+		".1.3.6.1.4.1.8072.9999.1.10.1\ninteger\n2350\n"
+		".1.3.6.1.4.1.8072.9999.1.1.1\ninteger\n1\n"
+		".1.3.6.1.4.1.8072.9999.1.3.1\ninteger\n0\n"
+		"NONE\n"
+		"not-writable\n"
+		".1.3.6.1.4.1.8072.9999.1.31.1\nstring\n41\n"
+		".1.3.6.1.4.1.8072.9999.1.50.1\ninteger\n2350\n"
+		".1.3.6.1.4.1.8072.9999.1.90.1\ninteger\n2350\n"
+		"NONE\n"
+		"NONE\n";
+	struct sensor *saved_sensors = sensors;
+	int saved_amount = amount_sensors;
+	struct sensor test_sensors[2];
+	uint32_t oid[10];
+	char answer[1024];
+	int in[2];
+	int out[2];
+	ssize_t len;
+	int failures = 0;
+
+	memset(test_sensors, 0, sizeof(test_sensors));
+	strcpy(test_sensors[0].name, "sim0");
+	strcpy(test_sensors[1].name, "sim1");
+	temper_invalidate(test_sensors[0].latest.values);
+	test_sensors[0].latest.values[TEMPER_INT_TEMP] = 23.5;
+	test_sensors[0].latest.values[TEMPER_INT_HUM] = 41.0;
+	test_sensors[0].latest.timestamp_us = temper_time_us(CLOCK_REALTIME);
+	test_sensors[0].has_latest = true;
+	// the quantiles of the hour and the day, none for the second device
+	failures += !alloc_quantiles(&test_sensors[0]);
+	temper_windowed_add(&test_sensors[0].quantiles[TEMPER_INT_TEMP],
+		test_sensors[0].latest.timestamp_us, 23.5);
+	sensors = test_sensors;
+	amount_sensors = 2;
+	failures += temper_snmp_init(&snmp, "1.3.6.1.4.1.8072.9999", snmp_columns,
+		sizeof(snmp_columns) / sizeof(snmp_columns[0]), snmp_object, NULL) != TEMPER_OK;
+	failures += (temper_snmp_parse_oid(".1.3..6", oid, 10) != -1) || (temper_snmp_parse_oid("1.3.", oid, 10) != -1) ||
+		(temper_snmp_parse_oid("", oid, 10) != -1) || (temper_snmp_parse_oid("1.x", oid, 10) != -1) ||
+		(temper_snmp_parse_oid("1.2.3", oid, 2) != -1) || (temper_snmp_parse_oid(".1.2", oid, 2) != 2);
+
+	if ((pipe(in) != 0) || (pipe(out) != 0))
+	{
+		return failures + 1;
+	}
+	(void)write(in[1], script[0], strlen(script[0]));
+	failures += !temper_snmp_input(&snmp, amount_sensors, in[0], out[1]);
+	(void)write(in[1], script[1], strlen(script[1]));
+	close(in[1]);
+	while (temper_snmp_input(&snmp, amount_sensors, in[0], out[1]))
+		;
+	close(in[0]);
+	close(out[1]);
+	len = read(out[0], answer, sizeof(answer) - 1);
+	close(out[0]);
+	answer[(len > 0) ? len : 0] = '\0';
+	failures += strcmp(answer, expected) != 0;
+	debug_print("snmp answers:\n%s/ expected:\n%s", answer, expected);
+
+	free(test_sensors[0].quantiles);
+	sensors = saved_sensors;
+	amount_sensors = saved_amount;
+	return failures;
+}
+
+/*
+ * test_collectd
+ *
+ * passes three ticks of two devices through the PUTVAL output into a
+ * pipe, the second device missing one sample. Returns the amount of
+ * failures.
+ */
+
+int test_collectd()
+{
+	const char *expected =
+		"PUTVAL \"node1/tempersensor-hidraw0/temperature-internal\" interval=10.000 1600000000.250:23.50\n"
+		"PUTVAL \"node1/tempersensor-hidraw0/humidity-internal\" interval=10.000 1600000000.250:41.00\n"
+		"PUTVAL \"node1/tempersensor-sim_1/temperature-external\" interval=10.000 1600000000.300:-4.25\n"
+		"PUTVAL \"node1/tempersensor-hidraw0/temperature-internal\" interval=10.000 1600000010.250:23.50\n"
+		"PUTVAL \"node1/tempersensor-hidraw0/humidity-internal\" interval=10.000 1600000010.250:41.00\n"
+		"PUTVAL \"node1/tempersensor-hidraw0/temperature-internal\" interval=10.000 1600000020.250:23.50\n"
+		"PUTVAL \"node1/tempersensor-hidraw0/humidity-internal\" interval=10.000 1600000020.250:41.00\n"
+		"PUTVAL \"node1/tempersensor-sim_1/temperature-external\" interval=10.000 1600000020.300:-4.25\n";
+	struct sensor *saved_sensors = sensors;
+	int saved_amount = amount_sensors;
+	struct sensor test_sensors[2];
+	struct temper_sample sample[2];
+	char output[2048];
+	int fds[2];
+	ssize_t len;
+	int failures = 0;
+	int cnt;
+
+	memset(test_sensors, 0, sizeof(test_sensors));
+	strcpy(test_sensors[0].name, "/dev/hidraw0");
+	strcpy(test_sensors[1].name, "sim:1");
+	memset(sample, 0, sizeof(sample));
+	temper_invalidate(sample[0].values);
+	sample[0].values[TEMPER_INT_TEMP] = 23.5;
+	sample[0].values[TEMPER_INT_HUM] = 41.0;
+	temper_invalidate(sample[1].values);
+	sample[1].device = 1;
+	sample[1].values[TEMPER_EXT_TEMP] = -4.25;
+	sensors = test_sensors;
+	amount_sensors = 2;
+	if ((pipe(fds) != 0) || (temper_collectd_open(&collectd, "node1", 10000, amount_sensors, fds[1]) != TEMPER_OK))
+	{
+		failures++;
+	}
+	for (cnt = 0; (cnt < 3) && (failures == 0); cnt++)
+	{
+		sample[0].timestamp_us = 1600000000250000ULL + cnt * 10000000ULL;
+		sample[1].timestamp_us = sample[0].timestamp_us + 50000;
+		collectd_sample(&sample[0]);
+		// a tick is written once, when the last device reported
+		failures += collectd.writes != cnt;
+		if (cnt != 1)
+		{
+			collectd_sample(&sample[1]);
+			failures += collectd.writes != cnt + 1;
+		}
+	}
+	if (failures == 0)
+	{
+		temper_collectd_close(&collectd);
+		close(fds[1]);
+		len = read(fds[0], output, sizeof(output) - 1);
+		close(fds[0]);
+		output[(len > 0) ? len : 0] = '\0';
+		failures += strcmp(output, expected) != 0;
+		debug_print("collectd output:\n%s/ expected:\n%s", output, expected);
+	}
+
+	sensors = saved_sensors;
+	amount_sensors = saved_amount;
+	return failures;
+}
+
+/*
+ * test_alert
+ *
+ * feeds a rising and falling series through alert rules and checks
+ * when conditions are raised and cleared, returns the amount of failures
+ */
+
+int test_alert()
+{
+	// one value per second
+	const float series[] = { 20.0, 29.0, 31.0, 29.8, 30.2, 29.4, 31.0, 31.0, 31.0, 20.0 };
+	const int high[] = { 0, 0, 1, 1, 1, 0, 1, 1, 1, 0 };
+	const int delayed[] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 0 };
+	const int rate[] = { 0, 1, 0, 0, 0, 0, 0, 0, 0, 1 };
+	struct temper_alert_rule rule;
+	struct temper_alert_state state[3];
+	uint64_t now;
+	int failures = 0;
+	int cnt;
+
+	memset(state, 0, sizeof(state));
+	memset(&rule, 0, sizeof(rule));
+	rule.channel = TEMPER_INT_TEMP;
+	rule.high = 30.0;
+	rule.hysteresis = 0.5;
+	rule.rate = 120.0;
+	for (cnt = 0; cnt < (int)(sizeof(series) / sizeof(series[0])); cnt++)
+	{
+		now = (cnt + 1) * 1000000ULL;
+		rule.checks = TEMPER_ALERT_HIGH;
+		rule.duration_ms = 0;
+		temper_alert_update(&rule, &state[0], now, series[cnt]);
+		rule.duration_ms = 2000;
+		temper_alert_update(&rule, &state[1], now, series[cnt]);
+		rule.checks = TEMPER_ALERT_RATE;
+		rule.duration_ms = 0;
+		temper_alert_update(&rule, &state[2], now, series[cnt]);
+		debug_print("alert %.1f: high %i, delayed %i, rate %i / expected: %i, %i, %i\n",
+			series[cnt], state[0].active != 0, state[1].active != 0,
+			state[2].active != 0, high[cnt], delayed[cnt], rate[cnt]);
+		failures += ((state[0].active != 0) != high[cnt]) ||
+			((state[1].active != 0) != delayed[cnt]) ||
+			((state[2].active != 0) != rate[cnt]);
+	}
+
+	return failures;
+}
+
+/*
+ * test_derive
+ *
+ * compares the derived channels against the reference formulas
+ * over the range of the sensors, returns the amount of failures
+ */
+
+int test_derive()
+{
+	double dp_error = 0.0;
+	double ah_error = 0.0;
+	double hi_error = 0.0;
+	float values[TEMPER_CHANNELS];
+	float temp;
+	float hum;
+	int failures = 0;
+
+	for (temp = -40.0; temp <= 60.0; temp += 0.0625)
+	{
+		for (hum = 1.0; hum <= 100.0; hum += 0.5)
+		{
+			temper_invalidate(values);
+			values[TEMPER_INT_TEMP] = temp;
+			values[TEMPER_INT_HUM] = hum;
+			temper_derive(values);
+			if (derive_dewpoint_reference(temp, hum) > DERIVE_SVP_MIN)
+			{
+				dp_error = fmax(dp_error, fabs(values[TEMPER_INT_DEWPOINT]
+					- derive_dewpoint_reference(temp, hum)));
+			}
+			ah_error = fmax(ah_error, fabs(values[TEMPER_INT_ABSHUM]
+				/ derive_abshum_reference(temp, hum) - 1.0));
+			hi_error = fmax(hi_error, fabs(values[TEMPER_INT_HEATINDEX]
+				- derive_heatindex_reference(temp, hum)));
+			failures += (values[TEMPER_EXT_DEWPOINT] > TEMPER_INVALID);
+		}
+	}
+	debug_print("derive max error: dew point %.4f °C, absolute humidity %.4f%%, heat index %.4f °C\n",
+		dp_error, ah_error * 100.0, hi_error);
+	failures += (dp_error > 0.005) + (ah_error > 0.0004) + (hi_error > 0.001);
+
+	// without humidity nothing can be derived
+	temper_invalidate(values);
+	values[TEMPER_INT_TEMP] = 20.0;
+	temper_derive(values);
+	failures += (values[TEMPER_INT_DEWPOINT] > TEMPER_INVALID) ||
+		(values[TEMPER_INT_ABSHUM] > TEMPER_INVALID) ||
+		(values[TEMPER_INT_HEATINDEX] > TEMPER_INVALID);
+
+	return failures;
+}
+
+/*
+ * test_oversample
+ *
+ * checks outlier rejection and reduction, returns the amount
+ * of failures
+ */
+
+int test_oversample()
+{
+	const float steady[] = { 20.0, 20.0625, 20.0, 19.9375, 20.0 };
+	const float glitch[] = { 20.0, 20.0625, 60.0, 20.0, 19.9375 };
+	const float trimmed[] = { 20.0, 20.5, 30.0, 21.0, 10.0, 20.5, 20.0, 20.0 };
+	struct temper_oversample os;
+	float values[TEMPER_CHANNELS];
+	int failures = 0;
+	int cnt;
+
+	temper_oversample_init(&os, TEMPER_REDUCE_MEDIAN, 1.0);
+	temper_invalidate(values);
+	for (cnt = 0; cnt < 4 * 5; cnt++)
+	{
+		if (cnt % 5 == 0)
+		{
+			temper_oversample_reset(&os);
+		}
+		values[0] = steady[cnt % 5];
+		temper_oversample_feed(&os, values);
+		if (cnt % 5 == 4)
+		{
+			temper_oversample_reduce(&os, values);
+		}
+	}
+	temper_oversample_reset(&os);
+	for (cnt = 0; cnt < 5; cnt++)
+	{
+		values[0] = glitch[cnt];
+		temper_oversample_feed(&os, values);
+	}
+	temper_oversample_reduce(&os, values);
+	debug_print("oversample glitch: %.4f, %lu rejected / expected: 20.0000, 1 rejected\n",
+		values[0], os.rejected);
+	failures += (values[0] != 20.0) || (os.rejected != 1);
+
+	// consistent readings far from the history are a real change
+	temper_oversample_reset(&os);
+	for (cnt = 0; cnt < 5; cnt++)
+	{
+		values[0] = 25.0;
+		temper_oversample_feed(&os, values);
+	}
+	temper_oversample_reduce(&os, values);
+	debug_print("oversample step: %.4f / expected: 25.0000\n", values[0]);
+	failures += (values[0] != 25.0);
+
+	temper_oversample_init(&os, TEMPER_REDUCE_TRIMMED, 0.0);
+	for (cnt = 0; cnt < 8; cnt++)
+	{
+		values[0] = trimmed[cnt];
+		temper_oversample_feed(&os, values);
+	}
+	temper_oversample_reduce(&os, values);
+	debug_print("oversample trimmed: %.4f / expected: 20.2500\n", values[0]);
+	failures += (values[0] != 20.25);
+
+	return failures;
+}
+
+#ifdef TEMPER_ALLOC_TEST
+/*
+ * steady_state_run
+ *
+ * samples two simulated devices through the output and storage of
+ * continuous mode (stdout, history, deadband, quantiles) with backend
+ * and oversample and fails if anything is allocated or freed once the
+ * first samples went through. Returns the amount of failures.
+ */
+
+int steady_state_run(int backend, int oversample)
+{
+	struct sensor *saved_sensors = sensors;
+	int saved_amount = amount_sensors;
+	struct config saved_config = config;
+	struct temper_sampler_config cfg;
+	struct temper_sampler *sampler;
+	struct temper_sampler_stats stats;
+	struct sensor test_sensors[2];
+	struct temper_sim sim;
+	struct continuous c;
+	int counts[2] = { 0, 0 };
+	unsigned long heap_calls = 0;
+	unsigned long samples = 0;
+	int failures = 0;
+	int saved_stdout;
+	int null_fd;
+	int cnt;
+
+	memset(test_sensors, 0, sizeof(test_sensors));
+	memset(&cfg, 0, sizeof(cfg));
+	memset(&c, 0, sizeof(c));
+	sensors = test_sensors;
+	amount_sensors = 2;
+	config.precision = 2;
+	config.quantiles = true;
+	config.use_deadband = true;
+	memset(&config.deadband, 0, sizeof(config.deadband));
+	config.count = 0;
+	cfg.workers = 1;
+	cfg.interval_ms = 5;
+	cfg.backend = backend;
+	cfg.timeout_ms = 200;
+	cfg.oversample = oversample;
+	cfg.budget_ms = 5;
+	cfg.callback = continuous_callback;
+	cfg.userdata = &c;
+	c.counts = counts;
+	c.history = fopen("/dev/null", "a");
+	sampler = temper_sampler_new(&cfg);
+	for (cnt = 0; (cnt < 2) && (sampler != NULL); cnt++)
+	{
+		sensors[cnt].ctx = temper_new();
+		(void)snprintf(sensors[cnt].name, sizeof(sensors[cnt].name), "sim%i", cnt);
+		(void)temper_sim_defaults(&sim, (cnt == 0) ? "TEMPerX_V3.1" : "TEMPer1F_V1.3");
+		sim.latency_us = 500;
+		if ((sensors[cnt].ctx == NULL) || (temper_open_sim(sensors[cnt].ctx, &sim) != TEMPER_OK) ||
+			(temper_identify(sensors[cnt].ctx) != TEMPER_OK) || !alloc_quantiles(&sensors[cnt]))
+		{
+			failures++;
+		}
+		temper_sampler_add(sampler, sensors[cnt].ctx, -1);
+	}
+	// the sample lines go nowhere, through stdio all the same
+	fflush(stdout);
+	saved_stdout = dup(STDOUT_FILENO);
+	null_fd = open("/dev/null", O_WRONLY);
+	if ((sampler == NULL) || (c.history == NULL) || (failures > 0) || (saved_stdout < 0) || (null_fd < 0) ||
+		(dup2(null_fd, STDOUT_FILENO) < 0) || (temper_sampler_start(sampler) != TEMPER_OK))
+	{
+		failures++;
+	}
+	else
+	{
+		// lazy buffers of stdio and the like are set up by the first samples
+		usleep(100000);
+		alloctest_start();
+		usleep(300000);
+		heap_calls = alloctest_stop();
+		temper_sampler_stop(sampler);
+		for (cnt = 0; cnt < 2; cnt++)
+		{
+			temper_sampler_stats(sampler, cnt, &stats);
+			samples += stats.samples;
+		}
+	}
+	fflush(stdout);
+	if (saved_stdout >= 0)
+	{
+		(void)dup2(saved_stdout, STDOUT_FILENO);
+		close(saved_stdout);
+	}
+	if (null_fd >= 0)
+	{
+		close(null_fd);
+	}
+	debug_print("steady state, %s backend, oversample %i: %lu heap calls during %lu samples / expected: none during 40 or more\n",
+		temper_backend_name(backend), oversample, heap_calls, samples);
+	failures += (heap_calls != 0) || (samples < 40);
+
+	temper_sampler_free(sampler);
+	for (cnt = 0; cnt < 2; cnt++)
+	{
+		if (sensors[cnt].ctx != NULL)
+		{
+			temper_free(sensors[cnt].ctx);
+		}
+		free(sensors[cnt].quantiles);
+	}
+	if (c.history != NULL)
+	{
+		fclose(c.history);
+	}
+	config = saved_config;
+	sensors = saved_sensors;
+	amount_sensors = saved_amount;
+	return failures;
+}
+
+/*
+ * test_steady_state
+ *
+ * checks that sampling allocates nothing after startup, neither in
+ * sequential nor in batched rounds, and that a round rebuilt after a
+ * recovery reuses its memory. Returns the amount of failures.
+ */
+
+int test_steady_state()
+{
+	struct temper_ctx *ctxs[2] = { NULL, NULL };
+	struct temper_round *round = NULL;
+	float values[2][TEMPER_CHANNELS];
+	int status[2] = { TEMPER_ERR_PARAM, TEMPER_ERR_PARAM };
+	struct temper_sim sim;
+	unsigned long heap_calls = 0;
+	int failures = 0;
+	int r = TEMPER_ERR_NOMEM;
+	int cnt;
+
+	failures += steady_state_run(TEMPER_BACKEND_SEQUENTIAL, 1);
+	failures += steady_state_run(TEMPER_BACKEND_AUTO, 2);
+
+	(void)temper_sim_defaults(&sim, "TEMPerX_V3.1");
+	for (cnt = 0; cnt < 2; cnt++)
+	{
+		ctxs[cnt] = temper_new();
+		if ((ctxs[cnt] == NULL) || (temper_open_sim(ctxs[cnt], &sim) != TEMPER_OK) ||
+			(temper_identify(ctxs[cnt]) != TEMPER_OK))
+		{
+			failures++;
+		}
+	}
+	if (failures == 0)
+	{
+		round = temper_round_new(ctxs, 2, TEMPER_BACKEND_AUTO, 200);
+	}
+	if (round != NULL)
+	{
+		alloctest_start();
+		r = temper_round_reset(round, ctxs, 2);
+		if (r == TEMPER_OK)
+		{
+			(void)temper_round_run(round, values, status);
+		}
+		heap_calls = alloctest_stop();
+		// larger than at creation
+		if (temper_round_reset(round, ctxs, 3) != TEMPER_ERR_PARAM)
+		{
+			failures++;
+		}
+	}
+	debug_print("round reset: %s, %lu heap calls, status %i %i / expected: %s, none, %i %i\n",
+		temper_strerror(r), heap_calls, status[0], status[1], temper_strerror(TEMPER_OK), TEMPER_OK, TEMPER_OK);
+	failures += (r != TEMPER_OK) || (heap_calls != 0) || (status[0] != TEMPER_OK) || (status[1] != TEMPER_OK);
+	temper_round_free(round);
+	for (cnt = 0; cnt < 2; cnt++)
+	{
+		temper_free(ctxs[cnt]);
+	}
+
+	return failures;
+}
+#endif
+
+/*
+ * calc_value
+ *
+ * calculates value from response from given starting character, the
+ * formulas as before the tables of libtempersensor. Kept as reference
+ * independent of decode_reference, which generated the tables.
+ */
+static float calc_value(int conversion_method, const unsigned char *valuestring, int startchar)
+{
+	if (conversion_method == 1)
+	{
+		/* see whether we have valid result */
+		if ((valuestring[startchar + 1] & 0x0F) != 0)
+		{
+			return -999.0;
+		}
+
+		if ((valuestring[startchar] & 0x80) != 0)
+		{
+			// convert fixed comma from 2'complement form, < 0
+			// 1. ignore comma
+			// 2. subtract 1
+			// 3. invert bits
+			// 4. multiply by -1
+			// 5. divide by amount of distinct values behind the comma
+			//    - here we calculate with 4 bits => 2 by power of 4
+
+			return (float)((((((valuestring[startchar] << 8) +
+				valuestring[startchar + 1]) >> 4) - 1) ^ 0xFFF) * -1) / pow(2, 4);
+		}
+		else
+		{
+			// convert fixed comma from 2'complement form, >= 0
+			// 1. ignore comma
+			// 2. divide by amount of distinct values behind the comma
+			//    - here we calculate with 4 bits => 2 by power of 4
+
+			return (float)(((valuestring[startchar] << 8) + valuestring[startchar + 1]) >> 4) / pow(2, 4);
+		}
+	}
+	else if (conversion_method == 2)
+	{
+		if ((valuestring[startchar] & 0x80) != 0)
+		{
+			// convert two's complement, < 0
+			// 1. convert two bytes to integer
+			// 2. subtract 1 from integer
+			// 3. invert bits
+			// 4. make negative
+			// 5. after conversion, divide by 100
+			return (float)(((((valuestring[startchar] << 8) + valuestring[startchar + 1])
+				- 1) ^ 0xFFFF) * -1) / 100.0;
+		}
+		else
+		{
+			// convert two's complement, >= 0
+			// 1. convert to bytes to integer
+			// 2. after conversion, divide by 100
+			return (float)((valuestring[startchar] << 8) + valuestring[startchar + 1]) / 100.0;
+		}
+	}
+
+	return -999.0;
+}
+
+/*
+ * test_calc
+ *
+ * checks the decoding of sample answers and of every raw value
+ * against the original formulas, returns the amount of mismatches
+ */
+
+int test_calc()
+{
+	unsigned char answer[4096];
+	float tmp;
+	int conversion_method;
+	int raw;
+	int mismatches = 0;
+
+	conversion_method = 1;
+
+	memmove(answer, (unsigned char[8]){ 0x80, 0x04, 0x00, 0x00, 0xff, 0xff, 0x00, 0x00 }, 8);
+	tmp = temper_decode(conversion_method, answer, 4);
+	debug_print("temp: %.4f / expected: error (-999.00)\n", tmp);
+
+	memmove(answer, (unsigned char[8]){ 0x80, 0x04, 0xff, 0xff, 0x00, 0x00, 0x00, 0x00 }, 8);
+	tmp = temper_decode(conversion_method, answer, 2);
+	debug_print("temp: %.4f / expected: error (-999.00)\n", tmp);
+
+	memmove(answer, (unsigned char[8]){ 0x80, 0x04, 0x1a, 0x1a, 0x1a, 0x10, 0x00, 0x00 }, 8);
+	tmp = temper_decode(conversion_method, answer, 4);
+	debug_print("temp: %.4f / expected: 20.0625\n", tmp);
+
+	memmove(answer, (unsigned char[8]){ 0x80, 0x04, 0x14, 0x14, 0x14, 0xd0, 0x00, 0x00 }, 8);
+	tmp = temper_decode(conversion_method, answer, 4);
+	debug_print("temp: %.4f / expected: 20.8125\n", tmp);
+
+	memmove(answer, (unsigned char[8]){ 0x80, 0x04, 0x01, 0x01, 0x01, 0x60, 0x00, 0x00 }, 8);
+	tmp = temper_decode(conversion_method, answer, 4);
+	debug_print("temp: %.4f / expected: 1.3750\n", tmp);
+
+	memmove(answer, (unsigned char[8]){ 0x80, 0x04, 0x00, 0x00, 0x00, 0x60, 0x00, 0x00 }, 8);
+	tmp = temper_decode(conversion_method, answer, 4);
+	debug_print("temp: %.4f / expected: 0.3750\n", tmp);
+
+	memmove(answer, (unsigned char[8]){ 0x80, 0x04, 0x00, 0x00, 0x00, 0x10, 0x00, 0x00 }, 8);
+	tmp = temper_decode(conversion_method, answer, 4);
+	debug_print("temp: %.4f / expected: 0.0625\n", tmp);
+
+	memmove(answer, (unsigned char[8]){ 0x80, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, 8);
+	tmp = temper_decode(conversion_method, answer, 4);
+	debug_print("temp: %.4f / expected: 0.0000\n", tmp);
+
+	memmove(answer, (unsigned char[8]){ 0x80, 0x04, 0x00, 0x00, 0xff, 0xf0, 0x00, 0x00 }, 8);
+	tmp = temper_decode(conversion_method, answer, 4);
+	debug_print("temp: %.4f / expected: -0.0625\n", tmp);
+
+	memmove(answer, (unsigned char[8]){ 0x80, 0x04, 0xff, 0xff, 0xff, 0x40, 0x00, 0x00 }, 8);
+	tmp = temper_decode(conversion_method, answer, 4);
+	debug_print("temp: %.4f / expected: -0.7500\n", tmp);
+
+	memmove(answer, (unsigned char[8]){ 0x80, 0x04, 0xff, 0xff, 0xff, 0x00, 0x00, 0x00 }, 8);
+	tmp = temper_decode(conversion_method, answer, 4);
+	debug_print("temp: %.4f / expected: -1.0000\n", tmp);
+
+	memmove(answer, (unsigned char[8]){ 0x80, 0x04, 0xfe, 0xfe, 0xfe, 0xf0, 0x00, 0x00 }, 8);
+	tmp = temper_decode(conversion_method, answer, 4);
+	debug_print("temp: %.4f / expected: -1.0625\n", tmp);
+
+	memmove(answer, (unsigned char[8]){ 0x80, 0x04, 0xfe, 0xfe, 0xfe, 0x00, 0x00, 0x00 }, 8);
+	tmp = temper_decode(conversion_method, answer, 4);
+	debug_print("temp: %.4f / expected: -2.0000\n", tmp);
+
+	memmove(answer, (unsigned char[8]){ 0x80, 0x04, 0xfd, 0xfd, 0xfd, 0xf0, 0x00, 0x00 }, 8);
+	tmp = temper_decode(conversion_method, answer, 4);
+	debug_print("temp: %.4f / expected: -2.0625\n", tmp);
+
+	memmove(answer, (unsigned char[8]){ 0x80, 0x04, 0xfe, 0xfe, 0x01, 0x00, 0x00, 0x00 }, 8);
+	tmp = temper_decode(conversion_method, answer, 4);
+	debug_print("temp: %.4f / expected: 1.0000\n", tmp);
+
+	memmove(answer, (unsigned char[8]){ 0x80, 0x04, 0xfe, 0xfe, 0x00, 0x00, 0x00, 0x00 }, 8);
+	tmp = temper_decode(conversion_method, answer, 4);
+	debug_print("temp: %.4f / expected: 0.0000\n", tmp);
+
+	memmove(answer, (unsigned char[8]){ 0x80, 0x04, 0x00, 0x00, 0xff, 0xf0, 0x00, 0x00 }, 8);
+	tmp = temper_decode(conversion_method, answer, 4);
+	debug_print("temp: %.4f / expected: -0.0625\n", tmp);
+
+	memmove(answer, (unsigned char[8]){ 0x80, 0x04, 0xfe, 0xfe, 0xFF, 0x00, 0x00, 0x00 }, 8);
+	tmp = temper_decode(conversion_method, answer, 4);
+	debug_print("temp: %.4f / expected: -1.0000\n", tmp);
+
+	memmove(answer, (unsigned char[8]){ 0x80, 0x04, 0xfe, 0xfe, 0xFE, 0x00, 0x00, 0x00 }, 8);
+	tmp = temper_decode(conversion_method, answer, 4);
+	debug_print("temp: %.4f / expected: -2.0000\n", tmp);
+
+	memmove(answer, (unsigned char[8]){ 0x80, 0x04, 0xfe, 0xfe, 0xFD, 0x00, 0x00, 0x00 }, 8);
+	tmp = temper_decode(conversion_method, answer, 4);
+	debug_print("temp: %.4f / expected: -3.0000\n", tmp);
+
+	memmove(answer, (unsigned char[8]){ 0x80, 0x04, 0xee, 0xee, 0xee, 0x40, 0x00, 0x00 }, 8);
+	tmp = fahrenheit(temper_decode(conversion_method, answer, 4));
+	debug_print("temp: %.4f / expected: 0.0500\n", tmp);
+
+	memmove(answer, (unsigned char[8]){ 0x80, 0x04, 0xee, 0xee, 0xee, 0x30, 0x00, 0x00 }, 8);
+	tmp = fahrenheit(temper_decode(conversion_method, answer, 4));
+	debug_print("temp: %.4f / expected: -0.0625\n", tmp);
+
+	memmove(answer, (unsigned char[8]){ 0x80, 0x04, 0xfe, 0xfe, 0x00, 0x00, 0x00, 0x00 }, 8);
+	tmp = fahrenheit(temper_decode(conversion_method, answer, 4));
+	debug_print("temp: %.4f / expected: 32.0000\n", tmp);
+
+	memmove(answer, (unsigned char[8]){ 0x80, 0x04, 0x23, 0x23, 0x23, 0x90, 0x00, 0x00 }, 8);
+	tmp = fahrenheit(temper_decode(conversion_method, answer, 4));
+	debug_print("temp: %.4f / expected: 96.0125\n", tmp);
+
+	conversion_method = 2;
+
+	memmove(answer, (unsigned char[8]){ 0x80, 0x04, 0x09, 0x66, 0x00, 0x00, 0x00, 0x00 }, 8);
+	tmp = temper_decode(conversion_method, answer, 2);
+	debug_print("temp: %.4f / expected: 24.0600\n", tmp);
+
+	memmove(answer, (unsigned char[8]){ 0x80, 0x04, 0xf6, 0x9a, 0x00, 0x00, 0x00, 0x00 }, 8);
+	tmp = temper_decode(conversion_method, answer, 2);
+	debug_print("temp: %.4f / expected: -24.0600\n", tmp);
+
+	memmove(answer, (unsigned char[8]){ 0x80, 0x04, 0x05, 0x90, 0x00, 0x00, 0x00, 0x00 }, 8);
+	tmp = temper_decode(conversion_method, answer, 2);
+	debug_print("temp: %.4f / expected: 14.2400\n", tmp);
+
+	memmove(answer, (unsigned char[8]){ 0x80, 0x04, 0xfa, 0x70, 0x00, 0x00, 0x00, 0x00 }, 8);
+	tmp = temper_decode(conversion_method, answer, 2);
+	debug_print("temp: %.4f / expected: -14.2400\n", tmp);
+
+	/* some values provided by Samuel Progin from TEMPer V1.4:
+	 * 80 02 19 30 65 72 46 31
+	 * 80 02 19 40 65 72 46 31
+	 * 80 02 19 50 65 72 46 31
+	 * 80 02 19 60 65 72 46 31
+	 * 80 02 1a 90 65 72 46 31
+	 * Temperature sensor seems to be starting at offset 2
+	 * probably the byte at offset 1 defines where the sensor values can be read?
+	 * probably some other bytes define what/how many sensors are present?
+	 * Compare to TEMPer V1.3:
+	 * 80 04 06 06 06 f0 00 00
+	 * Compare to TEMPerHUM (TEMPerX_V3.3)
+	 * 80 40 0a f9 14 63 00 00
+	 * 80 40 0b 5c 14 94 00 00
+	 * Offset 0: constant 80 - could mean one temperature sensor?
+	 * Offset 1: 04 at V1.3 - this is the offset where temperature sensor has it's values
+	 *           02 at V1.4 - this is the offset where temperature sensor has it's values
+	 *           40 at TEMPerHUM (TEMPerX_V3.3) - no idea what this could mean...
+	 * Offset 2: V1.3: has always the same value as offset 3 and 4
+	 *           V1.4: first byte of value
+	 * Offset 3: V1.3: has always the same value as offset 2 and 4
+	 *           V1.4: second byte of value
+	 * Offset 4: V1.3: first byte of value
+	 *           V1.4: constant 65
+	 * Offset 5: V1.3: second byte of value
+	 *           V1.4: constant 72
+	 * Offset 6: V1.3: constant 00
+	 *           V1.4: constant 46
+	 * Offset 7: V1.3: constant 00
+	 *           V1.4: constant 31
+	 */
+	conversion_method = 1;
+
+	memmove(answer, (unsigned char[8]){ 0x80, 0x02, 0x1a, 0x90, 0x65, 0x72, 0x46, 0x31 }, 8);
+	tmp = temper_decode(conversion_method, answer, 2);
+	debug_print("temp: %.4f / expected: 26.5625\n", tmp);
+
+	/*
+	 * the values above are samples, now compare the tables of
+	 * libtempersensor against the original formulas for every raw
+	 * value, and the formulas gentables uses against them too
+	 */
+	for (conversion_method = 1; conversion_method <= 2; conversion_method++)
+	{
+		for (raw = 0; raw <= 0xFFFF; raw++)
+		{
+			answer[0] = raw >> 8;
+			answer[1] = raw & 0xFF;
+			tmp = temper_decode(conversion_method, answer, 0);
+			if ((tmp != calc_value(conversion_method, answer, 0)) ||
+				(decode_reference(conversion_method, raw) != calc_value(conversion_method, answer, 0)))
+			{
+				debug_print("method %i, raw 0x%04x: %.4f, generator %.4f / expected: %.4f\n",
+					conversion_method, raw, tmp, decode_reference(conversion_method, raw),
+					calc_value(conversion_method, answer, 0));
+				mismatches++;
+			}
+		}
+		debug_print("method %i: %i raw values compared\n", conversion_method, raw);
+	}
+
+	return mismatches;
+}
+
+/*
+ * self tests
+ *
+ * each returns the amount of its failures
+ */
+const static struct
+{
+	const char *name;
+	int (*run)();
+} tests[] =
+{
+	{ "calc", test_calc },
+	{ "sketch", test_sketch },
+	{ "oversample", test_oversample },
+	{ "derive", test_derive },
+	{ "alert", test_alert },
+	{ "deadband", test_deadband },
+	{ "cache", test_cache },
+	{ "hotplug", test_hotplug },
+	{ "low_power", test_low_power },
+	{ "standby", test_standby },
+	{ "recover", test_recover },
+	{ "realtime", test_realtime },
+	{ "push", test_push },
+	{ "mqtt", test_mqtt },
+	{ "stream", test_stream },
+#ifdef TEMPER_ALLOC_TEST
+	{ "steady_state", test_steady_state },
+#endif
+	{ "snmp", test_snmp },
+	{ "collectd", test_collectd },
+};
+
+/*
+ * run_tests
+ *
+ * runs all self tests and exits with EXIT_FAILURE if any failed
+ */
+
+void run_tests()
+{
+	int amount = sizeof(tests) / sizeof(tests[0]);
+	int failed = 0;
+	int failures;
+	int cnt;
+
+	// there will only be an output in debug mode
+	config.debug = 1;
+	for (cnt = 0; cnt < amount; cnt++)
+	{
+		failures = tests[cnt].run();
+		if (failures > 0)
+		{
+			fprintf(stderr, "test %s: %i failures\n", tests[cnt].name, failures);
+			failed++;
+		}
+	}
+	if (failed > 0)
+	{
+		fprintf(stderr, "%i of %i tests failed\n", failed, amount);
+		exit(EXIT_FAILURE);
+	}
+
+	exit(EXIT_SUCCESS);
+}
+#endif
+
+/*
+ * select_device
+ *
+ * looks for supported devices and picks the one to use
+ */
+
+int select_device(struct temper_devinfo *device)
+{
+	struct temper_devinfo devlist[MAX_DEVICES];
+	int amount = 0;
+	int r;
+	int cnt = 0;
+
+	debug_print("Scanning for hidraw devices\n");
+	r = temper_discover(devlist, MAX_DEVICES, &amount);
+	if (r != TEMPER_OK)
+	{
+		print_error(temper_strerror(r));
+		return 0;
+	}
+	if (amount > MAX_DEVICES)
+	{
+		amount = MAX_DEVICES;
+	}
+
+	device->vendor_id = 0;
+	debug_print("looking for supported devices\n");
+	while (cnt < amount)
+	{
+		debug_print("VendorId: %04x / ", devlist[cnt].vendor_id);
+		debug_print("ProductId: %04x / ", devlist[cnt].product_id);
+		debug_print("Device: '%s'\n", devlist[cnt].devpath);
+		if ((config.standby != NULL) && !strcmp(devlist[cnt].devpath, config.standby))
+		{
+			debug_print("keeping %s as standby\n", devlist[cnt].devpath);
+		}
+		else if (device->vendor_id == 0)
+		{
+			*device = devlist[cnt];
+			debug_print("storing %s as devpath\n", device->devpath);
+		}
+		else if (device->vendor_id == devlist[cnt].vendor_id)
+		{
+			if (strcmp(device->devpath, devlist[cnt].devpath) < 0)
+			{
+				debug_print("Switching devpath from %s to %s\n",
+					device->devpath, devlist[cnt].devpath);
+				*device = devlist[cnt];
+			}
+			else
+			{
+				debug_print("Not switching devpath from %s to %s\n",
+					device->devpath, devlist[cnt].devpath);
+			}
+		}
+		else
+		{
+			debug_print("Found two supported devices, sticking to %04x:%04x and ignoring %04x:%04x\n",
+				device->vendor_id, device->product_id, devlist[cnt].vendor_id, devlist[cnt].product_id);
+		}
+		cnt++;
+	}
+
+	return 1;
+}
+
+/*
+ * select_standby
+ *
+ * looks up the device given by --standby, simulated devices
+ * are only named
+ */
+
+int select_standby(struct temper_devinfo *device)
+{
+	struct temper_devinfo devlist[MAX_DEVICES];
+	int amount = 0;
+	int r;
+	int cnt;
+
+	memset(device, 0, sizeof(*device));
+	if (config.simulate > 0)
+	{
+		if (strncmp(config.standby, "sim", 3) || !isdigit(config.standby[3]))
+		{
+			print_error("Standby has to be a simulated device");
+			return 0;
+		}
+		(void)snprintf(device->devpath, sizeof(device->devpath), "%s", config.standby);
+		return 1;
+	}
+	r = temper_discover(devlist, MAX_DEVICES, &amount);
+	if (r != TEMPER_OK)
+	{
+		print_error(temper_strerror(r));
+		return 0;
+	}
+	for (cnt = 0; (cnt < amount) && (cnt < MAX_DEVICES); cnt++)
+	{
+		if (!strcmp(devlist[cnt].devpath, config.standby))
+		{
+			*device = devlist[cnt];
+			return 1;
+		}
+	}
+	print_error("Standby device not found");
+
+	return 0;
+}
+
+/*
+ * open_simulated
+ *
+ * opens a simulated device, the presets are used in turn so
+ * all conversion methods and layouts are exercised
+ */
+
+int open_simulated(struct temper_ctx *ctx, int index, int latency_us)
+{
+#ifdef TEMPER_SINGLE_PROFILE
+	return TEMPER_ERR_UNSUPPORTED;
+#else
+	const char *presets[] = { "TEMPerX_V3.3", "TEMPer1F_V1.3", "TEMPerF1.4", "TEMPerX_V3.1" };
+	struct temper_sim sim;
+
+	(void)temper_sim_defaults(&sim, presets[index % 4]);
+	if (latency_us >= 0)
+	{
+		sim.latency_us = latency_us;
+	}
+	if (index == 0)
+	{
+		sim.answers = config.simulate_hang;
+	}
+	return temper_open_sim(ctx, &sim);
+#endif
+}
+
+/*
+ * open_sensors
+ *
+ * opens and identifies all supported devices for continuous
+ * mode, devices failing are reported and skipped
+ */
+
+int open_sensors()
+{
+	struct temper_devinfo devlist[MAX_DEVICES];
+	struct temper_ctx *ctx;
+	int amount = 0;
+	int cnt;
+	int r;
+
+	if (config.simulate > 0)
+	{
+		amount = config.simulate;
+	}
+	else
+	{
+		r = temper_discover(devlist, MAX_DEVICES, &amount);
+		if ((r == TEMPER_ERR_NODEVICE) && config.hotplug)
+		{
+			amount = 0;
+		}
+		else if (r != TEMPER_OK)
+		{
+			fprintf(stderr, "%s\n", temper_strerror(r));
+			return 0;
+		}
+		if (amount > MAX_DEVICES)
+		{
+			amount = MAX_DEVICES;
+		}
+	}
+
+	// room for the devices plugged in later
+	sensors = (struct sensor *) calloc(amount + (config.hotplug ? TEMPER_HOTPLUG_DEVICES : 0) + 1,
+		sizeof(struct sensor));
+	if (sensors == NULL)
+	{
+		fprintf(stderr, "%s\n", temper_strerror(TEMPER_ERR_NOMEM));
+		return 0;
+	}
+	amount_sensors = 0;
+	for (cnt = 0; cnt < amount; cnt++)
+	{
+		ctx = temper_new();
+		if (ctx == NULL)
+		{
+			fprintf(stderr, "%s\n", temper_strerror(TEMPER_ERR_NOMEM));
+			break;
+		}
+		temper_set_debug(ctx, config.debug);
+		temper_set_conversion_method(ctx, config.conversion_method);
+		if (config.simulate > 0)
+		{
+			(void)snprintf(sensors[amount_sensors].name,
+				sizeof(sensors[amount_sensors].name), "sim%i", cnt);
+			r = open_simulated(ctx, cnt, -1);
+		}
+		else
+		{
+			strcpy(sensors[amount_sensors].name, devlist[cnt].devpath);
+			r = temper_open(ctx, &devlist[cnt]);
+		}
+		if (r == TEMPER_OK)
+		{
+			r = temper_identify(ctx);
+		}
+		if (r != TEMPER_OK)
+		{
+			fprintf(stderr, "%s: %s\n", sensors[amount_sensors].name,
+				(temper_errmsg(ctx)[0] != 0) ? temper_errmsg(ctx) : temper_strerror(r));
+			temper_free(ctx);
+			continue;
+		}
+		sensors[amount_sensors].ctx = ctx;
+		amount_sensors++;
+	}
+
+	return (amount_sensors > 0) || config.hotplug;
+}
+
+void close_sensors()
+{
+	int cnt;
+
+	for (cnt = 0; cnt < amount_sensors; cnt++)
+	{
+		temper_free(sensors[cnt].ctx);
+		free(sensors[cnt].quantiles);
+	}
+	free(sensors);
+	sensors = NULL;
+	amount_sensors = 0;
+}
+
+/*
+ * display_value
+ *
+ * converts a valid value of a channel to the configured unit
+ */
+
+float display_value(int channel, float value)
+{
+	if (config.fahrenheit &&
+		((channel == TEMPER_INT_TEMP) || (channel == TEMPER_EXT_TEMP) ||
+		(channel == TEMPER_INT_DEWPOINT) || (channel == TEMPER_EXT_DEWPOINT) ||
+		(channel == TEMPER_INT_HEATINDEX) || (channel == TEMPER_EXT_HEATINDEX)))
+	{
+		return fahrenheit(value);
+	}
+	return value;
+}
+
+/*
+ * format_value
+ *
+ * formats the value of a channel with the configured
+ * precision and unit
+ */
+
+void format_value(char *buf, size_t size, int channel, float value)
+{
+	if (value <= TEMPER_INVALID)
+	{
+		(void)snprintf(buf, size, "%s", INVALID_VALUE);
+		return;
+	}
+	(void)snprintf(buf, size, "%.*f", config.precision, display_value(channel, value));
+}
+
+/*
+ * format_sample
+ *
+ * formats a sample as one line: timestamp, device and the
+ * values of all channels, the format of the history file
+ */
+
+void format_sample(char *line, size_t size, const struct temper_sample *sample)
+{
+	char value[30];
+	int channel;
+	size_t len;
+
+	len = snprintf(line, size, "%llu.%03llu %s",
+		(unsigned long long)(sample->timestamp_us / 1000000),
+		(unsigned long long)((sample->timestamp_us / 1000) % 1000),
+		sensors[sample->device].name);
+	for (channel = 0; (channel < TEMPER_CHANNELS) && (len < size); channel++)
+	{
+		format_value(value, sizeof(value), channel, sample->values[channel]);
+		len += snprintf(line + len, size - len, " %s", value);
+	}
+	if (config.snapshot && (len < size))
+	{
+		len += snprintf(line + len, size - len, " %u", sample->spread_us);
+	}
+	if ((config.standby != NULL) && (len < size))
+	{
+		// where the values are from, the standby if it took over
+		len += snprintf(line + len, size - len, " %s", sensors[sample->source].name);
+	}
+	if (len < size)
+	{
+		(void)snprintf(line + len, size - len, "\n");
+	}
+}
+
+/*
+ * check_alerts
+ *
+ * evaluates the alert rules of the device of sample and sends
+ * an event line for every condition raised or cleared
+ */
+
+void check_alerts(const struct temper_sample *sample)
+{
+	struct sensor *sensor = &sensors[sample->device];
+	const struct temper_alert_rule *rule;
+	char line[512];
+	char value[30];
+	int changed;
+	int condition;
+	int cnt;
+
+	for (cnt = 0; cnt < config.amount_alerts; cnt++)
+	{
+		if (!(sensor->alert_rules & (1 << cnt)))
+		{
+			continue;
+		}
+		rule = &config.alerts[cnt];
+		changed = temper_alert_update(rule, &sensor->alerts[cnt],
+			sample->timestamp_us, sample->values[rule->channel]);
+		for (condition = 1; changed != 0; condition <<= 1)
+		{
+			if (!(changed & condition))
+			{
+				continue;
+			}
+			changed &= ~condition;
+			format_value(value, sizeof(value), rule->channel, sample->values[rule->channel]);
+			(void)snprintf(line, sizeof(line), "%llu.%03llu %s %s %s %s %s\n",
+				(unsigned long long)(sample->timestamp_us / 1000000),
+				(unsigned long long)((sample->timestamp_us / 1000) % 1000),
+				sensor->name, channel_names[rule->channel],
+				temper_alert_name(condition),
+				(sensor->alerts[cnt].active & condition) ? "raised" : "cleared",
+				value);
+			if (config.alert_output == NULL)
+				fputs(line, stderr);
+			else
+				temper_alert_emit(&alert_sink, line);
+		}
+	}
+}
+
+/*
+ * match_alert_rules
+ *
+ * selects the alert rules applying to sensor
+ */
+
+void match_alert_rules(struct sensor *sensor)
+{
+	const char *node;
+	int rule;
+
+	// devices can be given as /dev/hidraw0 or hidraw0
+	node = strrchr(sensor->name, '/');
+	node = (node != NULL) ? node + 1 : sensor->name;
+	for (rule = 0; rule < config.amount_alerts; rule++)
+	{
+		if ((config.alert_devices[rule] == NULL) ||
+			!strcmp(config.alert_devices[rule], sensor->name) ||
+			!strcmp(config.alert_devices[rule], node))
+		{
+			sensor->alert_rules |= 1 << rule;
+		}
+	}
+}
+
+#ifndef TEMPER_SINGLE_PROFILE
+/*
+ * alloc_quantiles
+ *
+ * prepares collecting the quantiles of all channels of sensor
+ */
+
+bool alloc_quantiles(struct sensor *sensor)
+{
+	int channel;
+
+	sensor->quantiles = (struct temper_windowed *)
+		malloc(TEMPER_CHANNELS * sizeof(struct temper_windowed));
+	if (sensor->quantiles == NULL)
+	{
+		return false;
+	}
+	for (channel = 0; channel < TEMPER_CHANNELS; channel++)
+	{
+		temper_windowed_init(&sensor->quantiles[channel]);
+	}
+	return true;
+}
+
+/*
+ * device_label
+ *
+ * the node of a device without /dev/ and with only letters, digits
+ * and dots, usable in collectd names and MQTT topics
+ */
+
+void device_label(const char *name, char *buf, size_t size)
+{
+	const char *node = strrchr(name, '/');
+	size_t cnt;
+
+	node = (node != NULL) ? node + 1 : name;
+	for (cnt = 0; (node[cnt] != '\0') && (cnt < size - 1); cnt++)
+	{
+		buf[cnt] = (isalnum((unsigned char) node[cnt]) || (node[cnt] == '.')) ? node[cnt] : '_';
+	}
+	buf[cnt] = '\0';
+}
+
+/*
+ * collectd_sample
+ *
+ * adds the PUTVAL lines of sample, named after the node of its device
+ */
+
+void collectd_sample(const struct temper_sample *sample)
+{
+	char instance[64];
+
+	device_label(sensors[sample->device].name, instance, sizeof(instance));
+	// collectd expects °C, whatever --fahrenheit says
+	temper_collectd_sample(&collectd, sample, instance, amount_sensors);
+}
+
+/*
+ * mqtt_sample
+ *
+ * publishes the valid channels of sample as TOPIC/DEVICE/CHANNEL,
+ * written together without waiting for the broker
+ */
+
+void mqtt_sample(const struct temper_sample *sample)
+{
+	char device[64];
+	char topic[TEMPER_MQTT_PACKET];
+	char value[32];
+	int channel;
+
+	device_label(sensors[sample->device].name, device, sizeof(device));
+	pthread_mutex_lock(&mqtt_lock);
+	for (channel = 0; channel < TEMPER_CHANNELS; channel++)
+	{
+		if (sample->values[channel] > TEMPER_INVALID)
+		{
+			(void)snprintf(topic, sizeof(topic), "%s/%s/%s",
+				config.mqtt_topic, device, channel_names[channel]);
+			format_value(value, sizeof(value), channel, sample->values[channel]);
+			(void)temper_mqtt_publish(&mqtt, topic, value, strlen(value));
+		}
+	}
+	temper_mqtt_flush(&mqtt);
+	pthread_mutex_unlock(&mqtt_lock);
+}
+#endif
+
+/*
+ * continuous_callback
+ *
+ * output and storage of samples, called from the aggregator thread
+ */
+
+void continuous_callback(const struct temper_sample *sample, void *userdata)
+{
+	struct continuous *c = (struct continuous *) userdata;
+	char line[512];
+#ifndef TEMPER_SINGLE_PROFILE
+	struct temper_windowed *quantiles = sensors[sample->device].quantiles;
+	uint64_t one = 1;
+	bool started;
+	int channel;
+#endif
+
+	if (sample->status == TEMPER_OK)
+	{
+		check_alerts(sample);
+	}
+#ifndef TEMPER_SINGLE_PROFILE
+	if (config.collectd)
+	{
+		collectd_sample(sample);
+	}
+	if (config.stream != NULL)
+	{
+		// subscribers have their own deadbands
+		pthread_mutex_lock(&stream_lock);
+		temper_stream_sample(&stream, sample);
+		pthread_mutex_unlock(&stream_lock);
+	}
+#endif
+	if (config.snmp_base != NULL)
+	{
+		pthread_mutex_lock(&latest_lock);
+		sensors[sample->device].latest = *sample;
+		sensors[sample->device].has_latest = true;
+		pthread_mutex_unlock(&latest_lock);
+	}
+	if (config.snapshot)
+	{
+		snapshot_samples++;
+		snapshot_spread_sum += sample->spread_us;
+		if (sample->spread_us > snapshot_spread_max)
+		{
+			snapshot_spread_max = sample->spread_us;
+		}
+	}
+#ifndef TEMPER_SINGLE_PROFILE
+	if ((quantiles != NULL) && (sample->status == TEMPER_OK))
+	{
+		pthread_mutex_lock(&quantiles_lock);
+		for (channel = 0; channel < TEMPER_CHANNELS; channel++)
+		{
+			if (sample->values[channel] > TEMPER_INVALID)
+			{
+				temper_windowed_add(&quantiles[channel],
+					sample->timestamp_us, sample->values[channel]);
+			}
+		}
+		pthread_mutex_unlock(&quantiles_lock);
+	}
+#endif
+	if (!config.use_deadband || temper_deadband_pass(&config.deadband,
+		&sensors[sample->device].deadband, sample->timestamp_us, sample->values))
+	{
+		format_sample(line, sizeof(line), sample);
+		if ((config.snmp_base == NULL) && !config.collectd)
+		{
+			// stdout belongs to snmpd or collectd otherwise
+			fputs(line, stdout);
+			fflush(stdout);
+		}
+#ifndef TEMPER_SINGLE_PROFILE
+		if (config.push != NULL)
+		{
+			pthread_mutex_lock(&push_lock);
+			(void)temper_push_add(&push, sample->device, sample->timestamp_us,
+				sample->status, sample->values);
+			started = (push.count == 1);
+			pthread_mutex_unlock(&push_lock);
+			if (started)
+			{
+				// a new batch, the main thread sleeps until something is due
+				(void)write(main_wakefd, &one, sizeof(one));
+			}
+		}
+		if ((config.mqtt != NULL) && (sample->status == TEMPER_OK))
+		{
+			mqtt_sample(sample);
+		}
+#endif
+		if (c->history != NULL)
+		{
+			fputs(line, c->history);
+			fflush(c->history);
+		}
+	}
+	if (config.count > 0)
+	{
+		c->counts[sample->device]++;
+		if (c->counts[sample->device] == config.count)
+		{
+			c->complete++;
+			if (c->complete == amount_sensors)
+			{
+				/* the main thread waits for this signal */
+				kill(getpid(), SIGTERM);
+			}
+		}
+	}
+}
+
+/*
+ * continuous_hotplug
+ *
+ * takes a device plugged in or retires one removed, called from
+ * the aggregator thread before the first sample of a new device
+ */
+
+void continuous_hotplug(int device, const struct temper_devinfo *info, int action, void *userdata)
+{
+	struct continuous *c = (struct continuous *) userdata;
+	struct sensor *sensor = &sensors[device];
+
+	if (action == TEMPER_HOTPLUG_REMOVE)
+	{
+		fprintf(stderr, "%s: removed\n", sensor->name);
+		if ((config.count > 0) && (c->counts[device] < config.count))
+		{
+			// a device gone does not keep the others running
+			c->counts[device] = config.count;
+			c->complete++;
+			if (c->complete == amount_sensors)
+			{
+				kill(getpid(), SIGTERM);
+			}
+		}
+		return;
+	}
+	if (device < amount_sensors)
+	{
+		// the slot of a device removed before, the new one starts afresh
+		if ((config.count > 0) && (c->counts[device] >= config.count))
+		{
+			c->complete--;
+		}
+		c->counts[device] = 0;
+		memset(sensor->alerts, 0, sizeof(sensor->alerts));
+		sensor->alert_rules = 0;
+		memset(&sensor->deadband, 0, sizeof(sensor->deadband));
+		pthread_mutex_lock(&latest_lock);
+		sensor->has_latest = false;
+		pthread_mutex_unlock(&latest_lock);
+	}
+	(void)snprintf(sensor->name, sizeof(sensor->name), "%s", info->devpath);
+	match_alert_rules(sensor);
+	// print_quantiles runs in the main thread
+	pthread_mutex_lock(&quantiles_lock);
+#ifndef TEMPER_SINGLE_PROFILE
+	free(sensor->quantiles);
+	sensor->quantiles = NULL;
+	if (config.quantiles && !alloc_quantiles(sensor))
+	{
+		fprintf(stderr, "%s: no quantiles, %s\n", sensor->name, temper_strerror(TEMPER_ERR_NOMEM));
+	}
+#endif
+	if (device >= amount_sensors)
+	{
+		amount_sensors = device + 1;
+	}
+	pthread_mutex_unlock(&quantiles_lock);
+#ifndef TEMPER_SINGLE_PROFILE
+	if (config.stream != NULL)
+	{
+		pthread_mutex_lock(&stream_lock);
+		temper_stream_name(&stream, device, sensor->name);
+		pthread_mutex_unlock(&stream_lock);
+	}
+#endif
+	fprintf(stderr, "%s: plugged in\n", sensor->name);
+}
+
+/*
+ * print_jitter
+ *
+ * prints the histogram of the delays of all queries after their
+ * scheduled time, the buckets without queries left out
+ */
+
+void print_jitter(const unsigned long *jitter)
+{
+	int bucket;
+
+	for (bucket = 0; bucket < TEMPER_JITTER_BUCKETS; bucket++)
+	{
+		if (jitter[bucket] == 0)
+		{
+			continue;
+		}
+		if (bucket == TEMPER_JITTER_BUCKETS - 1)
+			fprintf(stderr, "jitter >= %llu us: %lu\n", 1ULL << (bucket - 1), jitter[bucket]);
+		else
+			fprintf(stderr, "jitter < %llu us: %lu\n", 1ULL << bucket, jitter[bucket]);
+	}
+}
+
+void print_stats(const struct temper_sampler *sampler)
+{
+	struct temper_sampler_stats stats;
+	struct rusage usage;
+	unsigned long jitter[TEMPER_JITTER_BUCKETS];
+	unsigned long queries;
+	uint64_t elapsed;
+	int bucket;
+	int cnt;
+
+	memset(jitter, 0, sizeof(jitter));
+
+	for (cnt = 0; cnt < amount_sensors; cnt++)
+	{
+		if (temper_sampler_stats(sampler, cnt, &stats) != TEMPER_OK)
+		{
+			continue;
+		}
+		fprintf(stderr, "%s: %lu samples, %lu errors, %lu dropped, %lu late, %lu syscalls, "
+			"%lu readings, %lu rejected\n",
+			sensors[cnt].name, stats.samples, stats.errors,
+			stats.dropped, stats.late, stats.syscalls,
+			stats.readings, stats.rejected);
+		for (bucket = 0, queries = 0; bucket < TEMPER_JITTER_BUCKETS; bucket++)
+		{
+			jitter[bucket] += stats.jitter[bucket];
+			queries += stats.jitter[bucket];
+		}
+		if (queries > 0)
+		{
+			fprintf(stderr, "%s: jitter mean %llu us, max %lu us\n", sensors[cnt].name,
+				(unsigned long long)(stats.jitter_us_total / queries), stats.jitter_us_max);
+		}
+		if (config.min_interval > 0)
+		{
+			fprintf(stderr, "%s: interval %lu ms, %lu times faster, %lu times slower",
+				sensors[cnt].name, stats.interval_ms, stats.faster, stats.slower);
+			if (stats.last_change > 0)
+				fprintf(stderr, ", last faster: %s changed %.2f per minute\n",
+					channel_names[stats.last_channel], stats.last_rate);
+			else if (stats.last_change < 0)
+				fprintf(stderr, ", last slower: values flat\n");
+			else
+				fprintf(stderr, "\n");
+		}
+		if (stats.failovers > 0)
+		{
+			fprintf(stderr, "%s: %lu samples from the standby\n", sensors[cnt].name, stats.failovers);
+		}
+		if (config.recover_after > 0)
+		{
+			fprintf(stderr, "%s: %lu recoveries, %lu recovered", sensors[cnt].name,
+				stats.recoveries, stats.recovered);
+			if (stats.recovered > 0)
+				fprintf(stderr, ", time to recovery: last %lu ms, mean %lu ms\n",
+					stats.recovery_ms, stats.recovery_ms_total / stats.recovered);
+			else
+				fprintf(stderr, "\n");
+		}
+	}
+	print_jitter(jitter);
+	for (cnt = 0; config.use_deadband && (cnt < amount_sensors); cnt++)
+	{
+		fprintf(stderr, "%s: %lu samples written, %lu suppressed by deadband\n",
+			sensors[cnt].name, sensors[cnt].deadband.passed,
+			sensors[cnt].deadband.suppressed);
+	}
+	if (config.snapshot && (snapshot_samples > 0))
+	{
+		fprintf(stderr, "snapshot spread: mean %llu us, max %u us\n",
+			(unsigned long long)(snapshot_spread_sum / snapshot_samples),
+			snapshot_spread_max);
+	}
+	if (config.alert_output != NULL)
+	{
+		fprintf(stderr, "alerts: %lu events sent, %lu lost\n",
+			alert_sink.sent, alert_sink.failed);
+	}
+#ifndef TEMPER_SINGLE_PROFILE
+	if (config.push != NULL)
+	{
+		pthread_mutex_lock(&push_lock);
+		fprintf(stderr, "push: %lu samples in %lu datagrams sent, %lu datagrams lost\n",
+			push.samples, push.datagrams, push.failed);
+		pthread_mutex_unlock(&push_lock);
+	}
+	if (config.mqtt != NULL)
+	{
+		pthread_mutex_lock(&mqtt_lock);
+		fprintf(stderr, "mqtt: %lu published, %lu acknowledged, %lu dropped, %lu connections\n",
+			mqtt.published, mqtt.acked, mqtt.dropped, mqtt.connects);
+		pthread_mutex_unlock(&mqtt_lock);
+	}
+	if (config.stream != NULL)
+	{
+		pthread_mutex_lock(&stream_lock);
+		fprintf(stderr, "stream: %lu frames, %lu sent in %lu writes, %lu coalesced, %lu subscribers dropped\n",
+			stream.frames, stream.sent, stream.writes, stream.coalesced, stream.dropped);
+		pthread_mutex_unlock(&stream_lock);
+	}
+#endif
+	// every voluntary context switch of a thread ends with a wakeup
+	elapsed = temper_time_us(CLOCK_MONOTONIC) - start_us;
+	if ((getrusage(RUSAGE_SELF, &usage) == 0) && (elapsed > 0))
+	{
+		fprintf(stderr, "wakeups: %ld in %.1f s, %.1f per minute\n",
+			usage.ru_nvcsw - start_usage.ru_nvcsw, elapsed / 1e6,
+			(usage.ru_nvcsw - start_usage.ru_nvcsw) * 60e6 / elapsed);
+	}
+}
+
+#ifndef TEMPER_SINGLE_PROFILE
+/*
+ * print_quantile_line
+ *
+ * prints one line of print_quantiles if the sketch holds values
+ */
+
+void print_quantile_line(const char *name, int channel, int window, struct temper_sketch *sketch)
+{
+	const double q[] = { 0.5, 0.95, 0.99 };
+	char value[3][32];
+	int cnt;
+
+	if (sketch->count == 0)
+	{
+		return;
+	}
+	for (cnt = 0; cnt < 3; cnt++)
+	{
+		format_value(value[cnt], sizeof(value[cnt]), channel,
+			temper_sketch_quantile(sketch, q[cnt]));
+	}
+	fprintf(stderr, "%s %s %s: %llu samples, p50 %s, p95 %s, p99 %s\n",
+		name, channel_names[channel], temper_window_name(window),
+		(unsigned long long) sketch->count, value[0], value[1], value[2]);
+}
+
+/*
+ * print_quantiles
+ *
+ * prints p50/p95/p99 per device and channel and, merged over
+ * all devices, per channel
+ */
+
+void print_quantiles()
+{
+	struct temper_sketch sketch;
+	struct temper_sketch all;
+	uint64_t now = temper_time_us(CLOCK_REALTIME);
+	int channel;
+	int window;
+	int cnt;
+
+	pthread_mutex_lock(&quantiles_lock);
+	for (channel = 0; channel < TEMPER_CHANNELS; channel++)
+	{
+		for (window = 0; window < TEMPER_WINDOWS; window++)
+		{
+			temper_sketch_init(&all);
+			for (cnt = 0; cnt < amount_sensors; cnt++)
+			{
+				if (sensors[cnt].quantiles == NULL)
+				{
+					continue;
+				}
+				temper_sketch_init(&sketch);
+				temper_windowed_query(&sensors[cnt].quantiles[channel],
+					window, now, &sketch);
+				print_quantile_line(sensors[cnt].name, channel, window, &sketch);
+				temper_sketch_merge(&all, &sketch);
+			}
+			if (amount_sensors > 1)
+			{
+				print_quantile_line("all", channel, window, &all);
+			}
+		}
+	}
+	pthread_mutex_unlock(&quantiles_lock);
+}
+#endif
+
+/*
+ * block_signals
+ *
+ * blocks the signals the main thread waits for, called before
+ * any thread is created so all threads inherit the mask
+ */
+
+void block_signals(sigset_t *signals)
+{
+	sigemptyset(signals);
+	sigaddset(signals, SIGINT);
+	sigaddset(signals, SIGTERM);
+	sigaddset(signals, SIGHUP);
+	sigaddset(signals, SIGUSR1);
+	pthread_sigmask(SIG_BLOCK, signals, NULL);
+}
+
+#ifndef TEMPER_SINGLE_PROFILE
+/*
+ * node_id
+ *
+ * derives the ID of this node at the collector from the host name
+ * (FNV-1a), so nodes need no configuration
+ */
+
+uint32_t node_id()
+{
+	char name[256];
+	uint32_t hash = 2166136261u;
+	const char *c;
+
+	if (gethostname(name, sizeof(name)) != 0)
+	{
+		return 1;
+	}
+	name[sizeof(name) - 1] = '\0';
+	for (c = name; *c != '\0'; c++)
+	{
+		hash = (hash ^ (unsigned char) *c) * 16777619u;
+	}
+	return hash;
+}
+
+/*
+ * snmp_quantile
+ *
+ * formats a quantile column (50 or more) of sensor for snmp_object,
+ * returns false without values in its window
+ */
+
+bool snmp_quantile(int column, const struct sensor *sensor, char *answer, size_t size)
+{
+	const double q[] = { 0.5, 0.95, 0.99 };
+	struct temper_sketch sketch;
+	int group = (column - 50) / 10;
+	int channel = column % 10;
+	float hundredths;
+
+	temper_sketch_init(&sketch);
+	pthread_mutex_lock(&quantiles_lock);
+	if (sensor->quantiles != NULL)
+	{
+		(void)temper_windowed_query(&sensor->quantiles[channel], group / 3,
+			temper_time_us(CLOCK_REALTIME), &sketch);
+	}
+	pthread_mutex_unlock(&quantiles_lock);
+	if (sketch.count == 0)
+	{
+		return false;
+	}
+	hundredths = display_value(channel, temper_sketch_quantile(&sketch, q[group % 3])) * 100;
+	(void)snprintf(answer, size, "integer\n%li\n", (long)(hundredths + ((hundredths < 0) ? -0.5 : 0.5)));
+	return true;
+}
+
+/*
+ * snmp_object
+ *
+ * formats type and value of the object in column of row (devices
+ * counting from 1) for temper_snmp_input, returns false if it does
+ * not exist
+ */
+
+bool snmp_object(int column, int row, char *answer, size_t size, void *userdata)
+{
+	const struct sensor *sensor;
+	char value[30];
+	float hundredths;
+	int channel;
+
+	if ((row < 1) || (row > amount_sensors))
+	{
+		return false;
+	}
+	sensor = &sensors[row - 1];
+	if (column >= 50)
+	{
+		return snmp_quantile(column, sensor, answer, size);
+	}
+	channel = (column >= 30) ? column - 30 : column - 10;
+	pthread_mutex_lock(&latest_lock);
+	if (((column > 2) && !sensor->has_latest) ||
+		((column >= 10) && (sensor->latest.values[channel] <= TEMPER_INVALID)))
+	{
+		pthread_mutex_unlock(&latest_lock);
+		return false;
+	}
+	switch (column)
+	{
+		case 1:
+			(void)snprintf(answer, size, "integer\n%i\n", row);
+			break;
+		case 2:
+			(void)snprintf(answer, size, "string\n%s\n", sensor->name);
+			break;
+		case 3:
+			(void)snprintf(answer, size, "integer\n%i\n", sensor->latest.status);
+			break;
+		case 4:
+			// timeticks are hundredths of a second
+			(void)snprintf(answer, size, "timeticks\n%llu\n", (unsigned long long)
+				((temper_time_us(CLOCK_REALTIME) - sensor->latest.timestamp_us) / 10000));
+			break;
+		default:
+			if (column < 30)
+			{
+				// rounded without libm, single profile builds don't link it
+				hundredths = display_value(channel, sensor->latest.values[channel]) * 100;
+				(void)snprintf(answer, size, "integer\n%li\n",
+					(long)(hundredths + ((hundredths < 0) ? -0.5 : 0.5)));
+			}
+			else
+			{
+				format_value(value, sizeof(value), channel, sensor->latest.values[channel]);
+				(void)snprintf(answer, size, "string\n%s\n", value);
+			}
+			break;
+	}
+	pthread_mutex_unlock(&latest_lock);
+	return true;
+}
+#endif
+
+/*
+ * arm_tick
+ *
+ * lets tick_fd expire on the first tick at least timeout ms from now,
+ * disarms it if timeout is negative
+ */
+
+void arm_tick(int timeout)
+{
+	struct itimerspec its;
+	uint64_t due;
+
+	memset(&its, 0, sizeof(its));
+	if (timeout >= 0)
+	{
+		due = temper_tick_next(temper_time_us(CLOCK_MONOTONIC) + (uint64_t) timeout * 1000, config.tick);
+		its.it_value.tv_sec = due / 1000000;
+		its.it_value.tv_nsec = (due % 1000000) * 1000;
+	}
+	(void)timerfd_settime(tick_fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+/*
+ * wait_signal
+ *
+ * waits for one of the signals of sigfd (a signalfd), sending the batch
+ * of samples for the collector when it is due, keeping the connection
+ * to the MQTT broker, serving the stream subscribers and answering
+ * SNMP requests. With a tick, every timeout ends on a tick. Returns the
+ * signal, SIGTERM when snmpd closed stdin or -1 on errors.
+ */
+
+int wait_signal(int sigfd)
+{
+	struct signalfd_siginfo info;
+	struct pollfd fds[6];
+	uint64_t counter;
+	int timeout;
+#ifndef TEMPER_SINGLE_PROFILE
+	int due;
+#endif
+
+	// unused entries have a negative fd, poll skips them
+	fds[0].fd = sigfd;
+	fds[0].events = POLLIN;
+	fds[1].fd = (config.snmp_base != NULL) ? STDIN_FILENO : -1;
+	fds[1].events = POLLIN;
+	fds[2].fd = -1;
+	fds[3].fd = -1;
+	fds[4].fd = main_wakefd;
+	fds[4].events = POLLIN;
+	fds[5].fd = tick_fd;
+	fds[5].events = POLLIN;
+#ifndef TEMPER_SINGLE_PROFILE
+	if (config.stream != NULL)
+	{
+		temper_stream_poll(&stream, &fds[3]);
+	}
+#endif
+	for (;;)
 	{
-		char *path;
-		struct dirent *dp;
-		DIR *dir = opendir(base_path);
-
-		if (!dir)
-			return 1;
-
-		while ((dp = readdir(dir)) != NULL)
+		timeout = -1;
+#ifndef TEMPER_SINGLE_PROFILE
+		if (config.push != NULL)
+		{
+			// -1 if nothing is waiting, the sample starting a batch wakes us
+			pthread_mutex_lock(&push_lock);
+			timeout = temper_push_tick(&push);
+			pthread_mutex_unlock(&push_lock);
+		}
+		if (config.mqtt != NULL)
 		{
-			if ((strcmp(dp->d_name, ".") != 0 && strcmp(dp->d_name, "..") != 0)
-				&& (dp->d_type != DT_LNK))
+			pthread_mutex_lock(&mqtt_lock);
+			due = temper_mqtt_tick(&mqtt);
+			temper_mqtt_poll(&mqtt, &fds[2]);
+			pthread_mutex_unlock(&mqtt_lock);
+			if ((timeout < 0) || (due < timeout))
 			{
-				path = malloc(strlen(base_path) + strlen(dp->d_name) + 2);
-				strcpy(path, base_path);
-				strcat(path, "/");
-				strcat(path, dp->d_name);
-				if (!strcmp(dp->d_name, "hidraw"))
-				{
-					if (!add_hiddev(path))
-					{
-						closedir(dir);
-						free(path);
-						return 0;
-					}
-				}
-				else
-					find_hidraw(path);
-				free(path);
+				timeout = due;
+			}
+		}
+		if (config.stream != NULL)
+		{
+			pthread_mutex_lock(&stream_lock);
+			(void)temper_stream_tick(&stream);
+			pthread_mutex_unlock(&stream_lock);
+		}
+#endif
+		if (tick_fd >= 0)
+		{
+			arm_tick(timeout);
+			timeout = -1;
+		}
+		if (poll(fds, 6, timeout) < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
 			}
+			return -1;
+		}
+		if ((fds[4].fd >= 0) && (fds[4].revents & POLLIN))
+		{
+			(void)read(main_wakefd, &counter, sizeof(counter));
+		}
+		if ((fds[5].fd >= 0) && (fds[5].revents & POLLIN))
+		{
+			(void)read(tick_fd, &counter, sizeof(counter));
+		}
+		if ((fds[0].revents & POLLIN) &&
+			(read(sigfd, &info, sizeof(info)) == sizeof(info)))
+		{
+			return info.ssi_signo;
 		}
+#ifndef TEMPER_SINGLE_PROFILE
+		if ((fds[1].fd >= 0) && (fds[1].revents & (POLLIN | POLLHUP | POLLERR)) &&
+			!temper_snmp_input(&snmp, amount_sensors, STDIN_FILENO, STDOUT_FILENO))
+		{
+			// snmpd went away
+			return SIGTERM;
+		}
+#endif
+	}
+}
 
-		closedir(dir);
-		return 1;
+/*
+ * close_wakeups
+ *
+ * closes the descriptors waking the main thread
+ */
+
+void close_wakeups()
+{
+	if (main_wakefd >= 0)
+	{
+		close(main_wakefd);
+		main_wakefd = -1;
+	}
+	if (tick_fd >= 0)
+	{
+		close(tick_fd);
+		tick_fd = -1;
 	}
+}
 
-	device.hidraw_devpath = NULL;
-	devlist = NULL;
-	debug_print("Scanning for hidraw devices\n");
-	if (!find_hidraw("/sys/devices"))
+/*
+ * pair_standby
+ *
+ * makes the device given by --standby the standby of the device
+ * one-shot mode would select
+ */
+
+int pair_standby(struct temper_sampler *sampler)
+{
+	struct temper_devinfo info;
+	int primary = -1;
+	int standby = -1;
+	int cnt;
+
+	if (config.simulate > 0)
+	{
+		strcpy(info.devpath, "sim0");
+	}
+	else if (!select_device(&info))
+	{
+		return 0;
+	}
+	for (cnt = 0; cnt < amount_sensors; cnt++)
+	{
+		if (!strcmp(sensors[cnt].name, info.devpath))
+		{
+			primary = cnt;
+		}
+		else if (!strcmp(sensors[cnt].name, config.standby))
+		{
+			standby = cnt;
+		}
+	}
+	if ((primary < 0) || (standby < 0))
 	{
+		fprintf(stderr, "%s\n", (primary < 0) ? "No device for the standby" : "Standby device not found");
 		return 0;
 	}
+	if (temper_sampler_standby(sampler, primary, standby) != TEMPER_OK)
+	{
+		fprintf(stderr, "%s\n", temper_strerror(TEMPER_ERR_PARAM));
+		return 0;
+	}
+	debug_print("%s takes over for %s\n", sensors[standby].name, sensors[primary].name);
 
-	device.vendor_id = 0;
-	debug_print("looking for supported devices\n");
-	int cnt = 0;
-	while (cnt < amount)
+	return 1;
+}
+
+/*
+ * run_continuous
+ *
+ * samples all devices until stopped by a signal or until
+ * every device delivered config.count samples
+ */
+
+int run_continuous()
+{
+	struct temper_sampler_config cfg;
+	struct temper_sampler *sampler;
+	struct continuous c;
+	sigset_t signals;
+#ifndef TEMPER_SINGLE_PROFILE
+	char client_id[24];
+#endif
+	bool error = false;
+	int sigfd;
+	int sig;
+	int cnt;
+	int r;
+
+#ifndef TEMPER_SINGLE_PROFILE
+	if (config.snmp_base != NULL)
+	{
+		if (temper_snmp_init(&snmp, config.snmp_base, snmp_columns,
+			sizeof(snmp_columns) / sizeof(snmp_columns[0]), snmp_object, NULL) != TEMPER_OK)
+		{
+			fprintf(stderr, "Invalid OID '%s'\n", config.snmp_base);
+			return 0;
+		}
+	}
+#endif
+	block_signals(&signals);
+	sigfd = signalfd(-1, &signals, SFD_CLOEXEC);
+	if (sigfd < 0)
+	{
+		perror("signalfd");
+		return 0;
+	}
+	if (!open_sensors())
+	{
+		close(sigfd);
+		return 0;
+	}
+	memset(&c, 0, sizeof(c));
+	c.counts = (int *) calloc(amount_sensors + (config.hotplug ? TEMPER_HOTPLUG_DEVICES : 0) + 1,
+		sizeof(int));
+#ifndef TEMPER_SINGLE_PROFILE
+	for (cnt = 0; config.quantiles && (cnt < amount_sensors); cnt++)
+	{
+		if (!alloc_quantiles(&sensors[cnt]))
+		{
+			fprintf(stderr, "%s\n", temper_strerror(TEMPER_ERR_NOMEM));
+			free(c.counts);
+			close_sensors();
+			close(sigfd);
+			return 0;
+		}
+	}
+#endif
+	for (cnt = 0; cnt < amount_sensors; cnt++)
+	{
+		match_alert_rules(&sensors[cnt]);
+	}
+	if (config.alert_output != NULL)
+	{
+		if (temper_alert_sink_open(&alert_sink, config.alert_output) != TEMPER_OK)
+		{
+			fprintf(stderr, "Invalid alert output '%s'\n", config.alert_output);
+			free(c.counts);
+			close_sensors();
+			close(sigfd);
+			return 0;
+		}
+		// writing to a FIFO without reader must not end the program
+		signal(SIGPIPE, SIG_IGN);
+	}
+	if (config.history != NULL)
+	{
+		c.history = fopen(config.history, "a");
+		if (c.history == NULL)
+		{
+			perror(config.history);
+			free(c.counts);
+			close_sensors();
+			close(sigfd);
+			return 0;
+		}
+	}
+#ifndef TEMPER_SINGLE_PROFILE
+	if (config.push != NULL)
 	{
-		if (is_device_supported(devlist[cnt].idVendor, devlist[cnt].idProduct))
+		if (temper_push_open(&push, config.push,
+			(config.push_node > 0) ? config.push_node : node_id(),
+			config.push_batch, config.push_flush) != TEMPER_OK)
 		{
-			if (device.vendor_id == 0)
+			fprintf(stderr, "Invalid collector '%s'\n", config.push);
+			if (c.history != NULL)
 			{
-				device.vendor_id = devlist[cnt].idVendor;
-				device.product_id = devlist[cnt].idProduct;
-				device.hidraw_devpath = malloc(strlen(devlist[cnt].devname) + 1);
-				strcpy(device.hidraw_devpath, devlist[cnt].devname);
-				debug_print("storing %s as devpath\n", device.hidraw_devpath);
+				fclose(c.history);
 			}
-			else if (device.vendor_id == devlist[cnt].idVendor)
+			free(c.counts);
+			close_sensors();
+			close(sigfd);
+			return 0;
+		}
+	}
+	if (config.mqtt != NULL)
+	{
+		if (config.mqtt_client != NULL)
+		{
+			(void)snprintf(client_id, sizeof(client_id), "%s", config.mqtt_client);
+		}
+		else
+		{
+			(void)snprintf(client_id, sizeof(client_id), "tempersensor-%08x", node_id());
+		}
+		if (temper_mqtt_open(&mqtt, config.mqtt, client_id, config.mqtt_qos, MQTT_KEEPALIVE) != TEMPER_OK)
+		{
+			fprintf(stderr, "Invalid broker '%s' or client ID '%s'\n", config.mqtt, client_id);
+			config.mqtt = NULL;
+			error = true;
+		}
+		mqtt.retain = config.mqtt_retain;
+	}
+	if (!error && (config.stream != NULL))
+	{
+		if (temper_stream_open(&stream, config.stream) != TEMPER_OK)
+		{
+			perror(config.stream);
+			config.stream = NULL;
+			error = true;
+		}
+		for (cnt = 0; (cnt < amount_sensors) && !error; cnt++)
+		{
+			temper_stream_name(&stream, cnt, sensors[cnt].name);
+		}
+	}
+	if (!error && config.collectd &&
+		(temper_collectd_open(&collectd, getenv("COLLECTD_HOSTNAME"), config.interval,
+		amount_sensors + (config.hotplug ? TEMPER_HOTPLUG_DEVICES : 0) + 1, STDOUT_FILENO) != TEMPER_OK))
+	{
+		fprintf(stderr, "%s\n", temper_strerror(TEMPER_ERR_NOMEM));
+		config.collectd = false;
+		error = true;
+	}
+#endif
+	if (!error)
+	{
+		main_wakefd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+		if (config.tick > 0)
+		{
+			tick_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+		}
+		if ((main_wakefd < 0) || ((config.tick > 0) && (tick_fd < 0)))
+		{
+			perror("timers");
+			error = true;
+		}
+	}
+	if (error)
+	{
+		close_wakeups();
+#ifndef TEMPER_SINGLE_PROFILE
+		if (config.stream != NULL)
+		{
+			temper_stream_close(&stream);
+		}
+		if (config.mqtt != NULL)
+		{
+			temper_mqtt_close(&mqtt);
+		}
+		if (config.push != NULL)
+		{
+			temper_push_close(&push);
+		}
+#endif
+		if (c.history != NULL)
+		{
+			fclose(c.history);
+		}
+		free(c.counts);
+		close_sensors();
+		close(sigfd);
+		return 0;
+	}
+
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.workers = ((config.workers > 0) && (config.workers < amount_sensors)) ?
+		config.workers : amount_sensors;
+	if (cfg.workers == 0)
+	{
+		// hotplug without devices yet
+		cfg.workers = (config.workers > 0) ? config.workers : 1;
+	}
+	if (config.snapshot)
+	{
+		// one batched round over all devices
+		cfg.workers = 1;
+		if (config.backend == TEMPER_BACKEND_SEQUENTIAL)
+		{
+			config.backend = TEMPER_BACKEND_EPOLL;
+		}
+	}
+	if (config.standby != NULL)
+	{
+		// the device and its standby share a batched round
+		cfg.timeout_ms = FAILOVER_TIMEOUT_MS;
+		if (config.backend == TEMPER_BACKEND_SEQUENTIAL)
+		{
+			config.backend = TEMPER_BACKEND_EPOLL;
+		}
+	}
+	cfg.interval_ms = config.interval;
+	cfg.min_interval_ms = config.min_interval;
+	cfg.max_interval_ms = config.max_interval;
+	cfg.adapt_rate = config.adapt_rate;
+	cfg.recover_after = config.recover_after;
+	cfg.recover_timeout_ms = config.recover_timeout;
+	cfg.tick_ms = config.tick;
+	cfg.slack_ms = config.slack;
+	cfg.sched_policy = config.sched_policy;
+	cfg.sched_priority = config.sched_priority;
+	cfg.cpus = config.cpus;
+	cfg.backend = config.backend;
+	cfg.oversample = config.oversample;
+	cfg.budget_ms = config.budget;
+	cfg.reduce = config.reduce;
+	cfg.max_deviation = config.max_deviation;
+	cfg.hotplug = config.hotplug;
+	cfg.hotplug_callback = continuous_hotplug;
+	cfg.callback = continuous_callback;
+	cfg.userdata = &c;
+	sampler = temper_sampler_new(&cfg);
+	if (sampler == NULL)
+	{
+		fprintf(stderr, "%s\n", temper_strerror(TEMPER_ERR_NOMEM));
+		return 0;
+	}
+	for (cnt = 0; cnt < amount_sensors; cnt++)
+	{
+		temper_sampler_add(sampler, sensors[cnt].ctx, -1);
+	}
+	if ((config.standby != NULL) && !pair_standby(sampler))
+	{
+		temper_sampler_free(sampler);
+		return 0;
+	}
+	if (config.slack > 0)
+	{
+		(void)prctl(PR_SET_TIMERSLACK, (unsigned long) config.slack * 1000000UL, 0, 0, 0);
+	}
+#ifdef MCL_ONFAULT
+	// the stacks of the threads only as far as they are used
+	if (config.mlock && (mlockall(MCL_CURRENT | MCL_FUTURE | MCL_ONFAULT) < 0))
+#else
+	if (config.mlock && (mlockall(MCL_CURRENT | MCL_FUTURE) < 0))
+#endif
+	{
+		perror("mlockall");
+		temper_sampler_free(sampler);
+		return 0;
+	}
+	(void)getrusage(RUSAGE_SELF, &start_usage);
+	start_us = temper_time_us(CLOCK_MONOTONIC);
+	r = temper_sampler_start(sampler);
+	if (r != TEMPER_OK)
+	{
+		fprintf(stderr, config.hotplug ? "Error starting sampler threads or listening for uevents: %s\n" :
+			"Error starting sampler threads: %s\n", temper_strerror(r));
+		temper_sampler_free(sampler);
+		return 0;
+	}
+
+	while ((sig = wait_signal(sigfd)) >= 0)
+	{
+		if (sig == SIGUSR1)
+		{
+			print_stats(sampler);
+#ifndef TEMPER_SINGLE_PROFILE
+			if (config.quantiles)
 			{
-				if (strcmp(device.hidraw_devpath, devlist[cnt].devname) < 0)
-				{
-					debug_print("Switching devpath from %s to %s\n",
-						device.hidraw_devpath, devlist[cnt].devname);
-					device.hidraw_devpath = realloc(device.hidraw_devpath, strlen(devlist[cnt].devname) + 1);
-					memcpy(device.hidraw_devpath, devlist[cnt].devname, strlen(devlist[cnt].devname));
-				}
-				else
-				{
-					debug_print("Not switching devpath from %s to %s\n",
-						device.hidraw_devpath, devlist[cnt].devname);
-				}
+				print_quantiles();
 			}
-			else
+#endif
+			continue;
+		}
+		break;
+	}
+
+	temper_sampler_stop(sampler);
+#ifndef TEMPER_SINGLE_PROFILE
+	if (config.push != NULL)
+	{
+		temper_push_close(&push);
+	}
+	if (config.mqtt != NULL)
+	{
+		temper_mqtt_close(&mqtt);
+	}
+	if (config.stream != NULL)
+	{
+		temper_stream_close(&stream);
+	}
+	if (config.collectd)
+	{
+		temper_collectd_close(&collectd);
+	}
+#endif
+	close_wakeups();
+	if (config.stats)
+	{
+		print_stats(sampler);
+	}
+#ifndef TEMPER_SINGLE_PROFILE
+	if (config.quantiles)
+	{
+		print_quantiles();
+	}
+#endif
+	temper_sampler_free(sampler);
+	if (c.history != NULL)
+	{
+		fclose(c.history);
+	}
+	if (config.alert_output != NULL)
+	{
+		temper_alert_sink_close(&alert_sink);
+	}
+	free(c.counts);
+	close_sensors();
+	close(sigfd);
+
+	return 1;
+}
+
+#ifndef TEMPER_SINGLE_PROFILE
+struct benchmark
+{
+	uint64_t *delays; /* from scheduled time to delivery */
+	int used;
+	int size;
+};
+
+void benchmark_callback(const struct temper_sample *sample, void *userdata)
+{
+	struct benchmark *b = (struct benchmark *) userdata;
+
+	if (b->used < b->size)
+	{
+		b->delays[b->used++] = temper_time_us(CLOCK_MONOTONIC) - sample->due_us;
+	}
+}
+
+int compare_delays(const void *a, const void *b)
+{
+	uint64_t da = *(const uint64_t *) a;
+	uint64_t db = *(const uint64_t *) b;
+
+	return (da > db) - (da < db);
+}
+
+/*
+ * benchmark_run
+ *
+ * samples simulated devices with the given amount of workers,
+ * every 4th device sits behind a slow hub
+ */
+
+void benchmark_run(int devices, int workers, int interval)
+{
+	struct temper_sampler_config cfg;
+	struct temper_sampler *sampler;
+	struct temper_sampler_stats stats;
+	struct temper_worker_stats wstats;
+	struct temper_ctx *ctxs[devices];
+	struct benchmark b;
+	unsigned long late = 0;
+	unsigned long syscalls = 0;
+	unsigned long switches = 0;
+	int backend = config.backend;
+	int cnt;
+
+	b.size = devices * (BENCHMARK_SECONDS * 1000 / (interval > 0 ? interval : 1) + 2);
+	if (interval == 0)
+	{
+		b.size = devices * BENCHMARK_SECONDS * 1000;
+	}
+	b.used = 0;
+	b.delays = (uint64_t *) malloc(b.size * sizeof(uint64_t));
+
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.workers = workers;
+	cfg.interval_ms = interval;
+	cfg.backend = config.backend;
+	cfg.callback = benchmark_callback;
+	cfg.userdata = &b;
+	sampler = temper_sampler_new(&cfg);
+	if ((sampler == NULL) || (b.delays == NULL))
+	{
+		fprintf(stderr, "%s\n", temper_strerror(TEMPER_ERR_NOMEM));
+		exit(EXIT_FAILURE);
+	}
+	for (cnt = 0; cnt < devices; cnt++)
+	{
+		ctxs[cnt] = temper_new();
+		if ((open_simulated(ctxs[cnt], 3, (cnt % 4 == 3) ? 40000 : 4000) != TEMPER_OK) ||
+			(temper_identify(ctxs[cnt]) != TEMPER_OK))
+		{
+			fprintf(stderr, "Error opening simulated device\n");
+			exit(EXIT_FAILURE);
+		}
+		temper_sampler_add(sampler, ctxs[cnt], -1);
+	}
+
+	temper_sampler_start(sampler);
+	sleep(BENCHMARK_SECONDS);
+	temper_sampler_stop(sampler);
+
+	for (cnt = 0; cnt < devices; cnt++)
+	{
+		temper_sampler_stats(sampler, cnt, &stats);
+		late += stats.late;
+		syscalls += stats.syscalls;
+		temper_free(ctxs[cnt]);
+	}
+	for (cnt = 0; cnt < workers; cnt++)
+	{
+		temper_sampler_worker(sampler, cnt, &wstats);
+		switches += wstats.context_switches;
+		backend = wstats.backend;
+	}
+	temper_sampler_free(sampler);
+
+	qsort(b.delays, b.used, sizeof(uint64_t), compare_delays);
+	if (b.used > 0)
+	{
+		printf("%7i %11.1f %8.2f %8.2f %8.2f %6lu %10.2f %10.2f  %s\n", workers,
+			(double) b.used / BENCHMARK_SECONDS,
+			b.delays[(b.used - 1) * 50 / 100] / 1000.0,
+			b.delays[(b.used - 1) * 99 / 100] / 1000.0,
+			b.delays[b.used - 1] / 1000.0, late,
+			(double) syscalls / b.used, (double) switches / b.used,
+			temper_backend_name(backend));
+	}
+	free(b.delays);
+}
+
+struct stream_drain
+{
+	int epoll_fd; /* subscribers reading */
+	volatile bool stop;
+	unsigned long bytes;
+};
+
+/*
+ * stream_drain_thread
+ *
+ * reads for the subscribers keeping up until stopped
+ */
+
+void *stream_drain_thread(void *arg)
+{
+	struct stream_drain *d = (struct stream_drain *) arg;
+	struct epoll_event events[64];
+	unsigned char buf[16384];
+	ssize_t len;
+	int n;
+	int cnt;
+
+	while (!d->stop)
+	{
+		n = epoll_wait(d->epoll_fd, events, 64, 10);
+		for (cnt = 0; cnt < n; cnt++)
+		{
+			while ((len = recv(events[cnt].data.fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0)
 			{
-				debug_print("Found two supported devices, sticking to %04x:%04x and ignoring %04x:%04x\n",
-					device.vendor_id, device.product_id, devlist[cnt].idVendor, devlist[cnt].idProduct);
+				d->bytes += len;
 			}
 		}
-		cnt++;
 	}
-	free(devlist);
-
-	/* if there still is no real device here, we didn't find any */
-	if (device.vendor_id == 0)
+	return NULL;
+}
+
+/*
+ * stream_benchmark_run
+ *
+ * fans samples of BENCHMARK_DEVICES devices out to subscribers until
+ * STREAM_BENCHMARK_FRAMES were due, every 10th of them never reading
+ * when slow is set
+ */
+
+void stream_benchmark_run(int subscribers, bool slow)
+{
+	struct temper_sample sample;
+	struct stream_drain drain;
+	struct epoll_event ev;
+	pthread_t thread;
+	int samples = STREAM_BENCHMARK_FRAMES / subscribers;
+	int fds[subscribers];
+	uint64_t start;
+	uint64_t elapsed;
+	int tries;
+	int cnt;
+
+	if (temper_stream_open(&stream, config.stream) != TEMPER_OK)
+	{
+		perror(config.stream);
+		exit(EXIT_FAILURE);
+	}
+	memset(&drain, 0, sizeof(drain));
+	drain.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	for (cnt = 0; cnt < subscribers; cnt++)
+	{
+		fds[cnt] = stream_connect(config.stream, TEMPER_STREAM_ALL, 0x3ff, 0);
+		if ((fds[cnt] < 0) || (drain.epoll_fd < 0))
+		{
+			fprintf(stderr, "Error connecting subscriber %i\n", cnt);
+			exit(EXIT_FAILURE);
+		}
+		ev.events = EPOLLIN;
+		ev.data.fd = fds[cnt];
+		if (!slow || (cnt % 10 != 9))
+		{
+			(void)epoll_ctl(drain.epoll_fd, EPOLL_CTL_ADD, fds[cnt], &ev);
+		}
+		// keep the backlog of the socket short
+		(void)temper_stream_tick(&stream);
+	}
+	for (tries = 0; (tries < 1000) && ((temper_stream_tick(&stream) > 0) || (stream.amount_clients < subscribers)); tries++)
 	{
-		print_error("No supported device found");
-		return 0;
+		(void)poll(NULL, 0, 1);
 	}
+	pthread_create(&thread, NULL, stream_drain_thread, &drain);
 
-
-	debug_print("Will use '%s'\n",device.hidraw_devpath);
-	return 1;
+	memset(&sample, 0, sizeof(sample));
+	temper_invalidate(sample.values);
+	start = temper_time_us(CLOCK_MONOTONIC);
+	for (cnt = 0; cnt < samples; cnt++)
+	{
+		sample.device = cnt % BENCHMARK_DEVICES;
+		sample.timestamp_us = temper_time_us(CLOCK_REALTIME);
+		sample.values[TEMPER_INT_TEMP] = 20.0 + (cnt % 100) / 10.0;
+		sample.values[TEMPER_INT_HUM] = 40.0 + (cnt % 50) / 10.0;
+		temper_stream_sample(&stream, &sample);
+		// the main thread serves the socket once in a while
+		if (cnt % BENCHMARK_DEVICES == 0)
+		{
+			(void)temper_stream_tick(&stream);
+		}
+	}
+	elapsed = temper_time_us(CLOCK_MONOTONIC) - start;
+	drain.stop = true;
+	pthread_join(thread, NULL);
+
+	printf("%11i %5s %11.0f %10.2f %14.1f %14.3f %10lu %8lu\n", subscribers, slow ? "10%" : "-",
+		samples * 1000000.0 / elapsed, (double) elapsed / samples,
+		elapsed * 1000.0 / samples / subscribers, (double) stream.writes / samples,
+		stream.coalesced, stream.dropped);
+	temper_stream_close(&stream);
+	for (cnt = 0; cnt < subscribers; cnt++)
+	{
+		close(fds[cnt]);
+	}
+	close(drain.epoll_fd);
 }
 
-void test_calc()
-{
-	unsigned char answer[4096];
-	float tmp;
-
-	// there will only be an output in debug mode
-	config.debug = 1;
-	device.conversion_method = 1;
-
-	memmove(answer, (unsigned char[8]){ 0x80, 0x04, 0x00, 0x00, 0xff, 0xff, 0x00, 0x00 }, 8);
-	tmp = calc_value(answer, 4);
-	debug_print("temp: %.4f / expected: error (-999.00)\n", tmp);
-
-	memmove(answer, (unsigned char[8]){ 0x80, 0x04, 0xff, 0xff, 0x00, 0x00, 0x00, 0x00 }, 8);
-	tmp = calc_value(answer, 2);
-	debug_print("temp: %.4f / expected: error (-999.00)\n", tmp);
+/*
+ * run_stream_benchmark
+ *
+ * shows the cost of streaming to increasing amounts of subscribers
+ */
 
-	memmove(answer, (unsigned char[8]){ 0x80, 0x04, 0x1a, 0x1a, 0x1a, 0x10, 0x00, 0x00 }, 8);
-	tmp = calc_value(answer, 4);
-	debug_print("temp: %.4f / expected: 20.0625\n", tmp);
+void run_stream_benchmark()
+{
+	const int subscribers[] = { 1, 10, 100, 250, 500 };
+	struct rlimit limit;
+	int cnt;
 
-	memmove(answer, (unsigned char[8]){ 0x80, 0x04, 0x14, 0x14, 0x14, 0xd0, 0x00, 0x00 }, 8);
-	tmp = calc_value(answer, 4);
-	debug_print("temp: %.4f / expected: 20.8125\n", tmp);
+	// two descriptors per subscriber
+	if ((getrlimit(RLIMIT_NOFILE, &limit) == 0) && (limit.rlim_cur < limit.rlim_max))
+	{
+		limit.rlim_cur = limit.rlim_max;
+		(void)setrlimit(RLIMIT_NOFILE, &limit);
+	}
+	printf("samples of %i devices fanned out to subscribers of all channels,\n", BENCHMARK_DEVICES);
+	printf("%i frames due per run\n", STREAM_BENCHMARK_FRAMES);
+	printf("slow = every 10th subscriber never reads\n");
+	printf("subscribers  slow   samples/s  us/sample  ns/subscriber  writes/sample  coalesced  dropped\n");
+	for (cnt = 0; cnt < (int)(sizeof(subscribers) / sizeof(subscribers[0])); cnt++)
+	{
+		stream_benchmark_run(subscribers[cnt], false);
+	}
+	for (cnt = 2; cnt < (int)(sizeof(subscribers) / sizeof(subscribers[0])); cnt++)
+	{
+		stream_benchmark_run(subscribers[cnt], true);
+	}
+}
 
-	memmove(answer, (unsigned char[8]){ 0x80, 0x04, 0x01, 0x01, 0x01, 0x60, 0x00, 0x00 }, 8);
-	tmp = calc_value(answer, 4);
-	debug_print("temp: %.4f / expected: 1.3750\n", tmp);
+/*
+ * run_benchmark
+ *
+ * compares throughput and delay of the samples for
+ * increasing amounts of worker threads
+ */
 
-	memmove(answer, (unsigned char[8]){ 0x80, 0x04, 0x00, 0x00, 0x00, 0x60, 0x00, 0x00 }, 8);
-	tmp = calc_value(answer, 4);
-	debug_print("temp: %.4f / expected: 0.3750\n", tmp);
+void run_benchmark()
+{
+	int devices = (config.simulate > 0) ? config.simulate : BENCHMARK_DEVICES;
+	int interval = (config.interval >= 0) ? config.interval : 100;
+	int workers = 1;
 
-	memmove(answer, (unsigned char[8]){ 0x80, 0x04, 0x00, 0x00, 0x00, 0x10, 0x00, 0x00 }, 8);
-	tmp = calc_value(answer, 4);
-	debug_print("temp: %.4f / expected: 0.0625\n", tmp);
+	if (config.stream != NULL)
+	{
+		run_stream_benchmark();
+		return;
+	}
+	printf("%i simulated devices, every 4th behind a slow hub, interval %i ms, %i s per run\n",
+		devices, interval, BENCHMARK_SECONDS);
+	printf("delay = time from scheduled query to delivery by the aggregator\n");
+	printf("syscalls and context switches of the workers per sample\n");
+	printf("workers   samples/s   p50 ms   p99 ms   max ms   late   syscalls   switches  backend\n");
+	while (1)
+	{
+		benchmark_run(devices, workers, interval);
+		if (workers >= devices)
+		{
+			break;
+		}
+		workers *= 2;
+		if (workers > devices)
+		{
+			workers = devices;
+		}
+	}
+}
+#endif
 
-	memmove(answer, (unsigned char[8]){ 0x80, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, 8);
-	tmp = calc_value(answer, 4);
-	debug_print("temp: %.4f / expected: 0.0000\n", tmp);
+/*
+ * open_device
+ *
+ * opens and identifies the device described by info (or the
+ * simulated device simN named by its devpath), returns TEMPER_OK
+ * or the error of the step failing, the message is in the context
+ */
 
-	memmove(answer, (unsigned char[8]){ 0x80, 0x04, 0x00, 0x00, 0xff, 0xf0, 0x00, 0x00 }, 8);
-	tmp = calc_value(answer, 4);
-	debug_print("temp: %.4f / expected: -0.0625\n", tmp);
+int open_device(const struct temper_devinfo *info, struct temper_ctx **ctx)
+{
+	int r;
 
-	memmove(answer, (unsigned char[8]){ 0x80, 0x04, 0xff, 0xff, 0xff, 0x40, 0x00, 0x00 }, 8);
-	tmp = calc_value(answer, 4);
-	debug_print("temp: %.4f / expected: -0.7500\n", tmp);
+	*ctx = temper_new();
+	if (*ctx == NULL)
+	{
+		return TEMPER_ERR_NOMEM;
+	}
+	temper_set_debug(*ctx, config.debug);
+	r = temper_set_conversion_method(*ctx, config.conversion_method);
+	if (r == TEMPER_OK)
+	{
+		r = (config.simulate > 0) ? open_simulated(*ctx, atoi(info->devpath + 3), -1) :
+			temper_open(*ctx, info);
+	}
+	if (r == TEMPER_OK)
+	{
+		r = temper_identify(*ctx);
+	}
 
-	memmove(answer, (unsigned char[8]){ 0x80, 0x04, 0xff, 0xff, 0xff, 0x00, 0x00, 0x00 }, 8);
-	tmp = calc_value(answer, 4);
-	debug_print("temp: %.4f / expected: -1.0000\n", tmp);
+	return r;
+}
 
-	memmove(answer, (unsigned char[8]){ 0x80, 0x04, 0xfe, 0xfe, 0xfe, 0xf0, 0x00, 0x00 }, 8);
-	tmp = calc_value(answer, 4);
-	debug_print("temp: %.4f / expected: -1.0625\n", tmp);
+/*
+ * store_result
+ *
+ * completes result with what has to be known about its device and
+ * keeps it for other calls if the lock file could be used
+ */
 
-	memmove(answer, (unsigned char[8]){ 0x80, 0x04, 0xfe, 0xfe, 0xfe, 0x00, 0x00, 0x00 }, 8);
-	tmp = calc_value(answer, 4);
-	debug_print("temp: %.4f / expected: -2.0000\n", tmp);
+void store_result(struct temper_ctx *ctx, int lock, struct temper_cached *result)
+{
+	result->timestamp_us = temper_time_us(CLOCK_REALTIME);
+	result->conversion_method = config.conversion_method;
+	result->in_sensor = temper_default_sensor(ctx, TEMPER_REPORT_IN);
+	result->out_sensor = temper_default_sensor(ctx, TEMPER_REPORT_OUT);
+	if ((lock >= 0) && (temper_cache_put(lock, result) != TEMPER_OK))
+	{
+		debug_print("Can't store result for other calls\n");
+	}
+}
 
-	memmove(answer, (unsigned char[8]){ 0x80, 0x04, 0xfd, 0xfd, 0xfd, 0xf0, 0x00, 0x00 }, 8);
-	tmp = calc_value(answer, 4);
-	debug_print("temp: %.4f / expected: -2.0625\n", tmp);
+/*
+ * cached_result
+ *
+ * locks the lock file of devpath and checks for a result of another
+ * call not older than cache_max_age. Returns true if result was
+ * filled, the lock is released then.
+ */
 
-	memmove(answer, (unsigned char[8]){ 0x80, 0x04, 0xfe, 0xfe, 0x01, 0x00, 0x00, 0x00 }, 8);
-	tmp = calc_value(answer, 4);
-	debug_print("temp: %.4f / expected: 1.0000\n", tmp);
+bool cached_result(const char *devpath, int *lock, struct temper_cached *result)
+{
+	int r = temper_cache_lock(config.cache_dir, devpath, TEMPER_CACHE_LOCK_MS, lock);
 
-	memmove(answer, (unsigned char[8]){ 0x80, 0x04, 0xfe, 0xfe, 0x00, 0x00, 0x00, 0x00 }, 8);
-	tmp = calc_value(answer, 4);
-	debug_print("temp: %.4f / expected: 0.0000\n", tmp);
+	if (r != TEMPER_OK)
+	{
+		debug_print("Can't use lock file in '%s' (%s), querying without lock\n",
+			config.cache_dir, temper_strerror(r));
+		return false;
+	}
+	if ((config.cache_max_age > 0) &&
+		temper_cache_get(*lock, config.cache_max_age, result) &&
+		(result->conversion_method == config.conversion_method))
+	{
+		debug_print("Using result of another call for '%s'\n", devpath);
+		temper_cache_unlock(*lock);
+		return true;
+	}
 
-	memmove(answer, (unsigned char[8]){ 0x80, 0x04, 0x00, 0x00, 0xff, 0xf0, 0x00, 0x00 }, 8);
-	tmp = calc_value(answer, 4);
-	debug_print("temp: %.4f / expected: -0.0625\n", tmp);
+	return false;
+}
 
-	memmove(answer, (unsigned char[8]){ 0x80, 0x04, 0xfe, 0xfe, 0xFF, 0x00, 0x00, 0x00 }, 8);
-	tmp = calc_value(answer, 4);
-	debug_print("temp: %.4f / expected: -1.0000\n", tmp);
+/*
+ * query_device
+ *
+ * one-shot query of the selected device. The lock file makes
+ * concurrent calls (MRTG, cron jobs, manual runs) wait for each
+ * other instead of mixing up their requests and responses, a
+ * result not older than cache_max_age is reused.
+ */
 
-	memmove(answer, (unsigned char[8]){ 0x80, 0x04, 0xfe, 0xfe, 0xFE, 0x00, 0x00, 0x00 }, 8);
-	tmp = calc_value(answer, 4);
-	debug_print("temp: %.4f / expected: -2.0000\n", tmp);
+int query_device(const struct temper_devinfo *info, struct temper_cached *result)
+{
+	struct temper_ctx *ctx;
+	struct temper_oversample os;
+	uint64_t start;
+	int lock = -1;
+	int r;
 
-	memmove(answer, (unsigned char[8]){ 0x80, 0x04, 0xfe, 0xfe, 0xFD, 0x00, 0x00, 0x00 }, 8);
-	tmp = calc_value(answer, 4);
-	debug_print("temp: %.4f / expected: -3.0000\n", tmp);
+	if (cached_result(info->devpath, &lock, result))
+	{
+		return 1;
+	}
 
-	memmove(answer, (unsigned char[8]){ 0x80, 0x04, 0xee, 0xee, 0xee, 0x40, 0x00, 0x00 }, 8);
-	tmp = fahrenheit(calc_value(answer, 4));
-	debug_print("temp: %.4f / expected: 0.0500\n", tmp);
+	r = open_device(info, &ctx);
+	if (ctx == NULL)
+	{
+		temper_cache_unlock(lock);
+		print_error(temper_strerror(r));
+		return 0;
+	}
+	if ((r == TEMPER_OK) && (config.oversample > 1))
+	{
+		temper_oversample_init(&os, config.reduce, 0.0);
+		start = temper_time_us(CLOCK_MONOTONIC);
+		r = temper_query_oversampled(ctx, &os, config.oversample, config.budget, result->values);
+		debug_print("%i of %i readings in %.1f ms\n", os.readings, config.oversample,
+			(temper_time_us(CLOCK_MONOTONIC) - start) / 1000.0);
+	}
+	else if (r == TEMPER_OK)
+	{
+		r = temper_query(ctx, result->values);
+	}
+	if (r != TEMPER_OK)
+	{
+		temper_cache_unlock(lock);
+		print_error(temper_errmsg(ctx));
+		temper_free(ctx);
+		return 0;
+	}
+	store_result(ctx, lock, result);
+	temper_free(ctx);
+	temper_cache_unlock(lock);
 
-	memmove(answer, (unsigned char[8]){ 0x80, 0x04, 0xee, 0xee, 0xee, 0x30, 0x00, 0x00 }, 8);
-	tmp = fahrenheit(calc_value(answer, 4));
-	debug_print("temp: %.4f / expected: -0.0625\n", tmp);
+	return 1;
+}
 
-	memmove(answer, (unsigned char[8]){ 0x80, 0x04, 0xfe, 0xfe, 0x00, 0x00, 0x00, 0x00 }, 8);
-	tmp = fahrenheit(calc_value(answer, 4));
-	debug_print("temp: %.4f / expected: 32.0000\n", tmp);
+/*
+ * reported_valid
+ *
+ * checks if the values to be reported as IN and OUT are valid
+ */
 
-	memmove(answer, (unsigned char[8]){ 0x80, 0x04, 0x23, 0x23, 0x23, 0x90, 0x00, 0x00 }, 8);
-	tmp = fahrenheit(calc_value(answer, 4));
-	debug_print("temp: %.4f / expected: 96.0125\n", tmp);
+bool reported_valid(const struct temper_cached *result)
+{
+	int in = (config.in_sensor == -1) ? result->in_sensor : config.in_sensor;
+	int out = (config.out_sensor == -1) ? result->out_sensor : config.out_sensor;
 
-	device.conversion_method = 2;
+	return (in >= 0) && (result->values[in] > TEMPER_INVALID) &&
+		((out < 0) || (result->values[out] > TEMPER_INVALID));
+}
 
-	memmove(answer, (unsigned char[8]){ 0x80, 0x04, 0x09, 0x66, 0x00, 0x00, 0x00, 0x00 }, 8);
-	tmp = calc_value(answer, 2);
-	debug_print("temp: %.4f / expected: 24.0600\n", tmp);
+/*
+ * query_redundant
+ *
+ * one-shot query of the selected device and its standby. Both are
+ * opened and queried in one round, so a primary failing costs at
+ * most one read timeout. The result of the primary is used if it
+ * succeeded with valid values, else the one of the standby, and
+ * failover is set. Oversampling is not done here, a round is a
+ * single query per device.
+ */
 
-	memmove(answer, (unsigned char[8]){ 0x80, 0x04, 0xf6, 0x9a, 0x00, 0x00, 0x00, 0x00 }, 8);
-	tmp = calc_value(answer, 2);
-	debug_print("temp: %.4f / expected: -24.0600\n", tmp);
+int query_redundant(const struct temper_devinfo *primary, const struct temper_devinfo *standby,
+	struct temper_cached *result, bool *failover)
+{
+	const struct temper_devinfo *infos[2] = { primary, standby };
+	struct temper_ctx *ctxs[2];
+	struct temper_ctx *opened[2];
+	struct temper_cached results[2];
+	struct temper_round *round;
+	float values[2][TEMPER_CHANNELS];
+	int status[2] = { TEMPER_ERR_OPEN, TEMPER_ERR_OPEN };
+	int index[2];
+	int locks[2] = { -1, -1 };
+	int amount = 0;
+	int first;
+	int cnt;
+	int r;
 
-	memmove(answer, (unsigned char[8]){ 0x80, 0x04, 0x05, 0x90, 0x00, 0x00, 0x00, 0x00 }, 8);
-	tmp = calc_value(answer, 2);
-	debug_print("temp: %.4f / expected: 14.2400\n", tmp);
+	*failover = false;
+	// lock in a fixed order, so calls naming the devices the other way round don't deadlock
+	first = (strcmp(primary->devpath, standby->devpath) > 0) ? 1 : 0;
+	for (cnt = 0; cnt < 2; cnt++)
+	{
+		r = temper_cache_lock(config.cache_dir, infos[first ^ cnt]->devpath, TEMPER_CACHE_LOCK_MS,
+			&locks[first ^ cnt]);
+		if (r != TEMPER_OK)
+		{
+			debug_print("Can't use lock file in '%s' (%s), querying without lock\n",
+				config.cache_dir, temper_strerror(r));
+		}
+	}
+	if ((locks[0] >= 0) && (config.cache_max_age > 0) &&
+		temper_cache_get(locks[0], config.cache_max_age, result) &&
+		(result->conversion_method == config.conversion_method) &&
+		reported_valid(result))
+	{
+		debug_print("Using result of another call for '%s'\n", primary->devpath);
+		temper_cache_unlock(locks[0]);
+		temper_cache_unlock(locks[1]);
+		return 1;
+	}
 
-	memmove(answer, (unsigned char[8]){ 0x80, 0x04, 0xfa, 0x70, 0x00, 0x00, 0x00, 0x00 }, 8);
-	tmp = calc_value(answer, 2);
-	debug_print("temp: %.4f / expected: -14.2400\n", tmp);
+	for (cnt = 0; cnt < 2; cnt++)
+	{
+		status[cnt] = open_device(infos[cnt], &ctxs[cnt]);
+		if (status[cnt] == TEMPER_OK)
+		{
+			index[cnt] = amount;
+			opened[amount++] = ctxs[cnt];
+		}
+	}
+	if (amount == 2)
+	{
+		round = temper_round_new(opened, 2, TEMPER_BACKEND_AUTO, FAILOVER_TIMEOUT_MS);
+		if (round == NULL)
+		{
+			status[0] = status[1] = TEMPER_ERR_NOMEM;
+		}
+		else
+		{
+			(void)temper_round_run(round, values, status);
+			temper_round_free(round);
+		}
+	}
+	else if (amount == 1)
+	{
+		cnt = (status[0] == TEMPER_OK) ? 0 : 1;
+		index[cnt] = 0;
+		status[cnt] = temper_query(ctxs[cnt], values[0]);
+	}
 
-	/* some values provided by Samuel Progin from TEMPer V1.4:
-	 * 80 02 19 30 65 72 46 31
-	 * 80 02 19 40 65 72 46 31
-	 * 80 02 19 50 65 72 46 31
-	 * 80 02 19 60 65 72 46 31
-	 * 80 02 1a 90 65 72 46 31
-	 * Temperature sensor seems to be starting at offset 2
-	 * probably the byte at offset 1 defines where the sensor values can be read?
-	 * probably some other bytes define what/how many sensors are present?
-	 * Compare to TEMPer V1.3:
-	 * 80 04 06 06 06 f0 00 00
-	 * Compare to TEMPerHUM (TEMPerX_V3.3)
-	 * 80 40 0a f9 14 63 00 00
-	 * 80 40 0b 5c 14 94 00 00
-	 * Offset 0: constant 80 - could mean one temperature sensor?
-	 * Offset 1: 04 at V1.3 - this is the offset where temperature sensor has it's values
-	 *           02 at V1.4 - this is the offset where temperature sensor has it's values
-	 *           40 at TEMPerHUM (TEMPerX_V3.3) - no idea what this could mean...
-	 * Offset 2: V1.3: has always the same value as offset 3 and 4
-	 *           V1.4: first byte of value
-	 * Offset 3: V1.3: has always the same value as offset 2 and 4
-	 *           V1.4: second byte of value
-	 * Offset 4: V1.3: first byte of value
-	 *           V1.4: constant 65
-	 * Offset 5: V1.3: second byte of value
-	 *           V1.4: constant 72
-	 * Offset 6: V1.3: constant 00
-	 *           V1.4: constant 46
-	 * Offset 7: V1.3: constant 00
-	 *           V1.4: constant 31
-	 */
-	device.conversion_method = 1;
+	for (cnt = 0; cnt < 2; cnt++)
+	{
+		if (status[cnt] == TEMPER_OK)
+		{
+			memcpy(results[cnt].values, values[index[cnt]], sizeof(results[cnt].values));
+			store_result(ctxs[cnt], locks[cnt], &results[cnt]);
+		}
+		else
+		{
+			debug_print("%s failed: %s\n", infos[cnt]->devpath, temper_strerror(status[cnt]));
+		}
+	}
+	for (cnt = 0; cnt < 2; cnt++)
+	{
+		temper_cache_unlock(locks[cnt]);
+		if (ctxs[cnt] != NULL)
+		{
+			temper_free(ctxs[cnt]);
+		}
+	}
 
-	memmove(answer, (unsigned char[8]){ 0x80, 0x02, 0x1a, 0x90, 0x65, 0x72, 0x46, 0x31 }, 8);
-	tmp = calc_value(answer, 2);
-	debug_print("temp: %.4f / expected: 26.5625\n", tmp);
+	if ((status[0] == TEMPER_OK) && reported_valid(&results[0]))
+	{
+		*result = results[0];
+		return 1;
+	}
+	if (status[1] == TEMPER_OK)
+	{
+		debug_print("Primary failed, using standby '%s'\n", standby->devpath);
+		*failover = true;
+		*result = results[1];
+		return 1;
+	}
+	if (status[0] == TEMPER_OK)
+	{
+		// invalid values of the primary are still better than none
+		*result = results[0];
+		return 1;
+	}
+	print_error("Neither the device nor its standby answered");
 
-	exit(EXIT_SUCCESS);
+	return 0;
 }
 
 /*
@@ -1372,32 +5392,62 @@ void test_calc()
 
 int main(int argc, char **argv)
 {
+	struct temper_devinfo info;
+	struct temper_devinfo standby;
+	struct temper_cached result;
+	char note[300] = "";
+	bool failover;
+	int ok;
+
 	parse_parameters(argc, argv);
 
-	if (!get_devnode())
+#ifndef TEMPER_SINGLE_PROFILE
+	if (config.benchmark)
 	{
-		cleanup();
-		exit(EXIT_FAILURE);
+		run_benchmark();
+		exit(EXIT_SUCCESS);
 	}
-	if (!init_device())
+#endif
+	if (config.interval >= 0)
 	{
-		cleanup();
-		exit(EXIT_FAILURE);
+		exit(run_continuous() ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+	if (config.simulate > 0)
+	{
+		// one simulated device stands in for the hardware
+		memset(&info, 0, sizeof(info));
+		strcpy(info.devpath, "sim0");
 	}
-	if (!evaluate_device_details())
+	else if (!select_device(&info))
 	{
-		cleanup();
 		exit(EXIT_FAILURE);
 	}
-	if (!query_values())
+	if (config.standby != NULL)
+	{
+		if (!select_standby(&standby))
+		{
+			exit(EXIT_FAILURE);
+		}
+		ok = query_redundant(&info, &standby, &result, &failover);
+		if (ok && failover)
+		{
+			(void)snprintf(note, sizeof(note), "standby %s", standby.devpath);
+		}
+	}
+	else
+	{
+		ok = query_device(&info, &result);
+	}
+	if (!ok)
 	{
-		cleanup();
 		exit(EXIT_FAILURE);
 	}
-	
-	debug_print("Found firmware: '%s'\n", device.firmware);
-	print_values(device.values[config.in_sensor], device.values[config.out_sensor], config.precision); 
-	cleanup();
+	if (config.in_sensor == -1)
+		config.in_sensor = result.in_sensor;
+	if (config.out_sensor == -1)
+		config.out_sensor = result.out_sensor;
+
+	print_values(result.values[config.in_sensor], result.values[config.out_sensor], config.precision, note);
 	exit(EXIT_SUCCESS);
 }
 